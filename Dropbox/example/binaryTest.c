@@ -0,0 +1,312 @@
+/*!
+ * \file    binaryTest.c
+ * \brief   Round trip of the binary encoding (encode, view and decode), and
+ *          check of truncated, corrupted and aliased buffers.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dropbox.h>
+
+/*! Offset of the encoded size in the buffer header. */
+#define HEADER_SIZE_OFFSET 8
+
+#define FOLDERS  4
+#define FILES    16
+#define CHILDREN 3
+
+static int failures = 0;
+
+/*!
+ * \brief   Report a failed check.
+ * \param   ok     check result
+ * \param   what   checked property
+ * \return  void
+ */
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+/*!
+ * \brief   Compare two optional strings.
+ * \return  true if both are NULL or equal, false otherwise.
+ */
+static bool sameStr(const char* a, const char* b) {
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+/*!
+ * \brief   Compare two optional values.
+ * \return  true if both are NULL or equal, false otherwise.
+ */
+static bool sameValue(const void* a, const void* b, size_t size) {
+    return a == b || (a && b && memcmp(a, b, size) == 0);
+}
+
+static bool sameList(const drbMetadataList* a, const drbMetadataList* b);
+
+/*!
+ * \brief   Compare two metadata and their contents.
+ * \return  true if all their fields are equal, false otherwise.
+ */
+static bool sameMetadata(const drbMetadata* a, const drbMetadata* b) {
+    return sameValue(a->bytes, b->bytes, sizeof(uint64_t)) &&
+           sameValue(a->clientMtimeEpoch, b->clientMtimeEpoch, sizeof(int64_t)) &&
+           sameValue(a->modifiedEpoch, b->modifiedEpoch, sizeof(int64_t)) &&
+           sameValue(a->revision, b->revision, sizeof(unsigned int)) &&
+           sameValue(a->isDir, b->isDir, sizeof(bool)) &&
+           sameValue(a->thumbExists, b->thumbExists, sizeof(bool)) &&
+           sameValue(a->isDeleted, b->isDeleted, sizeof(bool)) &&
+           sameStr(a->clientMtime, b->clientMtime) && sameStr(a->icon, b->icon) &&
+           sameStr(a->mimeType, b->mimeType) && sameStr(a->modified, b->modified) &&
+           sameStr(a->path, b->path) && sameStr(a->rev, b->rev) &&
+           sameStr(a->root, b->root) && sameStr(a->size, b->size) &&
+           sameStr(a->hash, b->hash) && sameList(a->contents, b->contents);
+}
+
+/*!
+ * \brief   Compare two metadata lists.
+ * \return  true if both are NULL or hold equal metadata, false otherwise.
+ */
+static bool sameList(const drbMetadataList* a, const drbMetadataList* b) {
+    if (a == b)
+        return true;
+    if (!a || !b || a->size != b->size)
+        return false;
+    for (size_t i = 0; i < a->size; i++)
+        if (!sameMetadata(a->array[i], b->array[i]))
+            return false;
+    return true;
+}
+
+/*!
+ * \brief   Compare two deltas.
+ * \return  true if all their fields and entries are equal, false otherwise.
+ */
+static bool sameDelta(const drbDelta* a, const drbDelta* b) {
+    if (!sameValue(a->reset, b->reset, sizeof(bool)) ||
+        !sameValue(a->hasMore, b->hasMore, sizeof(bool)) ||
+        !sameStr(a->cursor, b->cursor) || a->entries.size != b->entries.size)
+        return false;
+    for (size_t i = 0; i < a->entries.size; i++) {
+        const drbDeltaEntry *x = &a->entries.array[i], *y = &b->entries.array[i];
+        if (!sameStr(x->path, y->path) || !x->metadata != !y->metadata ||
+            (x->metadata && !sameMetadata(x->metadata, y->metadata)))
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief   Copy a buffer in a new memory block, aligned as the encoded buffers.
+ * \return  copied buffer (must be freed by caller).
+ */
+static void* copyBuffer(const void* buffer, size_t size) {
+    void* copy = malloc(size ? size : 1);
+    return copy ? memcpy(copy, buffer, size) : NULL;
+}
+
+/*!
+ * \brief   Encode, view, decode and encode again a structure.
+ * \param   name     structure name (for the failures)
+ * \param   src      structure to encode
+ * \param   encode   drbEncodeXxx function
+ * \param   view     drbViewXxx function
+ * \param   decode   drbDecodeXxx function
+ * \param   same     structures comparison
+ * \param   destroy  decoded structure release
+ * \return  void
+ */
+static void roundTrip(const char* name, const void* src,
+                      void* (*encode)(const void*, size_t*),
+                      const void* (*view)(const void*, size_t),
+                      void* (*decode)(const void*, size_t),
+                      bool (*same)(const void*, const void*),
+                      void (*destroy)(void*)) {
+    char what[128];
+    size_t size, size2;
+    void* buffer = encode(src, &size);
+    snprintf(what, sizeof(what), "%s encoding", name);
+    check(buffer != NULL, what);
+    if (!buffer)
+        return;
+    
+    // View and decode in place
+    void* decoded = decode(buffer, size);
+    snprintf(what, sizeof(what), "%s view and decoding", name);
+    check(view(buffer, size) && decoded && same(src, decoded), what);
+    
+    // The decoded structure encodes to the same bytes
+    void* again = decoded ? encode(decoded, &size2) : NULL;
+    snprintf(what, sizeof(what), "%s encoding stability", name);
+    check(again && size2 == size && memcmp(again, buffer, size) == 0, what);
+    free(again);
+    destroy(decoded);
+    
+    // Truncated buffers, with the header size left or cut
+    void* copy = copyBuffer(buffer, size);
+    for (size_t length = 0; length < size; length++) {
+        snprintf(what, sizeof(what), "%s truncated to %zu bytes", name, length);
+        check(!view(copy, length) && !decode(copy, length), what);
+        if (length >= HEADER_SIZE_OFFSET + sizeof(uint32_t)) {
+            uint32_t cut = (uint32_t)length;
+            memcpy((char*)copy + HEADER_SIZE_OFFSET, &cut, sizeof(uint32_t));
+            check(!view(copy, length) && !decode(copy, length), what);
+            memcpy(copy, buffer, size);
+        }
+    }
+    
+    // Corrupted buffers (each bit of each byte) must be rejected or decode to
+    // a structure that can be encoded again
+    for (size_t i = 0; i < size; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            ((unsigned char*)copy)[i] ^= 1 << bit;
+            decoded = decode(copy, size);
+            if (decoded) {
+                again = encode(decoded, &size2);
+                snprintf(what, sizeof(what), "%s corrupted at byte %zu bit %d", name, i, bit);
+                check(again != NULL, what);
+                free(again);
+                destroy(decoded);
+            }
+            ((unsigned char*)copy)[i] ^= 1 << bit;
+        }
+    }
+    
+    free(copy);
+    free(buffer);
+}
+
+/*
+ * Adapters of the typed functions to roundTrip.
+ */
+static void* encodeMetadata(const void* src, size_t* size) { return drbEncodeMetadata(src, size); }
+static void* encodeList(const void* src, size_t* size) { return drbEncodeMetadataList(src, size); }
+static void* encodeDelta(const void* src, size_t* size) { return drbEncodeDelta(src, size); }
+static const void* viewMetadata(const void* buffer, size_t size) { return drbViewMetadata(buffer, size); }
+static const void* viewList(const void* buffer, size_t size) { return drbViewMetadataList(buffer, size); }
+static const void* viewDelta(const void* buffer, size_t size) { return drbViewDelta(buffer, size); }
+static void* decodeMetadata(const void* buffer, size_t size) { return drbDecodeMetadata(buffer, size); }
+static void* decodeList(const void* buffer, size_t size) { return drbDecodeMetadataList(buffer, size); }
+static void* decodeDelta(const void* buffer, size_t size) { return drbDecodeDelta(buffer, size); }
+static bool compareMetadata(const void* a, const void* b) { return sameMetadata(a, b); }
+static bool compareList(const void* a, const void* b) { return sameList(a, b); }
+static bool compareDelta(const void* a, const void* b) { return sameDelta(a, b); }
+static void destroyMetadata(void* meta) { drbDestroyMetadata(meta, true); }
+static void destroyList(void* list) { drbDestroyMetadataList(list, true); }
+static void destroyDelta(void* delta) { drbDestroyDelta(delta, true); }
+
+int main (int argc, char **argv) {
+    
+    // A folder holding FOLDERS folders of CHILDREN files, and FILES files
+    static uint64_t bytes[FILES + FOLDERS * CHILDREN];
+    static int64_t epochs[FILES + FOLDERS * CHILDREN];
+    static unsigned int revisions[FILES + FOLDERS * CHILDREN];
+    static char paths[FILES + FOLDERS * (CHILDREN + 1)][32];
+    static drbMetadata files[FILES + FOLDERS * CHILDREN], folders[FOLDERS];
+    static drbMetadata* children[FOLDERS][CHILDREN];
+    static drbMetadataList lists[FOLDERS];
+    static drbMetadata* entries[FOLDERS + FILES];
+    static bool yes = true, no = false;
+    
+    for (int i = 0; i < FILES + FOLDERS * CHILDREN; i++) {
+        bytes[i] = (uint64_t)i << 30;
+        epochs[i] = 1282429880 + i * 3600;
+        revisions[i] = i + 1;
+        drbMetadata* file = &files[i];
+        if (i < FILES)
+            snprintf(paths[i], sizeof(paths[i]), "/photos/img_%04d.jpg", i);
+        else
+            snprintf(paths[i], sizeof(paths[i]), "/photos/album %d/img_%04d.jpg",
+                     (i - FILES) / CHILDREN, i);
+        file->path = paths[i];
+        file->bytes = &bytes[i];
+        file->size = "1.2 MB";
+        file->icon = "page_white_picture";
+        file->mimeType = "image/jpeg";
+        file->root = "dropbox";
+        file->modified = "Sat, 21 Aug 2010 22:31:20 +0000";
+        file->modifiedEpoch = &epochs[i];
+        file->clientMtime = i % 2 ? "Sat, 21 Aug 2010 22:31:20 +0000" : NULL;
+        file->clientMtimeEpoch = i % 2 ? &epochs[i] : NULL;
+        file->rev = "35e97029684fe";
+        file->revision = &revisions[i];
+        file->isDir = &no;
+        file->thumbExists = i % 3 ? &yes : &no;
+        file->isDeleted = i % 5 ? NULL : &no;
+        if (i >= FILES)
+            children[(i - FILES) / CHILDREN][(i - FILES) % CHILDREN] = file;
+        else
+            entries[FOLDERS + i] = file;
+    }
+    for (int i = 0; i < FOLDERS; i++) {
+        char* path = paths[FILES + FOLDERS * CHILDREN + i];
+        snprintf(path, sizeof(paths[0]), "/photos/album %d", i);
+        lists[i].array = children[i];
+        lists[i].size = CHILDREN;
+        folders[i].path = path;
+        folders[i].isDir = &yes;
+        folders[i].hash = "37eb1ba1849d4b0fb0b28caf7ef3af52";
+        folders[i].contents = &lists[i];
+        entries[i] = &folders[i];
+    }
+    drbMetadataList list = {entries, FOLDERS + FILES};
+    drbMetadata root = {NULL};
+    root.path = "/photos";
+    root.isDir = &yes;
+    root.hash = "efdac89c4da886a9cece1927e6c22977";
+    root.contents = &list;
+    
+    // A delta adding the files and deleting the folders
+    drbDeltaEntry deltaEntries[FOLDERS + FILES];
+    for (int i = 0; i < FOLDERS + FILES; i++) {
+        deltaEntries[i].path = entries[i]->path;
+        deltaEntries[i].metadata = i < FOLDERS ? NULL : entries[i];
+    }
+    drbDelta delta = {&yes, "AAGpTUnJ4zcM8YfVEL2UVfLZ", &no, {deltaEntries, FOLDERS + FILES}};
+    drbMetadataList empty = {NULL, 0};
+    drbDelta emptyDelta = {NULL};
+    
+    roundTrip("metadata", &root, encodeMetadata, viewMetadata, decodeMetadata,
+              compareMetadata, destroyMetadata);
+    roundTrip("metadata list", &list, encodeList, viewList, decodeList,
+              compareList, destroyList);
+    roundTrip("empty metadata list", &empty, encodeList, viewList, decodeList,
+              compareList, destroyList);
+    roundTrip("delta", &delta, encodeDelta, viewDelta, decodeDelta,
+              compareDelta, destroyDelta);
+    roundTrip("empty delta", &emptyDelta, encodeDelta, viewDelta, decodeDelta,
+              compareDelta, destroyDelta);
+    
+    // A buffer of one kind is not a buffer of another kind
+    size_t size;
+    void* buffer = drbEncodeMetadata(&root, &size);
+    check(buffer && !drbViewMetadataList(buffer, size) && !drbViewDelta(buffer, size),
+          "kind check");
+    
+    // Two folders referencing the same contents are rejected
+    const drbBinMetadata* meta = buffer ? drbViewMetadata(buffer, size) : NULL;
+    if (meta) {
+        drbBinMetadata* second = (drbBinMetadata*)&drbBinContents(meta)->array[1];
+        const drbBinMetadataList* shared = drbBinContents(&drbBinContents(meta)->array[0]);
+        second->contents = (int32_t)((const char*)shared - (const char*)second);
+        check(!drbViewMetadata(buffer, size) && !drbDecodeMetadata(buffer, size),
+              "aliased contents");
+    }
+    free(buffer);
+    
+    if (failures) {
+        fprintf(stderr, "%d failed checks\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
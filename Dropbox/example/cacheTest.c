@@ -0,0 +1,253 @@
+/*!
+ * \file    cacheTest.c
+ * \brief   Check of the metadata listings cache (drbMetadataCache): listings
+ *          revalidated by their hash and decoded as for a 304 answer, least
+ *          recently used eviction, and the bounds of the cache files loaded
+ *          after a restart.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dropbox.h>
+#include <dropboxCache.h>
+#include <dropboxUtils.h>
+
+/*! Offset of the hash size in a cache file header. */
+#define HEADER_HASH_SIZE_OFFSET 8
+
+/*! Offset of the encoding size in a cache file header. */
+#define HEADER_ENCODED_SIZE_OFFSET 12
+
+#define FILES 8
+
+static int failures = 0;
+
+/*!
+ * \brief   Report a failed check.
+ * \param   ok     check result
+ * \param   what   checked property
+ * \return  void
+ */
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+/*!
+ * \brief   Get the cache file path of a key.
+ * \param[out]  path   path buffer (256 bytes)
+ * \param       dir    cache directory
+ * \param       key    listing key
+ * \return  path.
+ */
+static char* cachePath(char* path, const char* dir, const char* key) {
+    snprintf(path, 256, "%s/%016llx.drbc", dir, (unsigned long long)drbStrHash(key));
+    return path;
+}
+
+/*!
+ * \brief   Find a listing and compare it with the expected one, decoded as
+ *          drbGetMetadata does on a 304 answer.
+ * \param   cache      cache to search
+ * \param   key        listing key
+ * \param   hash       expected listing hash
+ * \param   expected   expected listing
+ * \return  true if the listing was found and equal, false otherwise.
+ */
+static bool findSame(drbMetadataCache* cache, const char* key, const char* hash,
+                     const drbMetadata* expected) {
+    char* found = NULL;
+    void* encoded = NULL;
+    size_t size = 0;
+    if (!drbMetadataCacheFind(cache, key, &found, &encoded, &size))
+        return false;
+    
+    // The decoded listing encodes to the bytes of the expected one
+    drbMetadata* meta = drbDecodeMetadata(encoded, size);
+    size_t size2 = 0, size3 = 0;
+    void* again = meta ? drbEncodeMetadata(meta, &size2) : NULL;
+    void* reference = drbEncodeMetadata(expected, &size3);
+    bool same = !strcmp(found, hash) && meta && !strcmp(meta->path, expected->path) &&
+                meta->contents && meta->contents->size == expected->contents->size &&
+                again && reference && size2 == size3 && !memcmp(again, reference, size2);
+    free(reference);
+    free(again);
+    drbDestroyMetadata(meta, true);
+    free(encoded);
+    free(found);
+    return same;
+}
+
+/*!
+ * \brief   Write a cache file, and look its listing up from a new cache.
+ * \param   dir    cache directory
+ * \param   key    listing key
+ * \param   file   cache file content
+ * \param   size   cache file size
+ * \return  true if the listing was loaded, false otherwise.
+ */
+static bool loads(const char* dir, const char* key, const void* file, size_t size) {
+    char path[256];
+    FILE* stream = fopen(cachePath(path, dir, key), "wb");
+    if (!stream)
+        return false;
+    bool written = fwrite(file, 1, size, stream) == size;
+    if (fclose(stream) != 0 || !written)
+        return false;
+    
+    drbMetadataCache* cache = drbCreateMetadataCache(4, dir);
+    char* hash = NULL;
+    void* encoded = NULL;
+    size_t encodedSize = 0;
+    bool found = cache && drbMetadataCacheFind(cache, key, &hash, &encoded, &encodedSize);
+    free(hash);
+    free(encoded);
+    drbDestroyMetadataCache(cache);
+    return found;
+}
+
+int main (int argc, char **argv) {
+    
+    // A folder listing of FILES files
+    static char paths[FILES][32];
+    static drbMetadata files[FILES];
+    static drbMetadata* entries[FILES];
+    static uint64_t bytes[FILES];
+    static bool yes = true, no = false;
+    for (int i = 0; i < FILES; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "/photos/img_%04d.jpg", i);
+        bytes[i] = (uint64_t)i << 20;
+        files[i].path = paths[i];
+        files[i].bytes = &bytes[i];
+        files[i].mimeType = "image/jpeg";
+        files[i].isDir = &no;
+        entries[i] = &files[i];
+    }
+    drbMetadataList list = {entries, FILES};
+    drbMetadata folder = {NULL};
+    folder.path = "/photos";
+    folder.isDir = &yes;
+    folder.hash = "efdac89c4da886a9cece1927e6c22977";
+    folder.contents = &list;
+    drbMetadataList shortList = {entries, FILES / 2};
+    drbMetadata changed = folder;
+    changed.hash = "37eb1ba1849d4b0fb0b28caf7ef3af52";
+    changed.contents = &shortList;
+    
+    const char* key = "dropbox/photos?list=true|0";
+    const char* otherKey = "dropbox/photos?list=true&include_deleted=true|0";
+    char dir[] = "/tmp/cacheTestXXXXXX";
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Cache directory creation failed\n");
+        return EXIT_FAILURE;
+    }
+    
+    // A stored listing is revalidated with its hash, and served as it was
+    drbMetadataCacheStats stats;
+    drbMetadataCache* cache = drbCreateMetadataCache(4, dir);
+    char* hash = NULL;
+    void* encoded = NULL;
+    size_t size = 0;
+    check(cache && !drbMetadataCacheFind(cache, key, &hash, &encoded, &size), "empty cache");
+    if (cache) {
+        drbMetadataCacheStore(cache, key, folder.hash, &folder);
+        check(findSame(cache, key, folder.hash, &folder), "listing revalidated and decoded");
+        drbMetadataCacheHit(cache);
+        
+        // A changed listing replaces the cached one
+        drbMetadataCacheStore(cache, key, changed.hash, &changed);
+        check(findSame(cache, key, changed.hash, &changed), "changed listing replaced");
+        
+        // A listing without hash is not cached
+        drbMetadataCacheStore(cache, otherKey, NULL, &folder);
+        check(!drbMetadataCacheFind(cache, otherKey, &hash, &encoded, &size),
+              "listing without hash");
+        
+        drbMetadataCacheGetStats(cache, &stats);
+        check(stats.hits == 1 && stats.misses == 2 && stats.changed == 1 && stats.entries == 1 &&
+              stats.diskLoads == 0, "cache statistics");
+        drbDestroyMetadataCache(cache);
+    }
+    
+    // The least recently used listings are dropped from memory
+    cache = drbCreateMetadataCache(2, NULL);
+    if (cache) {
+        drbMetadataCacheStore(cache, key, folder.hash, &folder);
+        drbMetadataCacheStore(cache, otherKey, changed.hash, &changed);
+        check(findSame(cache, key, folder.hash, &folder), "listing kept in memory");
+        drbMetadataCacheStore(cache, "dropbox/music?list=true|0", folder.hash, &folder);
+        check(findSame(cache, key, folder.hash, &folder) &&
+              !drbMetadataCacheFind(cache, otherKey, &hash, &encoded, &size),
+              "least recently used listing dropped");
+        drbMetadataCacheGetStats(cache, &stats);
+        check(stats.entries == 2, "entries kept in memory");
+        drbDestroyMetadataCache(cache);
+    } else
+        check(false, "memory cache creation");
+    
+    // After a restart, the listing is loaded from its cache file
+    cache = drbCreateMetadataCache(4, dir);
+    if (cache) {
+        check(findSame(cache, key, changed.hash, &changed), "listing loaded after a restart");
+        drbMetadataCacheGetStats(cache, &stats);
+        check(stats.diskLoads == 1 && stats.entries == 1, "listing loaded from the disk");
+        drbDestroyMetadataCache(cache);
+    } else
+        check(false, "cache creation after a restart");
+    
+    // Truncated and oversized cache files are ignored
+    char path[256];
+    FILE* stream = fopen(cachePath(path, dir, key), "rb");
+    static unsigned char file[1 << 16];
+    size_t fileSize = stream ? fread(file, 1, sizeof(file), stream) : 0;
+    if (stream)
+        fclose(stream);
+    check(fileSize > HEADER_ENCODED_SIZE_OFFSET + sizeof(uint32_t) && fileSize < sizeof(file),
+          "cache file read");
+    if (fileSize > HEADER_ENCODED_SIZE_OFFSET + sizeof(uint32_t) && fileSize < sizeof(file)) {
+        for (size_t length = 0; length < fileSize; length++) {
+            char what[64];
+            snprintf(what, sizeof(what), "cache file truncated to %zu bytes", length);
+            check(!loads(dir, key, file, length), what);
+        }
+        
+        uint32_t hashSize, encodedSize;
+        memcpy(&hashSize, file + HEADER_HASH_SIZE_OFFSET, sizeof(uint32_t));
+        memcpy(&encodedSize, file + HEADER_ENCODED_SIZE_OFFSET, sizeof(uint32_t));
+        // Sizes beyond the hash limit (1 KiB), the file and the address space
+        uint32_t sizes[] = {UINT32_MAX, 1025, UINT32_MAX - (uint32_t)fileSize};
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            char what[64];
+            memcpy(file + HEADER_HASH_SIZE_OFFSET, &sizes[i], sizeof(uint32_t));
+            snprintf(what, sizeof(what), "cache file hash of %u bytes", sizes[i]);
+            check(!loads(dir, key, file, fileSize), what);
+            memcpy(file + HEADER_HASH_SIZE_OFFSET, &hashSize, sizeof(uint32_t));
+            memcpy(file + HEADER_ENCODED_SIZE_OFFSET, &sizes[i], sizeof(uint32_t));
+            snprintf(what, sizeof(what), "cache file encoding of %u bytes", sizes[i]);
+            check(!loads(dir, key, file, fileSize), what);
+            memcpy(file + HEADER_ENCODED_SIZE_OFFSET, &encodedSize, sizeof(uint32_t));
+        }
+        
+        // The file of another key with the same name is ignored
+        check(!loads(dir, otherKey, file, fileSize), "cache file of another key");
+        unlink(cachePath(path, dir, otherKey));
+        check(loads(dir, key, file, fileSize), "cache file restored");
+    }
+    unlink(cachePath(path, dir, key));
+    rmdir(dir);
+    
+    if (failures) {
+        fprintf(stderr, "%d failed checks\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
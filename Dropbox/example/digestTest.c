@@ -0,0 +1,146 @@
+/*!
+ * \file    digestTest.c
+ * \brief   Check of the transfer checksums (drbCrc32c and drbDigest) against
+ *          known vectors, whatever the split of the hashed data, and of the
+ *          upload of a failing read.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dropbox.h>
+#include <dropboxDigest.h>
+
+/*! Size of the buffer hashed in parts. */
+#define BUFFER_SIZE 4096
+
+static int failures = 0;
+
+/*!
+ * \brief   Report a failed check.
+ * \param   ok     check result
+ * \param   what   checked property
+ * \return  void
+ */
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+/*!
+ * \brief   Compare a SHA-256 with its hexadecimal notation.
+ * \return  true if they are equal, false otherwise.
+ */
+static bool sameSha(const unsigned char* sha, const char* hex) {
+    char str[65];
+    for (int i = 0; i < 32; i++)
+        sprintf(str + 2 * i, "%02x", sha[i]);
+    return strcmp(str, hex) == 0;
+}
+
+/*!
+ * \brief   Hash a buffer with a digest, updated by parts.
+ * \param[out]  digest   digest to compute (algorithms set by the caller)
+ * \param       buffer   data to hash
+ * \param       size     data size
+ * \param       part     size of the updates
+ * \return  false if the digest can't be started.
+ */
+static bool hash(drbDigest* digest, const void* buffer, size_t size, size_t part) {
+    drbDigestState state;
+    if (!drbDigestStart(&state, digest))
+        return false;
+    for (size_t done = 0; done < size; done += part)
+        drbDigestUpdate(&state, (const char*)buffer + done, size - done < part ? size - done : part);
+    drbDigestFinish(&state);
+    return true;
+}
+
+/*!
+ *   Act as an upload read call, failing after a first part of the file.
+ */
+static ssize_t failingRead(void* ptr, size_t size, size_t count, void* data) {
+    int* calls = data;
+    if ((*calls)++ > 0)
+        return -1;
+    memset(ptr, 'a', size * count);
+    return count;
+}
+
+int main (int argc, char **argv) {
+    
+    // Vectors of RFC 3720 (iSCSI) and the usual check value
+    unsigned char zeros[32], ones[32], ascending[32];
+    for (int i = 0; i < 32; i++)
+        zeros[i] = 0, ones[i] = 0xff, ascending[i] = i;
+    check(drbCrc32c(0, "123456789", 9) == 0xE3069283, "crc32c of 123456789");
+    check(drbCrc32c(0, zeros, 32) == 0x8A9136AA, "crc32c of 32 zeros");
+    check(drbCrc32c(0, ones, 32) == 0x62A8AB43, "crc32c of 32 ones");
+    check(drbCrc32c(0, ascending, 32) == 0x46DD794E, "crc32c of 32 ascending bytes");
+    check(drbCrc32c(0, "", 0) == 0, "crc32c of nothing");
+    
+    // Any split and alignment gives the crc of the whole buffer
+    static unsigned char buffer[BUFFER_SIZE + 8];
+    srand(42);
+    for (size_t i = 0; i < sizeof(buffer); i++)
+        buffer[i] = rand();
+    for (int offset = 0; offset < 8; offset++) {
+        uint32_t whole = drbCrc32c(0, buffer + offset, BUFFER_SIZE);
+        for (size_t cut = 0; cut <= BUFFER_SIZE; cut += 97) {
+            char what[64];
+            snprintf(what, sizeof(what), "crc32c at offset %d cut at %zu", offset, cut);
+            uint32_t crc = drbCrc32c(0, buffer + offset, cut);
+            check(drbCrc32c(crc, buffer + offset + cut, BUFFER_SIZE - cut) == whole, what);
+        }
+    }
+    
+    // A digest gives the same checksums whatever the size of its updates
+    drbDigest abc = {DRBDIGEST_CRC32C | DRBDIGEST_SHA256};
+    check(hash(&abc, "abc", 3, 3) && abc.bytes == 3 && abc.crc32c == drbCrc32c(0, "abc", 3) &&
+          sameSha(abc.sha256, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"),
+          "digest of abc");
+    drbDigest empty = {DRBDIGEST_SHA256};
+    check(hash(&empty, "", 0, 1) && empty.bytes == 0 &&
+          sameSha(empty.sha256, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"),
+          "digest of nothing");
+    drbDigest whole = {DRBDIGEST_CRC32C | DRBDIGEST_SHA256};
+    check(hash(&whole, buffer, BUFFER_SIZE, BUFFER_SIZE), "digest of the buffer");
+    size_t parts[] = {1, 7, 64, 1000};
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+        char what[64];
+        snprintf(what, sizeof(what), "digest updated by %zu bytes", parts[i]);
+        drbDigest digest = {DRBDIGEST_CRC32C | DRBDIGEST_SHA256};
+        check(hash(&digest, buffer, BUFFER_SIZE, parts[i]) && digest.bytes == BUFFER_SIZE &&
+              digest.crc32c == whole.crc32c && !memcmp(digest.sha256, whole.sha256, 32), what);
+    }
+    
+    // A failed read aborts a hashed upload before its request is sent
+    drbInit();
+    drbClient* cli = drbCreateClient("key", "secret", "token", "tokenSecret");
+    if (cli) {
+        int calls = 0;
+        void* output = NULL; // Local error message
+        drbDigest digest = {DRBDIGEST_CRC32C};
+        int err = drbPutFile(cli, &output, DRBOPT_ROOT, DRBVAL_ROOT_AUTO, DRBOPT_PATH, "/file",
+                             DRBOPT_IO_DATA, &calls, DRBOPT_IO_FUNC, failingRead,
+                             DRBOPT_DIGEST, &digest, DRBOPT_END);
+        check(err == DRBERR_IO, "upload of a failing read");
+        free(output);
+        drbDestroyClient(cli);
+    } else
+        check(false, "client creation");
+    drbCleanup();
+    
+    if (failures) {
+        fprintf(stderr, "%d failed checks\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
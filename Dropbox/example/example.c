@@ -170,7 +170,7 @@ void displayMetadata(drbMetadata* meta, char* title) {
         if(meta->hash)        printf("hash:        %s\n", meta->hash);
         if(meta->rev)         printf("rev:         %s\n", meta->rev);
         if(meta->thumbExists) printf("thumbExists: %s\n", strFromBool(*meta->thumbExists));
-        if(meta->bytes)       printf("bytes:       %d\n", *meta->bytes);
+        if(meta->bytes)       printf("bytes:       %llu\n", (unsigned long long)*meta->bytes);
         if(meta->modified)    printf("modified:    %s\n", meta->modified);
         if(meta->path)        printf("path:        %s\n", meta->path);
         if(meta->isDir)       printf("isDir:       %s\n", strFromBool(*meta->isDir));
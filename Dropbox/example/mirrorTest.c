@@ -0,0 +1,415 @@
+/*!
+ * \file    mirrorTest.c
+ * \brief   Check of the mirror checkpoint (drbMirror): recovery from the
+ *          snapshot and its log, torn or corrupted log tails, unreadable
+ *          snapshots, the compaction of the log in a new snapshot, and the
+ *          names index giving the results of a scan.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dropbox.h>
+
+/*! Files of each folder. */
+#define FOLDER_FILES 100
+
+/*! Files of each page applied until the log is compacted. */
+#define PAGE_FILES 1000
+
+/*! Size of the log header, the log size once cleared. */
+#define LOG_HEADER_SIZE 16
+
+/*! Files of the searched mirrors. */
+#define SEARCH_FILES 10000
+
+/*! Maximum number of search results. */
+#define SEARCH_LIMIT 1000
+
+static int failures = 0;
+
+/*!
+ * \brief   Report a failed check.
+ * \param   ok     check result
+ * \param   what   checked property
+ * \return  void
+ */
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+/*!
+ * \brief   Get the path of a file.
+ * \param[out]  path   path buffer (64 bytes)
+ * \param       i      file number
+ * \return  path.
+ */
+static char* filePath(char* path, size_t i) {
+    snprintf(path, 64, "/Folder %zu/File %zu.txt", i / FOLDER_FILES, i);
+    return path;
+}
+
+/*!
+ * \brief   Get the size of a file.
+ * \return  file size (0 if it doesn't exist).
+ */
+static size_t fileSize(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+/*!
+ * \brief   Apply a delta page adding files.
+ * \param   mirror    mirror to update
+ * \param   cursor    page cursor
+ * \param   reset     the page resets the delta
+ * \param   deleted   path deleted before the files are added (NULL for none)
+ * \param   first     first file number
+ * \param   count     number of files
+ * \param   rev       revision of the files
+ * \return  error code of drbMirrorApply.
+ */
+static int apply(drbMirror* mirror, char* cursor, bool reset, char* deleted, size_t first,
+                 size_t count, char* rev) {
+    drbDeltaEntry* entries = calloc(count + 1, sizeof(drbDeltaEntry));
+    drbMetadata* metadata = calloc(count ? count : 1, sizeof(drbMetadata));
+    char* paths = malloc(count * 64 + 1);
+    static bool no = false;
+    if (!entries || !metadata || !paths) {
+        free(paths), free(metadata), free(entries);
+        return DRBERR_MALLOC;
+    }
+    
+    drbDelta delta = {&reset, cursor, &no, {entries, 0}};
+    if (deleted)
+        entries[delta.entries.size++].path = deleted;
+    for (size_t i = 0; i < count; i++) {
+        drbMetadata* meta = &metadata[i];
+        meta->path = filePath(paths + i * 64, first + i);
+        meta->rev = rev;
+        meta->isDir = &no;
+        entries[delta.entries.size].path = meta->path;
+        entries[delta.entries.size++].metadata = meta;
+    }
+    int err = drbMirrorApply(mirror, &delta);
+    free(paths), free(metadata), free(entries);
+    return err;
+}
+
+/*!
+ * \brief   Check the revision of files of a mirror.
+ * \param   mirror   mirror to search
+ * \param   first    first file number
+ * \param   count    number of files
+ * \param   rev      expected revision (NULL if the files must be missing)
+ * \return  true if all the files have the revision, false otherwise.
+ */
+static bool hasFiles(drbMirror* mirror, size_t first, size_t count, const char* rev) {
+    char path[64];
+    bool same = true;
+    for (size_t i = first; i < first + count && same; i++) {
+        drbMetadata* meta = drbMirrorGetMetadata(mirror, filePath(path, i), false);
+        same = rev ? meta && meta->rev && !strcmp(meta->rev, rev) : !meta;
+        drbDestroyMetadata(meta, true);
+    }
+    return same;
+}
+
+/*!
+ * \brief   Check the cursor of a mirror.
+ * \param   mirror   mirror to query
+ * \param   cursor   expected cursor (NULL for none)
+ * \return  true if the mirror has the cursor, false otherwise.
+ */
+static bool hasCursor(drbMirror* mirror, const char* cursor) {
+    char* current = drbMirrorGetCursor(mirror);
+    bool same = cursor ? current && !strcmp(current, cursor) : !current;
+    free(current);
+    return same;
+}
+
+/*!
+ * \brief   Load a mirror again from its checkpoint.
+ * \param   mirror       mirror to free
+ * \param   checkpoint   snapshot file
+ * \return  loaded mirror (NULL on failure).
+ */
+static drbMirror* reload(drbMirror* mirror, const char* checkpoint) {
+    drbDestroyMirror(mirror);
+    return drbCreateMirror(checkpoint);
+}
+
+/*!
+ * \brief   Check the mirror state after the first two pages.
+ */
+static bool firstPages(drbMirror* mirror) {
+    drbMetadata* folder = drbMirrorGetMetadata(mirror, "/folder 1", true);
+    drbMetadata* deleted = drbMirrorGetMetadata(mirror, "/folder 0", false);
+    bool same = hasCursor(mirror, "c2") && hasFiles(mirror, 0, FOLDER_FILES, NULL) &&
+                hasFiles(mirror, FOLDER_FILES, 150, "r1") && hasFiles(mirror, 250, 500, "r2") &&
+                hasFiles(mirror, 750, 1, NULL) && !deleted && folder && folder->isDir &&
+                *folder->isDir && folder->contents && folder->contents->size == FOLDER_FILES;
+    drbDestroyMetadata(deleted, true);
+    drbDestroyMetadata(folder, true);
+    return same;
+}
+
+/*!
+ * \brief   Compare two paths, for qsort.
+ */
+static int comparePaths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/*!
+ * \brief   Compare the results of a query in a mirror with an index and in a
+ *          mirror without (scanned), whatever their order. Results cut at the
+ *          limit are different subsets, only their sizes are compared.
+ * \param   indexed   mirror with a names index
+ * \param   scanned   mirror with the same nodes and without index
+ * \param   path      folder to search in
+ * \param   query     words to search
+ * \return  true if both give the same paths, false otherwise.
+ */
+static bool sameSearch(drbMirror* indexed, drbMirror* scanned, const char* path,
+                       const char* query) {
+    drbMetadataList* a = drbMirrorSearch(indexed, path, query, 0, false);
+    drbMetadataList* b = drbMirrorSearch(scanned, path, query, 0, false);
+    bool same = a && b && a->size == b->size;
+    if (same && a->size == SEARCH_LIMIT) {
+        drbDestroyMetadataList(a, true);
+        drbDestroyMetadataList(b, true);
+        return true;
+    }
+    char** paths = same ? malloc((2 * a->size + 1) * sizeof(char*)) : NULL;
+    if (paths) {
+        for (size_t i = 0; i < a->size; i++)
+            paths[i] = a->array[i]->path, paths[a->size + i] = b->array[i]->path;
+        qsort(paths, a->size, sizeof(char*), comparePaths);
+        qsort(paths + a->size, a->size, sizeof(char*), comparePaths);
+        for (size_t i = 0; i < a->size && same; i++)
+            same = strcasecmp(paths[i], paths[a->size + i]) == 0;
+    }
+    free(paths);
+    drbDestroyMetadataList(a, true);
+    drbDestroyMetadataList(b, true);
+    return same && paths;
+}
+
+/*!
+ * \brief   Compare the results of queries in a mirror with an index and in a
+ *          mirror without.
+ * \param   indexed   mirror with a names index
+ * \param   scanned   mirror with the same nodes and without index
+ * \param   what      checked property
+ * \return  void
+ */
+static void checkSearch(drbMirror* indexed, drbMirror* scanned, const char* what) {
+    static const char* queries[] = {"file 12", "123", "FILE .txt 9", "ile 5 7", "folder 7",
+                                    "99.txt", "le 9", "nothing", "x"};
+    static const char* paths[] = {"/", "/folder 12", "/FOLDER 77/", "/missing"};
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+        for (size_t k = 0; k < sizeof(queries) / sizeof(queries[0]); k++) {
+            char message[128];
+            snprintf(message, sizeof(message), "%s: %s in %s", what, queries[k], paths[i]);
+            check(sameSearch(indexed, scanned, paths[i], queries[k]), message);
+        }
+}
+
+/*!
+ * \brief   Find whether a search with deleted entries finds a path.
+ * \param   mirror   mirror to search
+ * \param   path     file path
+ * \param   name     file name
+ * \return  true if the path is found as deleted, false otherwise.
+ */
+static bool findDeleted(drbMirror* mirror, const char* path, const char* name) {
+    drbMetadataList* results = drbMirrorSearch(mirror, "/", name, 0, true);
+    bool found = false;
+    for (size_t i = 0; results && i < results->size; i++)
+        found |= !strcasecmp(results->array[i]->path, path) && results->array[i]->isDeleted &&
+                 *results->array[i]->isDeleted;
+    drbDestroyMetadataList(results, true);
+    return found;
+}
+
+int main (int argc, char **argv) {
+    
+    char dir[] = "/tmp/mirrorTestXXXXXX";
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Checkpoint directory creation failed\n");
+        return EXIT_FAILURE;
+    }
+    char checkpoint[64], log[64];
+    snprintf(checkpoint, sizeof(checkpoint), "%s/mirror", dir);
+    snprintf(log, sizeof(log), "%s/mirror.log", dir);
+    
+    drbMirror* mirror = drbCreateMirror(checkpoint);
+    check(mirror && hasCursor(mirror, NULL) && fileSize(checkpoint) > 0 &&
+          fileSize(log) == LOG_HEADER_SIZE, "new checkpoint");
+    
+    // The pages of the log are applied again after a restart
+    check(mirror && apply(mirror, "c1", false, NULL, 0, 500, "r1") == DRBERR_OK &&
+          apply(mirror, "c2", false, "/folder 0", 250, 500, "r2") == DRBERR_OK &&
+          firstPages(mirror), "pages applied");
+    mirror = reload(mirror, checkpoint);
+    check(mirror && firstPages(mirror), "pages replayed from the log");
+    
+    // A snapshot clears the log
+    check(mirror && drbMirrorSave(mirror) == DRBERR_OK && fileSize(log) == LOG_HEADER_SIZE,
+          "log cleared by a snapshot");
+    mirror = reload(mirror, checkpoint);
+    check(mirror && firstPages(mirror), "mirror loaded from the snapshot");
+    
+    // A page torn by a crash is dropped, and fetched again from the cursor
+    size_t size = fileSize(log);
+    check(mirror && apply(mirror, "c3", false, NULL, 750, 10, "r3") == DRBERR_OK,
+          "page applied after a snapshot");
+    drbDestroyMirror(mirror);
+    check(truncate(log, (size + fileSize(log)) / 2) == 0, "log truncation");
+    mirror = drbCreateMirror(checkpoint);
+    check(mirror && firstPages(mirror) && hasFiles(mirror, 750, 10, NULL) &&
+          fileSize(log) == size, "torn page dropped");
+    check(mirror && apply(mirror, "c3", false, NULL, 750, 10, "r3") == DRBERR_OK,
+          "torn page applied again");
+    mirror = reload(mirror, checkpoint);
+    check(mirror && hasCursor(mirror, "c3") && hasFiles(mirror, 750, 10, "r3"),
+          "page logged after a torn one");
+    
+    // A corrupted page is dropped with the next ones
+    size = fileSize(log);
+    check(mirror && apply(mirror, "c4", false, NULL, 760, 10, "r4") == DRBERR_OK &&
+          apply(mirror, "c5", false, NULL, 770, 10, "r5") == DRBERR_OK, "pages applied");
+    drbDestroyMirror(mirror);
+    FILE* file = fopen(log, "r+b");
+    if (file) {
+        fseek(file, (long)size + 24, SEEK_SET);
+        int byte = fgetc(file);
+        fseek(file, (long)size + 24, SEEK_SET);
+        fputc(byte ^ 0x20, file);
+        fclose(file);
+    }
+    mirror = drbCreateMirror(checkpoint);
+    check(mirror && hasCursor(mirror, "c3") && hasFiles(mirror, 750, 10, "r3") &&
+          hasFiles(mirror, 760, 20, NULL) && fileSize(log) == size, "corrupted page dropped");
+    
+    // A reset page drops the previous files
+    check(mirror && apply(mirror, "c6", true, NULL, 0, 10, "r6") == DRBERR_OK, "reset applied");
+    mirror = reload(mirror, checkpoint);
+    check(mirror && hasCursor(mirror, "c6") && hasFiles(mirror, 0, 10, "r6") &&
+          hasFiles(mirror, 10, 760, NULL), "reset replayed from the log");
+    
+    // An unreadable snapshot starts an empty mirror, fetched again from scratch
+    drbDestroyMirror(mirror);
+    file = fopen(checkpoint, "r+b");
+    if (file) {
+        fseek(file, 8, SEEK_SET);
+        fputc(0xff, file);
+        fclose(file);
+    }
+    mirror = drbCreateMirror(checkpoint);
+    check(mirror && hasCursor(mirror, NULL) && hasFiles(mirror, 0, 10, NULL),
+          "unreadable snapshot");
+    check(mirror && apply(mirror, "c7", false, NULL, 0, 10, "r7") == DRBERR_OK,
+          "page applied after an unreadable snapshot");
+    mirror = reload(mirror, checkpoint);
+    check(mirror && hasCursor(mirror, "c7") && hasFiles(mirror, 0, 10, "r7"),
+          "log following a new snapshot");
+    drbDestroyMirror(mirror);
+    unlink(checkpoint);
+    unlink(log);
+    
+    // The log is compacted in a snapshot once it outgrows it
+    mirror = drbCreateMirror(checkpoint);
+    size_t pages = 0, previous = 0;
+    bool compacted = false;
+    while (mirror && !compacted && pages < 1000) {
+        char cursor[32];
+        snprintf(cursor, sizeof(cursor), "p%zu", pages);
+        if (apply(mirror, cursor, false, NULL, pages * PAGE_FILES, PAGE_FILES, "r1") != DRBERR_OK)
+            break;
+        pages++;
+        size = fileSize(log);
+        compacted = size < previous;
+        previous = size;
+    }
+    check(compacted && size == LOG_HEADER_SIZE && fileSize(checkpoint) > 16 * 1024 * 1024,
+          "log compacted");
+    mirror = reload(mirror, checkpoint);
+    char cursor[32];
+    snprintf(cursor, sizeof(cursor), "p%zu", pages - 1);
+    check(mirror && hasCursor(mirror, cursor) && hasFiles(mirror, 0, pages * PAGE_FILES, "r1"),
+          "mirror loaded from the compacted log");
+    drbDestroyMirror(mirror);
+    
+    unlink(checkpoint);
+    unlink(log);
+    rmdir(dir);
+    
+    // The index finds the names found by a scan, with the same updates
+    drbMirror* indexed = drbCreateMirror(NULL);
+    drbMirror* scanned = drbCreateMirror(NULL);
+    bool filled = indexed && scanned && drbMirrorEnableSearch(indexed);
+    for (size_t first = 0; filled && first < SEARCH_FILES; first += PAGE_FILES)
+        filled = apply(indexed, "s1", false, NULL, first, PAGE_FILES, "r1") == DRBERR_OK &&
+                 apply(scanned, "s1", false, NULL, first, PAGE_FILES, "r1") == DRBERR_OK;
+    check(filled, "searched mirrors filled");
+    if (filled) {
+        checkSearch(indexed, scanned, "index updated by the pages");
+        
+        // An index enabled on a filled mirror finds the same names
+        drbMirror* late = drbCreateMirror(NULL);
+        filled = late;
+        for (size_t first = 0; filled && first < SEARCH_FILES; first += PAGE_FILES)
+            filled = apply(late, "s1", false, NULL, first, PAGE_FILES, "r1") == DRBERR_OK;
+        check(filled && drbMirrorEnableSearch(late), "index of a filled mirror");
+        if (filled)
+            checkSearch(late, scanned, "index of a filled mirror");
+        drbDestroyMirror(late);
+        
+        // A deleted folder is found with the deleted entries only
+        filled = apply(indexed, "s2", false, "/folder 99", 0, 0, "r1") == DRBERR_OK &&
+                 apply(scanned, "s2", false, "/folder 99", 0, 0, "r1") == DRBERR_OK;
+        check(filled && findDeleted(indexed, "/folder 99/file 9950.txt", "9950"),
+              "deleted file found");
+        checkSearch(indexed, scanned, "index with deleted entries");
+        
+        // Once the deleted entries outnumber the others, they are dropped and
+        // the index ids are renumbered
+        for (int i = 0; filled && i < 60; i++) {
+            char folder[32];
+            snprintf(folder, sizeof(folder), "/folder %d", i);
+            filled = apply(indexed, "s3", false, folder, 0, 0, "r1") == DRBERR_OK &&
+                     apply(scanned, "s3", false, folder, 0, 0, "r1") == DRBERR_OK;
+        }
+        check(filled && !findDeleted(indexed, "/folder 99/file 9950.txt", "9950"),
+              "deleted entries dropped");
+        checkSearch(indexed, scanned, "index after the deleted entries are dropped");
+        
+        // New and added again files get ids after the renumbered ones
+        filled = apply(indexed, "s4", false, NULL, SEARCH_FILES - 500, 1000, "r2") == DRBERR_OK &&
+                 apply(scanned, "s4", false, NULL, SEARCH_FILES - 500, 1000, "r2") == DRBERR_OK &&
+                 apply(indexed, "s5", false, NULL, 1200, 100, "r2") == DRBERR_OK &&
+                 apply(scanned, "s5", false, NULL, 1200, 100, "r2") == DRBERR_OK;
+        check(filled, "files added after the renumbering");
+        checkSearch(indexed, scanned, "index after the renumbering");
+    }
+    drbDestroyMirror(indexed);
+    drbDestroyMirror(scanned);
+    
+    if (failures) {
+        fprintf(stderr, "%d failed checks\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
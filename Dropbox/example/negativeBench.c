@@ -0,0 +1,104 @@
+/*!
+ * \file    negativeBench.c
+ * \brief   Time of the metadata requests answered by the missing paths cache
+ *          (drbSetNegativeCache), and of the cache lookups and invalidations.
+ *
+ * The missing paths are stored as the 404 answers of the server would, so
+ * no request is sent and no server is needed.
+ *
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dropbox.h>
+#include <dropboxOAuth.h>
+
+/*! Missing paths kept in the cache. */
+static const size_t DRB_BENCH_ENTRIES = 100000;
+
+/*! Timed calls of each case. */
+static const size_t DRB_BENCH_CALLS = 1000000;
+
+/*! Error given by the server for a missing path. */
+static const char* DRB_BENCH_ERROR = "{\"error\": \"Path '/missing' not found\"}";
+
+/*!
+ * \brief   Get the current time of the monotonic clock.
+ * \return  time (s).
+ */
+static double now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*!
+ * \brief   Get the path of a missing file.
+ * \param[out]  path     path buffer (64 bytes)
+ * \param       folder   parent folder name
+ * \param       i        file number
+ * \return  path.
+ */
+static char* filePath(char* path, const char* folder, size_t i) {
+    snprintf(path, 64, "/%s/file-%zu.txt", folder, i % DRB_BENCH_ENTRIES);
+    return path;
+}
+
+int main (int argc, char **argv) {
+    
+    drbInit();
+    drbClient* cli = drbCreateClient("key", "secret", "token", "tokenSecret");
+    if (!cli || !drbSetNegativeCache(cli, DRB_BENCH_ENTRIES, 3600)) {
+        fprintf(stderr, "Client creation failed\n");
+        return EXIT_FAILURE;
+    }
+    
+    char path[64];
+    for (size_t i = 0; i < DRB_BENCH_ENTRIES; i++)
+        drbNegativeCacheStore(cli->negativeCache, DRBVAL_ROOT_DROPBOX,
+                              filePath(path, "missing", i), DRB_BENCH_ERROR,
+                              drbNegativeCacheGeneration(cli->negativeCache));
+    
+    // Each call must be answered locally with the stored error
+    double start = now();
+    for (size_t i = 0; i < DRB_BENCH_CALLS; i++) {
+        void* output = NULL;
+        int err = drbGetMetadata(cli, &output, DRBOPT_ROOT, DRBVAL_ROOT_DROPBOX,
+                                 DRBOPT_PATH, filePath(path, "missing", i), DRBOPT_END);
+        if (err != 404 || !output || strcmp(output, DRB_BENCH_ERROR) != 0) {
+            fprintf(stderr, "%s: not answered by the cache (%d)\n", path, err);
+            return EXIT_FAILURE;
+        }
+        free(output);
+    }
+    double metadata = now() - start;
+    
+    start = now();
+    for (size_t i = 0; i < DRB_BENCH_CALLS; i++)
+        drbNegativeCacheFind(cli->negativeCache, DRBVAL_ROOT_DROPBOX,
+                             filePath(path, "missing", i), NULL);
+    double find = now() - start;
+    
+    // Paths created outside the cached ones, as most delta entries
+    start = now();
+    for (size_t i = 0; i < DRB_BENCH_CALLS; i++)
+        drbNegativeCacheInvalidate(cli->negativeCache, filePath(path, "created", i), false);
+    double invalidate = now() - start;
+    
+    drbNegativeCacheStats stats;
+    drbGetNegativeCacheStats(cli, &stats);
+    printf("%zu missing paths cached (%zu hits)\n", stats.entries, stats.hits);
+    printf("drbGetMetadata answered locally: %6.2f us/call\n", metadata / DRB_BENCH_CALLS * 1e6);
+    printf("cache lookup:                    %6.2f us/call\n", find / DRB_BENCH_CALLS * 1e6);
+    printf("delta entry invalidation:        %6.2f us/call\n",
+           invalidate / DRB_BENCH_CALLS * 1e6);
+    
+    drbDestroyClient(cli);
+    drbCleanup();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+/*!
+ * \file    negativeTest.c
+ * \brief   Check of the missing paths cache (drbNegativeCache): expiry,
+ *          invalidation by the created paths, stores racing an invalidation,
+ *          eviction, and the metadata requests it answers locally.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dropbox.h>
+#include <dropboxOAuth.h>
+#include <dropboxNegative.h>
+
+/*! Error given by the server for a missing path. */
+static const char* ERROR = "{\"error\": \"Path '/missing' not found\"}";
+
+static int failures = 0;
+
+/*!
+ * \brief   Report a failed check.
+ * \param   ok     check result
+ * \param   what   checked property
+ * \return  void
+ */
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+/*!
+ * \brief   Keep a missing path, from a request started now.
+ * \param   cache   cache to fill
+ * \param   root    path root
+ * \param   path    missing path
+ * \return  void
+ */
+static void store(drbNegativeCache* cache, const char* root, const char* path) {
+    drbNegativeCacheStore(cache, root, path, ERROR, drbNegativeCacheGeneration(cache));
+}
+
+/*!
+ * \brief   Find whether a path is known to be missing, with its error.
+ * \param   cache   cache to search
+ * \param   root    path root
+ * \param   path    path to find
+ * \return  true if the path is missing with the stored error, false otherwise.
+ */
+static bool missing(drbNegativeCache* cache, const char* root, const char* path) {
+    char* error = NULL;
+    bool found = drbNegativeCacheFind(cache, root, path, &error) && !strcmp(error, ERROR);
+    free(error);
+    return found;
+}
+
+int main (int argc, char **argv) {
+    
+    drbNegativeCache* cache = drbCreateNegativeCache(100, 1);
+    if (!cache) {
+        fprintf(stderr, "Cache creation failed\n");
+        return EXIT_FAILURE;
+    }
+    
+    // A missing path is found whatever its case and trailing slash, in its root
+    store(cache, DRBVAL_ROOT_DROPBOX, "/Photos/Album/img.jpg");
+    check(missing(cache, DRBVAL_ROOT_DROPBOX, "/photos/ALBUM/img.jpg/"), "path case and slash");
+    check(!missing(cache, DRBVAL_ROOT_SANDBOX, "/photos/album/img.jpg"), "path of another root");
+    check(!missing(cache, DRBVAL_ROOT_DROPBOX, "/photos/album"), "parent of a missing path");
+    
+    // A missing path expires after the ttl
+    usleep(1200000);
+    check(!missing(cache, DRBVAL_ROOT_DROPBOX, "/photos/album/img.jpg"), "expired path");
+    drbNegativeCacheStats stats;
+    drbNegativeCacheGetStats(cache, &stats);
+    check(stats.entries == 0 && stats.hits == 1 && stats.misses == 3, "expiry statistics");
+    drbDestroyNegativeCache(cache);
+    
+    cache = drbCreateNegativeCache(100, 3600);
+    if (!cache) {
+        fprintf(stderr, "Cache creation failed\n");
+        return EXIT_FAILURE;
+    }
+    
+    // A created path drops itself and its parent folders, in all the roots
+    store(cache, DRBVAL_ROOT_DROPBOX, "/a");
+    store(cache, DRBVAL_ROOT_SANDBOX, "/a");
+    store(cache, DRBVAL_ROOT_DROPBOX, "/a/b");
+    store(cache, DRBVAL_ROOT_DROPBOX, "/a/b/c");
+    store(cache, DRBVAL_ROOT_DROPBOX, "/a/bc");
+    store(cache, DRBVAL_ROOT_DROPBOX, "/a/b/d");
+    drbNegativeCacheInvalidate(cache, "/A/b/c", false);
+    check(!missing(cache, DRBVAL_ROOT_DROPBOX, "/a") &&
+          !missing(cache, DRBVAL_ROOT_SANDBOX, "/a") &&
+          !missing(cache, DRBVAL_ROOT_DROPBOX, "/a/b") &&
+          !missing(cache, DRBVAL_ROOT_DROPBOX, "/a/b/c"), "created path and parents dropped");
+    check(missing(cache, DRBVAL_ROOT_DROPBOX, "/a/bc") &&
+          missing(cache, DRBVAL_ROOT_DROPBOX, "/a/b/d"), "siblings of a created path kept");
+    
+    // A created subtree (e.g. moved folder) drops the paths under it only
+    store(cache, DRBVAL_ROOT_SANDBOX, "/a/b/e");
+    drbNegativeCacheInvalidate(cache, "/a/b", true);
+    check(!missing(cache, DRBVAL_ROOT_DROPBOX, "/a/b/d") &&
+          !missing(cache, DRBVAL_ROOT_SANDBOX, "/a/b/e"), "created subtree dropped");
+    check(missing(cache, DRBVAL_ROOT_DROPBOX, "/a/bc"), "path sharing the subtree prefix kept");
+    drbNegativeCacheGetStats(cache, &stats);
+    check(stats.invalidated == 6 && stats.entries == 1, "invalidation statistics");
+    
+    // An answer received after an invalidation isn't kept: the path may have
+    // been created since the request
+    uint64_t generation = drbNegativeCacheGeneration(cache);
+    drbNegativeCacheInvalidate(cache, "/elsewhere", false);
+    drbNegativeCacheStore(cache, DRBVAL_ROOT_DROPBOX, "/late", ERROR, generation);
+    check(!drbNegativeCacheFind(cache, DRBVAL_ROOT_DROPBOX, "/late", NULL),
+          "store racing an invalidation");
+    
+    // A path stored without its error only answers the lookups without output
+    drbNegativeCacheStore(cache, DRBVAL_ROOT_DROPBOX, "/unknown", NULL,
+                          drbNegativeCacheGeneration(cache));
+    char* error = NULL;
+    check(drbNegativeCacheFind(cache, DRBVAL_ROOT_DROPBOX, "/unknown", NULL) &&
+          !drbNegativeCacheFind(cache, DRBVAL_ROOT_DROPBOX, "/unknown", &error) && !error,
+          "path stored without error");
+    drbDestroyNegativeCache(cache);
+    
+    // The oldest paths are dropped beyond the limit
+    cache = drbCreateNegativeCache(100, 3600);
+    if (cache) {
+        char path[32];
+        for (int i = 0; i < 1000; i++) {
+            snprintf(path, sizeof(path), "/file-%d", i);
+            store(cache, DRBVAL_ROOT_DROPBOX, path);
+        }
+        drbNegativeCacheGetStats(cache, &stats);
+        check(stats.entries == 100 && missing(cache, DRBVAL_ROOT_DROPBOX, "/file-999") &&
+              missing(cache, DRBVAL_ROOT_DROPBOX, "/file-900") &&
+              !missing(cache, DRBVAL_ROOT_DROPBOX, "/file-899"), "oldest paths dropped");
+        drbDestroyNegativeCache(cache);
+    } else
+        check(false, "bounded cache creation");
+    
+    // A metadata request of a missing path is answered locally with its error
+    drbInit();
+    drbClient* cli = drbCreateClient("key", "secret", "token", "tokenSecret");
+    if (cli && drbSetNegativeCache(cli, 100, 3600)) {
+        store(cli->negativeCache, DRBVAL_ROOT_DROPBOX, "/missing");
+        void* output = NULL;
+        int err = drbGetMetadata(cli, &output, DRBOPT_ROOT, DRBVAL_ROOT_DROPBOX,
+                                 DRBOPT_PATH, "/missing", DRBOPT_END);
+        check(err == 404 && output && !strcmp(output, ERROR), "metadata answered locally");
+        free(output);
+        err = drbGetMetadata(cli, NULL, DRBOPT_ROOT, DRBVAL_ROOT_DROPBOX,
+                             DRBOPT_PATH, "/missing", DRBOPT_END);
+        check(err == 404, "metadata answered locally without output");
+        drbGetNegativeCacheStats(cli, &stats);
+        check(stats.hits == 2 && stats.entries == 1, "client cache statistics");
+        drbDestroyClient(cli);
+    } else
+        check(false, "client creation");
+    drbCleanup();
+    
+    if (failures) {
+        fprintf(stderr, "%d failed checks\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+/*!
+ * \file    pipeTest.c
+ * \brief   Check of the pipes (drbPipe): data order between threads, writers
+ *          waiting on a full pipe, transfers paused and resumed, and closes.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dropbox.h>
+#include <dropboxPipe.h>
+
+/*! Bytes sent through the pipe by the producer. */
+#define TRANSFER_SIZE (16 * 1024 * 1024)
+
+/*! Smallest pipe (the capacity is raised to its minimum). */
+#define SMALL_PIPE 1
+
+static int failures = 0;
+
+/*!
+ * \brief   Report a failed check.
+ * \param   ok     check result
+ * \param   what   checked property
+ * \return  void
+ */
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+/*!
+ * \struct  producer
+ * \breif   Writer thread of a pipe.
+ */
+typedef struct {
+    drbPipe* pipe;      /*!< Pipe to write. */
+    size_t size;        /*!< Bytes to write. */
+    size_t written;     /*!< Bytes written so far. */
+    bool done;          /*!< All the bytes were written, or the pipe closed. */
+} producer;
+
+/*!
+ * \brief   Byte of the transferred data at an offset.
+ */
+static unsigned char pattern(size_t offset) {
+    return (unsigned char)(offset * 2654435761u >> 24);
+}
+
+/*!
+ * \brief   Producer thread: write the pattern in chunks of various sizes, then
+ *          close the pipe.
+ * \param   arg   producer
+ * \return  NULL
+ */
+static void* produce(void* arg) {
+    producer* p = arg;
+    static unsigned char chunk[70000];
+    size_t length = 1;
+    while (p->written < p->size) {
+        length = (length * 7 + 13) % sizeof(chunk) + 1;
+        if (length > p->size - p->written)
+            length = p->size - p->written;
+        for (size_t i = 0; i < length; i++)
+            chunk[i] = pattern(p->written + i);
+        size_t written = drbPipeWrite(chunk, 1, length, p->pipe);
+        p->written += written;
+        if (written < length)
+            break;
+    }
+    __atomic_store_n(&p->done, true, __ATOMIC_SEQ_CST);
+    drbClosePipe(p->pipe, DRBERR_OK);
+    return NULL;
+}
+
+/*!
+ * \brief   Transfer the pattern between two threads.
+ * \param   capacity   pipe capacity
+ * \return  void
+ */
+static void transfer(size_t capacity) {
+    char what[64];
+    drbPipe* pipe = drbCreatePipe(capacity);
+    producer p = {pipe, TRANSFER_SIZE, 0, false};
+    pthread_t thread;
+    snprintf(what, sizeof(what), "transfer through a %zu bytes pipe", capacity);
+    if (!pipe || pthread_create(&thread, NULL, produce, &p) != 0) {
+        check(false, what);
+        drbDestroyPipe(pipe);
+        return;
+    }
+    
+    static unsigned char buffer[50000];
+    size_t total = 0, length, size = 1;
+    bool same = true;
+    do {
+        size = (size * 5 + 11) % sizeof(buffer) + 1;
+        length = drbPipeRead(buffer, 1, size, pipe);
+        for (size_t i = 0; i < length && same; i++)
+            same = buffer[i] == pattern(total + i);
+        total += length;
+    } while (length > 0);
+    pthread_join(thread, NULL);
+    
+    check(same && total == TRANSFER_SIZE && p.written == TRANSFER_SIZE &&
+          drbPipeError(pipe) == DRBERR_OK, what);
+    drbDestroyPipe(pipe);
+}
+
+int main (int argc, char **argv) {
+    
+    transfer(0);
+    transfer(SMALL_PIPE);
+    
+    // A writer waits while the pipe is full, until the reader makes room
+    drbPipe* pipe = drbCreatePipe(SMALL_PIPE);
+    producer p = {pipe, 4 * 1024 * 1024, 0, false};
+    pthread_t thread;
+    if (pipe && pthread_create(&thread, NULL, produce, &p) == 0) {
+        usleep(100000);
+        check(!__atomic_load_n(&p.done, __ATOMIC_SEQ_CST), "writer waiting on a full pipe");
+        unsigned char buffer[4096];
+        size_t total = 0, length;
+        while ((length = drbPipeRead(buffer, 1, sizeof(buffer), pipe)) > 0)
+            total += length;
+        pthread_join(thread, NULL);
+        check(p.done && total == p.size, "writer resumed by the reader");
+    } else
+        check(false, "full pipe creation");
+    drbDestroyPipe(pipe);
+    
+    // A transfer is paused when a curl write doesn't fit, and resumed once a
+    // whole curl write fits
+    pipe = drbCreatePipe(SMALL_PIPE);
+    if (pipe) {
+        static char write[CURL_MAX_WRITE_SIZE], read[CURL_MAX_WRITE_SIZE];
+        size_t stored = 0, result;
+        drbPipeAttach(pipe, NULL);
+        check(!drbPipeResume(pipe), "transfer not paused");
+        while ((result = drbPipeTransferWrite(write, 1, sizeof(write), pipe)) == sizeof(write))
+            stored += result;
+        check(result == CURL_WRITEFUNC_PAUSE && stored > 0, "transfer paused on a full pipe");
+        check(!drbPipeResume(pipe), "transfer kept paused while the pipe is full");
+        
+        stored -= drbPipeRead(read, 1, sizeof(read) / 2, pipe);
+        check(!drbPipeResume(pipe), "transfer kept paused without room for a curl write");
+        stored -= drbPipeRead(read, 1, sizeof(read), pipe);
+        check(drbPipeResume(pipe), "transfer resumed once a curl write fits");
+        check(!drbPipeResume(pipe), "transfer resumed once");
+        check(drbPipeTransferWrite(write, 1, sizeof(write), pipe) == sizeof(write),
+              "write of the resumed transfer");
+        stored += sizeof(write);
+        
+        // A paused transfer is resumed by a close, to be aborted by its write
+        while (drbPipeTransferWrite(write, 1, sizeof(write), pipe) == sizeof(write))
+            stored += sizeof(write);
+        drbClosePipe(pipe, DRBERR_NETWORK);
+        drbClosePipe(pipe, DRBERR_OK);
+        check(drbPipeResume(pipe) && drbPipeTransferWrite(write, 1, sizeof(write), pipe) == 0,
+              "transfer aborted by the close");
+        check(drbPipeError(pipe) == DRBERR_NETWORK, "error of the first close");
+        
+        // The data written before the close is still read
+        size_t total = 0, length;
+        while ((length = drbPipeRead(read, 1, sizeof(read), pipe)) > 0)
+            total += length;
+        check(total == stored, "data read after the close");
+        check(drbPipeWrite(write, 1, 1, pipe) == 0, "write in a closed pipe");
+    } else
+        check(false, "transfer pipe creation");
+    drbDestroyPipe(pipe);
+    
+    if (failures) {
+        fprintf(stderr, "%d failed checks\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
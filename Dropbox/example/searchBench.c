@@ -0,0 +1,110 @@
+/*!
+ * \file    searchBench.c
+ * \brief   Time of the name queries of a mirror (drbMirrorSearch), with the
+ *          index of drbMirrorEnableSearch and with a scan of all the nodes.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <dropbox.h>
+
+/*! Default number of files in the mirror. */
+static const size_t DRB_BENCH_FILES = 10000000;
+
+/*! Files of each applied delta page. */
+static const size_t DRB_BENCH_PAGE = 10000;
+
+/*! Files of each folder. */
+static const size_t DRB_BENCH_FOLDER = 10000;
+
+/*!
+ * \brief   Get the current time of the monotonic clock.
+ * \return  time (s).
+ */
+static double now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*!
+ * \brief   Fill a mirror with files, by delta pages.
+ * \param   mirror   mirror to fill
+ * \param   count    number of files
+ * \return  false on failure.
+ */
+static bool fill(drbMirror* mirror, size_t count) {
+    drbDeltaEntry* entries = calloc(DRB_BENCH_PAGE, sizeof(drbDeltaEntry));
+    drbMetadata* metadata = calloc(DRB_BENCH_PAGE, sizeof(drbMetadata));
+    char* paths = malloc(DRB_BENCH_PAGE * 64);
+    bool isDir = false, ok = entries && metadata && paths;
+    
+    for (size_t first = 0; ok && first < count; first += DRB_BENCH_PAGE) {
+        drbDelta delta = {NULL, NULL, NULL, {entries, 0}};
+        for (size_t i = first; i < count && i < first + DRB_BENCH_PAGE; i++) {
+            char* path = paths + (i - first) * 64;
+            snprintf(path, 64, "/folder %zu/report %zu draft-%08x.docx", i / DRB_BENCH_FOLDER,
+                     i, (uint32_t)(i * 2654435761u));
+            metadata[delta.entries.size].path = path;
+            metadata[delta.entries.size].isDir = &isDir;
+            entries[delta.entries.size].path = path;
+            entries[delta.entries.size].metadata = &metadata[delta.entries.size];
+            delta.entries.size++;
+        }
+        ok = drbMirrorApply(mirror, &delta) == DRBERR_OK;
+    }
+    free(paths);
+    free(metadata);
+    free(entries);
+    return ok;
+}
+
+/*!
+ * \brief   Time the queries of a mirror.
+ * \param   mirror    mirror to search
+ * \param   queries   queries (NULL terminated)
+ * \return  void
+ */
+static void bench(drbMirror* mirror, const char** queries) {
+    for (int i = 0; queries[i]; i++) {
+        double start = now();
+        drbMetadataList* results = drbMirrorSearch(mirror, "/", queries[i], 0, false);
+        double time = (now() - start) * 1e3;
+        printf("  %-22s %4zu results %10.2f ms\n", queries[i], results ? results->size : 0,
+               time);
+        drbDestroyMetadataList(results, true);
+    }
+}
+
+int main (int argc, char **argv) {
+    
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : DRB_BENCH_FILES;
+    static const char* queries[] = {"draft-1234", "report 77777", "draft-00 docx", "nothing",
+                                    NULL};
+    drbMirror* mirror = drbCreateMirror(NULL);
+    double start = now();
+    if (!mirror || !fill(mirror, count)) {
+        fprintf(stderr, "Mirror fill failed\n");
+        return EXIT_FAILURE;
+    }
+    printf("%zu files mirrored in %.1f s\n", count, now() - start);
+    
+    printf("Scan of all the nodes:\n");
+    bench(mirror, queries);
+    
+    start = now();
+    if (!drbMirrorEnableSearch(mirror)) {
+        fprintf(stderr, "Search index failed\n");
+        return EXIT_FAILURE;
+    }
+    printf("Names indexed in %.1f s:\n", now() - start);
+    bench(mirror, queries);
+    
+    drbDestroyMirror(mirror);
+    return EXIT_SUCCESS;
+}
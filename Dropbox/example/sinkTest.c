@@ -0,0 +1,244 @@
+/*!
+ * \file    sinkTest.c
+ * \brief   Check of the transfer sinks and sources (drbSink and drbSource):
+ *          built-in ones, io_uring ones with their file positions, and the
+ *          upload of a failing source.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <dropbox.h>
+
+/*! Bytes written and read back through the io_uring sinks and sources. */
+#define FILE_SIZE (3 * 1024 * 1024 + 12345)
+
+static int failures = 0;
+
+/*!
+ * \brief   Report a failed check.
+ * \param   ok     check result
+ * \param   what   checked property
+ * \return  void
+ */
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+/*!
+ * \brief   Byte of the transferred data at an offset.
+ */
+static unsigned char pattern(size_t offset) {
+    return (unsigned char)(offset * 2654435761u >> 24);
+}
+
+/*!
+ * \brief   Create an empty temporary file, removed once closed.
+ * \return  file descriptor (-1 on failure).
+ */
+static int tempFile(void) {
+    char path[] = "/tmp/sinkTestXXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0)
+        unlink(path);
+    return fd;
+}
+
+/*!
+ * \brief   Compare the content of a file with the pattern.
+ * \param   fd       file descriptor
+ * \param   offset   file offset of the pattern start
+ * \param   size     pattern size
+ * \return  true if the file has the pattern, false otherwise.
+ */
+static bool hasPattern(int fd, off_t offset, size_t size) {
+    static unsigned char buffer[FILE_SIZE];
+    if (pread(fd, buffer, size, offset) != (ssize_t)size)
+        return false;
+    for (size_t i = 0; i < size; i++)
+        if (buffer[i] != pattern(i))
+            return false;
+    return true;
+}
+
+/*!
+ * \brief   Write the pattern in a uring sink as a download would, in chunks
+ *          of various sizes, from a file position.
+ * \param   depth       number of buffers
+ * \param   blockSize   size of a buffer
+ * \return  void
+ */
+static void uringSink(unsigned depth, size_t blockSize) {
+    char what[80];
+    snprintf(what, sizeof(what), "uring sink of %u buffers of %zu bytes", depth, blockSize);
+    int fd = tempFile();
+    drbSink* sink = fd >= 0 ? drbCreateUringSink(fd, depth, blockSize) : NULL;
+    if (!sink) {
+        check(false, what);
+        close(fd);
+        return;
+    }
+    
+    // A close without open (the answer was an error) keeps the position
+    lseek(fd, 5, SEEK_SET);
+    check(sink->close(DRBERR_NETWORK, sink->data) == DRBERR_NETWORK &&
+          lseek(fd, 0, SEEK_CUR) == 5, "uring sink closed without open");
+    
+    static unsigned char chunk[70000];
+    size_t written = 0, length = 1;
+    bool ok = sink->open(sink->data) && sink->preallocate(FILE_SIZE, sink->data);
+    while (ok && written < FILE_SIZE) {
+        length = (length * 7 + 13) % sizeof(chunk) + 1;
+        if (length > FILE_SIZE - written)
+            length = FILE_SIZE - written;
+        for (size_t i = 0; i < length; i++)
+            chunk[i] = pattern(written + i);
+        ok = drbSinkWrite(chunk, 1, length, sink) == length;
+        written += length;
+    }
+    check(sink->close(DRBERR_OK, sink->data) == DRBERR_OK && ok &&
+          lseek(fd, 0, SEEK_CUR) == 5 + FILE_SIZE && hasPattern(fd, 5, FILE_SIZE), what);
+    
+    // The sink is reused by the next transfer, from the new position
+    lseek(fd, 1, SEEK_SET);
+    check(sink->open(sink->data) && sink->write("xy", 2, sink->data) == 2 &&
+          sink->close(DRBERR_OK, sink->data) == DRBERR_OK && lseek(fd, 0, SEEK_CUR) == 3,
+          "uring sink reused");
+    
+    drbDestroyUringSink(sink);
+    close(fd);
+}
+
+/*!
+ * \brief   Read the pattern back with a uring source, as an upload would.
+ * \param   depth       number of buffers
+ * \param   blockSize   size of a buffer
+ * \return  void
+ */
+static void uringSource(unsigned depth, size_t blockSize) {
+    char what[80];
+    snprintf(what, sizeof(what), "uring source of %u buffers of %zu bytes", depth, blockSize);
+    int fd = tempFile();
+    drbSource* source = fd >= 0 ? drbCreateUringSource(fd, depth, blockSize) : NULL;
+    if (!source) {
+        check(false, what);
+        close(fd);
+        return;
+    }
+    
+    static unsigned char data[FILE_SIZE];
+    for (size_t i = 0; i < FILE_SIZE; i++)
+        data[i] = pattern(i);
+    bool same = pwrite(fd, "abc", 3, 0) == 3 && pwrite(fd, data, FILE_SIZE, 3) == FILE_SIZE;
+    
+    // Read from the position, in chunks of various sizes
+    static unsigned char buffer[50000];
+    size_t total = 0, length, size = 1;
+    lseek(fd, 3, SEEK_SET);
+    same = same && source->open(source->data);
+    do {
+        size = (size * 5 + 11) % sizeof(buffer) + 1;
+        length = drbSourceRead(buffer, 1, size, source);
+        for (size_t i = 0; i < length && same; i++)
+            same = buffer[i] == pattern(total + i);
+        total += length;
+    } while (same && length > 0);
+    check(source->close(DRBERR_OK, source->data) == DRBERR_OK && same && !source->failed &&
+          total == FILE_SIZE && lseek(fd, 0, SEEK_CUR) == 3 + FILE_SIZE, what);
+    
+    // The position is moved after the consumed data only
+    lseek(fd, 0, SEEK_SET);
+    check(source->open(source->data) && drbSourceRead(buffer, 1, 2, source) == 2 &&
+          !memcmp(buffer, "ab", 2) && source->close(DRBERR_OK, source->data) == DRBERR_OK &&
+          lseek(fd, 0, SEEK_CUR) == 2, "uring source partly consumed");
+    
+    drbDestroyUringSource(source);
+    close(fd);
+}
+
+int main (int argc, char **argv) {
+    
+    // File descriptor sink, with its writev hook
+    int fd = tempFile();
+    drbSink sink;
+    drbInitFdSink(&sink, fd);
+    struct iovec iov[] = {{"abc", 3}, {"", 0}, {"defg", 4}};
+    check(fd >= 0 && drbSinkWrite("0123", 1, 4, &sink) == 4 && sink.writev(iov, 3, sink.data) == 7,
+          "fd sink writes");
+    char buffer[16] = {0};
+    check(pread(fd, buffer, sizeof(buffer), 0) == 11 && !strcmp(buffer, "0123abcdefg"),
+          "fd sink content");
+    
+    // File descriptor source, reading from the position
+    drbSource source;
+    drbInitFdSource(&source, fd);
+    lseek(fd, 4, SEEK_SET);
+    memset(buffer, 0, sizeof(buffer));
+    check(drbSourceRead(buffer, 1, sizeof(buffer), &source) == 7 && !strcmp(buffer, "abcdefg") &&
+          drbSourceRead(buffer, 1, sizeof(buffer), &source) == 0 && !source.failed,
+          "fd source reads");
+    close(fd);
+    
+    // A source read error is kept as with ferror
+    int devNull = open("/dev/null", O_WRONLY);
+    drbInitFdSource(&source, devNull);
+    check(drbSourceRead(buffer, 1, sizeof(buffer), &source) == 0 && source.failed,
+          "fd source read error");
+    
+    // Memory sink and source
+    memStream stream;
+    memStreamInit(&stream);
+    drbInitMemorySink(&sink, &stream);
+    check(sink.preallocate(1000, sink.data) && stream.capacity > 1000 &&
+          drbSinkWrite("hello ", 1, 6, &sink) == 6 && drbSinkWrite("world", 5, 1, &sink) == 5 &&
+          stream.size == 11 && !memcmp(stream.data, "hello world", 11), "memory sink writes");
+    memStreamSeek(&stream, 6, SEEK_SET);
+    drbInitMemorySource(&source, &stream);
+    memset(buffer, 0, sizeof(buffer));
+    check(drbSourceRead(buffer, 1, sizeof(buffer), &source) == 5 && !strcmp(buffer, "world"),
+          "memory source reads from the cursor");
+    memStreamCleanup(&stream);
+    
+    drbInitNullSink(&sink);
+    check(drbSinkWrite(buffer, 1, sizeof(buffer), &sink) == sizeof(buffer), "null sink writes");
+    
+    uringSink(0, 0);
+    uringSink(1, 4096);
+    uringSink(3, 100000);
+    uringSource(0, 0);
+    uringSource(1, 4096);
+    uringSource(3, 100000);
+    
+    // A failed source read aborts the upload before its request is sent
+    drbInit();
+    drbClient* cli = drbCreateClient("key", "secret", "token", "tokenSecret");
+    if (cli) {
+        void* output = NULL; // Local error message
+        drbInitFdSource(&source, devNull);
+        int err = drbPutFile(cli, &output, DRBOPT_ROOT, DRBVAL_ROOT_AUTO, DRBOPT_PATH, "/file",
+                             DRBOPT_IO_DATA, &source, DRBOPT_IO_FUNC, drbSourceRead, DRBOPT_END);
+        check(err == DRBERR_IO && source.failed, "upload of a failing source");
+        free(output);
+        drbDestroyClient(cli);
+    } else
+        check(false, "client creation");
+    drbCleanup();
+    close(devNull);
+    
+    if (failures) {
+        fprintf(stderr, "%d failed checks\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
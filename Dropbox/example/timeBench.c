@@ -0,0 +1,77 @@
+/*!
+ * \file    timeBench.c
+ * \brief   Throughput of the metadata time parsing (drbParseTime) against
+ *          strptime and timegm.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <dropbox.h>
+
+/*! Times parsed by drbParseTime. */
+static const long DRB_BENCH_COUNT = 10000000;
+
+/*! Times parsed by strptime and timegm (slower). */
+static const long DRB_BENCH_LIBC_COUNT = 1000000;
+
+/*!
+ * \brief   Get the current time of the monotonic clock.
+ * \return  time (s).
+ */
+static double now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int main (int argc, char **argv) {
+    
+    // A week of distinct times, as found in a listing
+    static const char* times[] = {
+        "Sun, 15 Aug 2010 08:12:45 +0000", "Mon, 16 Aug 2010 13:04:10 +0000",
+        "Tue, 17 Aug 2010 17:59:03 +0000", "Wed, 18 Aug 2010 01:30:59 +0000",
+        "Thu, 19 Aug 2010 22:31:20 +0000", "Fri, 20 Aug 2010 10:00:00 +0000",
+        "Sat, 21 Aug 2010 23:45:31 +0000", "Sat, 21 Aug 2010 23:45:32 +0000"
+    };
+    int64_t time, sum = 0;
+    
+    // Both parsers must agree
+    for (int i = 0; i < 8; i++) {
+        struct tm tm = {0};
+        strptime(times[i], "%a, %d %b %Y %H:%M:%S %z", &tm);
+        if (!drbParseTime(times[i], &time) || time != timegm(&tm)) {
+            fprintf(stderr, "%s: wrong time\n", times[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    
+    double start = now();
+    for (long i = 0; i < DRB_BENCH_COUNT; i++) {
+        drbParseTime(times[i & 7], &time);
+        sum += time;
+    }
+    double parse = now() - start;
+    
+    start = now();
+    for (long i = 0; i < DRB_BENCH_LIBC_COUNT; i++) {
+        struct tm tm = {0};
+        strptime(times[i & 7], "%a, %d %b %Y %H:%M:%S %z", &tm);
+        sum += timegm(&tm);
+    }
+    double libc = now() - start;
+    
+    printf("drbParseTime:      %6.1f M times/s (%.1f ns/time)\n",
+           DRB_BENCH_COUNT / parse / 1e6, parse / DRB_BENCH_COUNT * 1e9);
+    printf("strptime + timegm: %6.1f M times/s (%.1f ns/time)\n",
+           DRB_BENCH_LIBC_COUNT / libc / 1e6, libc / DRB_BENCH_LIBC_COUNT * 1e9);
+    
+    // Keep the sum alive
+    return sum == 42 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
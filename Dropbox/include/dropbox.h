@@ -15,6 +15,10 @@ extern "C" {
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <memStream.h>
 
 #define DRBVAL_SIZE_XSMALL "xs"
 #define DRBVAL_SIZE_SMALL  "s"
@@ -29,6 +33,7 @@ extern "C" {
 #define DRBVAL_IGNORE_INT  -1
 #define DRBVAL_IGNORE_SIZE DRBVAL_IGNORE_STR
 #define DRBVAL_IGNORE_PTR  NULL
+#define DRBVAL_INVALID_TIME INT64_MIN
 
 /*!
  * \struct  drbClient
@@ -85,12 +90,14 @@ typedef struct {
 typedef struct drbMetadataList drbMetadataList;
 
 typedef struct {
-    unsigned int*  bytes;
+    uint64_t* bytes;
     char* clientMtime;
+    int64_t* clientMtimeEpoch; /*!< clientMtime in seconds since the epoch. */
     char* icon;
     bool* isDir;
     char* mimeType;
     char* modified;
+    int64_t* modifiedEpoch;    /*!< modified in seconds since the epoch. */
     char* path;
     char* rev;
     unsigned int* revision;
@@ -185,7 +192,427 @@ typedef struct {
     unsigned int* backoff;
 } drbPollDelta;
 
-    
+
+/*!
+ * Metadata and delta fields. Arena structures flag with them the fields that
+ * were defined in the server answer. They also select the metadata fields to
+ * decode with DRBOPT_FIELDS.
+ */
+enum {
+    DRBFIELD_BYTES        = 1<<0,
+    DRBFIELD_CLIENT_MTIME = 1<<1,
+    DRBFIELD_ICON         = 1<<2,
+    DRBFIELD_IS_DIR       = 1<<3,
+    DRBFIELD_MIME_TYPE    = 1<<4,
+    DRBFIELD_MODIFIED     = 1<<5,
+    DRBFIELD_PATH         = 1<<6,
+    DRBFIELD_REV          = 1<<7,
+    DRBFIELD_REVISION     = 1<<8,
+    DRBFIELD_ROOT         = 1<<9,
+    DRBFIELD_SIZE         = 1<<10,
+    DRBFIELD_THUMB_EXISTS = 1<<11,
+    DRBFIELD_IS_DELETED   = 1<<12,
+    DRBFIELD_HASH         = 1<<13,
+    DRBFIELD_CONTENTS     = 1<<14,
+    DRBFIELD_RESET        = 1<<15, /*!< delta only */
+    DRBFIELD_CURSOR       = 1<<16, /*!< delta only */
+    DRBFIELD_HAS_MORE     = 1<<17, /*!< delta only */
+    DRBFIELD_ALL          = (1<<15) - 1, /*!< all the metadata fields */
+};
+
+/*!
+ * \struct  drbArenaMetadata
+ * \breif   Dropbox file or folder metadata, allocated in an arena.
+ *
+ * Same fields as drbMetadata, but values are stored inline and the fields
+ * defined in the server answer are flagged (DRBFIELD_XXX) in fields. Missing
+ * strings are left blank with NULL value, missing or invalid times with
+ * DRBVAL_INVALID_TIME.
+ *
+ * Obtained with the DRBOPT_ARENA option. The whole answer (including the
+ * contents and their strings) is a single memory block, which must be freed
+ * with drbDestroyArena.
+ */
+typedef struct drbArenaMetadataList drbArenaMetadataList;
+
+typedef struct {
+    unsigned int fields; /*!< DRBFIELD_XXX bits of the defined fields. */
+    uint64_t bytes;
+    unsigned int revision;
+    bool isDir;
+    bool thumbExists;
+    bool isDeleted;
+    int64_t clientMtimeEpoch; /*!< clientMtime in seconds since the epoch. */
+    int64_t modifiedEpoch;    /*!< modified in seconds since the epoch. */
+    char* clientMtime;
+    char* icon;
+    char* mimeType;
+    char* modified;
+    char* path;
+    char* rev;
+    char* root;
+    char* size;
+    char* hash; /*!< Only defined for folders (isDir = true). */
+    drbArenaMetadataList* contents;
+} drbArenaMetadata;
+
+struct drbArenaMetadataList {
+    drbArenaMetadata* array; /*!< List of all metadata. */
+    size_t size;             /*!< List size. */
+};
+
+/*!
+ * \struct  drbArenaDeltaEntry
+ * \breif   Dropbox delta entry, allocated in an arena.
+ *
+ * metadata is NULL when the entry was deleted.
+ */
+typedef struct {
+    char* path;
+    drbArenaMetadata* metadata;
+} drbArenaDeltaEntry;
+
+/*!
+ * \struct  drbArenaDelta
+ * \breif   Dropbox delta informations, allocated in an arena.
+ *
+ * Obtained with the DRBOPT_ARENA option, must be freed with drbDestroyArena.
+ */
+typedef struct {
+    unsigned int fields; /*!< DRBFIELD_RESET, _CURSOR and _HAS_MORE bits. */
+    bool reset;
+    bool hasMore;
+    char* cursor;
+    struct {
+        drbArenaDeltaEntry* array; /*!< List of all delta entries. */
+        size_t size;               /*!< List size. */
+    } entries;
+} drbArenaDelta;
+
+/*!
+ * Boolean metadata fields, packed in drbMetadataTable and binary flags.
+ */
+enum {
+    DRBFLAG_IS_DIR       = 1<<0,
+    DRBFLAG_THUMB_EXISTS = 1<<1,
+    DRBFLAG_IS_DELETED   = 1<<2,
+    DRBFLAG_RESET        = 1<<3, /*!< binary delta only */
+    DRBFLAG_HAS_MORE     = 1<<4, /*!< binary delta only */
+};
+
+/*!
+ * \struct  drbMetadataTable
+ * \breif   Columnar (struct of arrays) list of Dropbox metadata.
+ *
+ * Each metadata field is a packed array with one value per row. String fields
+ * are offsets in the shared strings blob (0 when the field is undefined), use
+ * drbTableGetStr or drbTableGetRow to access them. Rows content is only
+ * meaningful for the fields flagged (DRBFIELD_XXX) in their fields value.
+ * The columns of the fields masked out with DRBOPT_FIELDS are NULL. Time
+ * columns are defined with their string column, and hold DRBVAL_INVALID_TIME
+ * for missing or invalid times.
+ *
+ * Obtained with the DRBOPT_COLUMNAR option. The whole table is a single
+ * memory block, which must be freed with drbDestroyMetadataTable.
+ */
+typedef struct {
+    size_t rows;               /*!< Number of rows. */
+    unsigned int* fields;      /*!< DRBFIELD_XXX bits of the defined fields. */
+    unsigned char* flags;      /*!< DRBFLAG_XXX boolean fields values. */
+    uint64_t* bytes;
+    unsigned int* revision;
+    int64_t* clientMtimeEpoch; /*!< clientMtime in seconds since the epoch. */
+    int64_t* modifiedEpoch;    /*!< modified in seconds since the epoch. */
+    unsigned int* clientMtime; /*!< Offsets in strings. */
+    unsigned int* icon;        /*!< Offsets in strings. */
+    unsigned int* mimeType;    /*!< Offsets in strings. */
+    unsigned int* modified;    /*!< Offsets in strings. */
+    unsigned int* path;        /*!< Offsets in strings. */
+    unsigned int* rev;         /*!< Offsets in strings. */
+    unsigned int* root;        /*!< Offsets in strings. */
+    unsigned int* size;        /*!< Offsets in strings. */
+    unsigned int* hash;        /*!< Offsets in strings. */
+    unsigned int* key;         /*!< Offsets in strings of the delta entries
+                                    path (NULL if not a delta table). */
+    char* strings;             /*!< Shared blob of all the strings. */
+    size_t stringsSize;        /*!< Strings blob size. */
+} drbMetadataTable;
+
+/*!
+ * \struct  drbDeltaTable
+ * \breif   Dropbox delta informations, with columnar entries.
+ *
+ * The rows of deleted entries have no defined fields (fields value is 0).
+ * Obtained with the DRBOPT_COLUMNAR option, must be freed with
+ * drbDestroyDeltaTable.
+ */
+typedef struct {
+    unsigned int fields; /*!< DRBFIELD_RESET, _CURSOR and _HAS_MORE bits. */
+    bool reset;
+    bool hasMore;
+    char* cursor;
+    drbMetadataTable entries; /*!< Entries metadata, with their path as key. */
+} drbDeltaTable;
+
+/*!
+ * \struct  drbLazyList
+ * \breif   Metadata list (or delta) decoded on access.
+ *
+ * The list keeps the raw server answer and the location of its entries. The
+ * entries fields are only decoded when they are accessed with the
+ * drbLazyGetXxx functions.
+ *
+ * Obtained with the DRBOPT_LAZY option, must be freed with drbDestroyLazyList.
+ */
+typedef struct drbLazyList drbLazyList;
+
+/*!
+ * \brief   Delta entry visitor, called by drbVisitDelta for each entry.
+ * \param   path   entry path (valid during the call only)
+ * \param   meta   entry metadata, NULL if the entry was deleted (valid
+ *                 during the call only)
+ * \param   data   visitor data given to drbVisitDelta
+ * \return  true to continue the visit, false to skip the remaining entries
+ */
+typedef bool (*drbDeltaVisitor)(const char* path, const drbMetadata* meta, void* data);
+
+/*!
+ * \struct  drbDeltaPager
+ * \breif   Delta pages fetched and parsed ahead of the application.
+ *
+ * The next page is requested as soon as the cursor of the current one is
+ * received, and the pages are parsed on other threads, so the pages transfer
+ * overlaps their parsing and handling. A few pages are kept ahead at most.
+ *
+ * Obtained with drbCreateDeltaPager, must be freed with drbDestroyDeltaPager.
+ */
+typedef struct drbDeltaPager drbDeltaPager;
+
+/*!
+ * \struct  drbMirror
+ * \breif   Local copy of the namespace, kept up to date with the delta pages.
+ *
+ * Each file and folder is indexed by its path (compared without case) and
+ * linked to its parent folder, so metadata and folder listings are answered
+ * from memory. With a checkpoint file, each applied delta page is appended to
+ * a log, and the log is compacted in a snapshot once it outgrows it.
+ * drbCreateMirror maps the snapshot and replays the log to resume from the
+ * last delta cursor.
+ *
+ * Obtained with drbCreateMirror, must be freed with drbDestroyMirror.
+ */
+typedef struct drbMirror drbMirror;
+
+/*!
+ * \struct  drbPipe
+ * \breif   Bounded ring buffer between a producer and a consumer thread.
+ *
+ * Given as DRBOPT_IO_DATA of drbGetFile with drbPipeWrite as DRBOPT_IO_FUNC,
+ * the download is paused while the pipe is full instead of blocking in the
+ * write function, and it is closed when the download is over. Another thread
+ * reads the file with drbPipeRead meanwhile, e.g. to upload it again with
+ * drbPutFile. So a slow consumer never stalls the socket, and the memory used
+ * is bounded by the pipe size.
+ *
+ * Obtained with drbCreatePipe, must be freed with drbDestroyPipe once both
+ * threads are done with it.
+ */
+typedef struct drbPipe drbPipe;
+
+/*!
+ * \struct  drbSink
+ * \breif   Destination of a download, written through hooks.
+ *
+ * Given as DRBOPT_IO_DATA of drbGetFile or drbGetThumbnail with drbSinkWrite
+ * as DRBOPT_IO_FUNC. For a sink with a writev hook, the received data is
+ * staged in a buffer of bufferSize bytes (256 KiB by default) and written
+ * along with the next chunk that doesn't fit, so the sink gets a few large
+ * writes instead of a call per network read. Only write is required, see
+ * drbInitFdSink, drbInitMemorySink and drbInitNullSink for built-in sinks.
+ */
+typedef struct {
+    /*! Called when a successful answer starts, false aborts the transfer. */
+    bool (*open)(void* data);
+    /*! Called after open with the answer size, when it is known. */
+    bool (*preallocate)(uint64_t size, void* data);
+    /*! Write size bytes, returns the number of bytes written (0 on error). */
+    size_t (*write)(const void* ptr, size_t size, void* data);
+    /*! Write count buffers, returns the number of bytes written (0 on error). */
+    size_t (*writev)(const struct iovec* iov, int count, void* data);
+    /*! Called once the call is over with its error code, returns the error
+     *  code of the call (e.g. err, or DRBERR_IO if the data can't be saved). */
+    int (*close)(int err, void* data);
+    void* data;        /*!< Hooks argument. */
+    size_t bufferSize; /*!< Network and staging buffer size (0 for default). */
+} drbSink;
+
+/*!
+ * \struct  drbSource
+ * \breif   Origin of an upload, read through hooks.
+ *
+ * Given as DRBOPT_IO_DATA of drbPutFile with drbSourceRead as
+ * DRBOPT_IO_FUNC. Only read is required, see drbInitFdSource and
+ * drbInitMemorySource for built-in sources.
+ */
+typedef struct {
+    /*! Called before the first read, false aborts the upload. */
+    bool (*open)(void* data);
+    /*! Read at most size bytes, returns the number of bytes read (0 at end,
+     *  -1 on error, which aborts the upload before its request is sent). */
+    ssize_t (*read)(void* ptr, size_t size, void* data);
+    /*! Called once the call is over with its error code, if open succeeded,
+     *  returns the error code of the call. */
+    int (*close)(int err, void* data);
+    void* data;        /*!< Hooks argument. */
+    size_t bufferSize; /*!< Read chunk size (0 for default). */
+    bool failed;       /*!< Set when read failed (as ferror), reset by the upload. */
+} drbSource;
+
+/*!
+ * Checksum algorithms of a drbDigest.
+ */
+enum {
+    DRBDIGEST_CRC32C = 1<<0, /*!< CRC32C (Castagnoli), as computed by drbCrc32c */
+    DRBDIGEST_SHA256 = 1<<1, /*!< SHA-256 */
+};
+
+/*!
+ * \struct  drbDigest
+ * \breif   Checksums of the bytes of a transferred file.
+ *
+ * Given with DRBOPT_DIGEST to drbGetFile, drbGetThumbnail or drbPutFile. The
+ * bytes are hashed as they are written in DRBOPT_IO_DATA (download) or read
+ * from it (upload), so a file doesn't need to be read again to be checked.
+ * The checksums are set once the call is over, and are only meaningful if it
+ * succeeded.
+ */
+typedef struct {
+    unsigned int algorithms;  /*!< DRBDIGEST_XXX to compute (set by the caller). */
+    uint64_t bytes;           /*!< Number of hashed bytes. */
+    uint32_t crc32c;          /*!< CRC32C, if requested. */
+    unsigned char sha256[32]; /*!< SHA-256, if requested. */
+} drbDigest;
+
+/*!
+ * \struct  drbBufferStats
+ * \breif   Usage statistics of the client buffer pool.
+ *
+ * The memory buffers of the requests (answers, headers and uploads) are taken
+ * from a pool of the client and given back to it, see drbSetBufferPool.
+ */
+typedef struct {
+    size_t hits;     /*!< Buffers taken from the pool. */
+    size_t misses;   /*!< Buffers allocated because the pool had none. */
+    size_t released; /*!< Buffers kept by the pool for reuse. */
+    size_t dropped;  /*!< Buffers freed because the pool was full. */
+    size_t cached;   /*!< Memory currently kept by the pool. */
+} drbBufferStats;
+
+/*!
+ * \struct  drbMetadataCacheStats
+ * \breif   Usage statistics of the client metadata cache.
+ *
+ * A cached folder listing is sent back to the server with its hash, which
+ * answers whether it changed, see drbSetMetadataCache. The hit rate is
+ * hits / (hits + misses + changed).
+ */
+typedef struct {
+    size_t hits;      /*!< Listings served from the cache (unchanged). */
+    size_t misses;    /*!< Listings fetched because they were not cached. */
+    size_t changed;   /*!< Listings fetched again because they changed. */
+    size_t diskLoads; /*!< Listings loaded from the cache directory. */
+    size_t entries;   /*!< Listings currently kept in memory. */
+} drbMetadataCacheStats;
+
+/*!
+ * \struct  drbNegativeCacheStats
+ * \breif   Usage statistics of the client missing paths cache.
+ *
+ * A path not found by drbGetMetadata is answered locally for a while, see
+ * drbSetNegativeCache.
+ */
+typedef struct {
+    size_t hits;        /*!< Missing paths answered from the cache. */
+    size_t misses;      /*!< Lookups sent to the server. */
+    size_t invalidated; /*!< Missing paths dropped because they were created. */
+    size_t entries;     /*!< Missing paths currently kept. */
+} drbNegativeCacheStats;
+
+/*!
+ * Binary encoding version and encoded structure kinds.
+ */
+#define DRBBIN_MAGIC   0x42425244 /* "DRBB" in little endian */
+#define DRBBIN_VERSION 1
+enum {
+    DRBBIN_METADATA = 1,
+    DRBBIN_METADATA_LIST,
+    DRBBIN_DELTA,
+};
+
+/*!
+ * \struct  drbBinMetadata
+ * \breif   Dropbox metadata in the binary encoding.
+ *
+ * The binary encoding (drbEncodeXxx) stores a drbMetadata, drbMetadataList or
+ * drbDelta in a single position independent buffer, in the host byte order.
+ * Its records are read in place with drbViewXxx, e.g. from a mapped file.
+ *
+ * References are offsets relative to the record holding them (0 for NULL),
+ * use drbBinStr, drbBinContents and drbBinEntryMetadata to follow them. Values
+ * are only meaningful for the fields flagged (DRBFIELD_XXX) in fields. Missing
+ * or invalid times are DRBVAL_INVALID_TIME.
+ */
+typedef struct {
+    uint32_t fields;          /*!< DRBFIELD_XXX bits of the defined fields. */
+    uint32_t flags;           /*!< DRBFLAG_XXX boolean fields values. */
+    uint64_t bytes;
+    int64_t clientMtimeEpoch; /*!< clientMtime in seconds since the epoch. */
+    int64_t modifiedEpoch;    /*!< modified in seconds since the epoch. */
+    uint32_t revision;
+    int32_t clientMtime;      /*!< String offset. */
+    int32_t icon;             /*!< String offset. */
+    int32_t mimeType;         /*!< String offset. */
+    int32_t modified;         /*!< String offset. */
+    int32_t path;             /*!< String offset. */
+    int32_t rev;              /*!< String offset. */
+    int32_t root;             /*!< String offset. */
+    int32_t size;             /*!< String offset. */
+    int32_t hash;             /*!< String offset. */
+    int32_t contents;         /*!< drbBinMetadataList offset. */
+    uint32_t reserved;        /*!< Always 0. */
+} drbBinMetadata;
+
+/*!
+ * \struct  drbBinMetadataList
+ * \breif   Dropbox metadata list in the binary encoding.
+ */
+typedef struct {
+    uint32_t size;           /*!< List size. */
+    uint32_t reserved;       /*!< Always 0. */
+    drbBinMetadata array[];  /*!< List of all metadata. */
+} drbBinMetadataList;
+
+/*!
+ * \struct  drbBinDeltaEntry
+ * \breif   Dropbox delta entry in the binary encoding.
+ */
+typedef struct {
+    int32_t path;     /*!< String offset. */
+    int32_t metadata; /*!< drbBinMetadata offset (0 if the entry was deleted). */
+} drbBinDeltaEntry;
+
+/*!
+ * \struct  drbBinDelta
+ * \breif   Dropbox delta informations in the binary encoding.
+ */
+typedef struct {
+    uint32_t fields;             /*!< DRBFIELD_RESET, _CURSOR and _HAS_MORE bits. */
+    uint32_t flags;              /*!< DRBFLAG_RESET and _HAS_MORE values. */
+    int32_t cursor;              /*!< String offset. */
+    uint32_t size;               /*!< Number of entries. */
+    drbBinDeltaEntry entries[];  /*!< List of all delta entries. */
+} drbBinDelta;
+
 /*!
  * \breif Function options and expected arguement type.
  *
@@ -226,6 +653,12 @@ enum {
     DRBOPT_NETWORK_TIMEOUT, /*!< integer */
     DRBOPT_INCL_MEDIA_INFO, /*!< boolean */
     DRBOPT_PATH_PREFIX,     /*!< string  */
+    DRBOPT_ARENA,           /*!< boolean (output allocated in a single arena) */
+    DRBOPT_COLUMNAR,        /*!< boolean (columnar list output) */
+    DRBOPT_FIELDS,          /*!< int (DRBFIELD_XXX mask of the metadata fields
+                                 to decode, 0 for all) */
+    DRBOPT_LAZY,            /*!< boolean (output decoded on access) */
+    DRBOPT_DIGEST,          /*!< drbDigest* (checksums of the transferred file) */
     
     DRBOPT_END,             /*!< no argument! ALWAYS REQUIRED as last option */
 };
@@ -245,6 +678,7 @@ enum {
     DRBERR_UNKNOWN,        /*!< 6: something that shouldn't happen, has happened */
     DRBERR_NETWORK,        /*!< 7: network issue */
     DRBERR_TIMEOUT,        /*!< 8: request timed out */
+    DRBERR_IO,             /*!< 9: local read or write failed (e.g. a sink) */
 };
 
 /*!
@@ -314,6 +748,262 @@ drbOAuthToken* drbObtainAccessToken(drbClient* cli);
  * \return  void
  */
 int drbSetDefault(drbClient* cli, ...);
+
+/*!
+ * \brief   Set the maximum memory kept by the client buffer pool.
+ *
+ * Released request buffers are kept in power of 2 size classes for the next
+ * requests of the client (from any thread), up to maxCached bytes (4 MiB by
+ * default). A smaller limit frees the kept buffers.
+ *
+ * \param   cli         dropbox client
+ * \param   maxCached   maximum memory kept (0 to disable the pool)
+ * \return  void
+ */
+void drbSetBufferPool(drbClient* cli, size_t maxCached);
+
+/*!
+ * \brief   Get the usage statistics of the client buffer pool.
+ * \param       cli     dropbox client
+ * \param[out]  stats   pool statistics
+ * \return  void
+ */
+void drbGetBufferStats(drbClient* cli, drbBufferStats* stats);
+
+/*!
+ * \brief   Set the size of a request buffer kept in memory.
+ *
+ * The answer headers and the uploaded file of drbPutFile are buffered during
+ * a request. Beyond threshold bytes (16 MiB by default), a buffer is spilled
+ * to an unlinked temporary file created in $TMPDIR (or /tmp).
+ *
+ * \param   cli         dropbox client
+ * \param   threshold   buffer size kept in memory (0 to never spill)
+ * \return  void
+ */
+void drbSetSpillThreshold(drbClient* cli, size_t threshold);
+
+/*!
+ * \brief   Cache the folder listings of drbGetMetadata.
+ *
+ * The listings are kept with their hash, which is sent along the next
+ * drbGetMetadata calls with the same root, path and options: an unchanged
+ * listing is then not downloaded again. Up to maxEntries listings are kept in
+ * memory, the least recently used are dropped. With a directory (created if
+ * needed), each listing is also written in a file of it, used after a restart
+ * or once dropped from memory. Listings of the DRBOPT_ARENA and DRBOPT_COLUMNAR
+ * outputs are not cached.
+ *
+ * Must not be called while other calls of the client are running.
+ *
+ * \param   cli          dropbox client
+ * \param   maxEntries   listings kept in memory (0 to disable the cache)
+ * \param   dir          cache directory (NULL to keep the listings in memory)
+ * \return  false if the cache can't be allocated.
+ */
+bool drbSetMetadataCache(drbClient* cli, size_t maxEntries, const char* dir);
+
+/*!
+ * \brief   Get the usage statistics of the client metadata cache.
+ * \param       cli     dropbox client
+ * \param[out]  stats   cache statistics (zeroed without a cache)
+ * \return  void
+ */
+void drbGetMetadataCacheStats(drbClient* cli, drbMetadataCacheStats* stats);
+
+/*!
+ * \brief   Cache the paths not found by drbGetMetadata.
+ *
+ * A path whose metadata was not found (404) is answered locally with the
+ * same error for ttl seconds, unless DRBOPT_REV or DRBOPT_INCL_DELETED is
+ * given. The paths are compared without case. The calls creating a path
+ * (drbPutFile, drbCreateFolder, drbMove, drbCopy and drbRestore) and the delta
+ * entries with metadata (received by drbGetDelta, drbVisitDelta or a delta
+ * pager, as for drbMirrorUpdate) drop the cached path and its parent folders,
+ * and the paths under a moved or copied one. Up to maxEntries paths
+ * are kept, the oldest are dropped.
+ *
+ * Must not be called while other calls of the client are running.
+ *
+ * \param   cli          dropbox client
+ * \param   maxEntries   missing paths kept (0 to disable the cache)
+ * \param   ttl          time a missing path is kept (seconds)
+ * \return  false if the cache can't be allocated.
+ */
+bool drbSetNegativeCache(drbClient* cli, size_t maxEntries, unsigned int ttl);
+
+/*!
+ * \brief   Get the usage statistics of the client missing paths cache.
+ * \param       cli     dropbox client
+ * \param[out]  stats   cache statistics (zeroed without a cache)
+ * \return  void
+ */
+void drbGetNegativeCacheStats(drbClient* cli, drbNegativeCacheStats* stats);
+
+/*!
+ * \brief   Create a pipe between a producer and a consumer thread.
+ * \param   capacity   pipe size (0 for 1 MiB, at least 32 KiB)
+ * \return  pipe (NULL on allocation failure).
+ */
+drbPipe* drbCreatePipe(size_t capacity);
+
+/*!
+ * \brief   As fread, but for a pipe (from the consumer thread only).
+ *
+ * Wait until the pipe has data, and read what it has.
+ *
+ * \return  number of bytes read, 0 once the pipe is closed and drained.
+ */
+size_t drbPipeRead(void* ptr, size_t size, size_t count, drbPipe* pipe);
+
+/*!
+ * \brief   As fwrite, but for a pipe (from the producer thread only).
+ *
+ * Wait while the pipe is full. As DRBOPT_IO_FUNC of drbGetFile, the download
+ * is paused instead.
+ *
+ * \return  number of bytes written, less than size * count if the pipe was
+ *          closed.
+ */
+size_t drbPipeWrite(const void* ptr, size_t size, size_t count, drbPipe* pipe);
+
+/*!
+ * \brief   Close a pipe (from any thread).
+ *
+ * The producer closes the pipe at the end of the data, the consumer closes it
+ * to give up (the writes then fail). drbGetFile closes its pipe with its
+ * error code when the download is over.
+ *
+ * \param   pipe   pipe to close
+ * \param   err    error code (DRBERR_XXX or http error), only kept by the
+ *                 first close
+ * \return  void
+ */
+void drbClosePipe(drbPipe* pipe, int err);
+
+/*!
+ * \brief   Get the error code a pipe was closed with.
+ * \param   pipe   pipe to handle
+ * \return  error code given to drbClosePipe (DRBERR_OK while it is open).
+ */
+int drbPipeError(drbPipe* pipe);
+
+/*!
+ * \brief   As fwrite, but for a sink.
+ *
+ * As DRBOPT_IO_FUNC, it only marks its DRBOPT_IO_DATA as a drbSink: the
+ * transfer then drives the sink hooks itself.
+ *
+ * \return  number of bytes written.
+ */
+size_t drbSinkWrite(const void* ptr, size_t size, size_t count, drbSink* sink);
+
+/*!
+ * \brief   As fread, but for a source.
+ *
+ * As DRBOPT_IO_FUNC, it also marks its DRBOPT_IO_DATA as a drbSource: the
+ * transfer then calls its open and close hooks.
+ *
+ * \return  number of bytes read (0 at end or on error, with failed set).
+ */
+size_t drbSourceRead(void* ptr, size_t size, size_t count, drbSource* source);
+
+/*!
+ * \brief   Set up a sink writing in a file descriptor.
+ *
+ * The file space is reserved from the answer size (Linux fallocate, keeping
+ * the file size), so a large download is not fragmented.
+ *
+ * \param   sink   sink to set up
+ * \param   fd     file descriptor to write
+ * \return  void
+ */
+void drbInitFdSink(drbSink* sink, int fd);
+
+/*!
+ * \brief   Set up a sink writing in a memory stream.
+ *
+ * The stream memory is allocated once from the answer size.
+ *
+ * \param   sink     sink to set up
+ * \param   stream   memory stream to write
+ * \return  void
+ */
+void drbInitMemorySink(drbSink* sink, memStream* stream);
+
+/*!
+ * \brief   Set up a sink discarding the data.
+ * \param   sink   sink to set up
+ * \return  void
+ */
+void drbInitNullSink(drbSink* sink);
+
+/*!
+ * \brief   Set up a source reading a file descriptor.
+ * \param   source   source to set up
+ * \param   fd       file descriptor to read
+ * \return  void
+ */
+void drbInitFdSource(drbSource* source, int fd);
+
+/*!
+ * \brief   Set up a source reading a memory stream from its cursor.
+ * \param   source   source to set up
+ * \param   stream   memory stream to read
+ * \return  void
+ */
+void drbInitMemorySource(drbSource* source, memStream* stream);
+
+/*!
+ * \brief   Create a sink writing a file with several requests in flight.
+ *
+ * The data is copied in depth buffers of blockSize bytes, and each full
+ * buffer is written by io_uring while the next ones are filled, so the
+ * transfer only waits for the disk when all the buffers are being written.
+ * The buffers are registered in the ring when the locked memory limit allows
+ * it. Without io_uring (e.g. not Linux, or disabled kernel), the sink writes
+ * with pwrite. The file is written from its position, which is moved after
+ * the written data by the end of the transfer.
+ *
+ * A sink can be used by one transfer at a time, and its data must be kept.
+ *
+ * \param   fd          descriptor of a regular file to write
+ * \param   depth       number of buffers (0 for default: 4)
+ * \param   blockSize   size of a buffer (0 for default: 256 KiB)
+ * \return  sink to give to drbGetFile (NULL on failure), must be freed with
+ *          drbDestroyUringSink (the file descriptor is not closed).
+ */
+drbSink* drbCreateUringSink(int fd, unsigned depth, size_t blockSize);
+
+/*!
+ * \brief   Create a source reading a file ahead with several requests in flight.
+ *
+ * The depth buffers of blockSize bytes are read by io_uring from the start of
+ * the transfer, and each one is read again as soon as it's consumed. Without
+ * io_uring, the source reads with pread. The file is read from its position,
+ * which is moved after the consumed data by the end of the transfer.
+ *
+ * A source can be used by one transfer at a time, and its data must be kept.
+ *
+ * \param   fd          descriptor of a regular file to read
+ * \param   depth       number of buffers (0 for default: 4)
+ * \param   blockSize   size of a buffer (0 for default: 256 KiB)
+ * \return  source to give to drbPutFile (NULL on failure), must be freed with
+ *          drbDestroyUringSource (the file descriptor is not closed).
+ */
+drbSource* drbCreateUringSource(int fd, unsigned depth, size_t blockSize);
+
+/*!
+ * \brief   Compute the CRC32C of a buffer.
+ *
+ * The crc32 instruction is used when the CPU has it (SSE 4.2 or ARMv8 CRC).
+ *
+ * \param   crc      CRC32C of the previous bytes (0 for the first buffer)
+ * \param   buffer   bytes to hash
+ * \param   size     number of bytes
+ * \return  CRC32C of the previous bytes followed by the buffer.
+ */
+uint32_t drbCrc32c(uint32_t crc, const void* buffer, size_t size);
     
 /*!
  * \brief   Get account general informations.
@@ -328,7 +1018,9 @@ int drbGetAccountInfo(drbClient* cli, void** output, ...);
 /*!
  * \brief   Get a file or folder metadata.
  * \param       cli      authenticated dropbox client
- * \param[out]  output   item metadata (drbMetadata*) or error (char*)
+ * \param[out]  output   item metadata (drbMetadata* or drbArenaMetadata*),
+ *                       the item and its contents as rows 0..n
+ *                       (drbMetadataTable*) or error (char*)
  * \param       ...      legal option/value pairs:
  *                         -# DRBOPT_ROOT (required)
  *                         -# DRBOPT_PATH (required)
@@ -338,6 +1030,9 @@ int drbGetAccountInfo(drbClient* cli, void** output, ...);
  *                         -# DRBOPT_INCL_DELETED
  *                         -# DRBOPT_REV
  *                         -# DRBOPT_LOCALE
+ *                         -# DRBOPT_ARENA
+ *                         -# DRBOPT_COLUMNAR (takes precedence over DRBOPT_ARENA)
+ *                         -# DRBOPT_FIELDS
  * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
  */
 //int drbGetMetadata(drbClient* cli, drbMetadata** meta, ...);
@@ -351,8 +1046,11 @@ int drbGetMetadata(drbClient* cli, void** output, ...);
  *                         -# DRBOPT_ROOT (required)
  *                         -# DRBOPT_PATH (required)
  *                         -# DRBOPT_IO_DATA, e.i. FILE*  (required)
- *                         -# DRBOPT_IO_FUNC, e.i. fwrite (required)
+ *                         -# DRBOPT_IO_FUNC, e.i. fwrite (required), or
+ *                            drbPipeWrite to feed a drbPipe, or
+ *                            drbSinkWrite to write in a drbSink
  *                         -# DRBOPT_REV
+ *                         -# DRBOPT_DIGEST
  * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
  */
 int drbGetFile(drbClient* cli, void** output, ...);
@@ -360,12 +1058,19 @@ int drbGetFile(drbClient* cli, void** output, ...);
 /*!
  * \brief   Get a file revisions.
  * \param       cli      authenticated dropbox client
- * \param[out]  output   file revisions list (drbMetadataList*) or error (char*)
+ * \param[out]  output   file revisions list (drbMetadataList*,
+ *                       drbArenaMetadataList*, drbMetadataTable* or
+ *                       drbLazyList*) or error (char*)
  * \param       ...      option/value pairs (function arguments) :
  *                         -# DRBOPT_ROOT (required)
  *                         -# DRBOPT_PATH (required)
  *                         -# DRBOPT_REV_LIMIT
  *                         -# DRBOPT_LOCALE
+ *                         -# DRBOPT_ARENA
+ *                         -# DRBOPT_COLUMNAR (takes precedence over DRBOPT_ARENA)
+ *                         -# DRBOPT_FIELDS
+ *                         -# DRBOPT_LAZY (takes precedence over the others
+ *                            output options)
  * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
  */
 int drbGetRevisions(drbClient* cli, void** output, ...);
@@ -373,7 +1078,9 @@ int drbGetRevisions(drbClient* cli, void** output, ...);
 /*!
  * \brief   Search a file or a folder.
  * \param       cli      authenticated dropbox client
- * \param[out]  output   founded items list (drbMetadataList*) or error (char*)
+ * \param[out]  output   founded items list (drbMetadataList*,
+ *                       drbArenaMetadataList*, drbMetadataTable* or
+ *                       drbLazyList*) or error (char*)
  * \param       ...      option/value pairs (function arguments) :
  *                         -# DRBOPT_ROOT (required)
  *                         -# DRBOPT_PATH (required)
@@ -381,6 +1088,11 @@ int drbGetRevisions(drbClient* cli, void** output, ...);
  *                         -# DRBOPT_FILE_LIMIT
  *                         -# DRBOPT_INCL_DELETED
  *                         -# DRBOPT_LOCALE
+ *                         -# DRBOPT_ARENA
+ *                         -# DRBOPT_COLUMNAR (takes precedence over DRBOPT_ARENA)
+ *                         -# DRBOPT_FIELDS
+ *                         -# DRBOPT_LAZY (takes precedence over the others
+ *                            output options)
  * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
  */
 int drbSearch(drbClient* cli, void** output, ...);
@@ -393,9 +1105,11 @@ int drbSearch(drbClient* cli, void** output, ...);
  *                         -# DRBOPT_ROOT (required)
  *                         -# DRBOPT_PATH (required)
  *                         -# DRBOPT_IO_DATA, e.i. FILE*  (required)
- *                         -# DRBOPT_IO_FUNC, e.i. fwrite (required)
+ *                         -# DRBOPT_IO_FUNC, e.i. fwrite (required), or
+ *                            drbSinkWrite to write in a drbSink
  *                         -# DRBOPT_FORMAT
  *                         -# DRBOPT_SIZE
+ *                         -# DRBOPT_DIGEST
  * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
  */
 int drbGetThumbnail(drbClient* cli, void** output, ...);
@@ -453,14 +1167,211 @@ int drbMove(drbClient* cli, void** ouput, ...);
 /*!
  * \brief   Get changed files and folders.
  * \param       cli      authenticated dropbox client
- * \param[out]  output   delta informations (drbDelta*) or error (char*)
+ * \param[out]  output   delta informations (drbDelta*, drbArenaDelta*,
+ *                       drbDeltaTable* or drbLazyList*) or error (char*)
  * \param       ...      option/value pairs (function arguments) :
  *                         -# DRBOPT_CURSOR
  *                         -# DRBOPT_LOCALE
+ *                         -# DRBOPT_ARENA
+ *                         -# DRBOPT_COLUMNAR (takes precedence over DRBOPT_ARENA)
+ *                         -# DRBOPT_FIELDS
+ *                         -# DRBOPT_LAZY (takes precedence over the others
+ *                            output options)
  * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
  */
 int drbGetDelta(drbClient* cli, void** output, ...);
 
+/*!
+ * \brief   Visit changed files and folders while they are received.
+ *
+ * Unlike drbGetDelta, the entries are not stored: each one is decoded, given
+ * to the visitor and released before the next one is decoded, so the memory
+ * used does not depend on the number of entries.
+ *
+ * \param       cli       authenticated dropbox client
+ * \param[out]  output    delta informations without entries (drbDelta*) or
+ *                        error (char*)
+ * \param       visitor   function called for each entry (NULL to skip them)
+ * \param       data      visitor data
+ * \param       ...       option/value pairs (function arguments) :
+ *                          -# DRBOPT_CURSOR
+ *                          -# DRBOPT_LOCALE
+ *                          -# DRBOPT_FIELDS
+ * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
+ */
+int drbVisitDelta(drbClient* cli, void** output, drbDeltaVisitor visitor, void* data, ...);
+
+/*!
+ * \brief   Create a delta pager, which starts fetching the delta pages.
+ *
+ * The client must outlive the pager and must not be destroyed while it runs.
+ *
+ * \param       cli      authenticated dropbox client
+ * \param[out]  output   pager (drbDeltaPager*) or error (char*)
+ * \param       ...      option/value pairs (function arguments) :
+ *                         -# DRBOPT_CURSOR (cursor of the first page)
+ *                         -# DRBOPT_LOCALE
+ *                         -# DRBOPT_PATH_PREFIX
+ *                         -# DRBOPT_INCL_MEDIA_INFO
+ *                         -# DRBOPT_FIELDS
+ * \return  error code (DRBERR_XXX)
+ */
+int drbCreateDeltaPager(drbClient* cli, void** output, ...);
+
+/*!
+ * \brief   Get the next delta page of a pager, waiting for it if needed.
+ *
+ * After the last page (has_more false) or an error, the pager is over and
+ * this function gives a NULL output.
+ *
+ * \param       pager    delta pager
+ * \param[out]  output   delta page (drbDelta*), error (char*), or NULL when
+ *                       the pager is over
+ * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
+ */
+int drbDeltaPagerNext(drbDeltaPager* pager, void** output);
+
+/*!
+ * \brief   Compact delta entries to their net changes.
+ *
+ * Only the final state of each path (compared without case) is kept, and the
+ * entries of a path or its children that precede the deletion of the path are
+ * dropped. The deletion is kept before a new entry of the same path, as it
+ * also deletes the previous children. The kept entries keep their order.
+ *
+ * \param   delta   delta to compact (dropped entries are freed)
+ * \return  error code (DRBERR_XXX), the delta is partially compacted but
+ *          still valid on error.
+ */
+int drbCompactDelta(drbDelta* delta);
+
+/*!
+ * \brief   Merge the next delta page in a delta and compact the result.
+ *
+ * The cursor and has_more of the delta become the ones of the next page. If
+ * the next page resets the delta, the previous entries are dropped.
+ *
+ * \param   delta   delta to merge into
+ * \param   next    next delta page (freed on success)
+ * \return  error code (DRBERR_XXX), next is left untouched on error.
+ */
+int drbMergeDelta(drbDelta* delta, drbDelta* next);
+
+/*!
+ * \brief   Create a mirror of the namespace.
+ *
+ * An existing checkpoint (the snapshot file, and its log with ".log"
+ * appended) is loaded. A log page torn by a crash is dropped with the next
+ * ones, which are fetched again. If the snapshot can't be read, the mirror
+ * starts empty and the next update fetches the whole namespace.
+ *
+ * \param   checkpoint   snapshot file (NULL to keep the mirror in memory)
+ * \return  mirror (NULL if the memory can't be allocated or the checkpoint
+ *          can't be written), must be freed with drbDestroyMirror.
+ */
+drbMirror* drbCreateMirror(const char* checkpoint);
+
+/*!
+ * \brief   Update a mirror with the delta pages following its cursor.
+ *
+ * The pages are fetched with a delta pager until has_more is false, and
+ * applied with drbMirrorApply.
+ *
+ * \param       cli      authenticated dropbox client
+ * \param       mirror   mirror to update
+ * \param[out]  output   NULL or error (char*)
+ * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
+ */
+int drbMirrorUpdate(drbClient* cli, drbMirror* mirror, void** output);
+
+/*!
+ * \brief   Apply a delta page to a mirror.
+ *
+ * A reset clears the mirror, an entry without metadata removes its path and
+ * children, and an entry with metadata adds it (and its missing parent
+ * folders) or replaces it. A folder keeps its children, a file drops them.
+ * The mirror cursor becomes the page cursor. With a checkpoint, the page is
+ * logged before it is applied, and a snapshot is written once the log is
+ * larger than the last one (and than 16 MiB).
+ *
+ * \param   mirror   mirror to update
+ * \param   delta    delta page (e.g. from drbGetDelta or drbDeltaPagerNext)
+ * \return  error code (DRBERR_XXX), the cursor is kept on error so the page
+ *          can be applied again.
+ */
+int drbMirrorApply(drbMirror* mirror, const drbDelta* delta);
+
+/*!
+ * \brief   Write a snapshot of a mirror and clear its log.
+ *
+ * The snapshot is written aside and renamed, so a crash keeps the previous
+ * checkpoint. Updates wait while the mirror is written.
+ *
+ * \param   mirror   mirror to save
+ * \return  error code (DRBERR_XXX), DRBERR_OK without checkpoint file.
+ */
+int drbMirrorSave(drbMirror* mirror);
+
+/*!
+ * \brief   Get the delta cursor of a mirror.
+ * \param   mirror   mirror to query
+ * \return  cursor (NULL if the mirror was never updated), must be freed by the
+ *          caller.
+ */
+char* drbMirrorGetCursor(drbMirror* mirror);
+
+/*!
+ * \brief   Get the metadata of a path from a mirror.
+ *
+ * Folders only known as parents of other entries get a metadata with their
+ * lower case path and isDir only. Lookups can run from several threads, and
+ * while the mirror is updated.
+ *
+ * \param   mirror   mirror to search
+ * \param   path     file or folder path (compared without case)
+ * \param   list     set the contents of a folder, as DRBOPT_LIST does
+ * \return  metadata (NULL if the path is not found or on memory allocation
+ *          failure), must be freed with drbDestroyMetadata.
+ */
+drbMetadata* drbMirrorGetMetadata(drbMirror* mirror, const char* path, bool list);
+
+/*!
+ * \brief   Index the names of a mirror for drbMirrorSearch.
+ *
+ * The nodes already in the mirror are indexed, then the updates keep the
+ * index. From then on, deleted entries are kept (hidden from
+ * drbMirrorGetMetadata) to be found by drbMirrorSearch with includeDeleted,
+ * until a reset, until they are added again, or until a delta page leaves
+ * more deleted entries than others, which drops all of them. Enabling the
+ * search twice does nothing.
+ *
+ * \param   mirror   mirror to index
+ * \return  false if the memory can't be allocated (the mirror is left
+ *          unindexed).
+ */
+bool drbMirrorEnableSearch(drbMirror* mirror);
+
+/*!
+ * \brief   Search the names of a mirror, as drbSearch does.
+ *
+ * The results are the files and folders under path whose name holds all the
+ * words (separated by spaces) of the query, without case. The names are
+ * looked up in the index of drbMirrorEnableSearch, or in all the nodes under
+ * path without it.
+ *
+ * \param   mirror           mirror to search
+ * \param   path             folder to search in
+ * \param   query            words to search
+ * \param   fileLimit        maximum number of results (0 or more than 1000
+ *                           for 1000), as DRBOPT_FILE_LIMIT
+ * \param   includeDeleted   also find deleted entries (with isDeleted set), as
+ *                           DRBOPT_INCL_DELETED
+ * \return  found items list (NULL on memory allocation failure), must be freed
+ *          with drbDestroyMetadataList.
+ */
+drbMetadataList* drbMirrorSearch(drbMirror* mirror, const char* path, const char* query,
+                                 unsigned int fileLimit, bool includeDeleted);
+
 /*!
  * \brief   Restore a file.
  * \param       cli      authenticated dropbox client
@@ -518,10 +1429,12 @@ int drbGetCopyRef(drbClient* cli, void** output, ...);
  *                         -# DRBOPT_ROOT (required)
  *                         -# DRBOPT_PATH (required)
  *                         -# DRBOPT_IO_DATA (required)
- *                         -# DRBOPT_IO_FUNC (required)
+ *                         -# DRBOPT_IO_FUNC (required), e.g. drbSourceRead
+ *                            to read a drbSource
  *                         -# DRBOPT_OVERWRITE
  *                         -# DRBOPT_PARENT_REV
  *                         -# DRBOPT_LOCALE
+ *                         -# DRBOPT_DIGEST
  * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
  */
 int drbPutFile(drbClient* cli, void** output, ...);
@@ -536,6 +1449,237 @@ int drbPutFile(drbClient* cli, void** output, ...);
  * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
  */
 int drbLongPollDelta(drbClient* cli, void** output, ...);
+
+/*!
+ * \brief   Convert a Dropbox time (RFC 2822 format, e.g.
+ *          "Sat, 21 Aug 2010 22:31:20 +0000") to seconds since the epoch.
+ *
+ * The format is parsed by hand, so the conversion depends neither on the
+ * locale nor on the local time zone.
+ *
+ * \param       str    time to convert
+ * \param[out]  time   converted time
+ * \return  true if str is a valid time, false otherwise.
+ */
+bool drbParseTime(const char* str, int64_t* time);
+
+/*!
+ * \brief   Get a string field of a metadata table row.
+ * \param   table    metadata table
+ * \param   column   string column (e.g. table->path)
+ * \param   row      row index
+ * \return  string (NULL if undefined or if the column is not loaded), valid as
+ *          long as the table exists.
+ */
+const char* drbTableGetStr(const drbMetadataTable* table, const unsigned int* column, size_t row);
+
+/*!
+ * \brief   Get all the fields of a metadata table row.
+ * \param       table   metadata table
+ * \param       row     row index
+ * \param[out]  meta    row metadata (its contents are NULL); its strings are
+ *                       valid as long as the table exists.
+ * \return  void
+ */
+void drbTableGetRow(const drbMetadataTable* table, size_t row, drbArenaMetadata* meta);
+
+/*!
+ * \brief   Get the number of entries of a lazy list.
+ * \param   list   lazy list
+ * \return  number of entries.
+ */
+size_t drbLazySize(const drbLazyList* list);
+
+/*!
+ * \brief   Check whether a lazy list entry has metadata.
+ * \param   list   lazy list
+ * \param   row    entry index
+ * \return  false if the entry has no metadata (e.g. deleted delta entry).
+ */
+bool drbLazyHasMetadata(const drbLazyList* list, size_t row);
+
+/*!
+ * \brief   Get a string field of a lazy list entry.
+ *
+ * The string is a view in the server answer and is not NUL terminated,
+ * unless it had escape sequences: it is then decoded once in a copy owned by
+ * the list. In both cases, it is valid as long as the list exists.
+ *
+ * \param       list     lazy list
+ * \param       row      entry index
+ * \param       field    DRBFIELD_XXX bit of the field (e.g. DRBFIELD_PATH)
+ * \param[out]  str      string
+ * \param[out]  length   string length
+ * \return  true if the field is defined, false otherwise.
+ */
+bool drbLazyGetStr(drbLazyList* list, size_t row, unsigned int field,
+                   const char** str, size_t* length);
+
+/*!
+ * \brief   Get an integer field of a lazy list entry.
+ * \param       list    lazy list
+ * \param       row     entry index
+ * \param       field   DRBFIELD_XXX bit of the field (e.g. DRBFIELD_BYTES)
+ * \param[out]  value   field value
+ * \return  true if the field is defined, false otherwise.
+ */
+bool drbLazyGetInt(const drbLazyList* list, size_t row, unsigned int field,
+                   uint64_t* value);
+
+/*!
+ * \brief   Get a time field of a lazy list entry.
+ * \param       list    lazy list
+ * \param       row     entry index
+ * \param       field   DRBFIELD_XXX bit of the field (e.g. DRBFIELD_MODIFIED)
+ * \param[out]  time    field value, in seconds since the epoch
+ * \return  true if the field is defined and valid, false otherwise.
+ */
+bool drbLazyGetTime(drbLazyList* list, size_t row, unsigned int field, int64_t* time);
+
+/*!
+ * \brief   Get a boolean field of a lazy list entry.
+ * \param       list    lazy list
+ * \param       row     entry index
+ * \param       field   DRBFIELD_XXX bit of the field (e.g. DRBFIELD_IS_DIR)
+ * \param[out]  value   field value
+ * \return  true if the field is defined, false otherwise.
+ */
+bool drbLazyGetBool(const drbLazyList* list, size_t row, unsigned int field,
+                    bool* value);
+
+/*!
+ * \brief   Get the path of a lazy delta entry (as drbLazyGetStr).
+ * \param       list     lazy delta list
+ * \param       row      entry index
+ * \param[out]  str      entry path
+ * \param[out]  length   entry path length
+ * \return  true if the entry has a path, false otherwise.
+ */
+bool drbLazyGetKey(drbLazyList* list, size_t row, const char** str, size_t* length);
+
+/*!
+ * \brief   Decode the metadata of a lazy list entry.
+ * \param   list     lazy list
+ * \param   row      entry index
+ * \param   fields   DRBFIELD_XXX mask of the fields to decode (0 for all)
+ * \return  entry metadata (NULL if it has none), must be freed with
+ *          drbDestroyMetadata.
+ */
+drbMetadata* drbLazyGetMetadata(const drbLazyList* list, size_t row, unsigned int fields);
+
+/*!
+ * \brief   Get the delta informations of a lazy delta list.
+ * \param       list      lazy delta list
+ * \param[out]  reset     delta reset value
+ * \param[out]  hasMore   delta has_more value
+ * \param[out]  cursor    delta cursor (valid as long as the list exists)
+ * \return  DRBFIELD_RESET, _CURSOR and _HAS_MORE bits of the defined values.
+ */
+unsigned int drbLazyGetDelta(const drbLazyList* list, bool* reset, bool* hasMore,
+                             const char** cursor);
+
+/*!
+ * \brief   Encode a metadata (and its contents) in the binary encoding.
+ * \param       meta   metadata to encode
+ * \param[out]  size   encoded size
+ * \return  encoded buffer (NULL on failure), must be freed with free.
+ */
+void* drbEncodeMetadata(const drbMetadata* meta, size_t* size);
+
+/*!
+ * \brief   Encode a metadata list in the binary encoding.
+ * \param       list   metadata list to encode
+ * \param[out]  size   encoded size
+ * \return  encoded buffer (NULL on failure), must be freed with free.
+ */
+void* drbEncodeMetadataList(const drbMetadataList* list, size_t* size);
+
+/*!
+ * \brief   Encode a delta (and its entries metadata) in the binary encoding.
+ * \param       delta   delta to encode
+ * \param[out]  size    encoded size
+ * \return  encoded buffer (NULL on failure), must be freed with free.
+ */
+void* drbEncodeDelta(const drbDelta* delta, size_t* size);
+
+/*!
+ * \brief   Read an encoded metadata in place.
+ *
+ * The whole buffer is checked once (version, kind and bounds of every
+ * reference), so its records can then be read without further checks. The
+ * buffer must be aligned on 8 bytes (as malloc and mmap buffers are).
+ *
+ * \param   buffer   encoded buffer
+ * \param   size     buffer size
+ * \return  metadata record in buffer (NULL if the buffer is invalid).
+ */
+const drbBinMetadata* drbViewMetadata(const void* buffer, size_t size);
+
+/*!
+ * \brief   Read an encoded metadata list in place (as drbViewMetadata).
+ * \param   buffer   encoded buffer
+ * \param   size     buffer size
+ * \return  metadata list record in buffer (NULL if the buffer is invalid).
+ */
+const drbBinMetadataList* drbViewMetadataList(const void* buffer, size_t size);
+
+/*!
+ * \brief   Read an encoded delta in place (as drbViewMetadata).
+ * \param   buffer   encoded buffer
+ * \param   size     buffer size
+ * \return  delta record in buffer (NULL if the buffer is invalid).
+ */
+const drbBinDelta* drbViewDelta(const void* buffer, size_t size);
+
+/*!
+ * \brief   Get a string of a binary record.
+ * \param   record   record holding the string offset
+ * \param   offset   string offset (e.g. meta->path)
+ * \return  string (NULL if undefined), valid as long as the buffer exists.
+ */
+const char* drbBinStr(const void* record, int32_t offset);
+
+/*!
+ * \brief   Get the contents of a binary metadata.
+ * \param   meta   binary metadata
+ * \return  contents (NULL if undefined), valid as long as the buffer exists.
+ */
+const drbBinMetadataList* drbBinContents(const drbBinMetadata* meta);
+
+/*!
+ * \brief   Get the metadata of a binary delta entry.
+ * \param   entry   binary delta entry
+ * \return  metadata (NULL if the entry was deleted), valid as long as the
+ *          buffer exists.
+ */
+const drbBinMetadata* drbBinEntryMetadata(const drbBinDeltaEntry* entry);
+
+/*!
+ * \brief   Decode an encoded metadata.
+ * \param   buffer   encoded buffer
+ * \param   size     buffer size
+ * \return  decoded metadata (NULL if the buffer is invalid or on failure), must
+ *          be freed with drbDestroyMetadata.
+ */
+drbMetadata* drbDecodeMetadata(const void* buffer, size_t size);
+
+/*!
+ * \brief   Decode an encoded metadata list.
+ * \param   buffer   encoded buffer
+ * \param   size     buffer size
+ * \return  decoded metadata list (NULL if the buffer is invalid or on failure),
+ *          must be freed with drbDestroyMetadataList.
+ */
+drbMetadataList* drbDecodeMetadataList(const void* buffer, size_t size);
+
+/*!
+ * \brief   Decode an encoded delta.
+ * \param   buffer   encoded buffer
+ * \param   size     buffer size
+ * \return  decoded delta (NULL if the buffer is invalid or on failure), must be
+ *          freed with drbDestroyDelta.
+ */
+drbDelta* drbDecodeDelta(const void* buffer, size_t size);
     
     
 void drbDestroyClient(drbClient* cli);
@@ -547,6 +1691,15 @@ void drbDestroyAccountInfo(drbAccountInfo* info);
 void drbDestroyLink(drbLink* link);
 void drbDestroyDelta(drbDelta* delta, bool withMetadata);
 void drbDestroyPollDelta(drbPollDelta* poll);
+void drbDestroyArena(void* arena);
+void drbDestroyMetadataTable(drbMetadataTable* table);
+void drbDestroyDeltaTable(drbDeltaTable* delta);
+void drbDestroyDeltaPager(drbDeltaPager* pager);
+void drbDestroyMirror(drbMirror* mirror);
+void drbDestroyPipe(drbPipe* pipe);
+void drbDestroyUringSink(drbSink* sink);
+void drbDestroyUringSource(drbSource* source);
+void drbDestroyLazyList(drbLazyList* list);
     
 #ifdef __cplusplus
 }
@@ -0,0 +1,27 @@
+/*!
+ * \file    dropboxCache.h
+ * \brief   Cache of the metadata listings revalidated with their hash.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#ifndef DROPBOX_CACHE_H
+#define DROPBOX_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "dropbox.h"
+
+typedef struct drbMetadataCache drbMetadataCache;
+
+drbMetadataCache* drbCreateMetadataCache(size_t maxEntries, const char* dir);
+void drbDestroyMetadataCache(drbMetadataCache* cache);
+bool drbMetadataCacheFind(drbMetadataCache* cache, const char* key, char** hash,
+                          void** encoded, size_t* size);
+void drbMetadataCacheHit(drbMetadataCache* cache);
+void drbMetadataCacheStore(drbMetadataCache* cache, const char* key, const char* hash,
+                           const drbMetadata* meta);
+void drbMetadataCacheGetStats(drbMetadataCache* cache, drbMetadataCacheStats* stats);
+
+#endif /* DROPBOX_CACHE_H */
@@ -0,0 +1,32 @@
+/*!
+ * \file    dropboxDigest.h
+ * \brief   Checksums of the transferred files.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#ifndef DROPBOX_DIGEST_H
+#define DROPBOX_DIGEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "dropbox.h"
+
+/*!
+ * \struct  drbDigestState
+ * \breif   Checksums being computed for a drbDigest.
+ */
+typedef struct {
+    drbDigest* digest;  /*!< Digest to set once the transfer is over. */
+    uint64_t bytes;     /*!< Hashed bytes count. */
+    uint32_t crc;       /*!< Running CRC32C (not inverted). */
+    void* sha;          /*!< SHA-256 context (NULL if not requested). */
+} drbDigestState;
+
+bool drbDigestStart(drbDigestState* state, drbDigest* digest);
+void drbDigestUpdate(drbDigestState* state, const void* ptr, size_t size);
+void drbDigestFinish(drbDigestState* state);
+
+#endif /* DROPBOX_DIGEST_H */
@@ -9,8 +9,22 @@
 #ifndef DROPBOX_JSON_H
 #define DROPBOX_JSON_H
 
+#include <jansson.h>
 #include "dropbox.h"
 
+/*!
+ * \struct  drbJsonVisit
+ * \breif   Delta visit state, loader argument of drbLoadDeltaVisit.
+ */
+typedef struct {
+    drbDeltaVisitor visitor; /*!< Function called for each entry (NULL to skip them). */
+    void* data;              /*!< Visitor data. */
+    unsigned int fields;     /*!< DRBFIELD_XXX mask of the metadata fields to load. */
+} drbJsonVisit;
+
+json_t* drbLoadJson(size_t (*xread)(void*, size_t, void*), void* data, void* arg);
+json_t* drbLoadDeltaVisit(size_t (*xread)(void*, size_t, void*), void* data, void* arg);
+
 char* drbParseError(char* str);
 drbCopyRef* drbParseCopyRef(char* str);
 drbLink* drbParseLink(char* str);
@@ -21,4 +35,21 @@ drbDelta* drbParseDelta(char* str);
 drbMetadataList* drbStrParseMetadataList(char *str);
 drbPollDelta* drbParsePollDelta(char* str);
 
+char* drbBuildError(json_t* root);
+drbCopyRef* drbBuildCopyRef(json_t* root);
+drbLink* drbBuildLink(json_t* root);
+drbMetadataList* drbBuildMetadataList(json_t* root, unsigned int fields);
+drbMetadata* drbBuildMetadata(json_t* root, unsigned int fields);
+drbAccountInfo* drbBuildAccountInfo(json_t* root);
+drbDelta* drbBuildDelta(json_t* root, unsigned int fields);
+drbPollDelta* drbBuildPollDelta(json_t* root);
+
+drbArenaMetadata* drbBuildArenaMetadata(json_t* root, unsigned int fields);
+drbArenaMetadataList* drbBuildArenaMetadataList(json_t* root, unsigned int fields);
+drbArenaDelta* drbBuildArenaDelta(json_t* root, unsigned int fields);
+
+drbMetadataTable* drbBuildMetadataTable(json_t* root, unsigned int fields);
+drbMetadataTable* drbBuildItemTable(json_t* root, unsigned int fields);
+drbDeltaTable* drbBuildDeltaTable(json_t* root, unsigned int fields);
+
 #endif /* DROPBOX_JSON_H */
\ No newline at end of file
@@ -0,0 +1,20 @@
+/*!
+ * \file    dropboxLazy.h
+ * \brief   Metadata lists decoded on access from the raw server answer.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#ifndef DROPBOX_LAZY_H
+#define DROPBOX_LAZY_H
+
+#include <stddef.h>
+#include "dropbox.h"
+
+char* drbLoadLazy(size_t (*xread)(void*, size_t, void*), void* data, void* arg);
+
+drbLazyList* drbBuildLazyList(char* raw);
+drbLazyList* drbBuildLazyDelta(char* raw);
+
+#endif /* DROPBOX_LAZY_H */
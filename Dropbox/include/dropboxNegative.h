@@ -0,0 +1,29 @@
+/*!
+ * \file    dropboxNegative.h
+ * \brief   Cache of the paths not found by the metadata requests.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#ifndef DROPBOX_NEGATIVE_H
+#define DROPBOX_NEGATIVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "dropbox.h"
+
+typedef struct drbNegativeCache drbNegativeCache;
+
+drbNegativeCache* drbCreateNegativeCache(size_t maxEntries, unsigned int ttl);
+void drbDestroyNegativeCache(drbNegativeCache* cache);
+bool drbNegativeCacheFind(drbNegativeCache* cache, const char* root, const char* path,
+                          char** error);
+uint64_t drbNegativeCacheGeneration(drbNegativeCache* cache);
+void drbNegativeCacheStore(drbNegativeCache* cache, const char* root, const char* path,
+                           const char* error, uint64_t generation);
+void drbNegativeCacheInvalidate(drbNegativeCache* cache, const char* path, bool subtree);
+void drbNegativeCacheGetStats(drbNegativeCache* cache, drbNegativeCacheStats* stats);
+
+#endif /* DROPBOX_NEGATIVE_H */
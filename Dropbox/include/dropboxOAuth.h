@@ -10,8 +10,12 @@
 #define DROPBOX_OAUTH_H
 
 #include <stdbool.h>
+#include <pthread.h>
+#include <memStream.h>
 #include "dropbox.h"
 #include "dropboxUtils.h"
+#include "dropboxCache.h"
+#include "dropboxNegative.h"
 
 typedef union {
     void* ptr;
@@ -27,15 +31,46 @@ struct drbClient{
     drbOAuthToken c;
     drbOAuthToken t;
     drbOptArg defaultOptions[DRBOPT_END];
+    memPool pool;                     /*!< Buffers of the requests memory streams. */
+    pthread_mutex_t poolLock;         /*!< Serialize the pool use between threads. */
+    size_t spillThreshold;            /*!< Request buffer size kept in memory. */
+    drbMetadataCache* metadataCache;  /*!< Folder listings (NULL for none). */
+    drbNegativeCache* negativeCache;  /*!< Paths not found (NULL for none). */
 };
 
+/*!
+ * Pull the next bytes of a server answer (at most size), return 0 at its end.
+ */
+typedef size_t (*drbReadFct)(void* buffer, size_t size, void* data);
+
+/*!
+ * Consume a whole server answer by reading it with xread(buffer, size, data).
+ * arg is the loader argument given with the request.
+ */
+typedef void* (*drbLoadFct)(drbReadFct xread, void* data, void* arg);
+
+/*!
+ * Tell whether a request must be given up, arg is the loader argument.
+ */
+typedef bool (*drbAbortFct)(void* arg);
+
 int drbOAuthGet(drbClient* cli, const char* url, void* data, void* writeFct, int timeout);
 int drbOAuthPost(drbClient* cli, const char* url, void* data, void* writeFct, int timeout);
 
-int drbOAuthGetFile(drbClient* cli, const char* url, void* data, void* writeFct, char** answer, int timeout);
+int drbOAuthGetStream(drbClient* cli, const char* url, drbLoadFct loadFct, void* loadArg,
+                      void** loaded, int timeout);
+int drbOAuthPostStream(drbClient* cli, const char* url, drbLoadFct loadFct, void* loadArg,
+                       void** loaded, int timeout);
+int drbOAuthPostStreamUntil(drbClient* cli, const char* url, drbLoadFct loadFct, void* loadArg,
+                            drbAbortFct abortFct, void** loaded, int timeout);
+
+int drbOAuthGetFile(drbClient* cli, const char* url, void* data, void* writeFct,
+                    drbDigest* digest, char** answer, int timeout);
 int drbOAuthPostFile(drbClient* cli, const char *url, void* data,
                      ssize_t (*readFct)(void *, size_t , size_t , void *),
-                     char** answer, int timeout);
+                     drbDigest* digest, char** answer, int timeout);
+bool drbAcquireStream(drbClient* cli, memStream* stream, size_t size);
+void drbReleaseStream(drbClient* cli, memStream* stream);
 char *drbEncodePath(const char *string);
 bool drbParseOauthTokenReply(const char *answer, char **key, char **secret);
 
@@ -0,0 +1,26 @@
+/*!
+ * \file    dropboxPager.h
+ * \brief   Delta pages fetched and parsed ahead of the application.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#ifndef DROPBOX_PAGER_H
+#define DROPBOX_PAGER_H
+
+#include <jansson.h>
+#include "dropbox.h"
+
+/*!
+ * Set the output of a delta page (drbDelta* loaded with the DRBFIELD_XXX
+ * fields, or error message) from its JSON answer.
+ */
+typedef void (*drbPagerOutputFct)(drbClient* cli, int err, json_t* root, unsigned int fields,
+                                  void** output);
+
+drbDeltaPager* drbCreatePager(drbClient* cli, const char* url, const char* args,
+                              const char* cursor, unsigned int fields, int timeout,
+                              drbPagerOutputFct outputFct);
+
+#endif /* DROPBOX_PAGER_H */
@@ -0,0 +1,20 @@
+/*!
+ * \file    dropboxPipe.h
+ * \brief   Ring buffer between a download and its consumer thread.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#ifndef DROPBOX_PIPE_H
+#define DROPBOX_PIPE_H
+
+#include <stdbool.h>
+#include <curl/curl.h>
+#include "dropbox.h"
+
+size_t drbPipeTransferWrite(const void* ptr, size_t size, size_t count, drbPipe* pipe);
+void drbPipeAttach(drbPipe* pipe, CURLM* multi);
+bool drbPipeResume(drbPipe* pipe);
+
+#endif /* DROPBOX_PIPE_H */
@@ -0,0 +1,35 @@
+/*!
+ * \file    dropboxSearch.h
+ * \brief   Trigram index of the names of local items.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#ifndef DROPBOX_SEARCH_H
+#define DROPBOX_SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct drbSearchIndex drbSearchIndex;
+
+/*!
+ * Visit a candidate item, return false to stop the visit.
+ */
+typedef bool (*drbSearchVisitor)(void* item, void* data);
+
+/*!
+ * Give the new id of an item renumbered by the index compaction.
+ */
+typedef void (*drbSearchRenumber)(void* item, uint32_t id);
+
+drbSearchIndex* drbCreateSearchIndex(drbSearchRenumber renumber);
+void drbDestroySearchIndex(drbSearchIndex* index);
+uint32_t drbSearchIndexAdd(drbSearchIndex* index, const char* name, void* item);
+void drbSearchIndexRemove(drbSearchIndex* index, uint32_t id);
+void drbSearchIndexVisit(drbSearchIndex* index, char* const* words, size_t count,
+                         drbSearchVisitor visitor, void* data);
+
+#endif /* DROPBOX_SEARCH_H */
@@ -0,0 +1,18 @@
+/*!
+ * \file    dropboxSink.h
+ * \brief   Download sinks and upload sources.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#ifndef DROPBOX_SINK_H
+#define DROPBOX_SINK_H
+
+#include <stdbool.h>
+#include <sys/uio.h>
+#include "dropbox.h"
+
+bool drbSinkWriteAll(drbSink* sink, struct iovec* iov, int count);
+
+#endif /* DROPBOX_SINK_H */
@@ -9,7 +9,58 @@
 #ifndef DROPBOX_UTILS_H
 #define DROPBOX_UTILS_H
 
+#include <stddef.h>
+#include <stdbool.h>
+
+/*!
+ * \struct  drbStrEntry
+ * \breif   Interned string.
+ */
+typedef struct {
+    const char* str; /*!< Interned string content (NULL if the slot is free). */
+    char* copy;      /*!< Copy of the string shared by its users. */
+    size_t hash;     /*!< String hash. */
+} drbStrEntry;
+
+/*!
+ * \struct  drbStrTable
+ * \breif   Hash table of interned strings.
+ *
+ * The table only references the strings it is given, they must outlive it.
+ */
+typedef struct {
+    drbStrEntry* entries; /*!< Open addressing slots. */
+    size_t capacity;      /*!< Number of slots (power of 2). */
+    size_t count;         /*!< Number of interned strings. */
+} drbStrTable;
+
+/*!
+ * \struct  drbArena
+ * \breif   Bump allocator over a single memory block.
+ *
+ * While base is NULL, the arena only measures the memory the allocations
+ * would need (and they return NULL), so the block can be sized exactly.
+ */
+typedef struct {
+    char* base;  /*!< Memory block (NULL to measure). */
+    size_t size; /*!< Memory block size. */
+    size_t used; /*!< Memory used so far. */
+    drbStrTable* strings; /*!< Interned strings (NULL to not intern). */
+} drbArena;
+
 char* drbStrDup(const char*);
-char* drbGetHeaderFieldContent(const char* field, char* header);
+size_t drbStrHash(const char* str);
+char* drbPathKey(const char* path);
+char* drbGetHeaderFieldContent(const char* field, const char* header);
+void* drbArenaAlloc(drbArena* arena, size_t size);
+char* drbArenaStrDup(drbArena* arena, const char* str);
+char* drbArenaStrIntern(drbArena* arena, const char* str);
+bool drbStrTableReserve(drbStrTable* table, size_t count);
+drbStrEntry* drbStrTableFind(drbStrTable* table, const char* str, bool* added);
+drbStrEntry* drbPathTableFind(drbStrTable* table, const char* path, size_t hash,
+                              bool* added);
+bool drbPathTableCovers(drbStrTable* table, const char* path, size_t* hash);
+void drbStrTableClear(drbStrTable* table);
+void drbStrTableFree(drbStrTable* table);
 
 #endif /* DROPBOX_UTILS_H */
@@ -18,7 +18,12 @@
 #include "dropboxOAuth.h"
 #include "dropboxJson.h"
 #include "dropboxUtils.h"
+#include "dropboxLazy.h"
+#include "dropboxPager.h"
 
+/*! Default maximum memory kept by the client buffer pool. */
+static const size_t DRB_POOL_MAX_CACHED = 4 * 1024 * 1024;
+static const size_t DRB_SPILL_THRESHOLD = 16 * 1024 * 1024;
 
 enum {
     DRBBIT_VOID,
@@ -47,20 +52,28 @@ enum {
     DRBBIT_NETWORK_TIMEOUT = 1<<DRBOPT_NETWORK_TIMEOUT,
     DRBBIT_INCL_MEDIA_INFO = 1<<DRBOPT_INCL_MEDIA_INFO,
     DRBBIT_PATH_PREFIX     = 1<<DRBOPT_PATH_PREFIX,
+    DRBBIT_ARENA           = 1<<DRBOPT_ARENA,
+    DRBBIT_COLUMNAR        = 1<<DRBOPT_COLUMNAR,
+    DRBBIT_FIELDS          = 1<<DRBOPT_FIELDS,
+    DRBBIT_LAZY            = 1<<DRBOPT_LAZY,
+    DRBBIT_DIGEST          = 1<<DRBOPT_DIGEST,
     
     DRBBIT_END             = 1<<DRBOPT_END,
 };
 
 // Special Arguments
+static const long DRBSA_OPTIONAL       = DRBBIT_NETWORK_TIMEOUT | DRBBIT_CURSOR | DRBBIT_ARENA | DRBBIT_COLUMNAR | DRBBIT_FIELDS | DRBBIT_LAZY | DRBBIT_DIGEST;
 static const long DRBSA_ACC_INFO       = DRBBIT_NETWORK_TIMEOUT;
-static const long DRBSA_GET_FILES      = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH| DRBBIT_IO_DATA | DRBBIT_IO_FUNC;
-static const long DRBSA_PUT_FILES      = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH | DRBBIT_IO_DATA | DRBBIT_IO_FUNC;
-static const long DRBSA_METADATA       = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH;
-static const long DRBSA_DELTA          = DRBBIT_NETWORK_TIMEOUT;
-static const long DRBSA_REVISIONS      = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH;
+static const long DRBSA_GET_FILES      = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH| DRBBIT_IO_DATA | DRBBIT_IO_FUNC | DRBBIT_DIGEST;
+static const long DRBSA_PUT_FILES      = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH | DRBBIT_IO_DATA | DRBBIT_IO_FUNC | DRBBIT_DIGEST;
+static const long DRBSA_METADATA       = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH | DRBBIT_ARENA | DRBBIT_COLUMNAR | DRBBIT_FIELDS;
+static const long DRBSA_DELTA          = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ARENA | DRBBIT_COLUMNAR | DRBBIT_FIELDS | DRBBIT_LAZY;
+static const long DRBSA_VISIT_DELTA    = DRBBIT_NETWORK_TIMEOUT | DRBBIT_FIELDS;
+static const long DRBSA_DELTA_PAGER    = DRBBIT_NETWORK_TIMEOUT | DRBBIT_CURSOR | DRBBIT_FIELDS;
+static const long DRBSA_REVISIONS      = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH | DRBBIT_ARENA | DRBBIT_COLUMNAR | DRBBIT_FIELDS | DRBBIT_LAZY;
 static const long DRBSA_RESTORE        = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH;
-static const long DRBSA_SEARCH         = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH;
-static const long DRBSA_THUMBNAILS     = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH | DRBBIT_IO_DATA | DRBBIT_IO_FUNC;
+static const long DRBSA_SEARCH         = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH | DRBBIT_ARENA | DRBBIT_COLUMNAR | DRBBIT_FIELDS | DRBBIT_LAZY;
+static const long DRBSA_THUMBNAILS     = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH | DRBBIT_IO_DATA | DRBBIT_IO_FUNC | DRBBIT_DIGEST;
 static const long DRBSA_SHARES         = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH;
 static const long DRBSA_MEDIA          = DRBBIT_NETWORK_TIMEOUT | DRBBIT_ROOT | DRBBIT_PATH;
 static const long DRBSA_COPY           = DRBBIT_NETWORK_TIMEOUT;
@@ -76,6 +89,7 @@ static const long DRBRA_GET_FILES      = DRBBIT_REV ;
 static const long DRBRA_PUT_FILES      = DRBBIT_LOCALE | DRBBIT_OVERWRITE | DRBBIT_PARENT_REV;
 static const long DRBRA_METADATA       = DRBBIT_LOCALE | DRBBIT_FILE_LIMIT | DRBBIT_HASH | DRBBIT_LIST | DRBBIT_INCL_DELETED | DRBBIT_REV | DRBBIT_INCL_MEDIA_INFO;
 static const long DRBRA_DELTA          = DRBBIT_LOCALE | DRBBIT_CURSOR | DRBBIT_PATH_PREFIX | DRBBIT_INCL_MEDIA_INFO;
+static const long DRBRA_DELTA_PAGER    = DRBBIT_LOCALE | DRBBIT_PATH_PREFIX | DRBBIT_INCL_MEDIA_INFO;
 static const long DRBRA_REVISIONS      = DRBBIT_LOCALE | DRBBIT_REV_LIMIT;
 static const long DRBRA_RESTORE        = DRBBIT_LOCALE | DRBBIT_REV;
 static const long DRBRA_SEARCH         = DRBBIT_LOCALE | DRBBIT_QUERY | DRBBIT_FILE_LIMIT | DRBBIT_INCL_DELETED;
@@ -112,7 +126,9 @@ static const char* DRBURI_COPY_REF       = "https://api.dropbox.com/1/copy_ref";
 static const char* DRBURI_LONGPOLL_DELTA = "https://api-notify.dropbox.com/1/longpoll_delta";
 
 // Special Handler arguments array Indexs
-enum {DRBSHI_NETWORK_TIMEOUT, DRBSHI_ROOT, DRBSHI_PATH, DRBSHI_IO_DATA, DRBSHI_IO_FUNC};
+enum {DRBSHI_NETWORK_TIMEOUT, DRBSHI_ROOT, DRBSHI_PATH, DRBSHI_IO_DATA, DRBSHI_IO_FUNC,
+      DRBSHI_ARENA, DRBSHI_COLUMNAR, DRBSHI_FIELDS, DRBSHI_LAZY, DRBSHI_CURSOR, DRBSHI_DIGEST,
+      DRBSHI_END};
 
 
 /*!
@@ -233,7 +249,12 @@ static bool drbGetOptAttr(int opt, char** name, drbOptType* type) {
         case DRBOPT_NETWORK_TIMEOUT: *name = NULL,              *type = DRBTYPE_VAL;  break;
         case DRBOPT_INCL_MEDIA_INFO: *name = "size",            *type = DRBTYPE_BOOL; break;
         case DRBOPT_PATH_PREFIX:     *name = "to_path",         *type = DRBTYPE_PATH; break;
-            
+        case DRBOPT_ARENA:           *name = NULL,              *type = DRBTYPE_VAL;  break;
+        case DRBOPT_COLUMNAR:        *name = NULL,              *type = DRBTYPE_VAL;  break;
+        case DRBOPT_FIELDS:          *name = NULL,              *type = DRBTYPE_VAL;  break;
+        case DRBOPT_LAZY:            *name = NULL,              *type = DRBTYPE_VAL;  break;
+        case DRBOPT_DIGEST:          *name = NULL,              *type = DRBTYPE_PTR;  break;
+        
         default:
             return false; // Unknown option
     }
@@ -288,7 +309,7 @@ static void drbSetDefaultRegularArgs(drbClient* cli, char** args, int ra) {
 static int drbSetDefaultSpecialArgs(drbClient* cli, drbOptArg *sArgs, int sa) {
     for (int opt = 0; opt < DRBOPT_END; opt++) {
         int optBit = sa & (1 << opt);
-        if (optBit && (opt == DRBOPT_NETWORK_TIMEOUT || cli->defaultOptions[opt].ptr)) {
+        if (optBit && (optBit & DRBSA_OPTIONAL || cli->defaultOptions[opt].ptr)) {
             sa ^= optBit;
             switch (opt) {
                 case DRBOPT_ROOT:
@@ -306,6 +327,24 @@ static int drbSetDefaultSpecialArgs(drbClient* cli, drbOptArg *sArgs, int sa) {
                 case DRBOPT_IO_FUNC:
                     sArgs[DRBSHI_IO_FUNC] = cli->defaultOptions[DRBOPT_IO_FUNC];
                     break;
+                case DRBOPT_ARENA:
+                    sArgs[DRBSHI_ARENA] = cli->defaultOptions[DRBOPT_ARENA];
+                    break;
+                case DRBOPT_COLUMNAR:
+                    sArgs[DRBSHI_COLUMNAR] = cli->defaultOptions[DRBOPT_COLUMNAR];
+                    break;
+                case DRBOPT_FIELDS:
+                    sArgs[DRBSHI_FIELDS] = cli->defaultOptions[DRBOPT_FIELDS];
+                    break;
+                case DRBOPT_LAZY:
+                    sArgs[DRBSHI_LAZY] = cli->defaultOptions[DRBOPT_LAZY];
+                    break;
+                case DRBOPT_CURSOR:
+                    sArgs[DRBSHI_CURSOR].str = drbStrDup(cli->defaultOptions[DRBOPT_CURSOR].str);
+                    break;
+                case DRBOPT_DIGEST:
+                    sArgs[DRBSHI_DIGEST] = cli->defaultOptions[DRBOPT_DIGEST];
+                    break;
             }
         }
     }
@@ -369,7 +408,7 @@ static int drbGetOpt(drbClient* cli, va_list* ap, int sa, int ra, char** args,
                     //   - drbGetOptArg parsed the argument with success
                     //   - the argument is not ignored
                     err = drbGetOptArg(ap, type, &arg, &ignored);
-                    if (!err && !ignored) {
+                    if (!err && !ignored && name) { // local options are not sent
                         err = drbAppendOpt(args, name, arg.str);
                         free(arg.ptr);
                     }
@@ -412,6 +451,18 @@ static int specialHandler(int optBit, va_list* ap, drbOptArg* shArg, bool* ignor
         case DRBBIT_IO_FUNC:
             *ignored = (shArg[DRBSHI_IO_FUNC].ptr = va_arg(*ap, void*)) == NULL;
             return DRBERR_OK;
+        case DRBBIT_ARENA:
+            return drbGetOptArg(ap, DRBTYPE_VAL, &shArg[DRBSHI_ARENA], ignored);
+        case DRBBIT_COLUMNAR:
+            return drbGetOptArg(ap, DRBTYPE_VAL, &shArg[DRBSHI_COLUMNAR], ignored);
+        case DRBBIT_FIELDS:
+            return drbGetOptArg(ap, DRBTYPE_VAL, &shArg[DRBSHI_FIELDS], ignored);
+        case DRBBIT_LAZY:
+            return drbGetOptArg(ap, DRBTYPE_VAL, &shArg[DRBSHI_LAZY], ignored);
+        case DRBBIT_CURSOR:
+            return drbGetOptArg(ap, DRBTYPE_STR, &shArg[DRBSHI_CURSOR], ignored);
+        case DRBBIT_DIGEST:
+            return drbGetOptArg(ap, DRBTYPE_PTR, &shArg[DRBSHI_DIGEST], ignored);
         default:
             *ignored = true;
             return DRBERR_UNKNOWN;
@@ -434,6 +485,7 @@ static char* drbLocalError(int code) {
         case DRBERR_UNKNOWN:        message = "Unknown error";            break;
         case DRBERR_NETWORK:        message = "Network issue";            break;
         case DRBERR_TIMEOUT:        message = "Request timed out";        break;
+        case DRBERR_IO:             message = "Local I/O error";          break;
     }
     return message ? drbStrDup(message) : NULL;
 }
@@ -455,6 +507,186 @@ static void drbSetOutput(int err, char* str, void* (*drbParseFct)(char *str), vo
     }
 }
 
+/*!
+ * \brief   Set the right output (structure or error message) from a JSON answer.
+ * \param       err            current error code
+ * \param       root           JSON output loaded from dropbox
+ * \param       drbBuildFct    handle the JSON to structure conversion
+ * \param[out]  output         output structure or message
+ * \return  void
+ */
+static void drbSetJsonOutput(int err, json_t* root, void* (*drbBuildFct)(json_t* root), void** output) {
+    if (output) {
+        if (err) {
+            if((*output = drbLocalError(err)) == NULL)
+                *output = drbBuildError(root);
+        } else  *output = drbBuildFct(root);
+    }
+}
+
+/*!
+ * \brief   Set the metadata output of a function from a JSON root node.
+ * \param       err            function error code
+ * \param       root           JSON root node to convert
+ * \param       drbBuildFct    handle the JSON to structure conversion
+ * \param       fields         DRBFIELD_XXX mask of the metadata fields to load
+ *                             (0 for all)
+ * \param[out]  output         structure to set with the conversion result
+ * \return  void
+ */
+static void drbSetJsonFieldsOutput(int err, json_t* root,
+                                   void* (*drbBuildFct)(json_t* root, unsigned int fields),
+                                   unsigned int fields, void** output) {
+    if (output) {
+        if (err) {
+            if((*output = drbLocalError(err)) == NULL)
+                *output = drbBuildError(root);
+        } else  *output = drbBuildFct(root, fields ? fields : DRBFIELD_ALL);
+    }
+}
+
+/*!
+ * \brief   Forget the missing paths that a call may have created.
+ * \param   cli       dropbox client
+ * \param   path      created encoded path (NULL if unknown)
+ * \param   subtree   the path may have children (e.g. moved folder)
+ * \return  void
+ */
+static void drbForgetMissing(drbClient* cli, const char* path, bool subtree) {
+    if (cli->negativeCache && path)
+        drbNegativeCacheInvalidate(cli->negativeCache, path, subtree);
+}
+
+/*!
+ * \brief   Forget the missing paths of a delta entry with metadata.
+ * \param   cli      dropbox client
+ * \param   path     entry path (not encoded)
+ * \param   length   path length
+ * \return  void
+ */
+static void drbForgetEntryMissing(drbClient* cli, const char* path, size_t length) {
+    char* copy = strndup(path, length);
+    char* encoded = copy ? drbEncodePath(copy) : NULL;
+    drbForgetMissing(cli, encoded, false);
+    free(encoded);
+    free(copy);
+}
+
+/*!
+ * \brief   Forget the missing paths that the entries of a delta page create.
+ * \param   cli    dropbox client
+ * \param   root   delta page JSON root node (NULL for none)
+ * \return  void
+ */
+static void drbForgetDeltaMissing(drbClient* cli, json_t* root) {
+    json_t* entries = cli->negativeCache ? json_object_get(root, "entries") : NULL;
+    for (size_t i = 0; i < json_array_size(entries); i++) {
+        json_t* entry = json_array_get(entries, i);
+        const char* path = json_string_value(json_array_get(entry, 0));
+        if (path && json_is_object(json_array_get(entry, 1)))
+            drbForgetEntryMissing(cli, path, strlen(path));
+    }
+}
+
+/*!
+ * \brief   Forget the missing paths that the entries of a lazy delta create.
+ * \param   cli     dropbox client
+ * \param   delta   lazy delta (NULL for none)
+ * \return  void
+ */
+static void drbForgetLazyMissing(drbClient* cli, drbLazyList* delta) {
+    const char* path;
+    size_t length;
+    for (size_t i = 0; cli->negativeCache && i < drbLazySize(delta); i++)
+        if (drbLazyHasMetadata(delta, i) && drbLazyGetKey(delta, i, &path, &length))
+            drbForgetEntryMissing(cli, path, length);
+}
+
+/*!
+ * \struct  drbForgetVisit
+ * \breif   Delta visit forgetting the missing paths of the visited entries.
+ */
+typedef struct {
+    drbClient* cli;          /*!< Dropbox client. */
+    drbDeltaVisitor visitor; /*!< Caller visitor (NULL for none). */
+    void* data;              /*!< Caller visitor data. */
+} drbForgetVisit;
+
+/*!
+ * \brief   Forget the missing path of a visited delta entry, then visit it.
+ * \param   path   entry path
+ * \param   meta   entry metadata (NULL if the entry was deleted)
+ * \param   data   visit (drbForgetVisit*)
+ * \return  true (the caller visitor is dropped once it stops).
+ */
+static bool drbForgetVisitEntry(const char* path, const drbMetadata* meta, void* data) {
+    drbForgetVisit* visit = data;
+    if (meta && path)
+        drbForgetEntryMissing(visit->cli, path, strlen(path));
+    
+    // The remaining entries are still visited for their paths
+    if (visit->visitor && !visit->visitor(path, meta, visit->data))
+        visit->visitor = NULL;
+    return true;
+}
+
+/*!
+ * \brief   Set the output of a delta pager page from its JSON answer.
+ *
+ * The missing paths that the page entries create are forgotten.
+ *
+ * \param       cli       dropbox client
+ * \param       err       page request error code
+ * \param       root      page JSON root node
+ * \param       fields    DRBFIELD_XXX mask of the metadata fields to load
+ *                        (0 for all)
+ * \param[out]  output    page output (drbDelta* or error)
+ * \return  void
+ */
+static void drbSetPagerOutput(drbClient* cli, int err, json_t* root, unsigned int fields,
+                              void** output) {
+    if (!err)
+        drbForgetDeltaMissing(cli, root);
+    drbSetJsonFieldsOutput(err, root, (void*)drbBuildDelta, fields, output);
+}
+
+/*!
+ * \brief   Set the lazy output of a function from its raw answer.
+ * \param       err            function error code
+ * \param       raw            raw answer (freed or owned by the output)
+ * \param       drbBuildFct    handle the raw answer indexing
+ * \param[out]  output         structure to set with the indexing result
+ * \return  void
+ */
+static void drbSetLazyOutput(int err, char* raw, drbLazyList* (*drbBuildFct)(char* raw),
+                             void** output) {
+    if (output) {
+        if (err) {
+            if((*output = drbLocalError(err)) == NULL && raw)
+                *output = drbParseError(raw);
+            free(raw);
+        } else  *output = drbBuildFct(raw);
+    } else
+        free(raw);
+}
+
+/*!
+ * \brief   Get the value of a regular argument.
+ * \param   args   regular arguments list
+ * \param   name   argument name
+ * \return  argument value (NULL if not found or on failure), must be freed by
+ *          the caller.
+ */
+static char* drbGetArgValue(const char* args, const char* name) {
+    size_t length = strlen(name);
+    for (const char* arg = args; arg && (arg = strchr(arg, '&')) != NULL; ) {
+        arg++;
+        if (strncmp(arg, name, length) == 0 && arg[length] == '=')
+            return strndup(arg + length + 1, strcspn(arg + length + 1, "&"));
+    }
+    return NULL;
+}
+
 int drbSetDefault(drbClient* cli, ...) {
     va_list ap;
     va_start(ap, cli);
@@ -479,6 +711,60 @@ int drbSetDefault(drbClient* cli, ...) {
     return err;
 }
 
+void drbSetBufferPool(drbClient* cli, size_t maxCached) {
+    pthread_mutex_lock(&cli->poolLock);
+    if (maxCached < cli->pool.maxCached)
+        memPoolCleanup(&cli->pool);
+    cli->pool.maxCached = maxCached;
+    pthread_mutex_unlock(&cli->poolLock);
+}
+
+void drbGetBufferStats(drbClient* cli, drbBufferStats* stats) {
+    pthread_mutex_lock(&cli->poolLock);
+    stats->hits     = cli->pool.stats.hits;
+    stats->misses   = cli->pool.stats.misses;
+    stats->released = cli->pool.stats.released;
+    stats->dropped  = cli->pool.stats.dropped;
+    stats->cached   = cli->pool.stats.cached;
+    pthread_mutex_unlock(&cli->poolLock);
+}
+
+void drbSetSpillThreshold(drbClient* cli, size_t threshold) {
+    cli->spillThreshold = threshold;
+}
+
+bool drbSetMetadataCache(drbClient* cli, size_t maxEntries, const char* dir) {
+    drbMetadataCache* cache = NULL;
+    if (maxEntries && (cache = drbCreateMetadataCache(maxEntries, dir)) == NULL)
+        return false;
+    drbDestroyMetadataCache(cli->metadataCache);
+    cli->metadataCache = cache;
+    return true;
+}
+
+void drbGetMetadataCacheStats(drbClient* cli, drbMetadataCacheStats* stats) {
+    if (cli->metadataCache)
+        drbMetadataCacheGetStats(cli->metadataCache, stats);
+    else
+        memset(stats, 0, sizeof(drbMetadataCacheStats));
+}
+
+bool drbSetNegativeCache(drbClient* cli, size_t maxEntries, unsigned int ttl) {
+    drbNegativeCache* cache = NULL;
+    if (maxEntries && (cache = drbCreateNegativeCache(maxEntries, ttl)) == NULL)
+        return false;
+    drbDestroyNegativeCache(cli->negativeCache);
+    cli->negativeCache = cache;
+    return true;
+}
+
+void drbGetNegativeCacheStats(drbClient* cli, drbNegativeCacheStats* stats) {
+    if (cli->negativeCache)
+        drbNegativeCacheGetStats(cli->negativeCache, stats);
+    else
+        memset(stats, 0, sizeof(drbNegativeCacheStats));
+}
+
 void drbDestroyMetadata(drbMetadata* meta, bool withList) {
     if (meta) {
         free(meta->hash);
@@ -486,12 +772,14 @@ void drbDestroyMetadata(drbMetadata* meta, bool withList) {
         free(meta->thumbExists);
         free(meta->bytes);
         free(meta->modified);
+        free(meta->modifiedEpoch);
         free(meta->path);
         free(meta->isDir);
         free(meta->icon);
         free(meta->root);
         free(meta->size);
         free(meta->clientMtime);
+        free(meta->clientMtimeEpoch);
         free(meta->isDeleted);
         free(meta->mimeType);
         free(meta->revision);
@@ -566,6 +854,134 @@ void drbDestroyPollDelta(drbPollDelta* poll) {
     }
 }
 
+void drbDestroyArena(void* arena) {
+    free(arena); // Arena outputs are a single memory block
+}
+
+/*!
+ * \brief   Compact delta entries to their net changes, as drbCompactDelta.
+ *
+ * The compaction can't fail if the tables are reserved for all the entries
+ * (drbStrTableReserve).
+ *
+ * \param   delta     delta to compact (dropped entries are freed)
+ * \param   deleted   empty paths table of the deleted paths (freed)
+ * \param   changed   empty paths table of the changed paths (freed)
+ * \return  error code (DRBERR_XXX).
+ */
+static int drbCompactEntries(drbDelta* delta, drbStrTable* deleted, drbStrTable* changed) {
+    int err = DRBERR_OK;
+    drbDeltaEntry* entries = delta->entries.array;
+    bool added;
+    size_t hash;
+    
+    // From the last entry, drop the ones superseded by a later entry. Each path
+    // is hashed once, while its parent folders are checked.
+    for (size_t i = delta->entries.size; i-- > 0 && !err; ) {
+        drbDeltaEntry* entry = &entries[i];
+        if (!entry->path || drbPathTableCovers(deleted, entry->path, &hash)
+            || (entry->metadata && drbPathTableFind(changed, entry->path, hash, NULL))) {
+            drbDestroyMetadata(entry->metadata, true);
+            free(entry->path);
+            entry->path = NULL, entry->metadata = NULL;
+        } else if (!drbPathTableFind(entry->metadata ? changed : deleted, entry->path, hash,
+                                     &added))
+            err = DRBERR_MALLOC;
+    }
+    drbStrTableFree(deleted);
+    drbStrTableFree(changed);
+    
+    size_t size = 0;
+    for (size_t i = 0; i < delta->entries.size; i++)
+        if (entries[i].path)
+            entries[size++] = entries[i];
+    delta->entries.size = size;
+    return err;
+}
+
+int drbCompactDelta(drbDelta* delta) {
+    drbStrTable deleted = {NULL, 0, 0}, changed = {NULL, 0, 0};
+    return drbCompactEntries(delta, &deleted, &changed);
+}
+
+int drbMergeDelta(drbDelta* delta, drbDelta* next) {
+    bool reset = next->reset && *next->reset;
+    size_t kept = reset ? 0 : delta->entries.size;
+    size_t size = kept + next->entries.size;
+    
+    // All the memory is allocated before next is consumed
+    drbStrTable deleted = {NULL, 0, 0}, changed = {NULL, 0, 0};
+    drbDeltaEntry* entries = malloc((size ? size : 1) * sizeof(drbDeltaEntry));
+    if (!entries || !drbStrTableReserve(&deleted, size) || !drbStrTableReserve(&changed, size)) {
+        drbStrTableFree(&deleted);
+        drbStrTableFree(&changed);
+        free(entries);
+        return DRBERR_MALLOC;
+    }
+    
+    // Previous entries are meaningless once the delta is reset
+    for (size_t i = kept; i < delta->entries.size; i++) {
+        free(delta->entries.array[i].path);
+        drbDestroyMetadata(delta->entries.array[i].metadata, true);
+    }
+    if (reset) {
+        free(delta->reset);
+        delta->reset = next->reset, next->reset = NULL;
+    }
+    
+    if (kept)
+        memcpy(entries, delta->entries.array, kept * sizeof(drbDeltaEntry));
+    if (next->entries.size)
+        memcpy(entries + kept, next->entries.array, next->entries.size * sizeof(drbDeltaEntry));
+    free(delta->entries.array);
+    delta->entries.array = entries;
+    delta->entries.size = size;
+    
+    // Take the next page cursor, and free what remains of it
+    free(delta->cursor);
+    free(delta->hasMore);
+    delta->cursor = next->cursor, next->cursor = NULL;
+    delta->hasMore = next->hasMore, next->hasMore = NULL;
+    next->entries.size = 0;
+    drbDestroyDelta(next, true);
+    
+    return drbCompactEntries(delta, &deleted, &changed);
+}
+
+void drbDestroyMetadataTable(drbMetadataTable* table) {
+    free(table); // Columns and strings are in the table memory block
+}
+
+void drbDestroyDeltaTable(drbDeltaTable* delta) {
+    free(delta); // Columns and strings are in the delta memory block
+}
+
+const char* drbTableGetStr(const drbMetadataTable* table, const unsigned int* column, size_t row) {
+    return column && column[row] ? table->strings + column[row] : NULL;
+}
+
+void drbTableGetRow(const drbMetadataTable* table, size_t row, drbArenaMetadata* meta) {
+    unsigned char flags = table->flags ? table->flags[row] : 0;
+    meta->fields      = table->fields[row] & ~DRBFIELD_CONTENTS;
+    meta->bytes       = table->bytes ? table->bytes[row] : 0;
+    meta->revision    = table->revision ? table->revision[row] : 0;
+    meta->clientMtimeEpoch = table->clientMtimeEpoch ? table->clientMtimeEpoch[row] : DRBVAL_INVALID_TIME;
+    meta->modifiedEpoch    = table->modifiedEpoch ? table->modifiedEpoch[row] : DRBVAL_INVALID_TIME;
+    meta->isDir       = flags & DRBFLAG_IS_DIR;
+    meta->thumbExists = flags & DRBFLAG_THUMB_EXISTS;
+    meta->isDeleted   = flags & DRBFLAG_IS_DELETED;
+    meta->clientMtime = (char*)drbTableGetStr(table, table->clientMtime, row);
+    meta->icon        = (char*)drbTableGetStr(table, table->icon, row);
+    meta->mimeType    = (char*)drbTableGetStr(table, table->mimeType, row);
+    meta->modified    = (char*)drbTableGetStr(table, table->modified, row);
+    meta->path        = (char*)drbTableGetStr(table, table->path, row);
+    meta->rev         = (char*)drbTableGetStr(table, table->rev, row);
+    meta->root        = (char*)drbTableGetStr(table, table->root, row);
+    meta->size        = (char*)drbTableGetStr(table, table->size, row);
+    meta->hash        = (char*)drbTableGetStr(table, table->hash, row);
+    meta->contents    = NULL;
+}
+
 drbClient* drbCreateClient(const char* cKey, const char* cSecret, const char* tKey, const char* tSecret) {
     drbClient* cli = NULL;
     if (cKey && cSecret) {
@@ -577,6 +993,11 @@ drbClient* drbCreateClient(const char* cKey, const char* cSecret, const char* tK
             cli->t.secret = drbStrDup(tSecret);
             
             memset(cli->defaultOptions, 0, sizeof(drbOptArg) * DRBOPT_END);
+            memPoolInit(&cli->pool, DRB_POOL_MAX_CACHED);
+            pthread_mutex_init(&cli->poolLock, NULL);
+            cli->spillThreshold = DRB_SPILL_THRESHOLD;
+            cli->metadataCache = NULL;
+            cli->negativeCache = NULL;
         }
     }
     return cli;
@@ -598,6 +1019,10 @@ void drbDestroyClient(drbClient* cli) {
                 if (cli->defaultOptions[opt].ptr)
                     free(cli->defaultOptions[opt].ptr);
         }
+        drbDestroyMetadataCache(cli->metadataCache);
+        drbDestroyNegativeCache(cli->negativeCache);
+        memPoolCleanup(&cli->pool);
+        pthread_mutex_destroy(&cli->poolLock);
         free(cli);
     }
 }
@@ -613,7 +1038,7 @@ void drbCleanup() {
 drbOAuthToken* drbObtainRequestToken(drbClient* cli) {
     drbOAuthToken* token = NULL;
     char *tKey, *tSecret;
-    memStream answer; memStreamInit(&answer);
+    memStream answer; drbAcquireStream(cli, &answer, 0);
     drbOAuthPost(cli, DRBURI_REQUEST, &answer, memStreamWrite, 0);
     
     if (answer.data) {
@@ -622,8 +1047,8 @@ drbOAuthToken* drbObtainRequestToken(drbClient* cli) {
             free(cli->t.secret), cli->t.secret = tSecret;
             token = &cli->t;
         }
-        memStreamCleanup(&answer);
     }
+    drbReleaseStream(cli, &answer);
     
     return token;
 }
@@ -637,7 +1062,7 @@ char* drbBuildAuthorizeUrl(drbOAuthToken* reqTok) {
 drbOAuthToken* drbObtainAccessToken(drbClient* cli) {
     drbOAuthToken* token = NULL;
     char *tKey, *tSecret;
-    memStream answer; memStreamInit(&answer);
+    memStream answer; drbAcquireStream(cli, &answer, 0);
     drbOAuthPost(cli, DRBURI_ACCESS, &answer, memStreamWrite, 0);
     
     if (answer.data) {
@@ -646,8 +1071,8 @@ drbOAuthToken* drbObtainAccessToken(drbClient* cli) {
             free(cli->t.secret), cli->t.secret = tSecret;
             token = &cli->t;
         }
-        memStreamCleanup(&answer);
     }
+    drbReleaseStream(cli, &answer);
     
     return token;
 }
@@ -655,8 +1080,8 @@ drbOAuthToken* drbObtainAccessToken(drbClient* cli) {
 int drbGetAccountInfo(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[1]; memset(sArgs, 0, 1 * sizeof(drbOptArg));
-    memStream answer;   memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    json_t* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
@@ -667,15 +1092,16 @@ int drbGetAccountInfo(drbClient* cli, void** output, ...) {
         int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
         int res = asprintf(&url, "%s%s", DRBURI_ACCOUNT_INFO, args);
         if(res != -1) {
-            err = drbOAuthPost(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthPostStream(cli, url, output ? (drbLoadFct)drbLoadJson : NULL, NULL,
+                                     (void**)&answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
     }
     
-    drbSetOutput(err, answer.data, (void*)drbParseAccountInfo, output);
+    drbSetJsonOutput(err, answer, (void*)drbBuildAccountInfo, output);
     
-    memStreamCleanup(&answer);
+    json_decref(answer);
     free(args);
     
     return err;
@@ -684,28 +1110,75 @@ int drbGetAccountInfo(drbClient* cli, void** output, ...) {
 int drbGetMetadata(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[3]; memset(sArgs, 0, 3 * sizeof(drbOptArg));
-    memStream answer;   memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    json_t* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
     int err = drbGetOpt(cli, &ap, DRBSA_METADATA, DRBRA_METADATA, &args, specialHandler, sArgs);
     va_end(ap);
     
+    // A path recently not found is answered locally, unless its revisions or
+    // deleted entries are asked
+    bool negative = !err && cli->negativeCache && !strstr(args, "&rev=") &&
+                    !strstr(args, "&include_deleted=true");
+    bool missing = false;
+    char* error = NULL;
+    uint64_t generation = negative ? drbNegativeCacheGeneration(cli->negativeCache) : 0;
+    if (negative && (missing = drbNegativeCacheFind(cli->negativeCache, sArgs[DRBSHI_ROOT].str,
+                                                    sArgs[DRBSHI_PATH].str,
+                                                    output ? &error : NULL))) {
+        err = 404;
+        if (output)
+            *output = error;
+    }
+    
+    // Revalidate the cached listing with its hash, unless the caller gave one
+    char *key = NULL, *hash = NULL;
+    void* encoded = NULL; size_t size = 0;
+    bool cached = false;
+    if (!err && cli->metadataCache && output && !sArgs[DRBSHI_COLUMNAR].value &&
+        !sArgs[DRBSHI_ARENA].value && !strstr(args, "&hash=")) {
+        if (asprintf(&key, "%s%s?%s|%u", sArgs[DRBSHI_ROOT].str, sArgs[DRBSHI_PATH].str,
+                     args, sArgs[DRBSHI_FIELDS].value) == -1)
+            key = NULL;
+        else
+            cached = drbMetadataCacheFind(cli->metadataCache, key, &hash, &encoded, &size);
+    }
+    
     if (!err) {
         int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
-        int res = asprintf(&url, "%s/%s%s?%s", DRBURI_METADATA,
-                           sArgs[DRBSHI_ROOT].str, sArgs[DRBSHI_PATH].str, args);
+        int res = asprintf(&url, "%s/%s%s?%s%s%s", DRBURI_METADATA,
+                           sArgs[DRBSHI_ROOT].str, sArgs[DRBSHI_PATH].str, args,
+                           cached ? "&hash=" : "", cached ? hash : "");
         if (res != -1) {
-            err = drbOAuthGet(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthGetStream(cli, url, output ? (drbLoadFct)drbLoadJson : NULL, NULL,
+                                    (void**)&answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
     }
     
-    drbSetOutput(err, answer.data, (void*)drbParseMetadata, output);
+    if (cached && err == 304) {
+        err = (*output = drbDecodeMetadata(encoded, size)) ? DRBERR_OK : DRBERR_MALLOC;
+        if (!err)
+            drbMetadataCacheHit(cli->metadataCache);
+    } else if (!missing) {
+        void* build = sArgs[DRBSHI_COLUMNAR].value ? (void*)drbBuildItemTable
+                    : sArgs[DRBSHI_ARENA].value    ? (void*)drbBuildArenaMetadata
+                    :                                (void*)drbBuildMetadata;
+        drbSetJsonFieldsOutput(err, answer, build, sArgs[DRBSHI_FIELDS].value, output);
+        if (!err && key && *output)
+            drbMetadataCacheStore(cli->metadataCache, key,
+                                  json_string_value(json_object_get(answer, "hash")), *output);
+        if (err == 404 && negative)
+            drbNegativeCacheStore(cli->negativeCache, sArgs[DRBSHI_ROOT].str,
+                                  sArgs[DRBSHI_PATH].str, output ? *output : NULL,
+                                  generation);
+    }
     
-    memStreamCleanup(&answer);
+    json_decref(answer);
+    free(key), free(hash), free(encoded);
     free(args),  free(sArgs[DRBSHI_ROOT].str), free(sArgs[DRBSHI_PATH].str);
     return err;
 }
@@ -713,7 +1186,7 @@ int drbGetMetadata(drbClient* cli, void** output, ...) {
 int drbGetFile(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[5]; memset(sArgs, 0, 5 * sizeof(void*));
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
     char *answer = NULL;
     
     va_list ap;
@@ -727,7 +1200,7 @@ int drbGetFile(drbClient* cli, void** output, ...) {
                            sArgs[DRBSHI_ROOT].str, sArgs[DRBSHI_PATH].str, args);
         if (res != -1) {
             err = drbOAuthGetFile(cli, url, sArgs[DRBSHI_IO_DATA].ptr,
-                                  sArgs[DRBSHI_IO_FUNC].ptr,
+                                  sArgs[DRBSHI_IO_FUNC].ptr, sArgs[DRBSHI_DIGEST].ptr,
                                   output ? &answer : NULL, timeout);
             free(url);
         } else
@@ -744,26 +1217,35 @@ int drbGetFile(drbClient* cli, void** output, ...) {
 int drbGetRevisions(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[3]; memset(sArgs, 0, 3 * sizeof(void*));
-    memStream answer;   memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    void* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
     int err = drbGetOpt(cli, &ap, DRBSA_REVISIONS, DRBRA_REVISIONS, &args, specialHandler, sArgs);
     va_end(ap);
     
+    bool lazy = sArgs[DRBSHI_LAZY].value;
+    drbLoadFct load = lazy ? (drbLoadFct)drbLoadLazy : (drbLoadFct)drbLoadJson;
     if (!err) {
         int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
         int res = asprintf(&url,"%s/%s%s%s", DRBURI_REVISIONS,
                            sArgs[DRBSHI_ROOT].str, sArgs[DRBSHI_PATH].str, args);
         if (res != -1) {
-            err = drbOAuthGet(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthGetStream(cli, url, output ? load : NULL, NULL, &answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
     }
-    drbSetOutput(err, answer.data, (void*)drbStrParseMetadataList, output);
-    memStreamCleanup(&answer);
+    if (lazy) {
+        drbSetLazyOutput(err, answer, drbBuildLazyList, output);
+    } else {
+        void* build = sArgs[DRBSHI_COLUMNAR].value ? (void*)drbBuildMetadataTable
+                    : sArgs[DRBSHI_ARENA].value    ? (void*)drbBuildArenaMetadataList
+                    :                                (void*)drbBuildMetadataList;
+        drbSetJsonFieldsOutput(err, answer, build, sArgs[DRBSHI_FIELDS].value, output);
+        json_decref(answer);
+    }
     free(args),  free(sArgs[DRBSHI_ROOT].str), free(sArgs[DRBSHI_PATH].str);
     return err;
 }
@@ -771,27 +1253,35 @@ int drbGetRevisions(drbClient* cli, void** output, ...) {
 int drbSearch(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[3]; memset(sArgs, 0, 3 * sizeof(void*));
-    memStream answer;   memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    void* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
     int err = drbGetOpt(cli, &ap, DRBSA_SEARCH, DRBRA_SEARCH, &args, specialHandler, sArgs);
     va_end(ap);
     
+    bool lazy = sArgs[DRBSHI_LAZY].value;
+    drbLoadFct load = lazy ? (drbLoadFct)drbLoadLazy : (drbLoadFct)drbLoadJson;
     if (!err) {
         int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
         int res = asprintf(&url,"%s/%s%s%s", DRBURI_SEARCH,
                            sArgs[DRBSHI_ROOT].str, sArgs[DRBSHI_PATH].str, args);
         if (res != -1) {
-            err = drbOAuthGet(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthGetStream(cli, url, output ? load : NULL, NULL, &answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
     }
-    drbSetOutput(err, answer.data, (void*)drbStrParseMetadataList, output);
-    
-    memStreamCleanup(&answer);
+    if (lazy) {
+        drbSetLazyOutput(err, answer, drbBuildLazyList, output);
+    } else {
+        void* build = sArgs[DRBSHI_COLUMNAR].value ? (void*)drbBuildMetadataTable
+                    : sArgs[DRBSHI_ARENA].value    ? (void*)drbBuildArenaMetadataList
+                    :                                (void*)drbBuildMetadataList;
+        drbSetJsonFieldsOutput(err, answer, build, sArgs[DRBSHI_FIELDS].value, output);
+        json_decref(answer);
+    }
     free(args),  free(sArgs[DRBSHI_ROOT].str), free(sArgs[DRBSHI_PATH].str);
     return err;
 }
@@ -800,7 +1290,7 @@ int drbGetThumbnail(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
     char *answer = NULL;
-    drbOptArg sArgs[5]; memset(sArgs, 0, 5 * sizeof(void*));
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
     
     
     va_list ap;
@@ -814,7 +1304,7 @@ int drbGetThumbnail(drbClient* cli, void** output, ...) {
         if (res != -1) {
             int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
             err = drbOAuthGetFile(cli, url, sArgs[DRBSHI_IO_DATA].ptr,
-                                  sArgs[DRBSHI_IO_FUNC].ptr,
+                                  sArgs[DRBSHI_IO_FUNC].ptr, sArgs[DRBSHI_DIGEST].ptr,
                                   output ? &answer : NULL, timeout);
             free(url);
         } else
@@ -832,8 +1322,8 @@ int drbGetThumbnail(drbClient* cli, void** output, ...) {
 int drbCopy(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[1]; memset(sArgs, 0, 1 * sizeof(void*));
-    memStream answer;   memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    json_t* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
@@ -844,13 +1334,18 @@ int drbCopy(drbClient* cli, void** output, ...) {
         int res = asprintf(&url,"%s%s", DRBURI_COPY, args);
         if (res != -1) {
             int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
-            err = drbOAuthPost(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthPostStream(cli, url, output ? (drbLoadFct)drbLoadJson : NULL, NULL,
+                                     (void**)&answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
+        
+        char* toPath = drbGetArgValue(args, "to_path");
+        drbForgetMissing(cli, toPath, true);
+        free(toPath);
     }
-    drbSetOutput(err, answer.data, (void*)drbParseMetadata, output);
-    memStreamCleanup(&answer);
+    drbSetJsonFieldsOutput(err, answer, (void*)drbBuildMetadata, DRBFIELD_ALL, output);
+    json_decref(answer);
     free(args);
     return err;
 }
@@ -858,8 +1353,8 @@ int drbCopy(drbClient* cli, void** output, ...) {
 int drbCreateFolder(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[1]; memset(sArgs, 0, 1 * sizeof(void*));
-    memStream answer;   memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    json_t* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
@@ -871,14 +1366,19 @@ int drbCreateFolder(drbClient* cli, void** output, ...) {
         int res = asprintf(&url,"%s%s", DRBURI_CREATE_FOLDER, args);
         if (res != -1) {
             int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
-            err = drbOAuthPost(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthPostStream(cli, url, output ? (drbLoadFct)drbLoadJson : NULL, NULL,
+                                     (void**)&answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
+        
+        char* path = drbGetArgValue(args, "path");
+        drbForgetMissing(cli, path, false);
+        free(path);
     }
     
-    drbSetOutput(err, answer.data, (void*)drbParseMetadata, output);
-    memStreamCleanup(&answer);
+    drbSetJsonFieldsOutput(err, answer, (void*)drbBuildMetadata, DRBFIELD_ALL, output);
+    json_decref(answer);
     free(args);
     return err;
 }
@@ -886,8 +1386,8 @@ int drbCreateFolder(drbClient* cli, void** output, ...) {
 int drbDelete(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[1]; memset(sArgs, 0, 1 * sizeof(void*));
-    memStream answer;   memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    json_t* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
@@ -898,14 +1398,15 @@ int drbDelete(drbClient* cli, void** output, ...) {
         int res = asprintf(&url,"%s%s", DRBURI_DELETE, args);
         if (res != -1) {
             int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
-            err = drbOAuthPost(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthPostStream(cli, url, output ? (drbLoadFct)drbLoadJson : NULL, NULL,
+                                     (void**)&answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
-        
+    
     }
-    drbSetOutput(err, answer.data, (void*)drbParseMetadata, output);
-    memStreamCleanup(&answer);
+    drbSetJsonFieldsOutput(err, answer, (void*)drbBuildMetadata, DRBFIELD_ALL, output);
+    json_decref(answer);
     free(args);
     return err;
 }
@@ -913,8 +1414,8 @@ int drbDelete(drbClient* cli, void** output, ...) {
 int drbMove(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[1]; memset(sArgs, 0, 1 * sizeof(void*));
-    memStream answer;   memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    json_t* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
@@ -925,13 +1426,18 @@ int drbMove(drbClient* cli, void** output, ...) {
         int res = asprintf(&url,"%s%s", DRBURI_MOVE, args);
         if (res != -1) {
             int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
-            err = drbOAuthPost(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthPostStream(cli, url, output ? (drbLoadFct)drbLoadJson : NULL, NULL,
+                                     (void**)&answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
+        
+        char* toPath = drbGetArgValue(args, "to_path");
+        drbForgetMissing(cli, toPath, true);
+        free(toPath);
     }
-    drbSetOutput(err, answer.data, (void*)drbParseMetadata, output);
-    memStreamCleanup(&answer);
+    drbSetJsonFieldsOutput(err, answer, (void*)drbBuildMetadata, DRBFIELD_ALL, output);
+    json_decref(answer);
     free(args);
     return err;
 }
@@ -939,35 +1445,138 @@ int drbMove(drbClient* cli, void** output, ...) {
 int drbGetDelta(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[1]; memset(sArgs, 0, 1 * sizeof(void*));
-    memStream answer;   memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    void* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
     int err = drbGetOpt(cli, &ap, DRBSA_DELTA, DRBRA_DELTA, &args, specialHandler, sArgs);
     va_end(ap);
     
+    bool lazy = sArgs[DRBSHI_LAZY].value;
+    drbLoadFct load = lazy ? (drbLoadFct)drbLoadLazy : (drbLoadFct)drbLoadJson;
     if (!err) {
         int res = asprintf(&url,"%s?%s", DRBURI_DELTA, args);
         if (res != -1) {
             int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
-            err = drbOAuthPost(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthPostStream(cli, url, output ? load : NULL, NULL, &answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
     }
     
-    drbSetOutput(err, answer.data, (void*)drbParseDelta, output);
-    memStreamCleanup(&answer);
+    // The paths of the entries with metadata exist (again)
+    if (lazy) {
+        drbSetLazyOutput(err, answer, drbBuildLazyDelta, output);
+        if (!err && output)
+            drbForgetLazyMissing(cli, *output);
+    } else {
+        if (!err)
+            drbForgetDeltaMissing(cli, answer);
+        void* build = sArgs[DRBSHI_COLUMNAR].value ? (void*)drbBuildDeltaTable
+                    : sArgs[DRBSHI_ARENA].value    ? (void*)drbBuildArenaDelta
+                    :                                (void*)drbBuildDelta;
+        drbSetJsonFieldsOutput(err, answer, build, sArgs[DRBSHI_FIELDS].value, output);
+        json_decref(answer);
+    }
     free(args);
     return err;
 }
 
+int drbVisitDelta(drbClient* cli, void** output, drbDeltaVisitor visitor, void* data, ...) {
+    char *args = NULL;
+    char *url = NULL;
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    json_t* answer = NULL;
+    
+    va_list ap;
+    va_start(ap, data);
+    int err = drbGetOpt(cli, &ap, DRBSA_VISIT_DELTA, DRBRA_DELTA, &args, specialHandler, sArgs);
+    va_end(ap);
+    
+    unsigned int fields = sArgs[DRBSHI_FIELDS].value ? sArgs[DRBSHI_FIELDS].value : DRBFIELD_ALL;
+    drbForgetVisit forget = {cli, visitor, data};
+    drbJsonVisit visit = {visitor, data, fields};
+    if (cli->negativeCache)
+        visit = (drbJsonVisit){drbForgetVisitEntry, &forget, fields};
+    if (!err) {
+        int res = asprintf(&url,"%s?%s", DRBURI_DELTA, args);
+        if (res != -1) {
+            int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
+            err = drbOAuthPostStream(cli, url, (drbLoadFct)drbLoadDeltaVisit, &visit,
+                                     (void**)&answer, timeout);
+            free(url);
+        } else
+            err = DRBERR_MALLOC;
+    }
+    drbSetJsonFieldsOutput(err, answer, (void*)drbBuildDelta, fields, output);
+    json_decref(answer);
+    free(args);
+    return err;
+}
+
+int drbCreateDeltaPager(drbClient* cli, void** output, ...) {
+    char *args = NULL;
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    drbDeltaPager* pager = NULL;
+    
+    va_list ap;
+    va_start(ap, output);
+    int err = drbGetOpt(cli, &ap, DRBSA_DELTA_PAGER, DRBRA_DELTA_PAGER, &args, specialHandler, sArgs);
+    va_end(ap);
+    
+    if (!err) {
+        int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
+        pager = drbCreatePager(cli, DRBURI_DELTA, args, sArgs[DRBSHI_CURSOR].str,
+                               sArgs[DRBSHI_FIELDS].value, timeout, drbSetPagerOutput);
+        if (pager == NULL)
+            err = DRBERR_MALLOC;
+    }
+    if (output)
+        *output = err ? (void*)drbLocalError(err) : pager;
+    else
+        drbDestroyDeltaPager(pager);
+    free(args), free(sArgs[DRBSHI_CURSOR].str);
+    return err;
+}
+
+int drbMirrorUpdate(drbClient* cli, drbMirror* mirror, void** output) {
+    char* cursor = drbMirrorGetCursor(mirror);
+    void* pager = NULL;
+    int err = drbCreateDeltaPager(cli, &pager, DRBOPT_CURSOR, cursor, DRBOPT_END);
+    free(cursor);
+    if (err) {
+        if (output)
+            *output = pager; // Error of the pager creation
+        else
+            free(pager);
+        return err;
+    }
+    
+    void* page = NULL;
+    while ((err = drbDeltaPagerNext(pager, &page)) == DRBERR_OK && page) {
+        err = drbMirrorApply(mirror, page);
+        drbDestroyDelta(page, true);
+        page = NULL;
+        if (err) {
+            page = drbLocalError(err);
+            break;
+        }
+    }
+    drbDestroyDeltaPager(pager);
+    
+    if (output)
+        *output = page;
+    else
+        free(page);
+    return err;
+}
+
 int drbRestore(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[3]; memset(sArgs, 0, 3 * sizeof(void*));
-    memStream answer;   memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    json_t* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
@@ -978,13 +1587,15 @@ int drbRestore(drbClient* cli, void** output, ...) {
         int res = asprintf(&url,"%s/%s%s%s", DRBURI_RESTORE, sArgs[DRBSHI_ROOT].str, sArgs[DRBSHI_PATH].str, args);
         if (res != -1) {
             int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
-            err = drbOAuthPost(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthPostStream(cli, url, output ? (drbLoadFct)drbLoadJson : NULL, NULL,
+                                     (void**)&answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
+        drbForgetMissing(cli, sArgs[DRBSHI_PATH].str, false);
     }
-    drbSetOutput(err, answer.data, (void*)drbParseMetadata, output);
-    memStreamCleanup(&answer);
+    drbSetJsonFieldsOutput(err, answer, (void*)drbBuildMetadata, DRBFIELD_ALL, output);
+    json_decref(answer);
     free(args),  free(sArgs[DRBSHI_ROOT].str), free(sArgs[DRBSHI_PATH].str);
     return err;
 }
@@ -992,8 +1603,8 @@ int drbRestore(drbClient* cli, void** output, ...) {
 int drbShare(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[3];   memset(sArgs, 0, 3 * sizeof(void*));
-    memStream answer; memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    json_t* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
@@ -1005,13 +1616,14 @@ int drbShare(drbClient* cli, void** output, ...) {
                            sArgs[DRBSHI_ROOT].str, sArgs[DRBSHI_PATH].str, args);
         if (res != -1) {
             int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
-            err = drbOAuthPost(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthPostStream(cli, url, output ? (drbLoadFct)drbLoadJson : NULL, NULL,
+                                     (void**)&answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
     }
-    drbSetOutput(err, answer.data, (void*)drbParseLink, output);
-    memStreamCleanup(&answer);
+    drbSetJsonOutput(err, answer, (void*)drbBuildLink, output);
+    json_decref(answer);
     free(args),  free(sArgs[DRBSHI_ROOT].str), free(sArgs[DRBSHI_PATH].str);
     return err;
 }
@@ -1019,8 +1631,8 @@ int drbShare(drbClient* cli, void** output, ...) {
 int drbGetMedia(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[3];   memset(sArgs, 0, 3 * sizeof(void*));
-    memStream answer; memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    json_t* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
@@ -1032,13 +1644,14 @@ int drbGetMedia(drbClient* cli, void** output, ...) {
                            sArgs[DRBSHI_ROOT].str, sArgs[DRBSHI_PATH].str, args);
         if (res != -1) {
             int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
-            err = drbOAuthPost(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthPostStream(cli, url, output ? (drbLoadFct)drbLoadJson : NULL, NULL,
+                                     (void**)&answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
     }
-    drbSetOutput(err, answer.data, (void*)drbParseLink, output);
-    memStreamCleanup(&answer);
+    drbSetJsonOutput(err, answer, (void*)drbBuildLink, output);
+    json_decref(answer);
     free(args),  free(sArgs[DRBSHI_ROOT].str), free(sArgs[DRBSHI_PATH].str);
     return err;
 }
@@ -1046,8 +1659,8 @@ int drbGetMedia(drbClient* cli, void** output, ...) {
 int drbGetCopyRef(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[3];   memset(sArgs, 0, 3 * sizeof(void*));
-    memStream answer; memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    json_t* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
@@ -1059,13 +1672,14 @@ int drbGetCopyRef(drbClient* cli, void** output, ...) {
                            sArgs[DRBSHI_ROOT].str, sArgs[DRBSHI_PATH].str, args);
         if (res != -1) {
             int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
-            err = drbOAuthGet(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthGetStream(cli, url, output ? (drbLoadFct)drbLoadJson : NULL, NULL,
+                                    (void**)&answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
     }
-    drbSetOutput(err, answer.data, (void*)drbParseCopyRef, output);
-    memStreamCleanup(&answer);
+    drbSetJsonOutput(err, answer, (void*)drbBuildCopyRef, output);
+    json_decref(answer);
     free(args),  free(sArgs[DRBSHI_ROOT].str), free(sArgs[DRBSHI_PATH].str);
     return err;  
 }
@@ -1073,7 +1687,7 @@ int drbGetCopyRef(drbClient* cli, void** output, ...) {
 int drbPutFile(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[5]; memset(sArgs, 0, 5 * sizeof(void*));
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
     char *answer = NULL;
     
     va_list ap;
@@ -1087,11 +1701,12 @@ int drbPutFile(drbClient* cli, void** output, ...) {
         if (res != -1) {      
             int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
             err = drbOAuthPostFile(cli, url, sArgs[DRBSHI_IO_DATA].ptr,
-                                   sArgs[DRBSHI_IO_FUNC].ptr,
+                                   sArgs[DRBSHI_IO_FUNC].ptr, sArgs[DRBSHI_DIGEST].ptr,
                                    output ? &answer : NULL, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
+        drbForgetMissing(cli, sArgs[DRBSHI_PATH].str, false);
     }
     drbSetOutput(err, answer, (void*)drbParseMetadata, output);
     free(answer);
@@ -1102,8 +1717,8 @@ int drbPutFile(drbClient* cli, void** output, ...) {
 int drbLongPollDelta(drbClient* cli, void** output, ...) {
     char *args = NULL;
     char *url = NULL;
-    drbOptArg sArgs[1];   memset(sArgs, 0, 1 * sizeof(void*));
-    memStream answer; memStreamInit(&answer);
+    drbOptArg sArgs[DRBSHI_END]; memset(sArgs, 0, sizeof(sArgs));
+    json_t* answer = NULL;
     
     va_list ap;
     va_start(ap, output);
@@ -1114,14 +1729,15 @@ int drbLongPollDelta(drbClient* cli, void** output, ...) {
         int res = asprintf(&url,"%s?%s", DRBURI_LONGPOLL_DELTA, args+1);
         if (res != -1) {
             int timeout = sArgs[DRBSHI_NETWORK_TIMEOUT].value;
-            err = drbOAuthGet(cli, url, &answer, output ? memStreamWrite : NULL, timeout);
+            err = drbOAuthGetStream(cli, url, output ? (drbLoadFct)drbLoadJson : NULL, NULL,
+                                    (void**)&answer, timeout);
             free(url);
         } else
             err = DRBERR_MALLOC;
     }
     
-    drbSetOutput(err, answer.data, (void*)drbParsePollDelta, output);
-    memStreamCleanup(&answer);
+    drbSetJsonOutput(err, answer, (void*)drbBuildPollDelta, output);
+    json_decref(answer);
     free(args);
     return err;
 }
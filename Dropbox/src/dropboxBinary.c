@@ -0,0 +1,568 @@
+/*!
+ * \file    dropboxBinary.c
+ * \brief   Compact binary encoding of the dropbox library structures.
+ *
+ * An encoded buffer starts with a header (magic, version, kind, size and root
+ * record offset), followed by the records aligned on 8 bytes and their
+ * strings. Records only reference each other with offsets relative to
+ * themselves, so the buffer can be stored, sent or mapped anywhere and read
+ * in place. The records referenced by a record (contents, entries metadata)
+ * always follow it, in the order of their references, so that no record is
+ * referenced twice and a buffer is checked in linear time. Strings of the
+ * fields with few distinct values are shared.
+ *
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#define _GNU_SOURCE
+
+#define BIN_ALIGN     8
+#define BIN_MAX_DEPTH 8
+#define BIN_MAX_SIZE  INT32_MAX
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "dropbox.h"
+#include "dropboxUtils.h"
+
+/*!
+ * \struct  drbBinHeader
+ * \breif   Header of an encoded buffer.
+ */
+typedef struct {
+    uint32_t magic;   /*!< DRBBIN_MAGIC (also checks the byte order). */
+    uint16_t version; /*!< DRBBIN_VERSION. */
+    uint16_t kind;    /*!< DRBBIN_XXX kind of the root record. */
+    uint32_t size;    /*!< Encoded size. */
+    uint32_t root;    /*!< Root record offset from the buffer start. */
+} drbBinHeader;
+
+/*!
+ * \struct  drbBinBounds
+ * \breif   Encoded buffer being checked.
+ */
+typedef struct {
+    const char* base; /*!< Buffer start. */
+    size_t size;      /*!< Encoded size. */
+    size_t next;      /*!< First position of the next referenced record. */
+} drbBinBounds;
+
+static void drbBinEncodeMetadataTo(drbArena* arena, const drbMetadata* meta, drbBinMetadata* bin);
+static bool drbBinCheckMetadata(drbBinBounds* bounds, const drbBinMetadata* meta, int depth);
+static drbMetadata* drbBinDecodeMetadata(const drbBinMetadata* bin);
+
+/*!
+ * \brief   Allocate a record in an arena, aligned on BIN_ALIGN.
+ * \param   arena   arena to allocate from
+ * \param   size    record size
+ * \return  allocated record (NULL while the arena measures)
+ */
+static void* drbBinAlloc(drbArena* arena, size_t size) {
+    arena->used = (arena->used + BIN_ALIGN - 1) & ~(size_t)(BIN_ALIGN - 1);
+    return drbArenaAlloc(arena, size);
+}
+
+/*!
+ * \brief   Compute the offset of a target relative to a record.
+ * \param   record   record holding the offset
+ * \param   target   referenced target (could be NULL)
+ * \return  target offset (0 if target is NULL).
+ */
+static int32_t drbBinOffset(const void* record, const void* target) {
+    return target ? (int32_t)((const char*)target - (const char*)record) : 0;
+}
+
+/*!
+ * \brief   Encode a string in an arena.
+ * \param   arena    arena where the string is copied
+ * \param   record   record holding the string offset
+ * \param   str      string to encode (could be NULL)
+ * \param   intern   share the copy with the equal strings
+ * \return  string offset (0 if str is NULL or while the arena measures).
+ */
+static int32_t drbBinEncodeStr(drbArena* arena, const void* record, const char* str, bool intern) {
+    if (!str)
+        return 0;
+    return drbBinOffset(record, intern ? drbArenaStrIntern(arena, str) : drbArenaStrDup(arena, str));
+}
+
+/*!
+ * \brief   Get the depth of a metadata list (1 for a list without contents).
+ * \param   list   metadata list
+ * \return  list depth (0 if list is NULL).
+ */
+static int drbBinListDepth(const drbMetadataList* list) {
+    int depth = 0;
+    for (size_t i = 0; list && i < list->size; i++) {
+        int contents = list->array[i] ? drbBinListDepth(list->array[i]->contents) : 0;
+        if (contents > depth)
+            depth = contents;
+    }
+    return list ? depth + 1 : 0;
+}
+
+/*!
+ * \brief   Encode a metadata list in an arena.
+ * \param   arena   arena where the list is encoded
+ * \param   list    metadata list to encode
+ * \return  encoded list (NULL while the arena measures)
+ */
+static drbBinMetadataList* drbBinEncodeList(drbArena* arena, const drbMetadataList* list) {
+    drbBinMetadataList* bin = drbBinAlloc(arena, sizeof(drbBinMetadataList) +
+                                          sizeof(drbBinMetadata) * list->size);
+    
+    // While measuring, entries are encoded in a dummy record
+    drbBinMetadata dummy;
+    for (size_t i = 0; i < list->size; i++) {
+        drbMetadata empty = {0}, *meta = list->array[i] ? list->array[i] : &empty;
+        drbBinEncodeMetadataTo(arena, meta, bin ? &bin->array[i] : &dummy);
+    }
+    
+    if (bin) {
+        bin->size = (uint32_t)list->size;
+        bin->reserved = 0;
+    }
+    return bin;
+}
+
+/*!
+ * \brief   Encode a metadata in an arena.
+ * \param   arena   arena where the metadata strings and contents are encoded
+ * \param   meta    metadata to encode
+ * \param   bin     record to load with the metadata
+ * \return  void
+ */
+static void drbBinEncodeMetadataTo(drbArena* arena, const drbMetadata* meta, drbBinMetadata* bin) {
+    memset(bin, 0, sizeof(drbBinMetadata));
+    bin->fields |= meta->bytes       ? DRBFIELD_BYTES        : 0;
+    bin->fields |= meta->clientMtime ? DRBFIELD_CLIENT_MTIME : 0;
+    bin->fields |= meta->icon        ? DRBFIELD_ICON         : 0;
+    bin->fields |= meta->isDir       ? DRBFIELD_IS_DIR       : 0;
+    bin->fields |= meta->mimeType    ? DRBFIELD_MIME_TYPE    : 0;
+    bin->fields |= meta->modified    ? DRBFIELD_MODIFIED     : 0;
+    bin->fields |= meta->path        ? DRBFIELD_PATH         : 0;
+    bin->fields |= meta->rev         ? DRBFIELD_REV          : 0;
+    bin->fields |= meta->revision    ? DRBFIELD_REVISION     : 0;
+    bin->fields |= meta->root        ? DRBFIELD_ROOT         : 0;
+    bin->fields |= meta->size        ? DRBFIELD_SIZE         : 0;
+    bin->fields |= meta->thumbExists ? DRBFIELD_THUMB_EXISTS : 0;
+    bin->fields |= meta->isDeleted   ? DRBFIELD_IS_DELETED   : 0;
+    bin->fields |= meta->hash        ? DRBFIELD_HASH         : 0;
+    bin->fields |= meta->contents    ? DRBFIELD_CONTENTS     : 0;
+    
+    bin->flags |= meta->isDir       && *meta->isDir       ? DRBFLAG_IS_DIR       : 0;
+    bin->flags |= meta->thumbExists && *meta->thumbExists ? DRBFLAG_THUMB_EXISTS : 0;
+    bin->flags |= meta->isDeleted   && *meta->isDeleted   ? DRBFLAG_IS_DELETED   : 0;
+    
+    bin->bytes            = meta->bytes            ? *meta->bytes            : 0;
+    bin->revision         = meta->revision         ? *meta->revision         : 0;
+    bin->clientMtimeEpoch = meta->clientMtimeEpoch ? *meta->clientMtimeEpoch : DRBVAL_INVALID_TIME;
+    bin->modifiedEpoch    = meta->modifiedEpoch    ? *meta->modifiedEpoch    : DRBVAL_INVALID_TIME;
+    
+    bin->clientMtime = drbBinEncodeStr(arena, bin, meta->clientMtime, false);
+    bin->icon        = drbBinEncodeStr(arena, bin, meta->icon,        true);
+    bin->mimeType    = drbBinEncodeStr(arena, bin, meta->mimeType,    true);
+    bin->modified    = drbBinEncodeStr(arena, bin, meta->modified,    false);
+    bin->path        = drbBinEncodeStr(arena, bin, meta->path,        false);
+    bin->rev         = drbBinEncodeStr(arena, bin, meta->rev,         false);
+    bin->root        = drbBinEncodeStr(arena, bin, meta->root,        true);
+    bin->size        = drbBinEncodeStr(arena, bin, meta->size,        true);
+    bin->hash        = drbBinEncodeStr(arena, bin, meta->hash,        false);
+    
+    if (meta->contents)
+        bin->contents = drbBinOffset(bin, drbBinEncodeList(arena, meta->contents));
+}
+
+/*!
+ * Encode a root metadata (drbBinEncode callback).
+ */
+static void* drbBinEncodeRootMetadata(const drbMetadata* meta, drbArena* arena) {
+    drbBinMetadata dummy, *bin = drbBinAlloc(arena, sizeof(drbBinMetadata));
+    drbBinEncodeMetadataTo(arena, meta, bin ? bin : &dummy);
+    return bin;
+}
+
+/*!
+ * Encode a root metadata list (drbBinEncode callback).
+ */
+static void* drbBinEncodeRootList(const drbMetadataList* list, drbArena* arena) {
+    return drbBinEncodeList(arena, list);
+}
+
+/*!
+ * Encode a root delta (drbBinEncode callback).
+ */
+static void* drbBinEncodeRootDelta(const drbDelta* delta, drbArena* arena) {
+    size_t size = delta->entries.size;
+    drbBinDelta dummy, *bin = drbBinAlloc(arena, sizeof(drbBinDelta) + sizeof(drbBinDeltaEntry) * size);
+    drbBinDelta* record = bin ? bin : &dummy;
+    
+    memset(record, 0, sizeof(drbBinDelta));
+    record->fields |= delta->reset   ? DRBFIELD_RESET    : 0;
+    record->fields |= delta->cursor  ? DRBFIELD_CURSOR   : 0;
+    record->fields |= delta->hasMore ? DRBFIELD_HAS_MORE : 0;
+    record->flags  |= delta->reset   && *delta->reset   ? DRBFLAG_RESET    : 0;
+    record->flags  |= delta->hasMore && *delta->hasMore ? DRBFLAG_HAS_MORE : 0;
+    record->cursor = drbBinEncodeStr(arena, record, delta->cursor, false);
+    record->size = (uint32_t)size;
+    
+    // The entries metadata follow the entries array
+    drbBinDeltaEntry dummyEntry;
+    drbBinMetadata dummyMeta;
+    for (size_t i = 0; i < size; i++) {
+        drbBinDeltaEntry* entry = bin ? &bin->entries[i] : &dummyEntry;
+        const drbDeltaEntry* src = &delta->entries.array[i];
+        
+        entry->path = drbBinEncodeStr(arena, entry, src->path, false);
+        entry->metadata = 0;
+        if (src->metadata) {
+            drbBinMetadata* meta = drbBinAlloc(arena, sizeof(drbBinMetadata));
+            drbBinEncodeMetadataTo(arena, src->metadata, meta ? meta : &dummyMeta);
+            entry->metadata = drbBinOffset(entry, meta);
+        }
+    }
+    return bin;
+}
+
+/*!
+ * \brief   Encode a structure in a single buffer.
+ *
+ * As drbJsonArenaBuild, the encode function is called twice: first to measure
+ * the needed memory, then to encode the structure in the exactly sized
+ * buffer, after its header.
+ *
+ * \param       src      structure to encode
+ * \param       kind     DRBBIN_XXX kind of the structure
+ * \param       encode   function encoding the structure in an arena
+ * \param[out]  size     encoded size
+ * \return  encoded buffer (NULL on failure)
+ */
+static void* drbBinEncode(const void* src, int kind, void* (*encode)(const void*, drbArena*),
+                          size_t* size) {
+    void* encoded = NULL;
+    drbStrTable strings = {NULL, 0, 0};
+    drbArena arena = {NULL, 0, 0, &strings};
+    
+    drbBinAlloc(&arena, sizeof(drbBinHeader));
+    encode(src, &arena);
+    if (arena.used <= BIN_MAX_SIZE && (arena.base = calloc(1, arena.used)) != NULL) {
+        arena.size = arena.used;
+        arena.used = 0;
+        drbStrTableClear(&strings);
+        
+        drbBinHeader* header = drbBinAlloc(&arena, sizeof(drbBinHeader));
+        header->magic = DRBBIN_MAGIC;
+        header->version = DRBBIN_VERSION;
+        header->kind = kind;
+        header->size = (uint32_t)arena.size;
+        header->root = (uint32_t)((char*)encode(src, &arena) - arena.base);
+        
+        encoded = arena.base;
+        if (size)
+            *size = arena.size;
+    }
+    drbStrTableFree(&strings);
+    return encoded;
+}
+
+void* drbEncodeMetadata(const drbMetadata* meta, size_t* size) {
+    drbMetadataList root = {(drbMetadata**)&meta, 1};
+    if (!meta || drbBinListDepth(&root) > BIN_MAX_DEPTH)
+        return NULL;
+    return drbBinEncode(meta, DRBBIN_METADATA, (void*)drbBinEncodeRootMetadata, size);
+}
+
+void* drbEncodeMetadataList(const drbMetadataList* list, size_t* size) {
+    if (!list || drbBinListDepth(list) > BIN_MAX_DEPTH)
+        return NULL;
+    return drbBinEncode(list, DRBBIN_METADATA_LIST, (void*)drbBinEncodeRootList, size);
+}
+
+void* drbEncodeDelta(const drbDelta* delta, size_t* size) {
+    if (!delta)
+        return NULL;
+    for (size_t i = 0; i < delta->entries.size; i++) {
+        drbMetadataList entry = {&delta->entries.array[i].metadata, 1};
+        if (entry.array[0] && drbBinListDepth(&entry) > BIN_MAX_DEPTH)
+            return NULL;
+    }
+    return drbBinEncode(delta, DRBBIN_DELTA, (void*)drbBinEncodeRootDelta, size);
+}
+
+/*!
+ * \brief   Check a record reference of an encoded buffer.
+ *
+ * A record must start after the previously referenced one, which rejects the
+ * records referenced twice (whose checks could grow exponentially with the
+ * depth) and the overlapping records.
+ *
+ * \param   bounds   encoded buffer, the next record position is updated
+ * \param   from     record holding the offset
+ * \param   offset   record offset (must be positive)
+ * \param   size     record size
+ * \return  true if the record is aligned and in the buffer, false otherwise.
+ */
+static bool drbBinCheckRecord(drbBinBounds* bounds, const void* from, int32_t offset,
+                              size_t size) {
+    size_t pos = (size_t)((const char*)from - bounds->base) + (size_t)offset;
+    if (offset <= 0 || pos % BIN_ALIGN || pos < bounds->next || pos > bounds->size ||
+        size > bounds->size - pos)
+        return false;
+    bounds->next = pos + size;
+    return true;
+}
+
+/*!
+ * \brief   Check a string reference of an encoded buffer.
+ * \param   bounds   encoded buffer
+ * \param   from     record holding the offset
+ * \param   offset   string offset (0 for NULL)
+ * \return  true if the string is NUL terminated in the buffer, false otherwise.
+ */
+static bool drbBinCheckStr(const drbBinBounds* bounds, const void* from, int32_t offset) {
+    ptrdiff_t pos = (const char*)from - bounds->base + offset;
+    return offset == 0 || (pos >= 0 && (size_t)pos < bounds->size &&
+                           memchr(bounds->base + pos, '\0', bounds->size - pos) != NULL);
+}
+
+/*!
+ * \brief   Check a metadata list reference of an encoded buffer.
+ * \param   bounds   encoded buffer
+ * \param   from     record holding the offset
+ * \param   offset   list offset
+ * \param   depth    list depth (1 for a root list)
+ * \return  true if the list and its records are valid, false otherwise.
+ */
+static bool drbBinCheckList(drbBinBounds* bounds, const void* from, int32_t offset, int depth) {
+    if (depth > BIN_MAX_DEPTH || !drbBinCheckRecord(bounds, from, offset, sizeof(drbBinMetadataList)))
+        return false;
+    
+    const drbBinMetadataList* list = (const void*)((const char*)from + offset);
+    size_t available = bounds->size - bounds->next;
+    if (list->size > available / sizeof(drbBinMetadata))
+        return false;
+    bounds->next += sizeof(drbBinMetadata) * list->size;
+    
+    for (size_t i = 0; i < list->size; i++)
+        if (!drbBinCheckMetadata(bounds, &list->array[i], depth))
+            return false;
+    return true;
+}
+
+/*!
+ * \brief   Check a metadata record of an encoded buffer.
+ * \param   bounds   encoded buffer
+ * \param   meta     metadata record (in the buffer)
+ * \param   depth    depth of the list holding the record (0 for a root record)
+ * \return  true if the record references are valid, false otherwise.
+ */
+static bool drbBinCheckMetadata(drbBinBounds* bounds, const drbBinMetadata* meta, int depth) {
+    return drbBinCheckStr(bounds, meta, meta->clientMtime) &&
+           drbBinCheckStr(bounds, meta, meta->icon) &&
+           drbBinCheckStr(bounds, meta, meta->mimeType) &&
+           drbBinCheckStr(bounds, meta, meta->modified) &&
+           drbBinCheckStr(bounds, meta, meta->path) &&
+           drbBinCheckStr(bounds, meta, meta->rev) &&
+           drbBinCheckStr(bounds, meta, meta->root) &&
+           drbBinCheckStr(bounds, meta, meta->size) &&
+           drbBinCheckStr(bounds, meta, meta->hash) &&
+           (!meta->contents || drbBinCheckList(bounds, meta, meta->contents, depth + 1));
+}
+
+/*!
+ * \brief   Check the header of an encoded buffer.
+ * \param       buffer   encoded buffer
+ * \param       size     buffer size
+ * \param       kind     DRBBIN_XXX expected kind
+ * \param       root     root record size
+ * \param[out]  bounds   checked buffer bounds
+ * \return  root record (NULL if the header is invalid).
+ */
+static const void* drbBinView(const void* buffer, size_t size, int kind, size_t root,
+                              drbBinBounds* bounds) {
+    const drbBinHeader* header = buffer;
+    if (!buffer || (uintptr_t)buffer % BIN_ALIGN || size < sizeof(drbBinHeader) ||
+        header->magic != DRBBIN_MAGIC || header->version != DRBBIN_VERSION ||
+        header->kind != kind || header->size > size || header->size > BIN_MAX_SIZE)
+        return NULL;
+    
+    bounds->base = buffer;
+    bounds->size = header->size;
+    bounds->next = sizeof(drbBinHeader);
+    if (!drbBinCheckRecord(bounds, buffer, (int32_t)header->root, root))
+        return NULL;
+    return (const char*)buffer + header->root;
+}
+
+const drbBinMetadata* drbViewMetadata(const void* buffer, size_t size) {
+    drbBinBounds bounds;
+    const drbBinMetadata* meta = drbBinView(buffer, size, DRBBIN_METADATA, sizeof(drbBinMetadata),
+                                            &bounds);
+    return meta && drbBinCheckMetadata(&bounds, meta, 0) ? meta : NULL;
+}
+
+const drbBinMetadataList* drbViewMetadataList(const void* buffer, size_t size) {
+    drbBinBounds bounds;
+    const drbBinHeader* header = buffer;
+    
+    // The root list record is checked with its entries
+    if (!drbBinView(buffer, size, DRBBIN_METADATA_LIST, 0, &bounds) ||
+        !drbBinCheckList(&bounds, buffer, (int32_t)header->root, 1))
+        return NULL;
+    return (const void*)((const char*)buffer + header->root);
+}
+
+const drbBinDelta* drbViewDelta(const void* buffer, size_t size) {
+    drbBinBounds bounds;
+    const drbBinDelta* delta = drbBinView(buffer, size, DRBBIN_DELTA, sizeof(drbBinDelta), &bounds);
+    if (!delta || !drbBinCheckStr(&bounds, delta, delta->cursor))
+        return NULL;
+    
+    size_t available = bounds.size - bounds.next;
+    if (delta->size > available / sizeof(drbBinDeltaEntry))
+        return NULL;
+    bounds.next += sizeof(drbBinDeltaEntry) * delta->size;
+    
+    for (size_t i = 0; i < delta->size; i++) {
+        const drbBinDeltaEntry* entry = &delta->entries[i];
+        if (!drbBinCheckStr(&bounds, entry, entry->path))
+            return NULL;
+        if (entry->metadata &&
+            (!drbBinCheckRecord(&bounds, entry, entry->metadata, sizeof(drbBinMetadata)) ||
+             !drbBinCheckMetadata(&bounds, drbBinEntryMetadata(entry), 0)))
+            return NULL;
+    }
+    return delta;
+}
+
+const char* drbBinStr(const void* record, int32_t offset) {
+    return offset ? (const char*)record + offset : NULL;
+}
+
+const drbBinMetadataList* drbBinContents(const drbBinMetadata* meta) {
+    return meta->contents ? (const void*)((const char*)meta + meta->contents) : NULL;
+}
+
+const drbBinMetadata* drbBinEntryMetadata(const drbBinDeltaEntry* entry) {
+    return entry->metadata ? (const void*)((const char*)entry + entry->metadata) : NULL;
+}
+
+/*!
+ * \brief   Copy a defined value in a new memory block.
+ * \param   value     value to copy
+ * \param   size      value size
+ * \param   defined   whether the value is defined
+ * \return  copied value (NULL if undefined, must be freed by caller)
+ */
+static void* drbBinDupValue(const void* value, size_t size, bool defined) {
+    void* copy = defined ? malloc(size) : NULL;
+    return copy ? memcpy(copy, value, size) : NULL;
+}
+
+/*!
+ * \brief   Decode a binary metadata list.
+ * \param   bin   binary metadata list
+ * \return  decoded list (NULL on failure, must be freed with drbDestroyMetadataList)
+ */
+static drbMetadataList* drbBinDecodeList(const drbBinMetadataList* bin) {
+    drbMetadataList* list = calloc(1, sizeof(drbMetadataList));
+    if (list && bin->size > 0) {
+        if ((list->array = calloc(bin->size, sizeof(drbMetadata*))) == NULL) {
+            free(list);
+            return NULL;
+        }
+        list->size = bin->size;
+        for (size_t i = 0; i < bin->size; i++) {
+            if ((list->array[i] = drbBinDecodeMetadata(&bin->array[i])) == NULL) {
+                drbDestroyMetadataList(list, true);
+                return NULL;
+            }
+        }
+    }
+    return list;
+}
+
+/*!
+ * \brief   Decode a binary metadata.
+ * \param   bin   binary metadata
+ * \return  decoded metadata (NULL on failure, must be freed with drbDestroyMetadata)
+ */
+static drbMetadata* drbBinDecodeMetadata(const drbBinMetadata* bin) {
+    drbMetadata* meta = calloc(1, sizeof(drbMetadata));
+    if (meta) {
+        unsigned int fields = bin->fields;
+        bool isDir       = bin->flags & DRBFLAG_IS_DIR;
+        bool thumbExists = bin->flags & DRBFLAG_THUMB_EXISTS;
+        bool isDeleted   = bin->flags & DRBFLAG_IS_DELETED;
+        
+        meta->bytes            = drbBinDupValue(&bin->bytes,    sizeof(uint64_t),     fields & DRBFIELD_BYTES);
+        meta->revision         = drbBinDupValue(&bin->revision, sizeof(unsigned int), fields & DRBFIELD_REVISION);
+        meta->isDir            = drbBinDupValue(&isDir,         sizeof(bool),         fields & DRBFIELD_IS_DIR);
+        meta->thumbExists      = drbBinDupValue(&thumbExists,   sizeof(bool),         fields & DRBFIELD_THUMB_EXISTS);
+        meta->isDeleted        = drbBinDupValue(&isDeleted,     sizeof(bool),         fields & DRBFIELD_IS_DELETED);
+        meta->clientMtimeEpoch = drbBinDupValue(&bin->clientMtimeEpoch, sizeof(int64_t),
+                                                bin->clientMtimeEpoch != DRBVAL_INVALID_TIME);
+        meta->modifiedEpoch    = drbBinDupValue(&bin->modifiedEpoch, sizeof(int64_t),
+                                                bin->modifiedEpoch != DRBVAL_INVALID_TIME);
+        
+        meta->clientMtime = drbStrDup(drbBinStr(bin, bin->clientMtime));
+        meta->icon        = drbStrDup(drbBinStr(bin, bin->icon));
+        meta->mimeType    = drbStrDup(drbBinStr(bin, bin->mimeType));
+        meta->modified    = drbStrDup(drbBinStr(bin, bin->modified));
+        meta->path        = drbStrDup(drbBinStr(bin, bin->path));
+        meta->rev         = drbStrDup(drbBinStr(bin, bin->rev));
+        meta->root        = drbStrDup(drbBinStr(bin, bin->root));
+        meta->size        = drbStrDup(drbBinStr(bin, bin->size));
+        meta->hash        = drbStrDup(drbBinStr(bin, bin->hash));
+        
+        if (bin->contents && (meta->contents = drbBinDecodeList(drbBinContents(bin))) == NULL) {
+            drbDestroyMetadata(meta, true);
+            return NULL;
+        }
+    }
+    return meta;
+}
+
+drbMetadata* drbDecodeMetadata(const void* buffer, size_t size) {
+    const drbBinMetadata* bin = drbViewMetadata(buffer, size);
+    return bin ? drbBinDecodeMetadata(bin) : NULL;
+}
+
+drbMetadataList* drbDecodeMetadataList(const void* buffer, size_t size) {
+    const drbBinMetadataList* bin = drbViewMetadataList(buffer, size);
+    return bin ? drbBinDecodeList(bin) : NULL;
+}
+
+drbDelta* drbDecodeDelta(const void* buffer, size_t size) {
+    const drbBinDelta* bin = drbViewDelta(buffer, size);
+    drbDelta* delta = bin ? calloc(1, sizeof(drbDelta)) : NULL;
+    if (delta) {
+        bool reset   = bin->flags & DRBFLAG_RESET;
+        bool hasMore = bin->flags & DRBFLAG_HAS_MORE;
+        delta->reset   = drbBinDupValue(&reset,   sizeof(bool), bin->fields & DRBFIELD_RESET);
+        delta->hasMore = drbBinDupValue(&hasMore, sizeof(bool), bin->fields & DRBFIELD_HAS_MORE);
+        delta->cursor  = drbStrDup(drbBinStr(bin, bin->cursor));
+        
+        if (bin->size > 0) {
+            if ((delta->entries.array = calloc(bin->size, sizeof(drbDeltaEntry))) == NULL) {
+                drbDestroyDelta(delta, true);
+                return NULL;
+            }
+            delta->entries.size = bin->size;
+            for (size_t i = 0; i < bin->size; i++) {
+                const drbBinDeltaEntry* entry = &bin->entries[i];
+                const drbBinMetadata* meta = drbBinEntryMetadata(entry);
+                delta->entries.array[i].path = drbStrDup(drbBinStr(entry, entry->path));
+                if (meta && (delta->entries.array[i].metadata = drbBinDecodeMetadata(meta)) == NULL) {
+                    drbDestroyDelta(delta, true);
+                    return NULL;
+                }
+            }
+        }
+    }
+    return delta;
+}
@@ -0,0 +1,435 @@
+/*!
+ * \file    dropboxCache.c
+ * \brief   Cache of the metadata listings revalidated with their hash.
+ *
+ * Listings are kept in their binary encoding with the hash given by the
+ * server, in a hash table whose entries are also linked from the most to the
+ * least recently used. With a backing directory, each entry is also written
+ * in a file named after its key hash, and the entries missing in memory are
+ * looked up there (e.g. after a restart).
+ *
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "dropboxCache.h"
+#include "dropboxUtils.h"
+
+/*! Magic number of a cache file ("DRBC"). */
+static const uint32_t DRB_CACHE_MAGIC = 0x43425244;
+
+/*! Initial number of buckets (power of 2). */
+static const size_t DRB_CACHE_BUCKETS = 64;
+
+/*! Largest encoded listing loaded from a cache file. */
+static const uint32_t DRB_CACHE_MAX_SIZE = 1 << 30;
+
+/*! Longest listing hash loaded from a cache file. */
+static const uint32_t DRB_CACHE_MAX_HASH_SIZE = 1024;
+
+/*!
+ * \struct  drbCacheEntry
+ * \breif   Cached listing.
+ */
+typedef struct drbCacheEntry {
+    struct drbCacheEntry* next;  /*!< Next entry of the bucket. */
+    struct drbCacheEntry* newer; /*!< More recently used entry. */
+    struct drbCacheEntry* older; /*!< Less recently used entry. */
+    size_t keyHash;              /*!< Key hash (drbStrHash). */
+    char* key;                   /*!< Root, path and listing options. */
+    char* hash;                  /*!< Listing hash given by the server. */
+    void* encoded;               /*!< Listing binary encoding. */
+    size_t size;                 /*!< Encoding size. */
+} drbCacheEntry;
+
+/*!
+ * \struct  drbCacheFileHeader
+ * \breif   Header of a cache file, followed by the key, hash and encoding.
+ */
+typedef struct {
+    uint32_t magic;       /*!< DRB_CACHE_MAGIC (also checks the byte order). */
+    uint32_t keySize;     /*!< Key length. */
+    uint32_t hashSize;    /*!< Hash length. */
+    uint32_t encodedSize; /*!< Encoding size. */
+} drbCacheFileHeader;
+
+/*!
+ * \struct  drbMetadataCache
+ * \breif   Listings cache of a client.
+ */
+struct drbMetadataCache {
+    pthread_mutex_t lock;         /*!< Serialize the cache use between threads. */
+    drbCacheEntry** buckets;      /*!< Entries chained by key hash. */
+    size_t bucketCount;           /*!< Number of buckets (power of 2). */
+    drbCacheEntry* newest;        /*!< Most recently used entry. */
+    drbCacheEntry* oldest;        /*!< Least recently used entry. */
+    size_t maxEntries;            /*!< Entries kept in memory. */
+    char* dir;                    /*!< Backing directory (NULL for none). */
+    drbMetadataCacheStats stats;  /*!< Usage statistics (entries included). */
+};
+
+/*!
+ * \brief   Free a cache entry.
+ * \param   entry   entry to free
+ * \return  void
+ */
+static void drbCacheFreeEntry(drbCacheEntry* entry) {
+    free(entry->key);
+    free(entry->hash);
+    free(entry->encoded);
+    free(entry);
+}
+
+/*!
+ * \brief   Find an entry in memory.
+ * \param   cache     cache to search
+ * \param   key       entry key
+ * \param   keyHash   key hash
+ * \return  entry (NULL if not found).
+ */
+static drbCacheEntry* drbCacheLookup(drbMetadataCache* cache, const char* key, size_t keyHash) {
+    drbCacheEntry* entry = cache->buckets[keyHash & (cache->bucketCount - 1)];
+    while (entry && (entry->keyHash != keyHash || strcmp(entry->key, key) != 0))
+        entry = entry->next;
+    return entry;
+}
+
+/*!
+ * \brief   Unlink an entry from the most recently used list.
+ * \param   cache   cache of the entry
+ * \param   entry   entry to unlink
+ * \return  void
+ */
+static void drbCacheUnlinkUse(drbMetadataCache* cache, drbCacheEntry* entry) {
+    if (entry->newer)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+    if (entry->older)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+}
+
+/*!
+ * \brief   Link an entry as the most recently used.
+ * \param   cache   cache of the entry
+ * \param   entry   entry to link
+ * \return  void
+ */
+static void drbCacheLinkUse(drbMetadataCache* cache, drbCacheEntry* entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest)
+        cache->newest->newer = entry;
+    else
+        cache->oldest = entry;
+    cache->newest = entry;
+}
+
+/*!
+ * \brief   Remove an entry from the cache, and free it.
+ * \param   cache   cache of the entry
+ * \param   entry   entry to remove
+ * \return  void
+ */
+static void drbCacheRemove(drbMetadataCache* cache, drbCacheEntry* entry) {
+    drbCacheEntry** link = &cache->buckets[entry->keyHash & (cache->bucketCount - 1)];
+    while (*link != entry)
+        link = &(*link)->next;
+    *link = entry->next;
+    drbCacheUnlinkUse(cache, entry);
+    drbCacheFreeEntry(entry);
+    cache->stats.entries--;
+}
+
+/*!
+ * \brief   Add an entry in the cache, replacing the one with the same key, and
+ *          evict the least recently used entries beyond the limit.
+ * \param   cache   cache to fill
+ * \param   entry   entry to add (owned by the cache)
+ * \return  indicates whether a previous entry was replaced.
+ */
+static bool drbCacheInsert(drbMetadataCache* cache, drbCacheEntry* entry) {
+    drbCacheEntry* previous = drbCacheLookup(cache, entry->key, entry->keyHash);
+    if (previous)
+        drbCacheRemove(cache, previous);
+    
+    // Keep at most one entry per bucket on average
+    if (cache->stats.entries >= cache->bucketCount) {
+        size_t count = cache->bucketCount * 2;
+        drbCacheEntry** buckets = calloc(count, sizeof(drbCacheEntry*));
+        if (buckets) {
+            for (size_t i = 0; i < cache->bucketCount; i++)
+                for (drbCacheEntry *e = cache->buckets[i], *next; e; e = next) {
+                    next = e->next;
+                    e->next = buckets[e->keyHash & (count - 1)];
+                    buckets[e->keyHash & (count - 1)] = e;
+                }
+            free(cache->buckets);
+            cache->buckets = buckets;
+            cache->bucketCount = count;
+        }
+    }
+    
+    drbCacheEntry** bucket = &cache->buckets[entry->keyHash & (cache->bucketCount - 1)];
+    entry->next = *bucket;
+    *bucket = entry;
+    drbCacheLinkUse(cache, entry);
+    cache->stats.entries++;
+    
+    while (cache->stats.entries > cache->maxEntries)
+        drbCacheRemove(cache, cache->oldest);
+    return previous != NULL;
+}
+
+/*!
+ * \brief   Get the backing file path of a key.
+ * \param   cache     cache with a backing directory
+ * \param   keyHash   key hash
+ * \return  file path (NULL on failure), must be freed by the caller.
+ */
+static char* drbCachePath(drbMetadataCache* cache, size_t keyHash) {
+    char* path = NULL;
+    if (asprintf(&path, "%s/%016llx.drbc", cache->dir, (unsigned long long)keyHash) == -1)
+        path = NULL;
+    return path;
+}
+
+/*!
+ * \brief   Write an entry in its backing file.
+ *
+ * The file is written aside, then renamed: a reader never sees a partial file.
+ *
+ * \param   cache   cache with a backing directory
+ * \param   entry   entry to write
+ * \return  void
+ */
+static void drbCacheSave(drbMetadataCache* cache, const drbCacheEntry* entry) {
+    char* path = drbCachePath(cache, entry->keyHash);
+    char* tmp = NULL;
+    if (!path || asprintf(&tmp, "%s/.drbcXXXXXX", cache->dir) == -1) {
+        free(path);
+        return;
+    }
+    
+    int fd = mkstemp(tmp);
+    FILE* file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (file) {
+        drbCacheFileHeader header = {DRB_CACHE_MAGIC, (uint32_t)strlen(entry->key),
+                                     (uint32_t)strlen(entry->hash), (uint32_t)entry->size};
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       fwrite(entry->key, 1, header.keySize, file) == header.keySize &&
+                       fwrite(entry->hash, 1, header.hashSize, file) == header.hashSize &&
+                       fwrite(entry->encoded, 1, entry->size, file) == entry->size;
+        if (fclose(file) == 0 && written && rename(tmp, path) == 0)
+            fd = -1;
+    } else if (fd >= 0)
+        close(fd);
+    if (fd >= 0)
+        unlink(tmp);
+    
+    free(tmp);
+    free(path);
+}
+
+/*!
+ * \brief   Read a string of a cache file.
+ * \param   file   cache file
+ * \param   size   string length
+ * \return  NUL terminated string (NULL on failure), must be freed by the caller.
+ */
+static char* drbCacheReadStr(FILE* file, size_t size) {
+    char* str = malloc(size + 1);
+    if (str && fread(str, 1, size, file) == size) {
+        str[size] = '\0';
+        return str;
+    }
+    free(str);
+    return NULL;
+}
+
+/*!
+ * \brief   Load an entry from its backing file.
+ * \param   cache     cache with a backing directory
+ * \param   key       entry key
+ * \param   keyHash   key hash
+ * \return  loaded entry (NULL if not found or invalid).
+ */
+static drbCacheEntry* drbCacheLoad(drbMetadataCache* cache, const char* key, size_t keyHash) {
+    char* path = drbCachePath(cache, keyHash);
+    FILE* file = path ? fopen(path, "rb") : NULL;
+    free(path);
+    if (!file)
+        return NULL;
+    
+    drbCacheEntry* entry = calloc(1, sizeof(drbCacheEntry));
+    drbCacheFileHeader header;
+    bool loaded = entry && fread(&header, sizeof(header), 1, file) == 1 &&
+                  header.magic == DRB_CACHE_MAGIC && header.keySize == strlen(key) &&
+                  header.hashSize <= DRB_CACHE_MAX_HASH_SIZE &&
+                  header.encodedSize <= DRB_CACHE_MAX_SIZE &&
+                  (entry->key = drbCacheReadStr(file, header.keySize)) != NULL &&
+                  strcmp(entry->key, key) == 0 &&
+                  (entry->hash = drbCacheReadStr(file, header.hashSize)) != NULL &&
+                  (entry->encoded = malloc(header.encodedSize)) != NULL &&
+                  fread(entry->encoded, 1, header.encodedSize, file) == header.encodedSize &&
+                  drbViewMetadata(entry->encoded, header.encodedSize) != NULL;
+    fclose(file);
+    
+    if (!loaded) {
+        if (entry)
+            drbCacheFreeEntry(entry);
+        return NULL;
+    }
+    entry->keyHash = keyHash;
+    entry->size = header.encodedSize;
+    return entry;
+}
+
+drbMetadataCache* drbCreateMetadataCache(size_t maxEntries, const char* dir) {
+    drbMetadataCache* cache = calloc(1, sizeof(drbMetadataCache));
+    if (!cache)
+        return NULL;
+    
+    cache->maxEntries = maxEntries;
+    cache->bucketCount = DRB_CACHE_BUCKETS;
+    cache->buckets = calloc(cache->bucketCount, sizeof(drbCacheEntry*));
+    cache->dir = dir ? strdup(dir) : NULL;
+    if (!cache->buckets || (dir && !cache->dir)) {
+        free(cache->buckets);
+        free(cache->dir);
+        free(cache);
+        return NULL;
+    }
+    if (dir)
+        mkdir(dir, 0700);
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void drbDestroyMetadataCache(drbMetadataCache* cache) {
+    if (cache) {
+        for (drbCacheEntry *entry = cache->newest, *older; entry; entry = older) {
+            older = entry->older;
+            drbCacheFreeEntry(entry);
+        }
+        pthread_mutex_destroy(&cache->lock);
+        free(cache->buckets);
+        free(cache->dir);
+        free(cache);
+    }
+}
+
+/*!
+ * \brief   Find a cached listing, in memory or in the backing directory.
+ * \param       cache     cache to search
+ * \param       key       listing key
+ * \param[out]  hash      listing hash, must be freed by the caller
+ * \param[out]  encoded   copy of the listing encoding, must be freed by the
+ *                        caller
+ * \param[out]  size      encoding size
+ * \return  indicates whether the listing was found.
+ */
+bool drbMetadataCacheFind(drbMetadataCache* cache, const char* key, char** hash,
+                          void** encoded, size_t* size) {
+    size_t keyHash = drbStrHash(key);
+    bool found = false;
+    
+    pthread_mutex_lock(&cache->lock);
+    drbCacheEntry* entry = drbCacheLookup(cache, key, keyHash);
+    if (!entry && cache->dir) {
+        // The file is read without holding the other threads
+        pthread_mutex_unlock(&cache->lock);
+        drbCacheEntry* loaded = drbCacheLoad(cache, key, keyHash);
+        pthread_mutex_lock(&cache->lock);
+        if (loaded) {
+            drbCacheInsert(cache, loaded);
+            cache->stats.diskLoads++;
+        }
+        entry = drbCacheLookup(cache, key, keyHash);
+    }
+    
+    if (entry) {
+        drbCacheUnlinkUse(cache, entry);
+        drbCacheLinkUse(cache, entry);
+        *hash = strdup(entry->hash);
+        *encoded = malloc(entry->size);
+        if (*hash && *encoded) {
+            memcpy(*encoded, entry->encoded, entry->size);
+            *size = entry->size;
+            found = true;
+        } else {
+            free(*hash), free(*encoded);
+            *hash = NULL, *encoded = NULL;
+        }
+    }
+    if (!found)
+        cache->stats.misses++;
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
+
+/*!
+ * \brief   Count a listing served from the cache.
+ * \param   cache   cache serving the listing
+ * \return  void
+ */
+void drbMetadataCacheHit(drbMetadataCache* cache) {
+    pthread_mutex_lock(&cache->lock);
+    cache->stats.hits++;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/*!
+ * \brief   Cache a listing fetched from the server.
+ * \param   cache   cache to fill
+ * \param   key     listing key
+ * \param   hash    listing hash given by the server (NULL to not cache it)
+ * \param   meta    listing
+ * \return  void
+ */
+void drbMetadataCacheStore(drbMetadataCache* cache, const char* key, const char* hash,
+                           const drbMetadata* meta) {
+    drbCacheEntry* entry = hash ? calloc(1, sizeof(drbCacheEntry)) : NULL;
+    if (!entry)
+        return;
+    
+    entry->keyHash = drbStrHash(key);
+    entry->key = strdup(key);
+    entry->hash = strdup(hash);
+    entry->encoded = drbEncodeMetadata(meta, &entry->size);
+    if (!entry->key || !entry->hash || !entry->encoded) {
+        drbCacheFreeEntry(entry);
+        return;
+    }
+    if (cache->dir)
+        drbCacheSave(cache, entry);
+    
+    pthread_mutex_lock(&cache->lock);
+    if (drbCacheInsert(cache, entry))
+        cache->stats.changed++;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/*!
+ * \brief   Get the usage statistics of a cache.
+ * \param       cache   cache to query
+ * \param[out]  stats   cache statistics
+ * \return  void
+ */
+void drbMetadataCacheGetStats(drbMetadataCache* cache, drbMetadataCacheStats* stats) {
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,193 @@
+/*!
+ * \file    dropboxDigest.c
+ * \brief   Checksums of the transferred files.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <openssl/evp.h>
+#include "dropboxDigest.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DRB_CRC32C_SSE42
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define DRB_CRC32C_ARM
+#include <arm_acle.h>
+#endif
+
+/*! CRC32C (Castagnoli) polynomial, reflected. */
+static const uint32_t DRB_CRC32C_POLY = 0x82F63B78;
+
+/*! Slicing-by-8 tables of the software CRC32C. */
+static uint32_t drbCrc32cTable[8][256];
+
+/*! CRC32C update function picked for the CPU. */
+static uint32_t (*drbCrc32cUpdate)(uint32_t crc, const unsigned char* p, size_t size);
+
+static pthread_once_t drbCrc32cOnce = PTHREAD_ONCE_INIT;
+
+/*!
+ * \brief   Update a CRC32C in software, 8 bytes at a time.
+ * \param   crc    running CRC32C (not inverted)
+ * \param   p      data to hash
+ * \param   size   data size
+ * \return  updated CRC32C.
+ */
+static uint32_t drbCrc32cSoft(uint32_t crc, const unsigned char* p, size_t size) {
+    const uint32_t (*t)[256] = (const uint32_t (*)[256])drbCrc32cTable;
+    
+    for (; size >= 8; size -= 8, p += 8) {
+        uint32_t lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+    }
+    while (size--)
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef DRB_CRC32C_SSE42
+
+/*!
+ * \brief   Update a CRC32C with the SSE 4.2 crc32 instruction.
+ * \param   crc    running CRC32C (not inverted)
+ * \param   p      data to hash
+ * \param   size   data size
+ * \return  updated CRC32C.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t drbCrc32cHard(uint32_t crc, const unsigned char* p, size_t size) {
+    uint64_t crc64;
+    
+    for (; size && ((uintptr_t)p & 7); size--)
+        crc = _mm_crc32_u8(crc, *p++);
+    crc64 = crc;
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+    while (size--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+
+#elif defined(DRB_CRC32C_ARM)
+
+/*!
+ * \brief   Update a CRC32C with the ARMv8 crc32c instructions.
+ * \param   crc    running CRC32C (not inverted)
+ * \param   p      data to hash
+ * \param   size   data size
+ * \return  updated CRC32C.
+ */
+static uint32_t drbCrc32cHard(uint32_t crc, const unsigned char* p, size_t size) {
+    for (; size && ((uintptr_t)p & 7); size--)
+        crc = __crc32cb(crc, *p++);
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc = __crc32cd(crc, word);
+    }
+    while (size--)
+        crc = __crc32cb(crc, *p++);
+    return crc;
+}
+
+#endif
+
+/*!
+ * \brief   Pick the CRC32C implementation, building the software tables
+ *          if the CPU has no CRC32C instruction.
+ * \return  void
+ */
+static void drbCrc32cSetup(void) {
+#if defined(DRB_CRC32C_SSE42)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        drbCrc32cUpdate = drbCrc32cHard;
+        return;
+    }
+#elif defined(DRB_CRC32C_ARM)
+    drbCrc32cUpdate = drbCrc32cHard;
+    return;
+#endif
+    
+    for (unsigned i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ DRB_CRC32C_POLY : crc >> 1;
+        drbCrc32cTable[0][i] = crc;
+    }
+    for (unsigned i = 0; i < 256; i++)
+        for (int k = 1; k < 8; k++)
+            drbCrc32cTable[k][i] = (drbCrc32cTable[k - 1][i] >> 8) ^
+                                   drbCrc32cTable[0][drbCrc32cTable[k - 1][i] & 0xff];
+    drbCrc32cUpdate = drbCrc32cSoft;
+}
+
+uint32_t drbCrc32c(uint32_t crc, const void* buffer, size_t size) {
+    pthread_once(&drbCrc32cOnce, drbCrc32cSetup);
+    return ~drbCrc32cUpdate(~crc, buffer, size);
+}
+
+/*!
+ * \brief   Start the checksums requested by a digest.
+ * \param   state    checksums state to initialize
+ * \param   digest   digest with the DRBDIGEST_XXX algorithms to compute
+ * \return  false if the SHA-256 context can't be allocated.
+ */
+bool drbDigestStart(drbDigestState* state, drbDigest* digest) {
+    memset(state, 0, sizeof(drbDigestState));
+    state->digest = digest;
+    state->crc = ~0u;
+    pthread_once(&drbCrc32cOnce, drbCrc32cSetup);
+    
+    if (digest->algorithms & DRBDIGEST_SHA256) {
+        EVP_MD_CTX* sha = EVP_MD_CTX_new();
+        if (!sha || !EVP_DigestInit_ex(sha, EVP_sha256(), NULL)) {
+            EVP_MD_CTX_free(sha);
+            return false;
+        }
+        state->sha = sha;
+    }
+    return true;
+}
+
+/*!
+ * \brief   Hash transferred bytes.
+ * \param   state   checksums state
+ * \param   ptr     transferred bytes
+ * \param   size    number of bytes
+ * \return  void
+ */
+void drbDigestUpdate(drbDigestState* state, const void* ptr, size_t size) {
+    state->bytes += size;
+    if (state->digest->algorithms & DRBDIGEST_CRC32C)
+        state->crc = drbCrc32cUpdate(state->crc, ptr, size);
+    if (state->sha)
+        EVP_DigestUpdate(state->sha, ptr, size);
+}
+
+/*!
+ * \brief   Set the digest with the final checksums, and free the state.
+ * \param   state   checksums state
+ * \return  void
+ */
+void drbDigestFinish(drbDigestState* state) {
+    drbDigest* digest = state->digest;
+    
+    digest->bytes = state->bytes;
+    digest->crc32c = ~state->crc;
+    if (state->sha) {
+        EVP_DigestFinal_ex(state->sha, digest->sha256, NULL);
+        EVP_MD_CTX_free(state->sha);
+        state->sha = NULL;
+    }
+}
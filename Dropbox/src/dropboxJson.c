@@ -9,11 +9,40 @@
 #define _GNU_SOURCE
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <jansson.h>
 #include "dropboxJson.h"
+#include "dropboxUtils.h"
 
-static void drbJsonParseMetadata(json_t *root, drbMetadata* meta);
+#define VISIT_READ_SIZE   (16*1024)
+#define VISIT_BUFFER_SIZE 256
+
+/*!
+ * \struct  drbJsonBuffer
+ * \breif   Growable text buffer.
+ */
+typedef struct {
+    char* data;      /*!< Buffer content (not NUL terminated). */
+    size_t size;     /*!< Content size. */
+    size_t capacity; /*!< Allocated size. */
+} drbJsonBuffer;
+
+/*!
+ * Destination of the delta answer text visited by drbLoadDeltaVisit.
+ */
+enum { VISIT_TRAILER, VISIT_ENTRY, VISIT_SKIP };
+
+static void drbJsonParseMetadata(json_t *root, drbMetadata* meta, unsigned int fields);
+static drbArenaMetadata* drbJsonArenaMetadata(json_t *root, drbArena* arena,
+                                              drbArenaMetadata* meta, unsigned int fields);
+
+/*!
+ * Fields with few distinct values, interned in arena outputs.
+ */
+static const unsigned int DRB_INTERNED_FIELDS = DRBFIELD_ICON | DRBFIELD_ROOT |
+                                                DRBFIELD_SIZE | DRBFIELD_MIME_TYPE;
 
 /*!
  * \brief   Parse a JSON string entry.
@@ -46,6 +75,42 @@ static unsigned int* drbJsonGetInt(json_t* root, char* key) {
     return pInt;
 }
 
+/*!
+ * \brief   Parse a JSON 64-bit integer entry.
+ * \param   root   JSON root node
+ * \param   key    key (name) of the entry to parse
+ * \return  pointer to the parsed integer (must be freed by caller)
+ */
+static uint64_t* drbJsonGetInt64(json_t* root, char* key) {
+    uint64_t* pInt = NULL;
+    json_int_t value;
+    if(json_unpack(root, "{sI}", key, &value) != -1) {
+        if((pInt = malloc(sizeof(uint64_t))) != NULL) {
+            *pInt = value;
+        }
+    }
+    return pInt;
+}
+
+/*!
+ * \brief   Parse a JSON time (string) entry.
+ * \param   root   JSON root node
+ * \param   key    key (name) of the entry to parse
+ * \return  pointer to the parsed time, in seconds since the epoch (must be
+ *          freed by caller)
+ */
+static int64_t* drbJsonGetTime(json_t* root, char* key) {
+    int64_t* pTime = NULL;
+    const char* str;
+    int64_t value;
+    if(json_unpack(root, "{ss}", key, &str) != -1 && drbParseTime(str, &value)) {
+        if((pTime = malloc(sizeof(int64_t))) != NULL) {
+            *pTime = value;
+        }
+    }
+    return pTime;
+}
+
 /*!
  * \brief   Parse a JSON boolean entry.
  * \param   root   JSON root node
@@ -65,11 +130,12 @@ static bool* drbJsonGetBool(json_t* root, char* key) {
 
 /*!
  * \brief   Parse a JSON metadata list entry.
- * \param       root   JSON root node that should contain the metadata list
- * \param[out]  list   list to load with JSON data
+ * \param       root     JSON root node that should contain the metadata list
+ * \param[out]  list     list to load with JSON data
+ * \param       fields   DRBFIELD_XXX mask of the fields to parse
  * \return  void
  */
-static void drbJsonParseMetadataList(json_t *root, drbMetadataList* list) {
+static void drbJsonParseMetadataList(json_t *root, drbMetadataList* list, unsigned int fields) {
     memset(list, 0, sizeof(drbMetadataList));
     if (root && json_is_array(root)) {
         list->size = json_array_size(root);
@@ -78,7 +144,7 @@ static void drbJsonParseMetadataList(json_t *root, drbMetadataList* list) {
                 for (int i = 0; i < list->size; i++) {
                     json_t* meta = json_array_get(root, i);
                     list->array[i] = malloc(sizeof(drbMetadata));
-                    drbJsonParseMetadata(meta, list->array[i]);
+                    drbJsonParseMetadata(meta, list->array[i], fields);
                 }
             }
         }
@@ -87,32 +153,39 @@ static void drbJsonParseMetadataList(json_t *root, drbMetadataList* list) {
 
 /*!
  * \brief   Parse a JSON metadata entry.
- * \param       root   JSON root node that should contain the metadata
- * \param[out]  meta   metadata to load with JSON data
+ *
+ * The fields masked out are left NULL, and the contents are not walked if
+ * DRBFIELD_CONTENTS is masked out.
+ *
+ * \param       root     JSON root node that should contain the metadata
+ * \param[out]  meta     metadata to load with JSON data
+ * \param       fields   DRBFIELD_XXX mask of the fields to parse
  * \return  void
  */
-static void drbJsonParseMetadata(json_t *root, drbMetadata* meta) {
+static void drbJsonParseMetadata(json_t *root, drbMetadata* meta, unsigned int fields) {
     if (root) {
         memset(meta, 0, sizeof(drbMetadata));
-        meta->hash        = drbJsonGetStr (root, "hash");
-        meta->rev         = drbJsonGetStr (root, "rev");
-        meta->thumbExists = drbJsonGetBool(root, "thumb_exists");
-        meta->bytes       = drbJsonGetInt (root, "bytes");
-        meta->modified    = drbJsonGetStr (root, "modified");
-        meta->path        = drbJsonGetStr (root, "path");
-        meta->isDir       = drbJsonGetBool(root, "is_dir");
-        meta->icon        = drbJsonGetStr (root, "icon");
-        meta->root        = drbJsonGetStr (root, "root");
-        meta->size        = drbJsonGetStr (root, "size");
-        meta->clientMtime = drbJsonGetStr (root, "client_mtime");
-        meta->isDeleted   = drbJsonGetBool(root, "is_deleted");
-        meta->mimeType    = drbJsonGetStr (root, "mime_type");
-        meta->revision    = drbJsonGetInt (root, "revision");
+        if (fields & DRBFIELD_HASH)         meta->hash             = drbJsonGetStr  (root, "hash");
+        if (fields & DRBFIELD_REV)          meta->rev              = drbJsonGetStr  (root, "rev");
+        if (fields & DRBFIELD_THUMB_EXISTS) meta->thumbExists      = drbJsonGetBool (root, "thumb_exists");
+        if (fields & DRBFIELD_BYTES)        meta->bytes            = drbJsonGetInt64(root, "bytes");
+        if (fields & DRBFIELD_MODIFIED)     meta->modified         = drbJsonGetStr  (root, "modified");
+        if (fields & DRBFIELD_MODIFIED)     meta->modifiedEpoch    = drbJsonGetTime (root, "modified");
+        if (fields & DRBFIELD_PATH)         meta->path             = drbJsonGetStr  (root, "path");
+        if (fields & DRBFIELD_IS_DIR)       meta->isDir            = drbJsonGetBool (root, "is_dir");
+        if (fields & DRBFIELD_ICON)         meta->icon             = drbJsonGetStr  (root, "icon");
+        if (fields & DRBFIELD_ROOT)         meta->root             = drbJsonGetStr  (root, "root");
+        if (fields & DRBFIELD_SIZE)         meta->size             = drbJsonGetStr  (root, "size");
+        if (fields & DRBFIELD_CLIENT_MTIME) meta->clientMtime      = drbJsonGetStr  (root, "client_mtime");
+        if (fields & DRBFIELD_CLIENT_MTIME) meta->clientMtimeEpoch = drbJsonGetTime (root, "client_mtime");
+        if (fields & DRBFIELD_IS_DELETED)   meta->isDeleted        = drbJsonGetBool (root, "is_deleted");
+        if (fields & DRBFIELD_MIME_TYPE)    meta->mimeType         = drbJsonGetStr  (root, "mime_type");
+        if (fields & DRBFIELD_REVISION)     meta->revision         = drbJsonGetInt  (root, "revision");
         
-        json_t *contents = json_object_get(root, "contents");
+        json_t *contents = fields & DRBFIELD_CONTENTS ? json_object_get(root, "contents") : NULL;
         if (contents) {
             if((meta->contents = malloc(sizeof(drbMetadataList))) != NULL) {
-                drbJsonParseMetadataList(contents, meta->contents);
+                drbJsonParseMetadataList(contents, meta->contents, fields);
             }
         }
     }
@@ -120,11 +193,12 @@ static void drbJsonParseMetadata(json_t *root, drbMetadata* meta) {
 
 /*!
  * \brief   Parse a JSON delta entry.
- * \param       root    JSON root node that should contain the delta entry
- * \param[out]  entry   entry to load with JSON data
+ * \param       root     JSON root node that should contain the delta entry
+ * \param[out]  entry    entry to load with JSON data
+ * \param       fields   DRBFIELD_XXX mask of the metadata fields to parse
  * \return  void
  */
-static void drbJsonParseDeltaEntry(json_t *root, drbDeltaEntry* entry) {
+static void drbJsonParseDeltaEntry(json_t *root, drbDeltaEntry* entry, unsigned int fields) {
     
     if (root && json_is_array(root) && json_array_size(root) == 2) {
         // Get path
@@ -132,14 +206,752 @@ static void drbJsonParseDeltaEntry(json_t *root, drbDeltaEntry* entry) {
         if (path && json_is_string(path))
             entry->path = strdup(json_string_value(path));
         
-        // Get metadata
+        // Get metadata (null for a deleted entry)
         json_t* meta = json_array_get(root, 1);
-        if (meta) {
+        if (meta && json_is_object(meta)) {
             if ((entry->metadata = malloc(sizeof(drbMetadata))) != NULL) {
-                drbJsonParseMetadata(meta, entry->metadata);
+                drbJsonParseMetadata(meta, entry->metadata, fields);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief   Load a JSON document from a stream, while it is read.
+ * \param   xread   function reading the next part of the document
+ * \param   data    xread data (stream)
+ * \param   arg     unused loader argument
+ * \return  loaded JSON root node (must be released with json_decref)
+ */
+json_t* drbLoadJson(size_t (*xread)(void*, size_t, void*), void* data, void* arg) {
+    return json_load_callback(xread, data, 0, NULL);
+}
+
+/*!
+ * \brief   Append a span of text to a growable buffer.
+ * \param   buf    buffer to append to (NULL to drop the text)
+ * \param   str    text to append
+ * \param   size   text size
+ * \return  true on success, false if the memory allocation failed
+ */
+static bool drbJsonBufferAppend(drbJsonBuffer* buf, const char* str, size_t size) {
+    if (buf && size > 0) {
+        if (buf->capacity - buf->size < size) {
+            size_t capacity = buf->capacity ? buf->capacity : VISIT_BUFFER_SIZE;
+            while (capacity - buf->size < size)
+                capacity *= 2;
+            char* data = realloc(buf->data, capacity);
+            if (data == NULL)
+                return false;
+            buf->data = data;
+            buf->capacity = capacity;
+        }
+        memcpy(buf->data + buf->size, str, size);
+        buf->size += size;
+    }
+    return true;
+}
+
+/*!
+ * \brief   Decode a delta entry and give it to the visitor.
+ * \param   visit   visit state
+ * \param   entry   JSON text of the entry ([path, metadata])
+ * \return  false if the visitor wants to stop the visit, true otherwise
+ */
+static bool drbJsonVisitEntry(drbJsonVisit* visit, drbJsonBuffer* entry) {
+    bool proceed = true;
+    json_t* root = json_loadb(entry->data, entry->size, 0, NULL);
+    if (root) {
+        json_t* path = json_array_get(root, 0);
+        if (json_is_string(path)) {
+            json_t* metaRoot = json_array_get(root, 1);
+            drbMetadata* meta = json_is_object(metaRoot)
+                              ? drbBuildMetadata(metaRoot, visit->fields) : NULL;
+            proceed = visit->visitor(json_string_value(path), meta, visit->data);
+            drbDestroyMetadata(meta, true);
+        }
+        json_decref(root);
+    }
+    return proceed;
+}
+
+/*!
+ * \brief   Load a delta answer from a stream, visiting its entries while it
+ *          is read.
+ *
+ * Each entry of the "entries" array is decoded alone, given to the visitor
+ * and released before the next one, so only one entry is kept in memory at a
+ * time. The rest of the answer (the trailer: cursor, reset, has_more or the
+ * error) is loaded with an empty entries array.
+ *
+ * \param   xread   function reading the next part of the answer
+ * \param   data    xread data (stream)
+ * \param   arg     visit state (drbJsonVisit*)
+ * \return  loaded trailer JSON root node (must be released with json_decref)
+ */
+json_t* drbLoadDeltaVisit(size_t (*xread)(void*, size_t, void*), void* data, void* arg) {
+    drbJsonVisit* visit = arg;
+    drbJsonBuffer trailer = {NULL, 0, 0}, entry = {NULL, 0, 0};
+    char chunk[VISIT_READ_SIZE];
+    char key[sizeof("entries")];
+    size_t keySize = sizeof(key), read;
+    int depth = 0, target = VISIT_TRAILER;
+    bool inStr = false, escaped = false, inEntries = false;
+    bool stop = !visit->visitor, ok = true;
+    json_t* root = NULL;
+    
+    while (ok && (read = xread(chunk, sizeof(chunk), data)) > 0) {
+        size_t mark = 0;
+        for (size_t i = 0; ok && i < read; i++) {
+            char c = chunk[i];
+            
+            // Route the char to the trailer, the current entry or nowhere
+            int charTarget;
+            if (!inEntries || (depth == 2 && !inStr && c == ']'))
+                charTarget = VISIT_TRAILER;
+            else if (depth > 2 || (!inStr && c == '['))
+                charTarget = stop ? VISIT_SKIP : VISIT_ENTRY;
+            else
+                charTarget = VISIT_SKIP; // Separators between entries
+            
+            if (charTarget != target) {
+                ok = drbJsonBufferAppend(target == VISIT_ENTRY   ? &entry
+                                       : target == VISIT_TRAILER ? &trailer : NULL,
+                                         chunk + mark, i - mark);
+                mark = i;
+                target = charTarget;
+            }
+            
+            // Follow the document structure
+            if (inStr) {
+                if (escaped)
+                    escaped = false;
+                else if (c == '\\')
+                    escaped = true, keySize = sizeof(key);
+                else if (c == '"')
+                    inStr = false;
+                else if (keySize < sizeof(key))
+                    key[keySize++] = c;
+            } else if (c == '"') {
+                inStr = true;
+                keySize = depth == 1 ? 0 : sizeof(key);
+            } else if (c == '[' || c == '{') {
+                if (depth == 1 && c == '[' && keySize == strlen("entries")
+                    && !memcmp(key, "entries", keySize))
+                    inEntries = true;
+                depth++;
+            } else if (c == ']' || c == '}') {
+                depth--;
+                if (inEntries && depth == 1) {
+                    inEntries = false;
+                } else if (inEntries && depth == 2 && target == VISIT_ENTRY) {
+                    ok = drbJsonBufferAppend(&entry, chunk + mark, i + 1 - mark);
+                    mark = i + 1;
+                    if (ok)
+                        stop = !drbJsonVisitEntry(visit, &entry);
+                    entry.size = 0;
+                }
             }
         }
+        if (ok)
+            ok = drbJsonBufferAppend(target == VISIT_ENTRY   ? &entry
+                                   : target == VISIT_TRAILER ? &trailer : NULL,
+                                     chunk + mark, read - mark);
     }
+    
+    if (ok && trailer.size > 0)
+        root = json_loadb(trailer.data, trailer.size, 0, NULL);
+    free(trailer.data);
+    free(entry.data);
+    return root;
+}
+
+/*!
+ * \brief   Parse a JSON text with a builder function.
+ * \param   str     JSON formated text
+ * \param   build   function that creates the structure from the JSON root
+ * \return  built structure
+ */
+static void* drbJsonParse(char* str, void* (*build)(json_t*)) {
+    void* built = NULL;
+    json_t *root = json_loads(str, 0, NULL);
+    if (root) {
+        built = build(root);
+        json_decref(root);
+    }
+    return built;
+}
+
+/*!
+ * \brief   Parse a JSON text with a metadata builder function.
+ * \param   str      JSON formated text
+ * \param   build    function that creates the structure from the JSON root
+ * \param   fields   DRBFIELD_XXX mask of the metadata fields to parse
+ * \return  built structure
+ */
+static void* drbJsonParseFields(char* str, void* (*build)(json_t*, unsigned int),
+                                unsigned int fields) {
+    void* built = NULL;
+    json_t *root = json_loads(str, 0, NULL);
+    if (root) {
+        built = build(root, fields);
+        json_decref(root);
+    }
+    return built;
+}
+
+/*!
+ * \brief   Extract the error message of a JSON error entry.
+ * \param   root   JSON error root node
+ * \return  extracted error message
+ */
+char* drbBuildError(json_t* root) {
+    return root ? drbJsonGetStr(root, "error") : NULL;
+}
+
+/*!
+ * \brief   Parse a JSON string entry in an arena.
+ *
+ * Strings of the DRB_INTERNED_FIELDS share their copy in the arena.
+ *
+ * \param       root    JSON root node
+ * \param       key     key (name) of the entry to parse
+ * \param       field   DRBFIELD_XXX bit of the entry (0 to skip it)
+ * \param       arena   arena where the string is copied
+ * \param[out]  str     parsed string
+ * \return  field if the entry was found, 0 otherwise.
+ */
+static unsigned int drbJsonArenaGetStr(json_t* root, char* key, unsigned int field,
+                                       drbArena* arena, char** str) {
+    const char* value;
+    if(field && json_unpack(root, "{ss}", key, &value) != -1) {
+        *str = field & DRB_INTERNED_FIELDS ? drbArenaStrIntern(arena, value)
+                                           : drbArenaStrDup(arena, value);
+        return field;
+    }
+    return 0;
+}
+
+/*!
+ * \brief   Parse a JSON integer entry in an arena structure.
+ * \param       root    JSON root node
+ * \param       key     key (name) of the entry to parse
+ * \param       field   DRBFIELD_XXX bit of the entry (0 to skip it)
+ * \param[out]  value   parsed integer
+ * \return  field if the entry was found, 0 otherwise.
+ */
+static unsigned int drbJsonArenaGetInt(json_t* root, char* key, unsigned int field,
+                                       unsigned int* value) {
+    return field && json_unpack(root, "{si}", key, value) != -1 ? field : 0;
+}
+
+/*!
+ * \brief   Parse a JSON 64-bit integer entry in an arena structure.
+ * \param       root    JSON root node
+ * \param       key     key (name) of the entry to parse
+ * \param       field   DRBFIELD_XXX bit of the entry (0 to skip it)
+ * \param[out]  value   parsed integer
+ * \return  field if the entry was found, 0 otherwise.
+ */
+static unsigned int drbJsonArenaGetInt64(json_t* root, char* key, unsigned int field,
+                                         uint64_t* value) {
+    json_int_t intValue;
+    if(field && json_unpack(root, "{sI}", key, &intValue) != -1) {
+        *value = intValue;
+        return field;
+    }
+    return 0;
+}
+
+/*!
+ * \brief   Parse a JSON time (string) entry of an arena structure.
+ * \param   root    JSON root node
+ * \param   key     key (name) of the entry to parse
+ * \param   field   DRBFIELD_XXX bit of the entry (0 to skip it)
+ * \return  parsed time in seconds since the epoch, DRBVAL_INVALID_TIME if the
+ *          entry is skipped, missing or invalid.
+ */
+static int64_t drbJsonArenaGetTime(json_t* root, char* key, unsigned int field) {
+    const char* str;
+    int64_t time;
+    if(field && json_unpack(root, "{ss}", key, &str) != -1 && drbParseTime(str, &time))
+        return time;
+    return DRBVAL_INVALID_TIME;
+}
+
+/*!
+ * \brief   Parse a JSON boolean entry in an arena structure.
+ * \param       root    JSON root node
+ * \param       key     key (name) of the entry to parse
+ * \param       field   DRBFIELD_XXX bit of the entry (0 to skip it)
+ * \param[out]  value   parsed boolean
+ * \return  field if the entry was found, 0 otherwise.
+ */
+static unsigned int drbJsonArenaGetBool(json_t* root, char* key, unsigned int field,
+                                        bool* value) {
+    int boolValue;
+    if(field && json_unpack(root, "{sb}", key, &boolValue) != -1) {
+        *value = boolValue;
+        return field;
+    }
+    return 0;
+}
+
+/*!
+ * \brief   Parse a JSON metadata list entry in an arena.
+ * \param   root     JSON root node that should contain the metadata list
+ * \param   arena    arena where the list is allocated
+ * \param   fields   DRBFIELD_XXX mask of the fields to parse
+ * \return  parsed list (NULL while the arena measures)
+ */
+static drbArenaMetadataList* drbJsonArenaMetadataList(json_t *root, drbArena* arena,
+                                                      unsigned int fields) {
+    drbArenaMetadataList* list = drbArenaAlloc(arena, sizeof(drbArenaMetadataList));
+    drbArenaMetadata* array = NULL;
+    size_t size = json_is_array(root) ? json_array_size(root) : 0;
+    
+    if (size > 0)
+        array = drbArenaAlloc(arena, sizeof(drbArenaMetadata) * size);
+    
+    // While measuring, entries are parsed in a dummy metadata
+    drbArenaMetadata dummy;
+    for (size_t i = 0; i < size; i++)
+        drbJsonArenaMetadata(json_array_get(root, i), arena, array ? &array[i] : &dummy, fields);
+    
+    if (list) {
+        list->array = array;
+        list->size = array ? size : 0;
+    }
+    return list;
+}
+
+/*!
+ * \brief   Parse a JSON metadata entry in an arena.
+ * \param   root     JSON root node that should contain the metadata
+ * \param   arena    arena where the metadata strings and contents are allocated
+ * \param   meta     metadata to load with JSON data
+ * \param   fields   DRBFIELD_XXX mask of the fields to parse
+ * \return  meta
+ */
+static drbArenaMetadata* drbJsonArenaMetadata(json_t *root, drbArena* arena,
+                                              drbArenaMetadata* meta, unsigned int fields) {
+    memset(meta, 0, sizeof(drbArenaMetadata));
+    meta->fields |= drbJsonArenaGetStr  (root, "hash",         DRBFIELD_HASH         & fields, arena, &meta->hash);
+    meta->fields |= drbJsonArenaGetStr  (root, "rev",          DRBFIELD_REV          & fields, arena, &meta->rev);
+    meta->fields |= drbJsonArenaGetBool (root, "thumb_exists", DRBFIELD_THUMB_EXISTS & fields, &meta->thumbExists);
+    meta->fields |= drbJsonArenaGetInt64(root, "bytes",        DRBFIELD_BYTES        & fields, &meta->bytes);
+    meta->fields |= drbJsonArenaGetStr  (root, "modified",     DRBFIELD_MODIFIED     & fields, arena, &meta->modified);
+    meta->fields |= drbJsonArenaGetStr  (root, "path",         DRBFIELD_PATH         & fields, arena, &meta->path);
+    meta->fields |= drbJsonArenaGetBool (root, "is_dir",       DRBFIELD_IS_DIR       & fields, &meta->isDir);
+    meta->fields |= drbJsonArenaGetStr  (root, "icon",         DRBFIELD_ICON         & fields, arena, &meta->icon);
+    meta->fields |= drbJsonArenaGetStr  (root, "root",         DRBFIELD_ROOT         & fields, arena, &meta->root);
+    meta->fields |= drbJsonArenaGetStr  (root, "size",         DRBFIELD_SIZE         & fields, arena, &meta->size);
+    meta->fields |= drbJsonArenaGetStr  (root, "client_mtime", DRBFIELD_CLIENT_MTIME & fields, arena, &meta->clientMtime);
+    meta->fields |= drbJsonArenaGetBool (root, "is_deleted",   DRBFIELD_IS_DELETED   & fields, &meta->isDeleted);
+    meta->fields |= drbJsonArenaGetStr  (root, "mime_type",    DRBFIELD_MIME_TYPE    & fields, arena, &meta->mimeType);
+    meta->fields |= drbJsonArenaGetInt  (root, "revision",     DRBFIELD_REVISION     & fields, &meta->revision);
+    meta->modifiedEpoch    = drbJsonArenaGetTime(root, "modified",     DRBFIELD_MODIFIED     & fields);
+    meta->clientMtimeEpoch = drbJsonArenaGetTime(root, "client_mtime", DRBFIELD_CLIENT_MTIME & fields);
+    
+    json_t *contents = fields & DRBFIELD_CONTENTS ? json_object_get(root, "contents") : NULL;
+    if (contents) {
+        meta->contents = drbJsonArenaMetadataList(contents, arena, fields);
+        meta->fields |= DRBFIELD_CONTENTS;
+    }
+    return meta;
+}
+
+/*!
+ * \brief   Parse a JSON delta in an arena.
+ * \param   root     JSON root node that should contain the delta
+ * \param   arena    arena where the delta is allocated
+ * \param   fields   DRBFIELD_XXX mask of the entries metadata fields to parse
+ * \return  parsed delta (NULL while the arena measures)
+ */
+static drbArenaDelta* drbJsonArenaDelta(json_t *root, drbArena* arena, unsigned int fields) {
+    drbArenaDelta dummy, *delta = drbArenaAlloc(arena, sizeof(drbArenaDelta));
+    if (!delta)
+        delta = &dummy;
+    
+    memset(delta, 0, sizeof(drbArenaDelta));
+    delta->fields |= drbJsonArenaGetBool (root, "reset",    DRBFIELD_RESET,    &delta->reset);
+    delta->fields |= drbJsonArenaGetStr  (root, "cursor",   DRBFIELD_CURSOR,   arena, &delta->cursor);
+    delta->fields |= drbJsonArenaGetBool (root, "has_more", DRBFIELD_HAS_MORE, &delta->hasMore);
+    
+    json_t *entries = json_object_get(root, "entries");
+    size_t size = json_is_array(entries) ? json_array_size(entries) : 0;
+    if (size > 0) {
+        drbArenaDeltaEntry dummyEntry, *array;
+        drbArenaMetadata dummyMeta;
+        array = drbArenaAlloc(arena, sizeof(drbArenaDeltaEntry) * size);
+        
+        for (size_t i = 0; i < size; i++) {
+            drbArenaDeltaEntry* entry = array ? &array[i] : &dummyEntry;
+            json_t* jsonEntry = json_array_get(entries, i);
+            json_t* path = json_array_get(jsonEntry, 0);
+            json_t* meta = json_array_get(jsonEntry, 1);
+            
+            entry->path = json_is_string(path) ? drbArenaStrDup(arena, json_string_value(path)) : NULL;
+            entry->metadata = NULL;
+            if (json_is_object(meta)) {
+                drbArenaMetadata* entryMeta = drbArenaAlloc(arena, sizeof(drbArenaMetadata));
+                entry->metadata = drbJsonArenaMetadata(meta, arena, entryMeta ? entryMeta : &dummyMeta,
+                                                       fields);
+            }
+        }
+        
+        delta->entries.array = array;
+        delta->entries.size = array ? size : 0;
+    }
+    return delta == &dummy ? NULL : delta;
+}
+
+/*!
+ * \brief   Build a structure from a JSON root node in a single memory block.
+ *
+ * The build function is called twice: first to measure the needed memory,
+ * then to build the structure in the exactly sized block. The structure is the
+ * first allocation of the arena, so freeing it releases the whole block.
+ *
+ * \param   src     build source (e.g. JSON root node)
+ * \param   build   function building the structure in an arena
+ * \return  built structure (must be freed with drbDestroyArena)
+ */
+static void* drbJsonArenaBuild(void* src, void* (*build)(void*, drbArena*)) {
+    void* built = NULL;
+    drbStrTable strings = {NULL, 0, 0};
+    drbArena arena = {NULL, 0, 0, &strings};
+    if (src) {
+        build(src, &arena);
+        if ((arena.base = malloc(arena.used)) != NULL) {
+            arena.size = arena.used;
+            arena.used = 0;
+            drbStrTableClear(&strings);
+            built = build(src, &arena);
+        }
+    }
+    drbStrTableFree(&strings);
+    return built;
+}
+
+/*!
+ * \struct  drbJsonArenaSrc
+ * \breif   Source of an arena structure to build.
+ */
+typedef struct {
+    json_t* root;        /*!< JSON root node of the answer. */
+    unsigned int fields; /*!< DRBFIELD_XXX mask of the metadata fields to parse. */
+} drbJsonArenaSrc;
+
+/*!
+ * Build an arena metadata (drbJsonArenaBuild callback).
+ */
+static void* drbJsonArenaRootMetadata(drbJsonArenaSrc* src, drbArena* arena) {
+    drbArenaMetadata dummy, *meta = drbArenaAlloc(arena, sizeof(drbArenaMetadata));
+    drbJsonArenaMetadata(src->root, arena, meta ? meta : &dummy, src->fields);
+    return meta;
+}
+
+/*!
+ * Build an arena metadata list (drbJsonArenaBuild callback).
+ */
+static void* drbJsonArenaRootMetadataList(drbJsonArenaSrc* src, drbArena* arena) {
+    return drbJsonArenaMetadataList(src->root, arena, src->fields);
+}
+
+/*!
+ * Build an arena delta (drbJsonArenaBuild callback).
+ */
+static void* drbJsonArenaRootDelta(drbJsonArenaSrc* src, drbArena* arena) {
+    return drbJsonArenaDelta(src->root, arena, src->fields);
+}
+
+/*!
+ * \brief   Create a drbArenaMetadata and load it from a JSON root node.
+ * \param   root     JSON root node to load in the new drbArenaMetadata
+ * \param   fields   DRBFIELD_XXX mask of the fields to load
+ * \return  created and loaded drbArenaMetadata pointer
+ */
+drbArenaMetadata* drbBuildArenaMetadata(json_t* root, unsigned int fields) {
+    drbJsonArenaSrc src = {root, fields};
+    return drbJsonArenaBuild(root ? &src : NULL, (void*)drbJsonArenaRootMetadata);
+}
+
+/*!
+ * \brief   Create a drbArenaMetadataList and load it from a JSON root node.
+ * \param   root     JSON root node to load in the new drbArenaMetadataList
+ * \param   fields   DRBFIELD_XXX mask of the fields to load
+ * \return  created and loaded drbArenaMetadataList pointer
+ */
+drbArenaMetadataList* drbBuildArenaMetadataList(json_t* root, unsigned int fields) {
+    drbJsonArenaSrc src = {root, fields};
+    return drbJsonArenaBuild(root ? &src : NULL, (void*)drbJsonArenaRootMetadataList);
+}
+
+/*!
+ * \brief   Create a drbArenaDelta and load it from a JSON root node.
+ * \param   root     JSON root node to load in the new drbArenaDelta
+ * \param   fields   DRBFIELD_XXX mask of the entries metadata fields to load
+ * \return  created and loaded drbArenaDelta pointer
+ */
+drbArenaDelta* drbBuildArenaDelta(json_t* root, unsigned int fields) {
+    drbJsonArenaSrc src = {root, fields};
+    return drbJsonArenaBuild(root ? &src : NULL, (void*)drbJsonArenaRootDelta);
+}
+
+/*!
+ * String columns of a drbMetadataTable, with their JSON key and field bit.
+ */
+static const struct {
+    char* key;
+    unsigned int field;
+    size_t column; /*!< Column offset in drbMetadataTable. */
+} drbTableStrColumns[] = {
+    {"client_mtime", DRBFIELD_CLIENT_MTIME, offsetof(drbMetadataTable, clientMtime)},
+    {"icon",         DRBFIELD_ICON,         offsetof(drbMetadataTable, icon)},
+    {"mime_type",    DRBFIELD_MIME_TYPE,    offsetof(drbMetadataTable, mimeType)},
+    {"modified",     DRBFIELD_MODIFIED,     offsetof(drbMetadataTable, modified)},
+    {"path",         DRBFIELD_PATH,         offsetof(drbMetadataTable, path)},
+    {"rev",          DRBFIELD_REV,          offsetof(drbMetadataTable, rev)},
+    {"root",         DRBFIELD_ROOT,         offsetof(drbMetadataTable, root)},
+    {"size",         DRBFIELD_SIZE,         offsetof(drbMetadataTable, size)},
+    {"hash",         DRBFIELD_HASH,         offsetof(drbMetadataTable, hash)},
+};
+
+#define DRB_TABLE_STR_COLUMNS (sizeof(drbTableStrColumns) / sizeof(drbTableStrColumns[0]))
+
+/*!
+ * \struct  drbJsonTableRows
+ * \breif   JSON nodes of the rows of a metadata table to build.
+ */
+typedef struct {
+    json_t* root;   /*!< JSON root node of the answer. */
+    json_t** rows;  /*!< Metadata of each row (JSON null for deleted entries). */
+    json_t** keys;  /*!< Delta path of each row. */
+    size_t count;   /*!< Number of rows. */
+    bool delta;     /*!< Rows are delta entries (keys are defined). */
+    unsigned int fields; /*!< DRBFIELD_XXX mask of the columns to build. */
+} drbJsonTableRows;
+
+/*!
+ * \brief   Copy a string in the strings blob of a table being built.
+ * \param   arena    arena where the table is built
+ * \param   start    strings blob position in the arena
+ * \param   str      string to copy
+ * \param   intern   share the copy with the equal strings
+ * \return  string offset in the strings blob (0 while the arena measures).
+ */
+static unsigned int drbJsonTableStr(drbArena* arena, size_t start, const char* str,
+                                    bool intern) {
+    char* copy = intern ? drbArenaStrIntern(arena, str) : drbArenaStrDup(arena, str);
+    return copy ? (unsigned int)(copy - arena->base - start) : 0;
+}
+
+/*!
+ * \brief   Build a metadata table in an arena.
+ *
+ * The columns of the fields masked out are not allocated (left NULL).
+ *
+ * \param       src     rows to load in the table
+ * \param       arena   arena where columns and strings are allocated
+ * \param[out]  table   table to load
+ * \return  table
+ */
+static drbMetadataTable* drbJsonTable(drbJsonTableRows* src, drbArena* arena,
+                                      drbMetadataTable* table) {
+    size_t count = src->count;
+    unsigned int mask = src->fields;
+    bool fill = arena->base != NULL; // otherwise, the arena only measures
+    
+    memset(table, 0, sizeof(drbMetadataTable));
+    table->rows     = count;
+    table->fields   = drbArenaAlloc(arena, count * sizeof(unsigned int));
+    if (mask & DRBFIELD_BYTES)
+        table->bytes    = drbArenaAlloc(arena, count * sizeof(uint64_t));
+    if (mask & DRBFIELD_REVISION)
+        table->revision = drbArenaAlloc(arena, count * sizeof(unsigned int));
+    if (mask & DRBFIELD_CLIENT_MTIME)
+        table->clientMtimeEpoch = drbArenaAlloc(arena, count * sizeof(int64_t));
+    if (mask & DRBFIELD_MODIFIED)
+        table->modifiedEpoch    = drbArenaAlloc(arena, count * sizeof(int64_t));
+    for (size_t c = 0; c < DRB_TABLE_STR_COLUMNS; c++) {
+        unsigned int** column = (void*)((char*)table + drbTableStrColumns[c].column);
+        if (mask & drbTableStrColumns[c].field)
+            *column = drbArenaAlloc(arena, count * sizeof(unsigned int));
+    }
+    if (src->delta)
+        table->key = drbArenaAlloc(arena, count * sizeof(unsigned int));
+    if (mask & (DRBFIELD_IS_DIR | DRBFIELD_THUMB_EXISTS | DRBFIELD_IS_DELETED))
+        table->flags    = drbArenaAlloc(arena, count * sizeof(unsigned char));
+    
+    // Offset 0 is an empty string, used by undefined strings
+    size_t start = arena->used;
+    table->strings = fill ? arena->base + start : NULL;
+    drbArenaStrDup(arena, "");
+    
+    for (size_t i = 0; i < count; i++) {
+        json_t* row = src->rows[i];
+        unsigned int fields = 0, revision = 0;
+        uint64_t bytes = 0;
+        unsigned char flags = 0;
+        bool isDir = false, thumbExists = false, isDeleted = false;
+        
+        fields |= drbJsonArenaGetInt64(row, "bytes",       DRBFIELD_BYTES        & mask, &bytes);
+        fields |= drbJsonArenaGetInt (row, "revision",     DRBFIELD_REVISION     & mask, &revision);
+        fields |= drbJsonArenaGetBool(row, "is_dir",       DRBFIELD_IS_DIR       & mask, &isDir);
+        fields |= drbJsonArenaGetBool(row, "thumb_exists", DRBFIELD_THUMB_EXISTS & mask, &thumbExists);
+        fields |= drbJsonArenaGetBool(row, "is_deleted",   DRBFIELD_IS_DELETED   & mask, &isDeleted);
+        flags |= (isDir ? DRBFLAG_IS_DIR : 0) | (thumbExists ? DRBFLAG_THUMB_EXISTS : 0)
+               | (isDeleted ? DRBFLAG_IS_DELETED : 0);
+        
+        for (size_t c = 0; c < DRB_TABLE_STR_COLUMNS; c++) {
+            const char* value;
+            unsigned int offset = 0;
+            if (!(mask & drbTableStrColumns[c].field))
+                continue;
+            if (json_unpack(row, "{ss}", drbTableStrColumns[c].key, &value) != -1) {
+                offset = drbJsonTableStr(arena, start, value,
+                                         drbTableStrColumns[c].field & DRB_INTERNED_FIELDS);
+                fields |= drbTableStrColumns[c].field;
+            }
+            if (fill)
+                (*(unsigned int**)((char*)table + drbTableStrColumns[c].column))[i] = offset;
+        }
+        
+        if (src->delta) {
+            json_t* key = src->keys[i];
+            unsigned int offset = json_is_string(key) ? drbJsonTableStr(arena, start, json_string_value(key), false) : 0;
+            if (fill)
+                table->key[i] = offset;
+        }
+        
+        if (fill) {
+            table->fields[i] = fields;
+            if (table->flags)
+                table->flags[i] = flags;
+            if (table->bytes)
+                table->bytes[i] = bytes;
+            if (table->revision)
+                table->revision[i] = revision;
+            if (table->clientMtimeEpoch)
+                table->clientMtimeEpoch[i] = drbJsonArenaGetTime(row, "client_mtime", DRBFIELD_CLIENT_MTIME);
+            if (table->modifiedEpoch)
+                table->modifiedEpoch[i] = drbJsonArenaGetTime(row, "modified", DRBFIELD_MODIFIED);
+        }
+    }
+    
+    table->stringsSize = arena->used - start;
+    return table;
+}
+
+/*!
+ * Build a drbMetadataTable (drbJsonArenaBuild callback).
+ */
+static void* drbJsonRootTable(drbJsonTableRows* src, drbArena* arena) {
+    drbMetadataTable dummy, *table = drbArenaAlloc(arena, sizeof(drbMetadataTable));
+    drbJsonTable(src, arena, table ? table : &dummy);
+    return table;
+}
+
+/*!
+ * Build a drbDeltaTable (drbJsonArenaBuild callback).
+ */
+static void* drbJsonRootDeltaTable(drbJsonTableRows* src, drbArena* arena) {
+    drbDeltaTable dummy, *delta = drbArenaAlloc(arena, sizeof(drbDeltaTable));
+    if (!delta)
+        delta = &dummy;
+    
+    memset(delta, 0, sizeof(drbDeltaTable));
+    delta->fields |= drbJsonArenaGetBool(src->root, "reset",    DRBFIELD_RESET,    &delta->reset);
+    delta->fields |= drbJsonArenaGetStr (src->root, "cursor",   DRBFIELD_CURSOR,   arena, &delta->cursor);
+    delta->fields |= drbJsonArenaGetBool(src->root, "has_more", DRBFIELD_HAS_MORE, &delta->hasMore);
+    drbJsonTable(src, arena, &delta->entries);
+    
+    return delta == &dummy ? NULL : delta;
+}
+
+/*!
+ * \brief   Build a table from its rows.
+ * \param   src     rows to load in the table (freed by the function)
+ * \param   build   function building the table in an arena
+ * \return  built table
+ */
+static void* drbJsonTableBuild(drbJsonTableRows* src, void* (*build)(drbJsonTableRows*, drbArena*)) {
+    void* table = NULL;
+    if (src->count == 0 || (src->rows && (!src->delta || src->keys))) {
+        table = drbJsonArenaBuild(src, (void*)build);
+    }
+    free(src->rows);
+    free(src->keys);
+    return table;
+}
+
+/*!
+ * \brief   Create a drbMetadataTable and load it from a JSON list root node.
+ * \param   root     JSON root node (metadata list) to load in the new table
+ * \param   fields   DRBFIELD_XXX mask of the columns to load
+ * \return  created and loaded drbMetadataTable pointer
+ */
+drbMetadataTable* drbBuildMetadataTable(json_t* root, unsigned int fields) {
+    drbJsonTableRows src = {root, NULL, NULL, 0, false, fields};
+    if (!json_is_array(root))
+        return NULL;
+    
+    if ((src.count = json_array_size(root)) > 0 &&
+        (src.rows = malloc(src.count * sizeof(json_t*))) != NULL) {
+        for (size_t i = 0; i < src.count; i++)
+            src.rows[i] = json_array_get(root, i);
+    }
+    return drbJsonTableBuild(&src, (void*)drbJsonRootTable);
+}
+
+/*!
+ * \brief   Create a drbMetadataTable and load it from a JSON metadata node.
+ *
+ * The metadata is the table first row, followed by its contents (unless
+ * DRBFIELD_CONTENTS is masked out).
+ *
+ * \param   root     JSON root node (metadata) to load in the new table
+ * \param   fields   DRBFIELD_XXX mask of the columns to load
+ * \return  created and loaded drbMetadataTable pointer
+ */
+drbMetadataTable* drbBuildItemTable(json_t* root, unsigned int fields) {
+    drbJsonTableRows src = {root, NULL, NULL, 0, false, fields};
+    json_t* contents = fields & DRBFIELD_CONTENTS ? json_object_get(root, "contents") : NULL;
+    if (!json_is_object(root))
+        return NULL;
+    
+    src.count = 1 + (json_is_array(contents) ? json_array_size(contents) : 0);
+    if ((src.rows = malloc(src.count * sizeof(json_t*))) != NULL) {
+        src.rows[0] = root;
+        for (size_t i = 1; i < src.count; i++)
+            src.rows[i] = json_array_get(contents, i - 1);
+    }
+    return drbJsonTableBuild(&src, (void*)drbJsonRootTable);
+}
+
+/*!
+ * \brief   Create a drbDeltaTable and load it from a JSON root node.
+ * \param   root     JSON root node to load in the new drbDeltaTable
+ * \param   fields   DRBFIELD_XXX mask of the entries columns to load
+ * \return  created and loaded drbDeltaTable pointer
+ */
+drbDeltaTable* drbBuildDeltaTable(json_t* root, unsigned int fields) {
+    drbJsonTableRows src = {root, NULL, NULL, 0, true, fields};
+    json_t* entries = json_object_get(root, "entries");
+    if (!json_is_object(root))
+        return NULL;
+    
+    if ((src.count = json_is_array(entries) ? json_array_size(entries) : 0) > 0 &&
+        (src.rows = malloc(src.count * sizeof(json_t*))) != NULL &&
+        (src.keys = malloc(src.count * sizeof(json_t*))) != NULL) {
+        for (size_t i = 0; i < src.count; i++) {
+            json_t* entry = json_array_get(entries, i);
+            src.keys[i] = json_array_get(entry, 0);
+            src.rows[i] = json_array_get(entry, 1);
+        }
+    }
+    return drbJsonTableBuild(&src, (void*)drbJsonRootDeltaTable);
 }
 
 /*!
@@ -148,95 +960,117 @@ static void drbJsonParseDeltaEntry(json_t *root, drbDeltaEntry* entry) {
  * \return  extracted error message
  */
 char* drbParseError(char* str) {
-    char* error = NULL;
-    json_t *root = json_loads(str, 0, NULL);
-    if (root){
-        error = drbJsonGetStr(root, "error");
-        json_decref(root);
-    }
-    return error;
+    return drbJsonParse(str, (void*)drbBuildError);
 }
 
 
 /*!
- * \brief   Create a drbCopyRef and load it from a JSON formated text.
- * \param   str   JSON formated text to load in the new drbCopyRef
+ * \brief   Create a drbCopyRef and load it from a JSON root node.
+ * \param   root   JSON root node to load in the new drbCopyRef
  * \return  created and loaded drbCopyRef pointer
  */
-drbCopyRef* drbParseCopyRef(char* str) {
+drbCopyRef* drbBuildCopyRef(json_t* root) {
     drbCopyRef* ref = NULL;
-    json_t *root = json_loads(str, 0, NULL);
     if (root) {
         if((ref = calloc(1, sizeof(drbCopyRef))) != NULL) {
             ref->copyRef = drbJsonGetStr (root, "copy_ref");
             ref->expires = drbJsonGetStr (root, "expires");
         }
-        json_decref(root);
     }
     return ref;
 }
 
 /*!
- * \brief   Create a drbParseLink and load it from a JSON formated text.
- * \param   str   JSON formated text to load in the new drbParseLink
+ * \brief   Create a drbCopyRef and load it from a JSON formated text.
+ * \param   str   JSON formated text to load in the new drbCopyRef
+ * \return  created and loaded drbCopyRef pointer
+ */
+drbCopyRef* drbParseCopyRef(char* str) {
+    return drbJsonParse(str, (void*)drbBuildCopyRef);
+}
+
+/*!
+ * \brief   Create a drbLink and load it from a JSON root node.
+ * \param   root   JSON root node to load in the new drbLink
  * \return  created and loaded drbLink pointer
  */
-drbLink* drbParseLink(char* str) {
-    json_t *root = json_loads(str, 0, NULL);
+drbLink* drbBuildLink(json_t* root) {
     drbLink* link = NULL;
     if (root) {
         if((link = calloc(1, sizeof(drbLink))) != NULL) {
             link->url     = drbJsonGetStr (root, "url");
             link->expires = drbJsonGetStr (root, "expires");
         }
-        json_decref(root);
     }
     return link;
 }
 
 /*!
- * \brief   Create a drbMetadataList and load it from a JSON formated text.
- * \param   str   JSON formated text to load in the new drbMetadataList
+ * \brief   Create a drbParseLink and load it from a JSON formated text.
+ * \param   str   JSON formated text to load in the new drbParseLink
+ * \return  created and loaded drbLink pointer
+ */
+drbLink* drbParseLink(char* str) {
+    return drbJsonParse(str, (void*)drbBuildLink);
+}
+
+/*!
+ * \brief   Create a drbMetadataList and load it from a JSON root node.
+ * \param   root     JSON root node to load in the new drbMetadataList
+ * \param   fields   DRBFIELD_XXX mask of the fields to load
  * \return  created and loaded drbMetadataList pointer
  */
-drbMetadataList* drbStrParseMetadataList(char* str) {
+drbMetadataList* drbBuildMetadataList(json_t* root, unsigned int fields) {
     drbMetadataList* list = NULL;
-    json_t *root = json_loads(str, 0, NULL);
     if (root) {
         if((list = malloc(sizeof(drbMetadataList))) != NULL) {
-            drbJsonParseMetadataList(root, list);
+            drbJsonParseMetadataList(root, list, fields);
         }
-        json_decref(root);
     }
     return list;
 }
 
 /*!
- * \brief   Create a drbMetadata and load it from a JSON formated text.
- * \param   str   JSON formated text to load in the new drbMetadata
+ * \brief   Create a drbMetadataList and load it from a JSON formated text.
+ * \param   str   JSON formated text to load in the new drbMetadataList
+ * \return  created and loaded drbMetadataList pointer
+ */
+drbMetadataList* drbStrParseMetadataList(char* str) {
+    return drbJsonParseFields(str, (void*)drbBuildMetadataList, DRBFIELD_ALL);
+}
+
+/*!
+ * \brief   Create a drbMetadata and load it from a JSON root node.
+ * \param   root     JSON root node to load in the new drbMetadata
+ * \param   fields   DRBFIELD_XXX mask of the fields to load
  * \return  created and loaded drbMetadata pointer
  */
-drbMetadata* drbParseMetadata(char* str) {
+drbMetadata* drbBuildMetadata(json_t* root, unsigned int fields) {
     drbMetadata* meta = NULL;
-    json_loads(NULL, 0, NULL);
-    json_t *root = json_loads(str, 0, NULL);
     if (root) {
         if((meta = malloc(sizeof(drbMetadata))) != NULL) {
-            drbJsonParseMetadata(root, meta);
+            drbJsonParseMetadata(root, meta, fields);
         }
-        json_decref(root);
     }
     return meta;
 }
 
 /*!
- * \brief   Create a drbAccountInfo and load it from a JSON formated text.
- * \param   str   JSON formated text to load in the new drbAccountInfo
+ * \brief   Create a drbMetadata and load it from a JSON formated text.
+ * \param   str   JSON formated text to load in the new drbMetadata
+ * \return  created and loaded drbMetadata pointer
+ */
+drbMetadata* drbParseMetadata(char* str) {
+    return drbJsonParseFields(str, (void*)drbBuildMetadata, DRBFIELD_ALL);
+}
+
+/*!
+ * \brief   Create a drbAccountInfo and load it from a JSON root node.
+ * \param   root   JSON root node to load in the new drbAccountInfo
  * \return  created and loaded drbAccountInfo pointer
  */
-drbAccountInfo* drbParseAccountInfo(char* str) {
+drbAccountInfo* drbBuildAccountInfo(json_t* root) {
     drbAccountInfo* info = NULL;
-    json_t *root = json_loads(str, 0, NULL);
     if (root) {
         if((info = calloc(1, sizeof(drbAccountInfo))) != NULL) {
             info->referralLink = drbJsonGetStr(root, "referral_link");
@@ -253,20 +1087,28 @@ drbAccountInfo* drbParseAccountInfo(char* str) {
                 info->quotaInfo.normal     = drbJsonGetInt(quota, "normal");
             }
         }
-        json_decref(root);
     }
     return info;
 }
 
+/*!
+ * \brief   Create a drbAccountInfo and load it from a JSON formated text.
+ * \param   str   JSON formated text to load in the new drbAccountInfo
+ * \return  created and loaded drbAccountInfo pointer
+ */
+drbAccountInfo* drbParseAccountInfo(char* str) {
+    return drbJsonParse(str, (void*)drbBuildAccountInfo);
+}
+
 
 /*!
- * \brief   Create a drbDelta and load it from a JSON formated text.
- * \param   str   JSON formated text to load in the new drbDelta
+ * \brief   Create a drbDelta and load it from a JSON root node.
+ * \param   root     JSON root node to load in the new drbDelta
+ * \param   fields   DRBFIELD_XXX mask of the entries metadata fields to load
  * \return  created and loaded drbDelta pointer
  */
-drbDelta* drbParseDelta(char* str) {
+drbDelta* drbBuildDelta(json_t* root, unsigned int fields) {
     drbDelta* delta = NULL;
-    json_t *root = json_loads(str, 0, NULL);
     
     if (root) {
         if((delta = calloc(1, sizeof(drbDelta))) != NULL) {
@@ -284,33 +1126,48 @@ drbDelta* drbParseDelta(char* str) {
                         delta->entries.size = size;
                         for (int i = 0; i < delta->entries.size; i++) {
                             json_t *entry = json_array_get(entries, i);
-                            drbJsonParseDeltaEntry(entry, &delta->entries.array[i]);
+                            drbJsonParseDeltaEntry(entry, &delta->entries.array[i], fields);
                         }
                     }
                 }
             }
         }
-        json_decref(root);
     }
     return delta;
 }
 
 /*!
- * \brief   Create a drbPollDelta and load it from a JSON formated text.
- * \param   str   JSON formated text to load in the new drbPollDelta
+ * \brief   Create a drbDelta and load it from a JSON formated text.
+ * \param   str   JSON formated text to load in the new drbDelta
+ * \return  created and loaded drbDelta pointer
+ */
+drbDelta* drbParseDelta(char* str) {
+    return drbJsonParseFields(str, (void*)drbBuildDelta, DRBFIELD_ALL);
+}
+
+/*!
+ * \brief   Create a drbPollDelta and load it from a JSON root node.
+ * \param   root   JSON root node to load in the new drbPollDelta
  * \return  created and loaded drbPollDelta pointer
  */
-drbPollDelta* drbParsePollDelta(char* str) {
+drbPollDelta* drbBuildPollDelta(json_t* root) {
     drbPollDelta* poll = NULL;
-    json_t *root = json_loads(str, 0, NULL);
     
     if (root) {
         if((poll = calloc(1, sizeof(drbPollDelta))) != NULL) {
             poll->changes = drbJsonGetBool(root, "changes");
             poll->backoff = drbJsonGetInt(root, "backoff");
         }
-        json_decref(root);
     }
     
     return poll;
+}
+
+/*!
+ * \brief   Create a drbPollDelta and load it from a JSON formated text.
+ * \param   str   JSON formated text to load in the new drbPollDelta
+ * \return  created and loaded drbPollDelta pointer
+ */
+drbPollDelta* drbParsePollDelta(char* str) {
+    return drbJsonParse(str, (void*)drbBuildPollDelta);
 }
\ No newline at end of file
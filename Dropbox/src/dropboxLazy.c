@@ -0,0 +1,617 @@
+/*!
+ * \file    dropboxLazy.c
+ * \brief   Metadata lists decoded on access from the raw server answer.
+ *
+ * The answer is kept as received and only its entries are located (one offset
+ * index per entry). Fields are found and decoded when they are accessed, and
+ * strings without escape sequences are returned as views in the answer.
+ *
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#define _GNU_SOURCE
+
+#define LAZY_READ_SIZE (16*1024)
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <jansson.h>
+#include <memStream.h>
+#include "dropboxLazy.h"
+#include "dropboxJson.h"
+
+/*!
+ * \struct  drbLazyEntry
+ * \breif   Location of a list entry in the raw answer.
+ */
+typedef struct {
+    size_t key;   /*!< Offset of the delta entry path string (0 if none). */
+    size_t start; /*!< Offset of the metadata object. */
+    size_t end;   /*!< End offset of the metadata object (start if none). */
+} drbLazyEntry;
+
+/*!
+ * \struct  drbLazyStr
+ * \breif   Decoded copy of an escaped string of the raw answer.
+ */
+typedef struct {
+    size_t offset; /*!< Offset of the string in the raw answer (0 if free). */
+    char* str;     /*!< Decoded string. */
+    size_t length; /*!< Decoded string length. */
+} drbLazyStr;
+
+struct drbLazyList {
+    char* raw;              /*!< Raw answer (NUL terminated). */
+    size_t rawSize;         /*!< Raw answer size. */
+    drbLazyEntry* entries;  /*!< Entries location. */
+    size_t size;            /*!< Number of entries. */
+    unsigned int fields;    /*!< DRBFIELD_RESET, _CURSOR and _HAS_MORE bits. */
+    bool reset;
+    bool hasMore;
+    char* cursor;
+    drbLazyStr* decoded;    /*!< Decoded strings, by offset (open addressing). */
+    size_t decodedCapacity; /*!< Number of decoded strings slots (power of 2). */
+    size_t decodedCount;    /*!< Number of decoded strings. */
+};
+
+/*!
+ * \brief   Get the JSON key of a metadata field.
+ * \param   field   DRBFIELD_XXX bit of the field
+ * \return  JSON key (NULL if field is not a metadata field).
+ */
+static const char* drbLazyFieldKey(unsigned int field) {
+    switch (field) {
+        case DRBFIELD_BYTES:        return "bytes";
+        case DRBFIELD_CLIENT_MTIME: return "client_mtime";
+        case DRBFIELD_ICON:         return "icon";
+        case DRBFIELD_IS_DIR:       return "is_dir";
+        case DRBFIELD_MIME_TYPE:    return "mime_type";
+        case DRBFIELD_MODIFIED:     return "modified";
+        case DRBFIELD_PATH:         return "path";
+        case DRBFIELD_REV:          return "rev";
+        case DRBFIELD_REVISION:     return "revision";
+        case DRBFIELD_ROOT:         return "root";
+        case DRBFIELD_SIZE:         return "size";
+        case DRBFIELD_THUMB_EXISTS: return "thumb_exists";
+        case DRBFIELD_IS_DELETED:   return "is_deleted";
+        case DRBFIELD_HASH:         return "hash";
+        default:                    return NULL;
+    }
+}
+
+/*!
+ * \brief   Skip JSON white spaces.
+ * \param   p     current position
+ * \param   end   end of the JSON text
+ * \return  position of the next significant character.
+ */
+static const char* drbLazySkipWs(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+        p++;
+    return p;
+}
+
+/*!
+ * \brief   Skip a JSON string.
+ * \param       p         string opening quote position
+ * \param       end       end of the JSON text
+ * \param[out]  escaped   set to true if the string has escape sequences
+ *                        (could be NULL)
+ * \return  position following the closing quote (NULL on syntax error).
+ */
+static const char* drbLazySkipStr(const char* p, const char* end, bool* escaped) {
+    for (p++; p < end; p++) {
+        if (*p == '\\') {
+            if (escaped)
+                *escaped = true;
+            p++;
+        } else if (*p == '"')
+            return p + 1;
+    }
+    return NULL;
+}
+
+/*!
+ * \brief   Skip a JSON value.
+ * \param   p     value position
+ * \param   end   end of the JSON text
+ * \return  position following the value (NULL on syntax error).
+ */
+static const char* drbLazySkipValue(const char* p, const char* end) {
+    if ((p = drbLazySkipWs(p, end)) >= end)
+        return NULL;
+    
+    if (*p == '"')
+        return drbLazySkipStr(p, end, NULL);
+    
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            if (*p == '"') {
+                if ((p = drbLazySkipStr(p, end, NULL)) == NULL)
+                    return NULL;
+                continue;
+            }
+            if (*p == '{' || *p == '[')
+                depth++;
+            else if ((*p == '}' || *p == ']') && --depth == 0)
+                return p + 1;
+            p++;
+        }
+        return NULL;
+    }
+    
+    // Number, boolean or null
+    const char* start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+           *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+        p++;
+    return p > start ? p : NULL;
+}
+
+/*!
+ * \brief   Skip the separator following an object member or array element.
+ * \param   p     position following the member or element
+ * \param   end   end of the JSON text
+ * \return  position of the next member or element (or of the closing char).
+ */
+static const char* drbLazySkipSeparator(const char* p, const char* end) {
+    p = drbLazySkipWs(p, end);
+    if (p < end && *p == ',')
+        p = drbLazySkipWs(p + 1, end);
+    return p;
+}
+
+/*!
+ * \brief   Find the value of a JSON object member.
+ * \param   p     object opening brace position
+ * \param   end   end of the object
+ * \param   key   member name (without escape sequences)
+ * \return  member value position (NULL if not found).
+ */
+static const char* drbLazyFindKey(const char* p, const char* end, const char* key) {
+    size_t keyLength = strlen(key);
+    
+    if (p >= end || *p != '{')
+        return NULL;
+    
+    p = drbLazySkipWs(p + 1, end);
+    while (p < end && *p == '"') {
+        const char* name = p;
+        if ((p = drbLazySkipStr(p, end, NULL)) == NULL)
+            return NULL;
+        bool found = p - name - 2 == keyLength && memcmp(name + 1, key, keyLength) == 0;
+        
+        p = drbLazySkipWs(p, end);
+        if (p >= end || *p != ':')
+            return NULL;
+        p = drbLazySkipWs(p + 1, end);
+        if (found)
+            return p;
+        
+        if ((p = drbLazySkipValue(p, end)) == NULL)
+            return NULL;
+        p = drbLazySkipSeparator(p, end);
+    }
+    return NULL;
+}
+
+/*!
+ * \brief   Read 4 hexadecimal digits of a \\u escape sequence.
+ * \param   p   first digit position
+ * \return  read code unit.
+ */
+static unsigned int drbLazyHex4(const char* p) {
+    unsigned int value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9')      value |= c - '0';
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+    }
+    return value;
+}
+
+/*!
+ * \brief   Decode the content of an escaped JSON string.
+ * \param       p     first character of the string content
+ * \param       end   closing quote position
+ * \param[out]  dst   decoded string (at least end - p + 1 bytes)
+ * \return  decoded string length.
+ */
+static size_t drbLazyUnescape(const char* p, const char* end, char* dst) {
+    char* out = dst;
+    while (p < end) {
+        if (*p != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+        p++;
+        switch (*p++) {
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                if (end - p < 4) {
+                    p = end; // truncated escape sequence
+                    break;
+                }
+                unsigned int code = drbLazyHex4(p);
+                p += 4;
+                // Surrogate pair
+                if (code >= 0xD800 && code <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    unsigned int low = drbLazyHex4(p + 2);
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                // UTF-8 encoding (never longer than the escape sequence)
+                if (code < 0x80) {
+                    *out++ = code;
+                } else if (code < 0x800) {
+                    *out++ = 0xC0 | (code >> 6);
+                    *out++ = 0x80 | (code & 0x3F);
+                } else if (code < 0x10000) {
+                    *out++ = 0xE0 | (code >> 12);
+                    *out++ = 0x80 | ((code >> 6) & 0x3F);
+                    *out++ = 0x80 | (code & 0x3F);
+                } else {
+                    *out++ = 0xF0 | (code >> 18);
+                    *out++ = 0x80 | ((code >> 12) & 0x3F);
+                    *out++ = 0x80 | ((code >> 6) & 0x3F);
+                    *out++ = 0x80 | (code & 0x3F);
+                }
+                break;
+            }
+            default: *out++ = p[-1]; break; // '"', '\\' and '/'
+        }
+    }
+    *out = '\0';
+    return out - dst;
+}
+
+/*!
+ * \brief   Find the decoded copy slot of an escaped string.
+ * \param   list     list owning the decoded strings
+ * \param   offset   offset of the string in the raw answer
+ * \return  string slot (free if the string was not decoded yet).
+ */
+static drbLazyStr* drbLazyDecodedSlot(drbLazyList* list, size_t offset) {
+    size_t mask = list->decodedCapacity - 1;
+    size_t slot = (offset * 0x9E3779B97F4A7C15ull >> 17) & mask;
+    while (list->decoded[slot].offset && list->decoded[slot].offset != offset)
+        slot = (slot + 1) & mask;
+    return &list->decoded[slot];
+}
+
+/*!
+ * \brief   Grow the decoded strings slots of a list.
+ * \param   list   list to grow
+ * \return  true on success, false if the memory can't be allocated.
+ */
+static bool drbLazyGrowDecoded(drbLazyList* list) {
+    drbLazyStr* old = list->decoded;
+    size_t oldCapacity = list->decodedCapacity;
+    size_t capacity = oldCapacity ? oldCapacity * 2 : 64;
+    
+    if ((list->decoded = calloc(capacity, sizeof(drbLazyStr))) == NULL) {
+        list->decoded = old;
+        return false;
+    }
+    list->decodedCapacity = capacity;
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (old[i].offset)
+            *drbLazyDecodedSlot(list, old[i].offset) = old[i];
+    }
+    free(old);
+    return true;
+}
+
+/*!
+ * \brief   Get a JSON string of the raw answer.
+ *
+ * Strings without escape sequences are views in the raw answer (they are not
+ * NUL terminated). Others are decoded once in a copy owned by the list.
+ *
+ * \param       list     list owning the raw answer
+ * \param       p        string opening quote position
+ * \param[out]  str      string
+ * \param[out]  length   string length
+ * \return  true on success, false on syntax error or memory allocation error.
+ */
+static bool drbLazyView(drbLazyList* list, const char* p, const char** str, size_t* length) {
+    bool escaped = false;
+    const char* end = drbLazySkipStr(p, list->raw + list->rawSize, &escaped);
+    if (!end)
+        return false;
+    
+    if (!escaped) {
+        *str = p + 1;
+        *length = end - p - 2;
+        return true;
+    }
+    
+    if ((list->decodedCount + 1) * 2 > list->decodedCapacity && !drbLazyGrowDecoded(list))
+        return false;
+    
+    drbLazyStr* decoded = drbLazyDecodedSlot(list, p - list->raw);
+    if (!decoded->offset) {
+        if ((decoded->str = malloc(end - p)) == NULL)
+            return false;
+        decoded->length = drbLazyUnescape(p + 1, end - 1, decoded->str);
+        decoded->offset = p - list->raw;
+        list->decodedCount++;
+    }
+    *str = decoded->str;
+    *length = decoded->length;
+    return true;
+}
+
+/*!
+ * \brief   Find the value of a metadata field of a list entry.
+ * \param   list    list to search
+ * \param   row     entry index
+ * \param   field   DRBFIELD_XXX bit of the field
+ * \return  field value position (NULL if not found).
+ */
+static const char* drbLazyFieldValue(const drbLazyList* list, size_t row, unsigned int field) {
+    const char* key = drbLazyFieldKey(field);
+    if (!list || row >= list->size || !key)
+        return NULL;
+    
+    drbLazyEntry* entry = &list->entries[row];
+    return drbLazyFindKey(list->raw + entry->start, list->raw + entry->end, key);
+}
+
+/*!
+ * \brief   Add an entry location to a list being indexed.
+ * \param   list       list being indexed
+ * \param   capacity   allocated entries
+ * \param   entry      entry location to add
+ * \return  true on success, false if the memory can't be allocated.
+ */
+static bool drbLazyAddEntry(drbLazyList* list, size_t* capacity, drbLazyEntry entry) {
+    if (list->size == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 256;
+        if ((list->entries = memRealloc(list->entries, *capacity * sizeof(drbLazyEntry))) == NULL)
+            return false;
+    }
+    list->entries[list->size++] = entry;
+    return true;
+}
+
+/*!
+ * \brief   Index the entries of a JSON array of metadata or delta entries.
+ * \param   list    list to index
+ * \param   p       array opening bracket position
+ * \param   delta   elements are delta entries ([path, metadata] arrays)
+ * \return  true on success, false on syntax error or memory allocation error.
+ */
+static bool drbLazyIndex(drbLazyList* list, const char* p, bool delta) {
+    const char* end = list->raw + list->rawSize;
+    size_t capacity = 0;
+    
+    if (p >= end || *p != '[')
+        return false;
+    
+    p = drbLazySkipWs(p + 1, end);
+    while (p < end && *p != ']') {
+        drbLazyEntry entry = {0, 0, 0};
+        const char* meta = p;
+        
+        if (delta) {
+            // [path, metadata or null]
+            if (*p != '[')
+                return false;
+            p = drbLazySkipWs(p + 1, end);
+            if (p < end && *p == '"')
+                entry.key = p - list->raw;
+            if ((p = drbLazySkipValue(p, end)) == NULL)
+                return false;
+            meta = drbLazySkipSeparator(p, end);
+        }
+        
+        if ((p = drbLazySkipValue(meta, end)) == NULL)
+            return false;
+        entry.start = meta - list->raw;
+        entry.end = *meta == '{' ? (size_t)(p - list->raw) : entry.start;
+        
+        if (delta) {
+            p = drbLazySkipWs(p, end);
+            if (p >= end || *p != ']')
+                return false;
+            p++;
+        }
+        
+        if (!drbLazyAddEntry(list, &capacity, entry))
+            return false;
+        p = drbLazySkipSeparator(p, end);
+    }
+    return p < end;
+}
+
+/*!
+ * \brief   Load the raw answer while it is read.
+ * \param   xread   function reading the next part of the answer
+ * \param   data    xread data (stream)
+ * \param   arg     unused loader argument
+ * \return  loaded answer, NUL terminated (must be freed by caller).
+ */
+char* drbLoadLazy(size_t (*xread)(void*, size_t, void*), void* data, void* arg) {
+    char* raw = NULL;
+    size_t size = 0, capacity = 0, read;
+    
+    do {
+        // Grow geometrically, the answer size is unknown
+        if (capacity - size < LAZY_READ_SIZE + 1) {
+            capacity = capacity ? capacity * 2 : 4 * LAZY_READ_SIZE;
+            if ((raw = memRealloc(raw, capacity)) == NULL)
+                return NULL;
+        }
+        size += (read = xread(raw + size, LAZY_READ_SIZE, data));
+    } while (read > 0);
+    
+    raw[size] = '\0';
+    return raw;
+}
+
+/*!
+ * \brief   Create an empty lazy list owning a raw answer.
+ * \param   raw   raw answer (freed on failure)
+ * \return  created list (NULL on failure)
+ */
+static drbLazyList* drbLazyCreate(char* raw) {
+    drbLazyList* list = NULL;
+    if (raw && (list = calloc(1, sizeof(drbLazyList))) != NULL) {
+        list->raw = raw;
+        list->rawSize = strlen(raw);
+    } else
+        free(raw);
+    return list;
+}
+
+/*!
+ * \brief   Create a drbLazyList from a raw metadata list answer.
+ * \param   raw   raw JSON answer (owned by the list, freed on failure)
+ * \return  created and indexed drbLazyList pointer
+ */
+drbLazyList* drbBuildLazyList(char* raw) {
+    drbLazyList* list = drbLazyCreate(raw);
+    if (list && !drbLazyIndex(list, drbLazySkipWs(raw, raw + list->rawSize), false)) {
+        drbDestroyLazyList(list);
+        list = NULL;
+    }
+    return list;
+}
+
+/*!
+ * \brief   Create a drbLazyList from a raw delta answer.
+ *
+ * The delta informations (cursor, reset and has_more) are decoded eagerly.
+ *
+ * \param   raw   raw JSON answer (owned by the list, freed on failure)
+ * \return  created and indexed drbLazyList pointer
+ */
+drbLazyList* drbBuildLazyDelta(char* raw) {
+    drbLazyList* list = drbLazyCreate(raw);
+    if (!list)
+        return NULL;
+    
+    const char* end = raw + list->rawSize;
+    const char* root = drbLazySkipWs(raw, end);
+    const char* value;
+    bool ok = true;
+    
+    if ((value = drbLazyFindKey(root, end, "reset")) != NULL) {
+        list->reset = strncmp(value, "true", 4) == 0;
+        list->fields |= DRBFIELD_RESET;
+    }
+    if ((value = drbLazyFindKey(root, end, "has_more")) != NULL) {
+        list->hasMore = strncmp(value, "true", 4) == 0;
+        list->fields |= DRBFIELD_HAS_MORE;
+    }
+    if ((value = drbLazyFindKey(root, end, "cursor")) != NULL && *value == '"') {
+        const char* cursor;
+        size_t length;
+        if ((ok = drbLazyView(list, value, &cursor, &length)) &&
+            (ok = (list->cursor = strndup(cursor, length)) != NULL))
+            list->fields |= DRBFIELD_CURSOR;
+    }
+    if (ok && (value = drbLazyFindKey(root, end, "entries")) != NULL)
+        ok = drbLazyIndex(list, value, true);
+    
+    if (!ok) {
+        drbDestroyLazyList(list);
+        list = NULL;
+    }
+    return list;
+}
+
+size_t drbLazySize(const drbLazyList* list) {
+    return list ? list->size : 0;
+}
+
+bool drbLazyHasMetadata(const drbLazyList* list, size_t row) {
+    return list && row < list->size && list->entries[row].end > list->entries[row].start;
+}
+
+bool drbLazyGetStr(drbLazyList* list, size_t row, unsigned int field,
+                   const char** str, size_t* length) {
+    const char* value = drbLazyFieldValue(list, row, field);
+    return value && *value == '"' && drbLazyView(list, value, str, length);
+}
+
+bool drbLazyGetInt(const drbLazyList* list, size_t row, unsigned int field,
+                   uint64_t* value) {
+    const char* p = drbLazyFieldValue(list, row, field);
+    if (!p || *p < '0' || *p > '9')
+        return false;
+    *value = strtoull(p, NULL, 10);
+    return true;
+}
+
+bool drbLazyGetTime(drbLazyList* list, size_t row, unsigned int field, int64_t* time) {
+    const char* str;
+    size_t length;
+    // Views are not NUL terminated, but their closing quote stops the parsing
+    return drbLazyGetStr(list, row, field, &str, &length) && drbParseTime(str, time);
+}
+
+bool drbLazyGetBool(const drbLazyList* list, size_t row, unsigned int field,
+                    bool* value) {
+    const char* p = drbLazyFieldValue(list, row, field);
+    if (p && strncmp(p, "true", 4) == 0)
+        *value = true;
+    else if (p && strncmp(p, "false", 5) == 0)
+        *value = false;
+    else
+        return false;
+    return true;
+}
+
+bool drbLazyGetKey(drbLazyList* list, size_t row, const char** str, size_t* length) {
+    return list && row < list->size && list->entries[row].key &&
+           drbLazyView(list, list->raw + list->entries[row].key, str, length);
+}
+
+drbMetadata* drbLazyGetMetadata(const drbLazyList* list, size_t row, unsigned int fields) {
+    drbMetadata* meta = NULL;
+    if (drbLazyHasMetadata(list, row)) {
+        drbLazyEntry* entry = &list->entries[row];
+        json_t* root = json_loadb(list->raw + entry->start, entry->end - entry->start, 0, NULL);
+        if (root) {
+            meta = drbBuildMetadata(root, fields ? fields : DRBFIELD_ALL);
+            json_decref(root);
+        }
+    }
+    return meta;
+}
+
+unsigned int drbLazyGetDelta(const drbLazyList* list, bool* reset, bool* hasMore,
+                             const char** cursor) {
+    if (!list)
+        return 0;
+    *reset = list->reset;
+    *hasMore = list->hasMore;
+    *cursor = list->cursor;
+    return list->fields;
+}
+
+void drbDestroyLazyList(drbLazyList* list) {
+    if (list) {
+        for (size_t i = 0; i < list->decodedCapacity; i++)
+            free(list->decoded[i].str);
+        free(list->decoded);
+        free(list->entries);
+        free(list->cursor);
+        free(list->raw);
+        free(list);
+    }
+}
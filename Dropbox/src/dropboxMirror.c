@@ -0,0 +1,1023 @@
+/*!
+ * \file    dropboxMirror.c
+ * \brief   Local copy of the namespace, kept up to date with the delta pages.
+ *
+ * Each file and folder is a node of a hash table keyed by its lower case path,
+ * and is linked in the children list of its parent folder. A node keeps its
+ * metadata in the binary encoding (drbEncodeMetadata), decoded on lookup.
+ * Folders only known as parents of other entries have no metadata.
+ *
+ * With a checkpoint, the mirror is persisted in two files:
+ * - the snapshot holds the delta cursor followed by the nodes, parents first.
+ *   Its records are aligned on 8 bytes and checksummed (CRC32C), so it is
+ *   mapped in memory on load and the nodes point to their path and metadata
+ *   in it. It is written aside, then renamed.
+ * - the log (checkpoint path with ".log") holds the delta pages applied since
+ *   the snapshot, in the binary encoding (drbEncodeDelta), each written before
+ *   it is applied. Once the log outgrows the snapshot, a new snapshot is
+ *   written and the log is cleared.
+ *
+ * Once the search is enabled, the names of the nodes are indexed, and the
+ * deleted nodes are kept (flagged) to be found with includeDeleted. When a
+ * page leaves more deleted nodes than others, they are all removed from the
+ * mirror and its index, so a long lived mirror does not grow with them.
+ *
+ * Both files carry a generation number, incremented by each snapshot: a log
+ * of another generation than the snapshot is already part of it. A page
+ * carries its cursor, so a lost or torn log tail (detected by the checksums)
+ * only moves the cursor back, and the log is not synced to the disk.
+ *
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "dropbox.h"
+#include "dropboxSearch.h"
+#include "dropboxUtils.h"
+
+/*! Magic number of a snapshot file ("DRBM"). */
+static const uint32_t DRB_MIRROR_MAGIC = 0x4d425244;
+
+/*! Magic number of a log file ("DRBL"). */
+static const uint32_t DRB_MIRROR_LOG_MAGIC = 0x4c425244;
+
+/*! Snapshot and log files format version. */
+static const uint32_t DRB_MIRROR_VERSION = 2;
+
+/*! Initial number of buckets (power of 2). */
+static const size_t DRB_MIRROR_BUCKETS = 1024;
+
+/*! Largest encoded metadata or path loaded from a snapshot. */
+static const uint32_t DRB_MIRROR_MAX_SIZE = 1 << 24;
+
+/*! Largest encoded delta page loaded from a log. */
+static const uint32_t DRB_MIRROR_MAX_PAGE = 1 << 30;
+
+/*! Log size always allowed before a new snapshot. */
+static const size_t DRB_MIRROR_LOG_MIN = 16 * 1024 * 1024;
+
+/*! Deleted nodes always kept for the search. */
+static const size_t DRB_MIRROR_DELETED_MIN = 4096;
+
+/*! Maximum number of search results, as drbSearch. */
+static const unsigned int DRB_MIRROR_FILE_LIMIT = 1000;
+
+/*! Size of a file part, padded to keep the next one aligned on 8 bytes. */
+#define DRB_MIRROR_PAD(size) (((size_t)(size) + 7) & ~(size_t)7)
+
+/*!
+ * \struct  drbMirrorNode
+ * \breif   File or folder of the mirror.
+ */
+typedef struct drbMirrorNode {
+    struct drbMirrorNode* next;        /*!< Next node of the bucket. */
+    struct drbMirrorNode* parent;      /*!< Parent folder (NULL for the root). */
+    struct drbMirrorNode* child;       /*!< First child. */
+    struct drbMirrorNode* prevSibling; /*!< Previous child of the parent. */
+    struct drbMirrorNode* nextSibling; /*!< Next child of the parent. */
+    size_t hash;                       /*!< Path hash (drbStrHash). */
+    char* path;                        /*!< Lower case path ("" for the root). */
+    void* encoded;                     /*!< Metadata encoding (NULL if unknown). */
+    size_t size;                       /*!< Encoding size. */
+    uint32_t searchId;                 /*!< Search index id (0 if not indexed). */
+    bool isDir;                        /*!< The node is a folder. */
+    bool deleted;                      /*!< The node was deleted (kept for the search). */
+} drbMirrorNode;
+
+/*!
+ * \struct  drbMirrorFileHeader
+ * \breif   Header of a snapshot, followed by the cursor and the nodes.
+ */
+typedef struct {
+    uint32_t magic;      /*!< DRB_MIRROR_MAGIC (also checks the byte order). */
+    uint32_t version;    /*!< DRB_MIRROR_VERSION. */
+    uint64_t generation; /*!< Snapshot generation. */
+    uint64_t count;      /*!< Number of nodes (root excluded). */
+    uint32_t cursorSize; /*!< Cursor length (0 for none). */
+    uint32_t crc;        /*!< CRC32C of the header (up to crc) and the cursor. */
+} drbMirrorFileHeader;
+
+/*!
+ * Snapshot node flags.
+ */
+enum {
+    DRB_MIRROR_DIR     = 1<<0, /*!< The node is a folder. */
+    DRB_MIRROR_DELETED = 1<<1, /*!< The node was deleted. */
+};
+
+/*!
+ * \struct  drbMirrorFileNode
+ * \breif   Node of a snapshot, followed by its path (NUL terminated) and
+ *          encoding, both padded to 8 bytes.
+ */
+typedef struct {
+    uint32_t pathSize;    /*!< Path length. */
+    uint32_t encodedSize; /*!< Encoding size (0 if the metadata is unknown). */
+    uint32_t flags;       /*!< DRB_MIRROR_XXX flags. */
+    uint32_t crc;         /*!< CRC32C of the record (up to crc), path and encoding. */
+} drbMirrorFileNode;
+
+/*!
+ * \struct  drbMirrorLogHeader
+ * \breif   Header of a log, followed by the pages.
+ */
+typedef struct {
+    uint32_t magic;      /*!< DRB_MIRROR_LOG_MAGIC (also checks the byte order). */
+    uint32_t version;    /*!< DRB_MIRROR_VERSION. */
+    uint64_t generation; /*!< Generation of the snapshot the log follows. */
+} drbMirrorLogHeader;
+
+/*!
+ * \struct  drbMirrorLogPage
+ * \breif   Page of a log, followed by its encoding padded to 8 bytes.
+ */
+typedef struct {
+    uint32_t size; /*!< Encoding size. */
+    uint32_t crc;  /*!< CRC32C of the encoding. */
+} drbMirrorLogPage;
+
+struct drbMirror {
+    pthread_rwlock_t lock;     /*!< Lookups share it, updates take it alone. */
+    pthread_mutex_t saveLock;  /*!< Serialize the snapshots. */
+    drbMirrorNode** buckets;   /*!< Nodes chained by path hash. */
+    size_t bucketCount;        /*!< Number of buckets (power of 2). */
+    size_t count;              /*!< Number of nodes (root excluded). */
+    size_t deletedCount;       /*!< Number of nodes flagged as deleted. */
+    drbMirrorNode root;        /*!< Root folder. */
+    char* cursor;              /*!< Cursor of the next delta page (NULL for none). */
+    char* checkpoint;          /*!< Snapshot file (NULL for none). */
+    char* logPath;             /*!< Log file. */
+    int logFd;                 /*!< Log file descriptor (-1 without checkpoint). */
+    size_t logSize;            /*!< Log size. */
+    size_t snapshotSize;       /*!< Last snapshot size. */
+    uint64_t generation;       /*!< Last snapshot generation. */
+    char* map;                 /*!< Loaded snapshot (NULL if none is mapped). */
+    size_t mapSize;            /*!< Loaded snapshot size. */
+    drbSearchIndex* search;    /*!< Names index (NULL until the search is enabled). */
+};
+
+/*!
+ * \brief   Find the node of a path.
+ * \param   mirror   mirror to search
+ * \param   key      normalized path (drbPathKey)
+ * \param   hash     path hash
+ * \return  node (NULL if not found).
+ */
+static drbMirrorNode* drbMirrorLookup(drbMirror* mirror, const char* key, size_t hash) {
+    if (!*key)
+        return &mirror->root;
+    drbMirrorNode* node = mirror->buckets[hash & (mirror->bucketCount - 1)];
+    while (node && (node->hash != hash || strcmp(node->path, key) != 0))
+        node = node->next;
+    return node;
+}
+
+/*!
+ * \brief   Get the next node of a subtree, after the children of the current one.
+ * \param   top    subtree root
+ * \param   node   current node
+ * \return  next node (NULL at the end of the subtree).
+ */
+static drbMirrorNode* drbMirrorSkipNode(drbMirrorNode* top, drbMirrorNode* node) {
+    while (node != top && !node->nextSibling)
+        node = node->parent;
+    return node != top ? node->nextSibling : NULL;
+}
+
+/*!
+ * \brief   Get the next node of a subtree, parents first.
+ * \param   top    subtree root
+ * \param   node   current node
+ * \return  next node (NULL at the end of the subtree).
+ */
+static drbMirrorNode* drbMirrorNextNode(drbMirrorNode* top, drbMirrorNode* node) {
+    if (node->child)
+        return node->child;
+    return drbMirrorSkipNode(top, node);
+}
+
+/*!
+ * \brief   Free a node path or encoding, unless it is in the loaded snapshot.
+ * \param   mirror   mirror of the node
+ * \param   ptr      node path or encoding
+ * \return  void
+ */
+static void drbMirrorFree(drbMirror* mirror, void* ptr) {
+    if (!mirror->map || (char*)ptr < mirror->map || (char*)ptr >= mirror->map + mirror->mapSize)
+        free(ptr);
+}
+
+/*!
+ * \brief   Remove a node and its children from the mirror, and free them.
+ * \param   mirror   mirror of the node
+ * \param   node     node to remove (not the root)
+ * \return  void
+ */
+static void drbMirrorRemove(drbMirror* mirror, drbMirrorNode* node) {
+    // Free the deepest first child until the node itself is freed
+    for (drbMirrorNode* current = node; ; ) {
+        if (current->child) {
+            current = current->child;
+            continue;
+        }
+        
+        drbMirrorNode* parent = current->parent;
+        if (current->prevSibling)
+            current->prevSibling->nextSibling = current->nextSibling;
+        else
+            parent->child = current->nextSibling;
+        if (current->nextSibling)
+            current->nextSibling->prevSibling = current->prevSibling;
+        
+        drbMirrorNode** link = &mirror->buckets[current->hash & (mirror->bucketCount - 1)];
+        while (*link != current)
+            link = &(*link)->next;
+        *link = current->next;
+        mirror->count--;
+        mirror->deletedCount -= current->deleted;
+        if (current->searchId)
+            drbSearchIndexRemove(mirror->search, current->searchId);
+        
+        bool over = current == node;
+        drbMirrorFree(mirror, current->path);
+        drbMirrorFree(mirror, current->encoded);
+        free(current);
+        if (over)
+            return;
+        current = parent;
+    }
+}
+
+/*!
+ * \brief   Remove the children of a node.
+ * \param   mirror   mirror of the node
+ * \param   node     node to empty
+ * \return  void
+ */
+static void drbMirrorRemoveChildren(drbMirror* mirror, drbMirrorNode* node) {
+    while (node->child)
+        drbMirrorRemove(mirror, node->child);
+}
+
+/*!
+ * \brief   Double the number of buckets when there are more nodes than them.
+ * \param   mirror   mirror to grow
+ * \return  void (the buckets are kept on failure)
+ */
+static void drbMirrorGrow(drbMirror* mirror) {
+    if (mirror->count < mirror->bucketCount)
+        return;
+    
+    size_t count = mirror->bucketCount * 2;
+    drbMirrorNode** buckets = calloc(count, sizeof(drbMirrorNode*));
+    if (buckets) {
+        for (size_t i = 0; i < mirror->bucketCount; i++)
+            for (drbMirrorNode *node = mirror->buckets[i], *next; node; node = next) {
+                next = node->next;
+                node->next = buckets[node->hash & (count - 1)];
+                buckets[node->hash & (count - 1)] = node;
+            }
+        free(mirror->buckets);
+        mirror->buckets = buckets;
+        mirror->bucketCount = count;
+    }
+}
+
+/*!
+ * \brief   Get the node of a path, adding it and its missing parent folders.
+ * \param   mirror   mirror to fill
+ * \param   key      normalized path (drbPathKey)
+ * \param   stored   path kept by an added node (NULL to copy key)
+ * \return  node (NULL if the memory can't be allocated).
+ */
+static drbMirrorNode* drbMirrorAdd(drbMirror* mirror, const char* key, char* stored) {
+    size_t hash = drbStrHash(key);
+    drbMirrorNode* node = drbMirrorLookup(mirror, key, hash);
+    if (node)
+        return node;
+    
+    // The parent folder path is the key up to its last slash
+    const char* name = strrchr(key, '/');
+    char* parentKey = strndup(key, name - key);
+    drbMirrorNode* parent = parentKey ? drbMirrorAdd(mirror, parentKey, NULL) : NULL;
+    free(parentKey);
+    if (!parent || (node = calloc(1, sizeof(drbMirrorNode))) == NULL)
+        return NULL;
+    if ((node->path = stored ? stored : strdup(key)) == NULL) {
+        free(node);
+        return NULL;
+    }
+    if (mirror->search && (node->searchId = drbSearchIndexAdd(mirror->search, name + 1, node)) == 0) {
+        drbMirrorFree(mirror, node->path);
+        free(node);
+        return NULL;
+    }
+    
+    drbMirrorGrow(mirror);
+    drbMirrorNode** bucket = &mirror->buckets[hash & (mirror->bucketCount - 1)];
+    node->next = *bucket;
+    *bucket = node;
+    node->hash = hash;
+    node->isDir = true;
+    node->parent = parent;
+    node->nextSibling = parent->child;
+    if (parent->child)
+        parent->child->prevSibling = node;
+    parent->child = node;
+    parent->isDir = true;
+    mirror->count++;
+    return node;
+}
+
+/*!
+ * \brief   Set the metadata of a path, as a delta entry does.
+ *
+ * A missing node and its missing parent folders are added. A file replaces
+ * whatever was at its path, a folder keeps its children.
+ *
+ * \param   mirror    mirror to update
+ * \param   key       normalized path (drbPathKey)
+ * \param   stored    path kept by an added node (NULL to copy key)
+ * \param   encoded   metadata encoding (owned by the mirror on success)
+ * \param   size      encoding size
+ * \param   isDir     the path is a folder
+ * \return  node of the path (NULL if the memory can't be allocated).
+ */
+static drbMirrorNode* drbMirrorSet(drbMirror* mirror, const char* key, char* stored,
+                                   void* encoded, size_t size, bool isDir) {
+    drbMirrorNode* node = drbMirrorAdd(mirror, key, stored);
+    if (!node)
+        return NULL;
+    if (!isDir)
+        drbMirrorRemoveChildren(mirror, node);
+    drbMirrorFree(mirror, node->encoded);
+    node->encoded = encoded;
+    node->size = size;
+    node->isDir = isDir;
+    return node;
+}
+
+/*!
+ * \brief   Delete a node and its children, as a delta entry does.
+ *
+ * Once the search is enabled, the nodes are only flagged as deleted (until
+ * drbMirrorPurge). The children of a deleted node are always deleted too.
+ *
+ * \param   mirror   mirror to update
+ * \param   node     node to delete (the root only loses its children)
+ * \return  void
+ */
+static void drbMirrorDelete(drbMirror* mirror, drbMirrorNode* node) {
+    if (mirror->search) {
+        for (drbMirrorNode* current = node; current; current = drbMirrorNextNode(node, current))
+            if (!current->deleted && current != &mirror->root) {
+                current->deleted = true;
+                mirror->deletedCount++;
+            }
+    } else if (node == &mirror->root)
+        drbMirrorRemoveChildren(mirror, node);
+    else
+        drbMirrorRemove(mirror, node);
+}
+
+/*!
+ * \brief   Remove the deleted nodes once they outnumber the others.
+ *
+ * As the index compacts its dead entries, all of them are removed at once,
+ * by a walk of the mirror while more than half of it is removed.
+ *
+ * \param   mirror   mirror to purge
+ * \return  void
+ */
+static void drbMirrorPurge(drbMirror* mirror) {
+    if (mirror->deletedCount < DRB_MIRROR_DELETED_MIN ||
+        mirror->deletedCount <= mirror->count - mirror->deletedCount)
+        return;
+    
+    // The children of a deleted node are removed with it
+    drbMirrorNode* node = drbMirrorNextNode(&mirror->root, &mirror->root);
+    while (node) {
+        drbMirrorNode* next;
+        if (node->deleted) {
+            next = drbMirrorSkipNode(&mirror->root, node);
+            drbMirrorRemove(mirror, node);
+        } else
+            next = drbMirrorNextNode(&mirror->root, node);
+        node = next;
+    }
+}
+
+/*!
+ * \brief   Remove all the nodes of the mirror.
+ * \param   mirror   mirror to clear
+ * \return  void
+ */
+static void drbMirrorClear(drbMirror* mirror) {
+    drbMirrorRemoveChildren(mirror, &mirror->root);
+    drbMirrorFree(mirror, mirror->root.encoded);
+    mirror->root.encoded = NULL;
+    free(mirror->cursor);
+    mirror->cursor = NULL;
+    
+    // No node references the loaded snapshot anymore
+    if (mirror->map) {
+        munmap(mirror->map, mirror->mapSize);
+        mirror->map = NULL;
+    }
+}
+
+/*!
+ * \brief   Decode the metadata of a node.
+ *
+ * Folders without metadata get one with their (lower case) path only, and
+ * deleted nodes get isDeleted.
+ *
+ * \param   node   node to decode
+ * \return  metadata (NULL if the memory can't be allocated).
+ */
+static drbMetadata* drbMirrorDecode(const drbMirrorNode* node) {
+    drbMetadata* meta = NULL;
+    if (node->encoded)
+        meta = drbDecodeMetadata(node->encoded, node->size);
+    else if ((meta = calloc(1, sizeof(drbMetadata))) != NULL) {
+        meta->path = strdup(*node->path ? node->path : "/");
+        if ((meta->isDir = malloc(sizeof(bool))) != NULL)
+            *meta->isDir = true;
+        if (!meta->path || !meta->isDir) {
+            drbDestroyMetadata(meta, true);
+            meta = NULL;
+        }
+    }
+    
+    if (meta && node->deleted) {
+        if (!meta->isDeleted && (meta->isDeleted = malloc(sizeof(bool))) == NULL) {
+            drbDestroyMetadata(meta, true);
+            return NULL;
+        }
+        *meta->isDeleted = true;
+    }
+    return meta;
+}
+
+/*!
+ * \brief   Apply a delta page to the mirror, whose lock is held.
+ * \param   mirror   mirror to update
+ * \param   delta    delta page
+ * \return  error code (DRBERR_XXX), the cursor is kept on error.
+ */
+static int drbMirrorApplyPage(drbMirror* mirror, const drbDelta* delta) {
+    int err = DRBERR_OK;
+    char* cursor = delta->cursor ? strdup(delta->cursor) : NULL;
+    if (delta->cursor && !cursor)
+        return DRBERR_MALLOC;
+    
+    if (delta->reset && *delta->reset)
+        drbMirrorClear(mirror);
+    
+    for (size_t i = 0; !err && i < delta->entries.size; i++) {
+        const drbDeltaEntry* entry = &delta->entries.array[i];
+        char* key = entry->path ? drbPathKey(entry->path) : NULL;
+        if (!key) {
+            err = entry->path ? DRBERR_MALLOC : DRBERR_OK;
+            continue;
+        }
+        
+        if (entry->metadata) {
+            // The contents are not part of the node metadata
+            drbMetadata meta = *entry->metadata;
+            meta.contents = NULL;
+            size_t size;
+            void* encoded = drbEncodeMetadata(&meta, &size);
+            bool isDir = meta.isDir && *meta.isDir;
+            drbMirrorNode* node = encoded ? drbMirrorSet(mirror, key, NULL, encoded, size, isDir)
+                                          : NULL;
+            if (!node) {
+                free(encoded);
+                err = DRBERR_MALLOC;
+            }
+            
+            // A deleted node is added again, with its deleted parents
+            for (; node; node = node->parent)
+                if (node->deleted) {
+                    node->deleted = false;
+                    mirror->deletedCount--;
+                }
+        } else {
+            size_t hash = drbStrHash(key);
+            drbMirrorNode* node = drbMirrorLookup(mirror, key, hash);
+            if (node)
+                drbMirrorDelete(mirror, node);
+        }
+        free(key);
+    }
+    
+    drbMirrorPurge(mirror);
+    
+    // The cursor only moves once the whole page is applied
+    if (!err && cursor) {
+        free(mirror->cursor);
+        mirror->cursor = cursor;
+        cursor = NULL;
+    }
+    free(cursor);
+    return err;
+}
+
+/*!
+ * \brief   Load a snapshot in an empty mirror.
+ *
+ * The snapshot is mapped in memory (and stays mapped while nodes use it).
+ *
+ * \param   mirror   mirror to fill
+ * \param   fd       snapshot file descriptor
+ * \return  false if the snapshot is invalid or the memory can't be allocated.
+ */
+static bool drbMirrorLoadSnapshot(drbMirror* mirror, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(drbMirrorFileHeader))
+        return false;
+    char* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return false;
+    mirror->map = map;
+    mirror->mapSize = st.st_size;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    
+    const drbMirrorFileHeader* header = (const drbMirrorFileHeader*)map;
+    size_t size = st.st_size, pos = sizeof(drbMirrorFileHeader);
+    if (header->magic != DRB_MIRROR_MAGIC || header->version != DRB_MIRROR_VERSION ||
+        DRB_MIRROR_PAD(header->cursorSize) > size - pos ||
+        drbCrc32c(drbCrc32c(0, header, offsetof(drbMirrorFileHeader, crc)), map + pos,
+                  header->cursorSize) != header->crc)
+        return false;
+    if (header->cursorSize && (mirror->cursor = strndup(map + pos, header->cursorSize)) == NULL)
+        return false;
+    pos += DRB_MIRROR_PAD(header->cursorSize);
+    
+    for (uint64_t i = 0; i < header->count; i++) {
+        const drbMirrorFileNode* record = (const drbMirrorFileNode*)(map + pos);
+        if (size - pos < sizeof(drbMirrorFileNode))
+            return false;
+        pos += sizeof(drbMirrorFileNode);
+        
+        size_t pathSpace = DRB_MIRROR_PAD(record->pathSize + 1);
+        size_t encodedSpace = DRB_MIRROR_PAD(record->encodedSize);
+        if (record->pathSize == 0 || record->pathSize > DRB_MIRROR_MAX_SIZE ||
+            record->encodedSize > DRB_MIRROR_MAX_SIZE || pathSpace + encodedSpace > size - pos)
+            return false;
+        
+        char* path = map + pos;
+        char* encoded = record->encodedSize ? map + pos + pathSpace : NULL;
+        uint32_t crc = drbCrc32c(0, record, offsetof(drbMirrorFileNode, crc));
+        crc = drbCrc32c(drbCrc32c(crc, path, record->pathSize), encoded, record->encodedSize);
+        if (crc != record->crc || path[0] != '/' || path[record->pathSize] != '\0' ||
+            memchr(path, '\0', record->pathSize) ||
+            (encoded && !drbViewMetadata(encoded, record->encodedSize)))
+            return false;
+        
+        drbMirrorNode* node = drbMirrorSet(mirror, path, path, encoded, record->encodedSize,
+                                           record->flags & DRB_MIRROR_DIR);
+        if (!node)
+            return false;
+        node->deleted = record->flags & DRB_MIRROR_DELETED;
+        mirror->deletedCount += node->deleted;
+        pos += pathSpace + encodedSpace;
+    }
+    
+    madvise(map, size, MADV_NORMAL);
+    mirror->generation = header->generation;
+    mirror->snapshotSize = size;
+    return pos == size && mirror->count == header->count;
+}
+
+/*!
+ * \brief   Clear the log, for the last snapshot generation.
+ * \param   mirror   mirror whose log to clear
+ * \return  false on I/O error.
+ */
+static bool drbMirrorResetLog(drbMirror* mirror) {
+    drbMirrorLogHeader header = {DRB_MIRROR_LOG_MAGIC, DRB_MIRROR_VERSION, mirror->generation};
+    if (ftruncate(mirror->logFd, 0) != 0 ||
+        write(mirror->logFd, &header, sizeof(header)) != sizeof(header))
+        return false;
+    mirror->logSize = sizeof(header);
+    return true;
+}
+
+/*!
+ * \brief   Apply the pages of the log that follows the loaded snapshot.
+ *
+ * The replay stops at the first invalid page (torn by a crash), which is
+ * dropped with the rest of the log.
+ *
+ * \param   mirror   mirror with a loaded snapshot
+ * \return  false if the log does not follow the snapshot.
+ */
+static bool drbMirrorReplayLog(drbMirror* mirror) {
+    drbMirrorLogHeader header;
+    if (pread(mirror->logFd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != DRB_MIRROR_LOG_MAGIC || header.version != DRB_MIRROR_VERSION ||
+        header.generation != mirror->generation)
+        return false;
+    
+    off_t pos = sizeof(header);
+    drbMirrorLogPage page;
+    while (pread(mirror->logFd, &page, sizeof(page), pos) == sizeof(page) &&
+           page.size && page.size <= DRB_MIRROR_MAX_PAGE) {
+        void* encoded = malloc(page.size);
+        drbDelta* delta = NULL;
+        if (encoded && pread(mirror->logFd, encoded, page.size, pos + sizeof(page)) == page.size &&
+            drbCrc32c(0, encoded, page.size) == page.crc)
+            delta = drbDecodeDelta(encoded, page.size);
+        free(encoded);
+        
+        int err = delta ? drbMirrorApplyPage(mirror, delta) : DRBERR_UNKNOWN;
+        drbDestroyDelta(delta, true);
+        if (err)
+            break;
+        pos += sizeof(page) + DRB_MIRROR_PAD(page.size);
+    }
+    
+    // The next pages are appended after the valid ones
+    if (ftruncate(mirror->logFd, pos) != 0)
+        return false;
+    mirror->logSize = pos;
+    return true;
+}
+
+/*!
+ * \brief   Append a delta page to the log.
+ *
+ * A page partially written is removed, so the next ones follow valid pages.
+ *
+ * \param   mirror    mirror with a log, whose lock is held
+ * \param   encoded   delta page encoding
+ * \param   size      encoding size
+ * \return  false on I/O error.
+ */
+static bool drbMirrorAppendLog(drbMirror* mirror, const void* encoded, size_t size) {
+    static const char padding[8];
+    drbMirrorLogPage page = {(uint32_t)size, drbCrc32c(0, encoded, size)};
+    struct iovec iov[3] = {
+        {&page, sizeof(page)},
+        {(void*)encoded, size},
+        {(void*)padding, DRB_MIRROR_PAD(size) - size},
+    };
+    
+    ssize_t total = sizeof(page) + DRB_MIRROR_PAD(size);
+    if (size > DRB_MIRROR_MAX_PAGE || writev(mirror->logFd, iov, 3) != total) {
+        if (ftruncate(mirror->logFd, mirror->logSize) != 0)
+            mirror->logSize = (size_t)lseek(mirror->logFd, 0, SEEK_END);
+        return false;
+    }
+    mirror->logSize += total;
+    return true;
+}
+
+/*!
+ * \brief   Write the next generation of the snapshot.
+ * \param   mirror   mirror to save, whose lock is held for reading
+ * \return  error code (DRBERR_XXX).
+ */
+static int drbMirrorWriteSnapshot(drbMirror* mirror) {
+    static const char padding[8];
+    char* tmp = NULL;
+    if (asprintf(&tmp, "%s.XXXXXX", mirror->checkpoint) == -1)
+        return DRBERR_MALLOC;
+    int fd = mkstemp(tmp);
+    FILE* file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!file) {
+        if (fd >= 0)
+            close(fd), unlink(tmp);
+        free(tmp);
+        return DRBERR_IO;
+    }
+    
+    drbMirrorFileHeader header = {DRB_MIRROR_MAGIC, DRB_MIRROR_VERSION, mirror->generation + 1,
+                                  mirror->count,
+                                  mirror->cursor ? (uint32_t)strlen(mirror->cursor) : 0, 0};
+    header.crc = drbCrc32c(drbCrc32c(0, &header, offsetof(drbMirrorFileHeader, crc)),
+                           mirror->cursor, header.cursorSize);
+    size_t size = sizeof(header) + DRB_MIRROR_PAD(header.cursorSize);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(mirror->cursor ? mirror->cursor : padding, 1, header.cursorSize,
+                          file) == header.cursorSize &&
+                   fwrite(padding, 1, size - sizeof(header) - header.cursorSize, file) ==
+                   size - sizeof(header) - header.cursorSize;
+    
+    drbMirrorNode* node = &mirror->root;
+    while (written && (node = drbMirrorNextNode(&mirror->root, node)) != NULL) {
+        uint32_t flags = (node->isDir ? DRB_MIRROR_DIR : 0) |
+                         (node->deleted ? DRB_MIRROR_DELETED : 0);
+        drbMirrorFileNode record = {(uint32_t)strlen(node->path),
+                                    node->encoded ? (uint32_t)node->size : 0, flags, 0};
+        record.crc = drbCrc32c(0, &record, offsetof(drbMirrorFileNode, crc));
+        record.crc = drbCrc32c(drbCrc32c(record.crc, node->path, record.pathSize),
+                               node->encoded, record.encodedSize);
+        
+        // The path is written with its NUL, then both are padded
+        size_t pathPad = DRB_MIRROR_PAD(record.pathSize + 1) - record.pathSize;
+        size_t encodedPad = DRB_MIRROR_PAD(record.encodedSize) - record.encodedSize;
+        written = fwrite(&record, sizeof(record), 1, file) == 1 &&
+                  fwrite(node->path, 1, record.pathSize, file) == record.pathSize &&
+                  fwrite(padding, 1, pathPad, file) == pathPad &&
+                  (!node->encoded ||
+                   fwrite(node->encoded, 1, record.encodedSize, file) == record.encodedSize) &&
+                  fwrite(padding, 1, encodedPad, file) == encodedPad;
+        size += sizeof(record) + record.pathSize + pathPad + record.encodedSize + encodedPad;
+    }
+    
+    // The snapshot must be on the disk before the log it replaces is cleared
+    written = fflush(file) == 0 && written && fsync(fd) == 0;
+    if (fclose(file) != 0 || !written || rename(tmp, mirror->checkpoint) != 0) {
+        unlink(tmp);
+        free(tmp);
+        return DRBERR_IO;
+    }
+    free(tmp);
+    mirror->generation++;
+    mirror->snapshotSize = size;
+    return DRBERR_OK;
+}
+
+drbMirror* drbCreateMirror(const char* checkpoint) {
+    drbMirror* mirror = calloc(1, sizeof(drbMirror));
+    if (!mirror)
+        return NULL;
+    
+    mirror->bucketCount = DRB_MIRROR_BUCKETS;
+    mirror->buckets = calloc(mirror->bucketCount, sizeof(drbMirrorNode*));
+    mirror->root.path = "";
+    mirror->root.isDir = true;
+    mirror->logFd = -1;
+    if (checkpoint && ((mirror->checkpoint = strdup(checkpoint)) == NULL ||
+                       asprintf(&mirror->logPath, "%s.log", checkpoint) == -1))
+        mirror->logPath = NULL;
+    if (!mirror->buckets || (checkpoint && !mirror->logPath)) {
+        free(mirror->buckets);
+        free(mirror->checkpoint);
+        free(mirror);
+        return NULL;
+    }
+    pthread_rwlock_init(&mirror->lock, NULL);
+    pthread_mutex_init(&mirror->saveLock, NULL);
+    if (!checkpoint)
+        return mirror;
+    
+    int fd = open(checkpoint, O_RDONLY);
+    bool loaded = fd >= 0 && drbMirrorLoadSnapshot(mirror, fd);
+    if (fd >= 0)
+        close(fd);
+    
+    mirror->logFd = open(mirror->logPath, O_RDWR | O_CREAT | O_APPEND, 0600);
+    bool ready = mirror->logFd >= 0;
+    if (ready && loaded)
+        ready = drbMirrorReplayLog(mirror) || drbMirrorResetLog(mirror);
+    else if (ready) {
+        // An unreadable snapshot only costs a full update. The new snapshot
+        // generation must differ from the one of the existing log.
+        drbMirrorLogHeader header;
+        drbMirrorClear(mirror);
+        mirror->generation = 0;
+        if (pread(mirror->logFd, &header, sizeof(header), 0) == sizeof(header) &&
+            header.magic == DRB_MIRROR_LOG_MAGIC)
+            mirror->generation = header.generation;
+        ready = drbMirrorSave(mirror) == DRBERR_OK;
+    }
+    
+    if (!ready) {
+        drbDestroyMirror(mirror);
+        return NULL;
+    }
+    return mirror;
+}
+
+void drbDestroyMirror(drbMirror* mirror) {
+    if (mirror) {
+        drbMirrorClear(mirror);
+        drbDestroySearchIndex(mirror->search);
+        if (mirror->logFd >= 0)
+            close(mirror->logFd);
+        pthread_rwlock_destroy(&mirror->lock);
+        pthread_mutex_destroy(&mirror->saveLock);
+        free(mirror->buckets);
+        free(mirror->checkpoint);
+        free(mirror->logPath);
+        free(mirror);
+    }
+}
+
+int drbMirrorApply(drbMirror* mirror, const drbDelta* delta) {
+    size_t size = 0;
+    void* encoded = NULL;
+    if (mirror->logFd >= 0 && (encoded = drbEncodeDelta(delta, &size)) == NULL)
+        return DRBERR_MALLOC;
+    
+    // The page is logged before it is applied
+    pthread_rwlock_wrlock(&mirror->lock);
+    int err = encoded && !drbMirrorAppendLog(mirror, encoded, size) ? DRBERR_IO : DRBERR_OK;
+    if (!err)
+        err = drbMirrorApplyPage(mirror, delta);
+    bool compact = !err && encoded && mirror->logSize > DRB_MIRROR_LOG_MIN &&
+                   mirror->logSize > mirror->snapshotSize;
+    pthread_rwlock_unlock(&mirror->lock);
+    free(encoded);
+    
+    if (compact)
+        err = drbMirrorSave(mirror);
+    return err;
+}
+
+int drbMirrorSave(drbMirror* mirror) {
+    if (!mirror->checkpoint)
+        return DRBERR_OK;
+    
+    pthread_mutex_lock(&mirror->saveLock);
+    pthread_rwlock_rdlock(&mirror->lock);
+    int err = drbMirrorWriteSnapshot(mirror);
+    if (!err && !drbMirrorResetLog(mirror))
+        err = DRBERR_IO;
+    pthread_rwlock_unlock(&mirror->lock);
+    pthread_mutex_unlock(&mirror->saveLock);
+    return err;
+}
+
+char* drbMirrorGetCursor(drbMirror* mirror) {
+    pthread_rwlock_rdlock(&mirror->lock);
+    char* cursor = drbStrDup(mirror->cursor);
+    pthread_rwlock_unlock(&mirror->lock);
+    return cursor;
+}
+
+drbMetadata* drbMirrorGetMetadata(drbMirror* mirror, const char* path, bool list) {
+    char* key = drbPathKey(path);
+    if (!key)
+        return NULL;
+    
+    pthread_rwlock_rdlock(&mirror->lock);
+    drbMirrorNode* node = drbMirrorLookup(mirror, key, drbStrHash(key));
+    drbMetadata* meta = node && !node->deleted ? drbMirrorDecode(node) : NULL;
+    if (meta && list && node->isDir) {
+        size_t count = 0;
+        for (drbMirrorNode* child = node->child; child; child = child->nextSibling)
+            count += !child->deleted;
+        
+        drbMetadataList* contents = calloc(1, sizeof(drbMetadataList));
+        if (contents && (contents->array = malloc((count ? count : 1) * sizeof(drbMetadata*)))) {
+            for (drbMirrorNode* child = node->child; child; child = child->nextSibling)
+                if (!child->deleted &&
+                    (contents->array[contents->size] = drbMirrorDecode(child)) != NULL)
+                    contents->size++;
+        }
+        if (!contents || !contents->array || contents->size != count) {
+            drbDestroyMetadataList(contents, true);
+            drbDestroyMetadata(meta, true);
+            meta = NULL;
+        } else
+            meta->contents = contents;
+    }
+    pthread_rwlock_unlock(&mirror->lock);
+    
+    free(key);
+    return meta;
+}
+
+/*!
+ * \struct  drbMirrorQuery
+ * \breif   Search of the mirror names, given to drbMirrorMatch.
+ */
+typedef struct {
+    const char* scope;         /*!< Folder key searched ("" for the root). */
+    size_t scopeLength;        /*!< Folder key length. */
+    char** words;              /*!< Words the names must hold (in lower case). */
+    size_t count;              /*!< Number of words. */
+    bool includeDeleted;       /*!< Deleted nodes are found too. */
+    unsigned int limit;        /*!< Maximum number of results. */
+    drbMetadataList* results;  /*!< Found metadata. */
+    bool failed;               /*!< The memory can't be allocated. */
+} drbMirrorQuery;
+
+/*!
+ * \brief   Add a node to the results of a search if it matches.
+ * \param   item   node to check
+ * \param   data   search (drbMirrorQuery*)
+ * \return  false once the search is over.
+ */
+static bool drbMirrorMatch(void* item, void* data) {
+    drbMirrorNode* node = item;
+    drbMirrorQuery* query = data;
+    if ((node->deleted && !query->includeDeleted) ||
+        strncmp(node->path, query->scope, query->scopeLength) != 0 ||
+        node->path[query->scopeLength] != '/')
+        return true;
+    
+    const char* name = strrchr(node->path, '/') + 1;
+    for (size_t i = 0; i < query->count; i++)
+        if (!strstr(name, query->words[i]))
+            return true;
+    
+    drbMetadata* meta = drbMirrorDecode(node);
+    if (!meta) {
+        query->failed = true;
+        return false;
+    }
+    query->results->array[query->results->size++] = meta;
+    return query->results->size < query->limit;
+}
+
+/*!
+ * \brief   Keep the new search index id of a node.
+ * \param   item   renumbered node (drbMirrorNode*)
+ * \param   id     new id
+ * \return  void
+ */
+static void drbMirrorRenumber(void* item, uint32_t id) {
+    ((drbMirrorNode*)item)->searchId = id;
+}
+
+bool drbMirrorEnableSearch(drbMirror* mirror) {
+    pthread_rwlock_wrlock(&mirror->lock);
+    bool enabled = mirror->search != NULL;
+    if (!enabled && (mirror->search = drbCreateSearchIndex(drbMirrorRenumber)) != NULL) {
+        enabled = true;
+        drbMirrorNode* node = &mirror->root;
+        while (enabled && (node = drbMirrorNextNode(&mirror->root, node)) != NULL)
+            enabled = (node->searchId = drbSearchIndexAdd(mirror->search,
+                                                          strrchr(node->path, '/') + 1,
+                                                          node)) != 0;
+        
+        // The mirror is left as it was without the memory for the index
+        if (!enabled) {
+            for (node = &mirror->root; (node = drbMirrorNextNode(&mirror->root, node)) != NULL; )
+                node->searchId = 0;
+            drbDestroySearchIndex(mirror->search);
+            mirror->search = NULL;
+        }
+    }
+    pthread_rwlock_unlock(&mirror->lock);
+    return enabled;
+}
+
+drbMetadataList* drbMirrorSearch(drbMirror* mirror, const char* path, const char* query,
+                                 unsigned int fileLimit, bool includeDeleted) {
+    if (fileLimit == 0 || fileLimit > DRB_MIRROR_FILE_LIMIT)
+        fileLimit = DRB_MIRROR_FILE_LIMIT;
+    
+    drbMirrorQuery search = {NULL, 0, NULL, 0, includeDeleted, fileLimit, NULL, false};
+    char* key = drbPathKey(path);
+    char* text = strdup(query);
+    search.words = malloc((strlen(query) / 2 + 1) * sizeof(char*));
+    search.results = calloc(1, sizeof(drbMetadataList));
+    if (!key || !text || !search.words || !search.results ||
+        (search.results->array = malloc(fileLimit * sizeof(drbMetadata*))) == NULL) {
+        drbDestroyMetadataList(search.results, true);
+        search.results = NULL;
+    } else {
+        // The query words are separated by spaces, and compared without case
+        char* save = NULL;
+        for (char* c = text; *c; c++)
+            *c = tolower((unsigned char)*c);
+        for (char* word = strtok_r(text, " ", &save); word; word = strtok_r(NULL, " ", &save))
+            search.words[search.count++] = word;
+        search.scope = key;
+        search.scopeLength = strlen(key);
+    }
+    
+    if (search.count) {
+        pthread_rwlock_rdlock(&mirror->lock);
+        if (mirror->search)
+            drbSearchIndexVisit(mirror->search, search.words, search.count, drbMirrorMatch,
+                                &search);
+        else {
+            drbMirrorNode* top = drbMirrorLookup(mirror, key, drbStrHash(key));
+            for (drbMirrorNode* node = top; node && (node = drbMirrorNextNode(top, node)) != NULL; )
+                if (!drbMirrorMatch(node, &search))
+                    break;
+        }
+        pthread_rwlock_unlock(&mirror->lock);
+    }
+    
+    if (search.failed) {
+        drbDestroyMetadataList(search.results, true);
+        search.results = NULL;
+    }
+    free(search.words);
+    free(text);
+    free(key);
+    return search.results;
+}
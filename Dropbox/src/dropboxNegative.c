@@ -0,0 +1,356 @@
+/*!
+ * \file    dropboxNegative.c
+ * \brief   Cache of the paths not found by the metadata requests.
+ *
+ * Missing paths are kept with the error given by the server for a fixed
+ * time, in a hash table of their lower case encoded path whose entries are
+ * also linked from the most to the least recently stored. As they all live
+ * as long, the least recently stored entries are the first to expire, and
+ * the first evicted beyond the limit. A path made to exist locally (or by a
+ * delta entry) drops the entries of itself and its parent folders, in all
+ * roots, which are aliases of the same namespace.
+ *
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include "dropboxNegative.h"
+#include "dropboxUtils.h"
+
+/*! Initial number of buckets (power of 2). */
+static const size_t DRB_NEGATIVE_BUCKETS = 64;
+
+/*!
+ * \struct  drbNegativeEntry
+ * \breif   Path not found.
+ */
+typedef struct drbNegativeEntry {
+    struct drbNegativeEntry* next;  /*!< Next entry of the bucket. */
+    struct drbNegativeEntry* newer; /*!< More recently stored entry. */
+    struct drbNegativeEntry* older; /*!< Less recently stored entry. */
+    size_t pathHash;                /*!< Path hash (drbStrHash). */
+    char* root;                     /*!< Root of the path. */
+    char* path;                     /*!< Lower case encoded path ("" for the root). */
+    char* error;                    /*!< Error given by the server (NULL if unknown). */
+    uint64_t expires;               /*!< Expiration time (ms, monotonic clock). */
+} drbNegativeEntry;
+
+/*!
+ * \struct  drbNegativeCache
+ * \breif   Missing paths cache of a client.
+ */
+struct drbNegativeCache {
+    pthread_mutex_t lock;         /*!< Serialize the cache use between threads. */
+    drbNegativeEntry** buckets;   /*!< Entries chained by path hash. */
+    size_t bucketCount;           /*!< Number of buckets (power of 2). */
+    drbNegativeEntry* newest;     /*!< Most recently stored entry. */
+    drbNegativeEntry* oldest;     /*!< Least recently stored entry. */
+    size_t maxEntries;            /*!< Entries kept in memory. */
+    uint64_t ttl;                 /*!< Entries lifetime (ms). */
+    uint64_t generation;          /*!< Number of invalidations. */
+    drbNegativeCacheStats stats;  /*!< Usage statistics (entries included). */
+};
+
+/*!
+ * \brief   Get the current time of the monotonic clock.
+ * \return  time (ms).
+ */
+static uint64_t drbNegativeNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/*!
+ * \brief   Free a cache entry.
+ * \param   entry   entry to free
+ * \return  void
+ */
+static void drbNegativeFreeEntry(drbNegativeEntry* entry) {
+    free(entry->root);
+    free(entry->path);
+    free(entry->error);
+    free(entry);
+}
+
+/*!
+ * \brief   Find the entry of a path in a root.
+ * \param   cache      cache to search
+ * \param   root       path root
+ * \param   path       normalized path (drbPathKey)
+ * \param   pathHash   path hash
+ * \return  entry (NULL if not found).
+ */
+static drbNegativeEntry* drbNegativeLookup(drbNegativeCache* cache, const char* root,
+                                           const char* path, size_t pathHash) {
+    drbNegativeEntry* entry = cache->buckets[pathHash & (cache->bucketCount - 1)];
+    while (entry && (entry->pathHash != pathHash || strcmp(entry->path, path) != 0 ||
+                     strcmp(entry->root, root) != 0))
+        entry = entry->next;
+    return entry;
+}
+
+/*!
+ * \brief   Remove an entry from the cache, and free it.
+ * \param   cache   cache of the entry
+ * \param   entry   entry to remove
+ * \return  void
+ */
+static void drbNegativeRemove(drbNegativeCache* cache, drbNegativeEntry* entry) {
+    drbNegativeEntry** link = &cache->buckets[entry->pathHash & (cache->bucketCount - 1)];
+    while (*link != entry)
+        link = &(*link)->next;
+    *link = entry->next;
+    
+    if (entry->newer)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+    if (entry->older)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+    drbNegativeFreeEntry(entry);
+    cache->stats.entries--;
+}
+
+/*!
+ * \brief   Remove the expired entries, which are the least recently stored.
+ * \param   cache   cache to purge
+ * \param   now     current time (drbNegativeNow)
+ * \return  void
+ */
+static void drbNegativePurge(drbNegativeCache* cache, uint64_t now) {
+    while (cache->oldest && cache->oldest->expires <= now)
+        drbNegativeRemove(cache, cache->oldest);
+}
+
+/*!
+ * \brief   Remove the entries of a path in all the roots.
+ * \param   cache      cache to update
+ * \param   path       normalized path (drbPathKey)
+ * \param   pathHash   path hash
+ * \return  void
+ */
+static void drbNegativeRemovePath(drbNegativeCache* cache, const char* path, size_t pathHash) {
+    drbNegativeEntry* entry = cache->buckets[pathHash & (cache->bucketCount - 1)];
+    while (entry) {
+        drbNegativeEntry* next = entry->next;
+        if (entry->pathHash == pathHash && strcmp(entry->path, path) == 0) {
+            drbNegativeRemove(cache, entry);
+            cache->stats.invalidated++;
+        }
+        entry = next;
+    }
+}
+
+drbNegativeCache* drbCreateNegativeCache(size_t maxEntries, unsigned int ttl) {
+    drbNegativeCache* cache = calloc(1, sizeof(drbNegativeCache));
+    if (!cache)
+        return NULL;
+    
+    cache->maxEntries = maxEntries;
+    cache->ttl = (uint64_t)ttl * 1000;
+    cache->bucketCount = DRB_NEGATIVE_BUCKETS;
+    if ((cache->buckets = calloc(cache->bucketCount, sizeof(drbNegativeEntry*))) == NULL) {
+        free(cache);
+        return NULL;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void drbDestroyNegativeCache(drbNegativeCache* cache) {
+    if (cache) {
+        for (drbNegativeEntry *entry = cache->newest, *older; entry; entry = older) {
+            older = entry->older;
+            drbNegativeFreeEntry(entry);
+        }
+        pthread_mutex_destroy(&cache->lock);
+        free(cache->buckets);
+        free(cache);
+    }
+}
+
+/*!
+ * \brief   Find whether a path was recently not found.
+ * \param       cache   cache to search
+ * \param       root    path root
+ * \param       path    encoded path
+ * \param[out]  error   NULL or copy of the error given by the server, must be
+ *                      freed by the caller (an entry whose error is unknown
+ *                      doesn't answer then)
+ * \return  indicates whether the path is known to be missing.
+ */
+bool drbNegativeCacheFind(drbNegativeCache* cache, const char* root, const char* path,
+                          char** error) {
+    char* key = drbPathKey(path);
+    if (!key)
+        return false;
+    
+    pthread_mutex_lock(&cache->lock);
+    drbNegativePurge(cache, drbNegativeNow());
+    drbNegativeEntry* entry = drbNegativeLookup(cache, root, key, drbStrHash(key));
+    bool found = entry != NULL;
+    if (entry && error)
+        found = entry->error && (*error = drbStrDup(entry->error)) != NULL;
+    if (found)
+        cache->stats.hits++;
+    else
+        cache->stats.misses++;
+    pthread_mutex_unlock(&cache->lock);
+    
+    free(key);
+    return found;
+}
+
+/*!
+ * \brief   Get the invalidations count of a cache, to be given to
+ *          drbNegativeCacheStore by a request started after.
+ * \param   cache   cache to query
+ * \return  invalidations count.
+ */
+uint64_t drbNegativeCacheGeneration(drbNegativeCache* cache) {
+    pthread_mutex_lock(&cache->lock);
+    uint64_t generation = cache->generation;
+    pthread_mutex_unlock(&cache->lock);
+    return generation;
+}
+
+/*!
+ * \brief   Keep a path not found by the server.
+ *
+ * The path isn't kept if an invalidation happened since the request was
+ * started: the path may have been created after the server answered.
+ *
+ * \param   cache        cache to fill
+ * \param   root         path root
+ * \param   path         encoded path
+ * \param   error        error given by the server (NULL if unknown)
+ * \param   generation   invalidations count before the request
+ *                       (drbNegativeCacheGeneration)
+ * \return  void
+ */
+void drbNegativeCacheStore(drbNegativeCache* cache, const char* root, const char* path,
+                           const char* error, uint64_t generation) {
+    drbNegativeEntry* entry = calloc(1, sizeof(drbNegativeEntry));
+    if (!entry)
+        return;
+    
+    entry->root = strdup(root);
+    entry->path = drbPathKey(path);
+    entry->error = error ? strdup(error) : NULL;
+    if (!entry->root || !entry->path || (error && !entry->error)) {
+        drbNegativeFreeEntry(entry);
+        return;
+    }
+    entry->pathHash = drbStrHash(entry->path);
+    
+    pthread_mutex_lock(&cache->lock);
+    if (cache->generation != generation) {
+        pthread_mutex_unlock(&cache->lock);
+        drbNegativeFreeEntry(entry);
+        return;
+    }
+    uint64_t now = drbNegativeNow();
+    entry->expires = now + cache->ttl;
+    drbNegativePurge(cache, now);
+    drbNegativeEntry* previous = drbNegativeLookup(cache, entry->root, entry->path,
+                                                   entry->pathHash);
+    if (previous)
+        drbNegativeRemove(cache, previous);
+    
+    // Keep at most one entry per bucket on average
+    if (cache->stats.entries >= cache->bucketCount) {
+        size_t count = cache->bucketCount * 2;
+        drbNegativeEntry** buckets = calloc(count, sizeof(drbNegativeEntry*));
+        if (buckets) {
+            for (size_t i = 0; i < cache->bucketCount; i++)
+                for (drbNegativeEntry *e = cache->buckets[i], *next; e; e = next) {
+                    next = e->next;
+                    e->next = buckets[e->pathHash & (count - 1)];
+                    buckets[e->pathHash & (count - 1)] = e;
+                }
+            free(cache->buckets);
+            cache->buckets = buckets;
+            cache->bucketCount = count;
+        }
+    }
+    
+    drbNegativeEntry** bucket = &cache->buckets[entry->pathHash & (cache->bucketCount - 1)];
+    entry->next = *bucket;
+    *bucket = entry;
+    entry->older = cache->newest;
+    if (cache->newest)
+        cache->newest->newer = entry;
+    else
+        cache->oldest = entry;
+    cache->newest = entry;
+    cache->stats.entries++;
+    
+    while (cache->stats.entries > cache->maxEntries)
+        drbNegativeRemove(cache, cache->oldest);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/*!
+ * \brief   Forget the missing paths that a path now exists for.
+ *
+ * The entries of the path and of its parent folders are removed, in all the
+ * roots. With subtree (e.g. the destination of a move), the entries of the
+ * paths under it are removed too.
+ *
+ * \param   cache     cache to update
+ * \param   path      encoded path now existing
+ * \param   subtree   the path may now have children
+ * \return  void
+ */
+void drbNegativeCacheInvalidate(drbNegativeCache* cache, const char* path, bool subtree) {
+    char* key = drbPathKey(path);
+    if (!key)
+        return;
+    
+    pthread_mutex_lock(&cache->lock);
+    cache->generation++;
+    if (subtree) {
+        size_t length = strlen(key);
+        for (drbNegativeEntry *entry = cache->newest, *older; entry; entry = older) {
+            older = entry->older;
+            if (strncmp(entry->path, key, length) == 0 && entry->path[length] == '/') {
+                drbNegativeRemove(cache, entry);
+                cache->stats.invalidated++;
+            }
+        }
+    }
+    
+    // The key is cut at each slash to remove the parent folders
+    for (char* end = key + strlen(key); ; ) {
+        *end = '\0';
+        drbNegativeRemovePath(cache, key, drbStrHash(key));
+        if (end == key)
+            break;
+        end = strrchr(key, '/');
+    }
+    pthread_mutex_unlock(&cache->lock);
+    free(key);
+}
+
+/*!
+ * \brief   Get the usage statistics of a cache.
+ * \param       cache   cache to query
+ * \param[out]  stats   cache statistics
+ * \return  void
+ */
+void drbNegativeCacheGetStats(drbNegativeCache* cache, drbNegativeCacheStats* stats) {
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -15,10 +15,25 @@
 #include <curl/curl.h>
 #include <memStream.h>
 #include "dropboxOAuth.h"
+#include "dropboxPipe.h"
+#include "dropboxSink.h"
+#include "dropboxDigest.h"
 #include "dropboxUtils.h"
 
 static const char* DRB_HEADER_FIELD_METADATA = "x-dropbox-metadata";
 
+/*! Received bytes kept for the answer loader before the transfer is paused. */
+static const size_t DRB_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/*! Maximum time (ms) to wait for network activity while the loader starves. */
+static const int DRB_STREAM_WAIT_MS = 1000;
+
+/*! Maximum time (ms) to notice that an abortable stream must be given up. */
+static const int DRB_STREAM_ABORT_MS = 100;
+
+/*! Default staging buffer size of the sinks. */
+static const size_t DRB_SINK_STAGE_SIZE = 256 * 1024;
+
 typedef enum {
     DRB_HTTP_GET = 0,
     DRB_HTTP_POST1,
@@ -31,13 +46,64 @@ typedef struct {
     void* data;
 } drbWrappedIO;
 
+/*!
+ * \struct  drbSinkIO
+ * \breif   Sink written by a transfer through a staging buffer.
+ */
+typedef struct {
+    drbSink* sink;      /*!< Sink to write. */
+    CURL* curl;         /*!< CURL handle to query for the answer size. */
+    memStream stage;    /*!< Received bytes not written in the sink yet. */
+    size_t stageSize;   /*!< Staged bytes limit (0 without staging). */
+    bool opened;        /*!< The sink was opened. */
+    bool failed;        /*!< A sink hook failed. */
+} drbSinkIO;
+
+/*!
+ * Perform a curl transfer writing in data (curl_easy_perform replacement).
+ */
+typedef CURLcode (*drbPerformFct)(CURL* curl, void* data);
+
 typedef struct {
     drbWrappedIO ok;  /*!< IO used when http code == 200. */
     drbWrappedIO ko;  /*!< IO used when http code != 200. */
     drbWrappedIO* io; /*!< Must be initialized to NULL. */
     CURL* curl;       /*!< CURL handle to query for the http call. */
+    drbDigestState* digest; /*!< Checksums of the 'ok' data (NULL for none). */
 } drbWrappedIOData;
 
+/*!
+ * \struct  drbDigestReader
+ * \breif   Upload read function hashing what it reads.
+ */
+typedef struct {
+    ssize_t (*fct)(void *, size_t , size_t , void *); /*!< Wrapped read. */
+    void* data;                                       /*!< Wrapped read data. */
+    drbDigestState* digest;                           /*!< Checksums to update. */
+    bool failed;                                      /*!< The wrapped read failed. */
+} drbDigestReader;
+
+/*!
+ * \struct  drbStream
+ * \breif   Answer consumed by a loader while it is downloaded.
+ *
+ * The loader pulls the answer with drbStreamRead, which drives the transfer
+ * (through a curl multi handle) only when the received bytes are consumed. So
+ * the answer is never fully buffered and its parsing overlaps the transfer.
+ */
+typedef struct {
+    drbLoadFct loadFct;   /*!< Function consuming the answer. */
+    void* loadArg;        /*!< loadFct argument. */
+    drbAbortFct abortFct; /*!< Tell whether to give the transfer up (NULL if never). */
+    void* loaded;         /*!< loadFct result. */
+    CURL* curl;           /*!< Easy handle of the transfer. */
+    CURLM* multi;         /*!< Multi handle driving the transfer. */
+    memStream chunk;      /*!< Received bytes not yet consumed by loadFct. */
+    bool paused;          /*!< Transfer paused because chunk is full. */
+    bool done;            /*!< Transfer is over (successfully or not). */
+    CURLcode result;      /*!< Transfer result, once done. */
+} drbStream;
+
 /*!
  * \brief   Translate a Curl error code to a DRBERR_XXX.
  * \param   code   code to translate.
@@ -51,6 +117,8 @@ static int drbErrorFromCurl(CURLcode code) {
         case CURLE_COULDNT_CONNECT:
         case CURLE_PARTIAL_FILE:          return DRBERR_NETWORK;
         case CURLE_OPERATION_TIMEDOUT:    return DRBERR_TIMEOUT;
+        case CURLE_WRITE_ERROR:
+        case CURLE_READ_ERROR:            return DRBERR_IO;
         default:                          return DRBERR_UNKNOWN;
     }
 }
@@ -71,11 +139,278 @@ static size_t drbWrappedIOCall(const void *ptr, size_t size, size_t count, drbWr
         long httpCode;
         curl_easy_getinfo (data->curl, CURLINFO_RESPONSE_CODE, &httpCode);
         data->io = (httpCode == 200 ? &data->ok : &data->ko);
+        
+        // Memory streams are allocated once when the answer size is known
+        curl_off_t length;
+        if ((void*)data->io->fct == (void*)memStreamWrite &&
+            curl_easy_getinfo(data->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) == CURLE_OK &&
+            length > 0) {
+            memStream* mem = data->io->data;
+            memStreamReserve(mem, mem->size + (size_t)length);
+        }
     }
-    return data->io->fct(ptr, size, count, data->io->data);
+    size_t written = data->io->fct(ptr, size, count, data->io->data);
+    
+    // A paused chunk is given again, so only the accepted ones are hashed
+    if (data->digest && data->io == &data->ok && written == size * count)
+        drbDigestUpdate(data->digest, ptr, written);
+    return written;
+}
+
+/*!
+ *   Act as an IO read call, and hash the read data. A read error ends the
+ *   data and is kept to abort the upload.
+ */
+static size_t drbDigestRead(void *ptr, size_t size, size_t count, drbDigestReader *reader) {
+    ssize_t len = reader->fct(ptr, size, count, reader->data);
+    if (len < 0)
+        reader->failed = true;
+    if (len <= 0)
+        return 0;
+    drbDigestUpdate(reader->digest, ptr, len * size);
+    return len;
 }
 
 
+/*!
+ *   Act as an IO write call, but keep the data for the stream loader. When the
+ *   loader is late, the transfer is paused to let the socket buffer the rest.
+ */
+static size_t drbStreamWrite(const void *ptr, size_t size, size_t count, drbStream *stream) {
+    if (stream->chunk.size >= DRB_STREAM_CHUNK_SIZE) {
+        stream->paused = true;
+        return CURL_WRITEFUNC_PAUSE;
+    }
+    return memStreamWrite(ptr, size, count, &stream->chunk);
+}
+
+/*!
+ * \brief   Read the answer of a stream, downloading it on demand.
+ * \param   buffer   where the read data are written
+ * \param   size     buffer size
+ * \param   data     stream to read (drbStream*)
+ * \return  number of bytes read, 0 when the answer is over.
+ */
+static size_t drbStreamRead(void *buffer, size_t size, void *data) {
+    drbStream* stream = data;
+    
+    while (stream->chunk.cursor >= stream->chunk.size && !stream->done) {
+        // Everything was consumed, reuse the chunk memory
+        stream->chunk.cursor = stream->chunk.size = 0;
+        
+        if (stream->abortFct && stream->abortFct(stream->loadArg)) {
+            // The rest of the answer is dropped with the connection
+            stream->result = CURLE_ABORTED_BY_CALLBACK;
+            stream->done = true;
+        } else if (stream->paused) {
+            // Resuming delivers the pending data through drbStreamWrite
+            stream->paused = false;
+            curl_easy_pause(stream->curl, CURLPAUSE_CONT);
+        } else {
+            int running = 0;
+            CURLMcode code = curl_multi_perform(stream->multi, &running);
+            if (code == CURLM_OK && running) {
+                if (stream->chunk.size == 0)
+                    code = curl_multi_wait(stream->multi, NULL, 0, stream->abortFct ?
+                                           DRB_STREAM_ABORT_MS : DRB_STREAM_WAIT_MS, NULL);
+            } else if (code == CURLM_OK) {
+                CURLMsg* msg;
+                int queued;
+                while ((msg = curl_multi_info_read(stream->multi, &queued)) != NULL)
+                    if (msg->msg == CURLMSG_DONE)
+                        stream->result = msg->data.result;
+                stream->done = true;
+            }
+            if (code != CURLM_OK) {
+                stream->result = code == CURLM_OUT_OF_MEMORY ? CURLE_OUT_OF_MEMORY : CURLE_FAILED_INIT;
+                stream->done = true;
+            }
+        }
+        
+        // Writes moved the cursor, read the received bytes from the start
+        memStreamRewind(&stream->chunk);
+    }
+    
+    return memStreamRead(buffer, 1, size, &stream->chunk);
+}
+
+/*!
+ * \brief   Perform a curl request whose answer is consumed by a stream loader.
+ * \param   curl     curl session, already set up to write in the stream
+ * \param   stream   stream with the loader to feed
+ * \return  curl transfer result.
+ */
+static CURLcode drbStreamPerform(CURL *curl, drbStream *stream) {
+    char buffer[1024];
+    
+    if ((stream->multi = curl_multi_init()) == NULL)
+        return CURLE_OUT_OF_MEMORY;
+    
+    stream->curl = curl;
+    stream->result = CURLE_OK;
+    stream->paused = stream->done = false;
+    curl_multi_add_handle(stream->multi, curl);
+    
+    stream->loaded = stream->loadFct(drbStreamRead, stream, stream->loadArg);
+    
+    // The loader may stop early (e.g. on a syntax error), complete the transfer
+    while (drbStreamRead(buffer, sizeof(buffer), stream) > 0);
+    
+    curl_multi_remove_handle(stream->multi, curl);
+    curl_multi_cleanup(stream->multi);
+    
+    return stream->result;
+}
+
+/*!
+ *   Act as an IO write call for a sink: open it on the first call, then stage
+ *   the data and write it along with the chunk that doesn't fit.
+ */
+static size_t drbSinkIOWrite(const void *ptr, size_t size, size_t count, drbSinkIO *io) {
+    size_t len = size * count;
+    drbSink* sink = io->sink;
+    
+    if (!io->opened) {
+        curl_off_t length;
+        io->opened = true;
+        if ((sink->open && !sink->open(sink->data)) ||
+            (sink->preallocate &&
+             curl_easy_getinfo(io->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) == CURLE_OK &&
+             length > 0 && !sink->preallocate((uint64_t)length, sink->data))) {
+            io->failed = true;
+            return 0;
+        }
+    }
+    
+    if (io->stage.data && io->stage.size + len <= io->stageSize) {
+        memcpy(io->stage.data + io->stage.size, ptr, len);
+        io->stage.size += len;
+        return len;
+    }
+    
+    struct iovec iov[2] = {{io->stage.data, io->stage.size}, {(void*)ptr, len}};
+    if (!drbSinkWriteAll(sink, iov, 2)) {
+        io->failed = true;
+        return 0;
+    }
+    io->stage.size = 0;
+    return len;
+}
+
+/*!
+ * \brief   Set up a sink to be written by a transfer.
+ * \param   cli    client owning the staging buffers pool
+ * \param   io     sink IO to set up
+ * \param   sink   sink to write
+ * \param   curl   curl session of the transfer
+ * \return  void
+ */
+static void drbOpenSinkIO(drbClient* cli, drbSinkIO* io, drbSink* sink, CURL* curl) {
+    memset(io, 0, sizeof(drbSinkIO));
+    io->sink = sink;
+    io->curl = curl;
+    
+    // Only a sink with writev can write the staged data along with a chunk
+    if (sink->writev) {
+        io->stageSize = sink->bufferSize ? sink->bufferSize : DRB_SINK_STAGE_SIZE;
+        drbAcquireStream(cli, &io->stage, io->stageSize);
+    }
+    if (sink->bufferSize)
+        curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, (long)sink->bufferSize);
+}
+
+/*!
+ * \brief   Flush the staged data of a sink and close it.
+ * \param   cli    client owning the staging buffers pool
+ * \param   io     sink IO to close
+ * \param   err    error code of the transfer
+ * \return  error code of the call (given by the sink close hook).
+ */
+static int drbCloseSinkIO(drbClient* cli, drbSinkIO* io, int err) {
+    struct iovec iov = {io->stage.data, io->stage.size};
+    
+    // What was received is written, even if the transfer failed
+    if (!io->failed && io->stage.size && !drbSinkWriteAll(io->sink, &iov, 1) && !err)
+        err = DRBERR_IO;
+    drbReleaseStream(cli, &io->stage);
+    
+    if (io->sink->close)
+        err = io->sink->close(err, io->sink->data);
+    return err;
+}
+
+/*!
+ * \brief   Perform a curl request whose answer feeds a pipe.
+ *
+ * The transfer is paused while the pipe is full, and resumed when the reader
+ * wakes the multi handle up.
+ *
+ * \param   curl   curl session, already set up to write in the pipe
+ * \param   data   wrapped IO whose ok data is the pipe
+ * \return  curl transfer result.
+ */
+static CURLcode drbPipePerform(CURL *curl, drbWrappedIOData *data) {
+    drbPipe* pipe = data->ok.data;
+    CURLcode result = CURLE_OK;
+    CURLMcode code;
+    CURLM* multi;
+    int running = 0;
+    
+    if ((multi = curl_multi_init()) == NULL)
+        return CURLE_OUT_OF_MEMORY;
+    
+    curl_multi_add_handle(multi, curl);
+    drbPipeAttach(pipe, multi);
+    
+    while ((code = curl_multi_perform(multi, &running)) == CURLM_OK && running) {
+        if (drbPipeResume(pipe))
+            curl_easy_pause(curl, CURLPAUSE_CONT);
+        else if ((code = curl_multi_poll(multi, NULL, 0, DRB_STREAM_WAIT_MS, NULL)) != CURLM_OK)
+            break;
+    }
+    
+    if (code == CURLM_OK) {
+        CURLMsg* msg;
+        int queued;
+        while ((msg = curl_multi_info_read(multi, &queued)) != NULL)
+            if (msg->msg == CURLMSG_DONE)
+                result = msg->data.result;
+    } else
+        result = code == CURLM_OUT_OF_MEMORY ? CURLE_OUT_OF_MEMORY : CURLE_FAILED_INIT;
+    
+    drbPipeAttach(pipe, NULL);
+    curl_multi_remove_handle(multi, curl);
+    curl_multi_cleanup(multi);
+    
+    return result;
+}
+
+/*!
+ * \brief   Initialize a memory stream with a buffer of the client pool.
+ * \param   cli      client owning the pool
+ * \param   stream   memory stream to initialize
+ * \param   size     number of bytes the stream must hold without reallocation
+ * \return  indicates whether the buffer was allocated.
+ */
+bool drbAcquireStream(drbClient* cli, memStream* stream, size_t size) {
+    pthread_mutex_lock(&cli->poolLock);
+    bool acquired = memStreamAcquire(stream, &cli->pool, size);
+    pthread_mutex_unlock(&cli->poolLock);
+    return acquired;
+}
+
+/*!
+ * \brief   Clean up a memory stream and give its buffer back to the client pool.
+ * \param   cli      client owning the pool
+ * \param   stream   memory stream to clean up
+ * \return  void
+ */
+void drbReleaseStream(drbClient* cli, memStream* stream) {
+    pthread_mutex_lock(&cli->poolLock);
+    memStreamRelease(stream, &cli->pool);
+    pthread_mutex_unlock(&cli->poolLock);
+}
+
 /*!
  * \brief   Found a copy the OAuth key and secret from the server answer.
  * \param       answer   server raw answer
@@ -191,11 +526,13 @@ char* drbEncodePath(const char *path) {
  * \param        writeFct   called function to write in data (e.g. fwrite)
  * \param[out]   header     server answer header (must be freed by caller)
  * \param        timeout    request timeout limit (0 is infinite)
+ * \param        perform    performs the transfer writing in data (NULL for
+ *                          curl_easy_perform)
  * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
  */
 static int drbOAuthCurlPerform(drbClient* cli, CURL *curl, const char* url,
                                drbHttpMethod method, void* data, void* writeFct,
-                               char** header, int timeout)
+                               char** header, int timeout, drbPerformFct perform)
 {
     int err = DRBERR_OK;
     
@@ -205,7 +542,8 @@ static int drbOAuthCurlPerform(drbClient* cli, CURL *curl, const char* url,
                                    cli->c.key, cli->c.secret,
                                    cli->t.key, cli->t.secret);
     
-    memStream headerData; memStreamInit(&headerData);
+    memSpillStream headerData; memSpillStreamInit(&headerData, cli->spillThreshold);
+    drbAcquireStream(cli, &headerData.mem, 0);
     
     if(method) {
         if (postArg){
@@ -238,7 +576,7 @@ static int drbOAuthCurlPerform(drbClient* cli, CURL *curl, const char* url,
         
         if (header) { // Only read the header if it's needed
             curl_easy_setopt(curl, CURLOPT_HEADERDATA, &headerData);
-            curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, memStreamWrite);
+            curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, memSpillStreamWrite);
         }
         
         // General curl options
@@ -246,12 +584,16 @@ static int drbOAuthCurlPerform(drbClient* cli, CURL *curl, const char* url,
         curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
         curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
         
-        CURLcode curlCode = curl_easy_perform(curl);
+        CURLcode curlCode = perform ? perform(curl, data) : curl_easy_perform(curl);
         if (curlCode == CURLE_OK) {
             curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
             
-            if (header)
-                *header = drbGetHeaderFieldContent(DRB_HEADER_FIELD_METADATA, headerData.data);
+            // The headers may be spilled to a file that can't be mapped
+            const char* headers = header ? memSpillStreamMap(&headerData) : NULL;
+            if (headers)
+                *header = drbGetHeaderFieldContent(DRB_HEADER_FIELD_METADATA, headers);
+            else if (header)
+                err = headerData.failed ? DRBERR_IO : DRBERR_MALLOC;
             
             if (httpCode != 200) {
                 err = (int)httpCode;
@@ -261,7 +603,8 @@ static int drbOAuthCurlPerform(drbClient* cli, CURL *curl, const char* url,
         }
     }
     
-    free(headerData.data);
+    drbReleaseStream(cli, &headerData.mem);
+    memSpillStreamCleanup(&headerData);
     free(postArg);
     free(reqUrl);
     
@@ -274,31 +617,54 @@ static int drbOAuthCurlPerform(drbClient* cli, CURL *curl, const char* url,
  * \param        url        request base url
  * \param        data       where the request answer is written (e.g. FILE*)
  * \param        writeFct   called function to write in data (e.g. fwrite)
+ * \param[out]   digest     checksums of the written data (NULL for none)
  * \param[out]   answer     server answer (must be freed by caller)
  * \param        timeout    request timeout limit (0 is infinite)
  * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
  */
 int drbOAuthGetFile(drbClient* cli, const char* url, void* data, void* writeFct,
-                    char** answer, int timeout)
+                    drbDigest* digest, char** answer, int timeout)
 {
     
     int err;
-    CURL *curl = curl_easy_init();
+    drbDigestState digestState;
+    if (digest && !drbDigestStart(&digestState, digest))
+        return DRBERR_MALLOC;
     
+    CURL *curl = curl_easy_init();
     if (curl) {
         memStream mem; memStreamInit(&mem);
         void* koWriteFct = answer? (void*)memStreamWrite : (void*)drbNullIOCall;
+        
+        // A pipe is fed without blocking, the transfer is paused while it is full
+        bool piped = writeFct == (void*)drbPipeWrite;
+        if (piped)
+            writeFct = (void*)drbPipeTransferWrite;
+        
+        // A sink is opened by the first chunk and closed by the transfer end
+        drbSinkIO sinkIO;
+        drbSink* sink = writeFct == (void*)drbSinkWrite ? data : NULL;
+        if (sink) {
+            drbOpenSinkIO(cli, &sinkIO, sink, curl);
+            data = &sinkIO, writeFct = (void*)drbSinkIOWrite;
+        }
+        
         drbWrappedIOData ioData;
         ioData.curl = curl;
         ioData.ok.data = data, ioData.ok.fct = writeFct;
         ioData.ko.data = &mem, ioData.ko.fct = koWriteFct;
         ioData.io = NULL;
+        ioData.digest = digest ? &digestState : NULL;
         
         char* header = NULL;
         err = drbOAuthCurlPerform(cli, curl, url, DRB_HTTP_GET, &ioData,
-                                  drbWrappedIOCall, answer ? &header : NULL,
-                                  timeout);
+                                  drbWrappedIOCall, answer ? &header : NULL, timeout,
+                                  piped ? (drbPerformFct)drbPipePerform : NULL);
         curl_easy_cleanup(curl);
+        if (piped)
+            drbClosePipe(data, err);
+        if (sink)
+            err = drbCloseSinkIO(cli, &sinkIO, err);
         if(!err || err > 200) {
             if (answer) {
                 if(err) {
@@ -312,6 +678,8 @@ int drbOAuthGetFile(drbClient* cli, const char* url, void* data, void* writeFct,
     } else
         err = DRBERR_MALLOC;
     
+    if (digest)
+        drbDigestFinish(&digestState);
     return err;
 }
 
@@ -329,7 +697,7 @@ int drbOAuthGet(drbClient* cli, const char* url, void* data, void* writeFct, int
     int err;
     CURL *curl = curl_easy_init();
     if (curl) {
-        err = drbOAuthCurlPerform(cli, curl, url, DRB_HTTP_GET, data, writeFct, NULL, timeout);
+        err = drbOAuthCurlPerform(cli, curl, url, DRB_HTTP_GET, data, writeFct, NULL, timeout, NULL);
         curl_easy_cleanup(curl);
     } else
         err = DRBERR_MALLOC;
@@ -350,7 +718,48 @@ int drbOAuthPost(drbClient* cli, const char* url, void* data, void* writeFct, in
     int err;
     CURL *curl = curl_easy_init();
     if (curl) {
-        err = drbOAuthCurlPerform(cli, curl, url, DRB_HTTP_POST1, data, writeFct, NULL, timeout);
+        err = drbOAuthCurlPerform(cli, curl, url, DRB_HTTP_POST1, data, writeFct, NULL, timeout, NULL);
+        curl_easy_cleanup(curl);
+    } else
+        err = DRBERR_MALLOC;
+    
+    return err;
+}
+
+/*!
+ * \brief   Perform an OAuth request whose answer is loaded during the transfer.
+ * \param        cli        authenticated dropbox client
+ * \param        url        request base url
+ * \param        method     DRB_HTTP_GET or DRB_HTTP_POST1
+ * \param        loadFct    function consuming the answer (NULL to ignore it)
+ * \param        loadArg    loadFct argument
+ * \param        abortFct   called with loadArg while the answer is awaited, the
+ *                          transfer is given up when it returns true (NULL if
+ *                          never)
+ * \param[out]   loaded     loadFct result, whatever the http code is
+ * \param        timeout    request timeout limit (0 is infinite)
+ * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
+ */
+static int drbOAuthStream(drbClient* cli, const char* url, drbHttpMethod method,
+                          drbLoadFct loadFct, void* loadArg, drbAbortFct abortFct,
+                          void** loaded, int timeout)
+{
+    int err;
+    CURL *curl = curl_easy_init();
+    if (curl) {
+        if (loadFct) {
+            drbStream stream;
+            memset(&stream, 0, sizeof(drbStream));
+            stream.loadFct = loadFct;
+            stream.loadArg = loadArg;
+            stream.abortFct = abortFct;
+            drbAcquireStream(cli, &stream.chunk, DRB_STREAM_CHUNK_SIZE + CURL_MAX_WRITE_SIZE);
+            err = drbOAuthCurlPerform(cli, curl, url, method, &stream, drbStreamWrite,
+                                      NULL, timeout, (drbPerformFct)drbStreamPerform);
+            drbReleaseStream(cli, &stream.chunk);
+            *loaded = stream.loaded;
+        } else
+            err = drbOAuthCurlPerform(cli, curl, url, method, NULL, NULL, NULL, timeout, NULL);
         curl_easy_cleanup(curl);
     } else
         err = DRBERR_MALLOC;
@@ -358,30 +767,102 @@ int drbOAuthPost(drbClient* cli, const char* url, void* data, void* writeFct, in
     return err;
 }
 
+/*!
+ * \brief   Perform an OAuth GET request and load its answer during the transfer.
+ * \param        cli        authenticated dropbox client
+ * \param        url        request base url
+ * \param        loadFct    function consuming the answer (NULL to ignore it)
+ * \param        loadArg    loadFct argument
+ * \param[out]   loaded     loadFct result, whatever the http code is
+ * \param        timeout    request timeout limit (0 is infinite)
+ * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
+ */
+int drbOAuthGetStream(drbClient* cli, const char* url, drbLoadFct loadFct, void* loadArg,
+                      void** loaded, int timeout) {
+    return drbOAuthStream(cli, url, DRB_HTTP_GET, loadFct, loadArg, NULL, loaded, timeout);
+}
+
+/*!
+ * \brief   Perform an OAuth POST request and load its answer during the transfer.
+ * \param        cli        authenticated dropbox client
+ * \param        url        request base url
+ * \param        loadFct    function consuming the answer (NULL to ignore it)
+ * \param        loadArg    loadFct argument
+ * \param[out]   loaded     loadFct result, whatever the http code is
+ * \param        timeout    request timeout limit (0 is infinite)
+ * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
+ */
+int drbOAuthPostStream(drbClient* cli, const char* url, drbLoadFct loadFct, void* loadArg,
+                       void** loaded, int timeout) {
+    return drbOAuthStream(cli, url, DRB_HTTP_POST1, loadFct, loadArg, NULL, loaded, timeout);
+}
+
+/*!
+ * \brief   Perform an OAuth POST request and load its answer during the
+ *          transfer, unless it is given up meanwhile.
+ * \param        cli        authenticated dropbox client
+ * \param        url        request base url
+ * \param        loadFct    function consuming the answer
+ * \param        loadArg    loadFct and abortFct argument
+ * \param        abortFct   tell whether to give the transfer up
+ * \param[out]   loaded     loadFct result, whatever the http code is
+ * \param        timeout    request timeout limit (0 is infinite)
+ * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
+ */
+int drbOAuthPostStreamUntil(drbClient* cli, const char* url, drbLoadFct loadFct, void* loadArg,
+                            drbAbortFct abortFct, void** loaded, int timeout) {
+    return drbOAuthStream(cli, url, DRB_HTTP_POST1, loadFct, loadArg, abortFct, loaded,
+                          timeout);
+}
+
 /*!
  * \brief   Perform an OAuth GET or POST request for a Dropbox client.
  * \param        cli        authenticated dropbox client
  * \param        url        request base url
  * \param        data       where the request answer is readed (e.g. FILE*)
  * \param        readFct    called function to read data content (e.g. fwrite)
+ * \param[out]   digest     checksums of the read data (NULL for none)
  * \param[out]   answer     server answer (must be freed by caller)
  * \param        timeout    request timeout limit (0 is infinite)
  * \return  error code (DRBERR_XXX or http error returned by the Dropbox server)
  */
 int drbOAuthPostFile(drbClient* cli, const char *url, void* data,
                      ssize_t (*readFct)(void *, size_t , size_t , void *),
-                     char** answer, int timeout)
+                     drbDigest* digest, char** answer, int timeout)
 {
     
     int err;
     
-    memStream fileData; memStreamInit(&fileData);
-    if (memStreamLoad(&fileData, data, (void*)readFct)) {
+    // A source is opened before being read in chunks of its buffer size
+    drbSource* source = (void*)readFct == (void*)drbSourceRead ? data : NULL;
+    if (source)
+        source->failed = false;
+    bool opened = !source || !source->open || source->open(source->data);
+    size_t chunk = source && source->bufferSize ? source->bufferSize : MEM_PIPE_BUFFER_SIZE;
+    
+    // The read data is hashed on its way to the request body
+    drbDigestState digestState;
+    drbDigestReader reader = {readFct, data, &digestState, false};
+    bool hashing = !digest || drbDigestStart(&digestState, digest);
+    if (digest)
+        data = &reader, readFct = (void*)drbDigestRead;
+    
+    // Large files are spilled to disk, and mapped to be signed
+    const char* body = NULL;
+    memSpillStream fileData; memSpillStreamInit(&fileData, cli->spillThreshold);
+    drbAcquireStream(cli, &fileData.mem, 0);
+    bool piped = opened && hashing &&
+        memStreamPipeBuffered(data, (void*)readFct, &fileData, (void*)memSpillStreamWrite, chunk);
+    
+    // A failed read ends the data early, the truncated body is not sent
+    bool failed = (source && source->failed) || reader.failed;
+    if (piped && !failed && (body = memSpillStreamMap(&fileData)) != NULL) {
+        memSpillStreamRewind(&fileData);
         
         // Build request url
         char *reqUrl = NULL;
         char* key = oauth_catenc(2, cli->c.secret, cli->t.secret);
-        char* sign = oauth_sign_hmac_sha1_raw(fileData.data, fileData.size, key, strlen(key));
+        char* sign = oauth_sign_hmac_sha1_raw(body, fileData.size, key, strlen(key));
         asprintf(&reqUrl,"%s&xoauth_body_signature=%s&param=val"
                  "&xoauth_body_signature_method=HMAC_SHA1", url, sign);
         free(key), free(sign);
@@ -398,17 +879,16 @@ int drbOAuthPostFile(drbClient* cli, const char *url, void* data,
             struct curl_slist *slist = curl_slist_append(NULL, header);
             curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slist);
             curl_easy_setopt(curl, CURLOPT_READDATA, &fileData);
-            curl_easy_setopt(curl, CURLOPT_READFUNCTION, memStreamRead);
+            curl_easy_setopt(curl, CURLOPT_READFUNCTION, memSpillStreamRead);
             curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, fileData.size);
             
             err = drbOAuthCurlPerform(cli, curl, reqUrl, DRB_HTTP_POST2,
                                       &answerData, answer ? memStreamWrite:NULL,
-                                      NULL, timeout);
+                                      NULL, timeout, NULL);
             
             free(header);
             curl_slist_free_all(slist);
             curl_easy_cleanup(curl);
-            free(fileData.data);
             
             if (answer)
                 *answer = answerData.data;
@@ -416,9 +896,17 @@ int drbOAuthPostFile(drbClient* cli, const char *url, void* data,
             err = DRBERR_MALLOC;
         
         free(reqUrl);
-    } else
+    } else if (!opened || failed || fileData.failed)
+        err = DRBERR_IO;
+    else
         err = DRBERR_MALLOC;
     
+    if (digest)
+        drbDigestFinish(&digestState);
+    drbReleaseStream(cli, &fileData.mem);
+    memSpillStreamCleanup(&fileData);
+    if (source && opened && source->close)
+        err = source->close(err, source->data);
     return err;
 }
 
@@ -0,0 +1,444 @@
+/*!
+ * \file    dropboxPager.c
+ * \brief   Delta pages fetched and parsed ahead of the application.
+ *
+ * The pages go through three stages linked by bounded queues: the fetchers
+ * download them, the parser builds their drbDelta and the application takes
+ * them with drbDeltaPagerNext. A fetcher watches the answer while it is
+ * received, and as soon as its cursor and has_more are known, the next page
+ * is requested by another fetcher, while the end of the current one is still
+ * downloading.
+ *
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#define _GNU_SOURCE
+
+#define PAGER_FETCHERS  2
+#define PAGER_DEPTH     4
+#define PAGER_READ_SIZE (16*1024)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <jansson.h>
+#include <memStream.h>
+#include "dropboxPager.h"
+#include "dropboxOAuth.h"
+
+/*!
+ * \struct  drbPage
+ * \breif   Delta page going through the pager stages.
+ */
+typedef struct {
+    int err;      /*!< Request error code. */
+    char* raw;    /*!< Raw answer, until the page is parsed. */
+    void* output; /*!< Page output (drbDelta* or error), once parsed. */
+} drbPage;
+
+/*!
+ * \struct  drbPageQueue
+ * \breif   Bounded FIFO of pages between two stages.
+ */
+typedef struct {
+    drbPage pages[PAGER_DEPTH];
+    size_t head;  /*!< Index of the oldest page. */
+    size_t count; /*!< Number of queued pages. */
+} drbPageQueue;
+
+struct drbDeltaPager {
+    drbClient* cli;
+    char* url;
+    char* args;
+    unsigned int fields;
+    int timeout;
+    drbPagerOutputFct outputFct;
+    
+    pthread_mutex_t lock;  /*!< Protects everything below. */
+    pthread_cond_t change; /*!< Signaled on every state change. */
+    pthread_t fetchers[PAGER_FETCHERS];
+    pthread_t parser;
+    size_t threads;        /*!< Number of started threads (parser first). */
+    
+    char* cursor;          /*!< Cursor of the next page to fetch. */
+    bool fetchReady;       /*!< The next page can be fetched. */
+    bool fetchOver;        /*!< No more page will be fetched. */
+    size_t fetching;       /*!< Number of pages being fetched. */
+    size_t fetchSeq;       /*!< Sequence number of the next fetched page. */
+    size_t queueSeq;       /*!< Sequence number of the next page to queue. */
+    drbPageQueue fetched;  /*!< Pages waiting to be parsed. */
+    drbPageQueue parsed;   /*!< Pages waiting for the application. */
+    bool parseOver;        /*!< No more page will be parsed. */
+    bool stop;             /*!< The pager is over (destroyed or failed). */
+};
+
+/*!
+ * \struct  drbPageLoad
+ * \breif   Loader state of a fetched page, looking for its cursor and has_more.
+ */
+typedef struct {
+    drbDeltaPager* pager;
+    bool announced;          /*!< The next page was announced to the fetchers. */
+    char* cursor;            /*!< Page cursor, once found. */
+    int hasMore;             /*!< Page has_more, -1 until found. */
+    int depth;               /*!< Current JSON nesting depth. */
+    bool inStr;              /*!< Inside a JSON string. */
+    bool escaped;            /*!< Previous string char was a backslash. */
+    char key[sizeof("has_more")];
+    size_t keySize;          /*!< Size of the last depth 1 string (key). */
+    enum {PAGE_NONE, PAGE_CURSOR, PAGE_HAS_MORE} expect; /*!< Next value kind. */
+    size_t cursorStart;      /*!< Offset of the cursor string, if open. */
+    bool inCursor;           /*!< Inside the cursor string. */
+} drbPageLoad;
+
+/*!
+ * \brief   Add a page at the end of a queue (which must not be full).
+ */
+static void drbPageQueuePush(drbPageQueue* queue, drbPage page) {
+    queue->pages[(queue->head + queue->count++) % PAGER_DEPTH] = page;
+}
+
+/*!
+ * \brief   Remove the oldest page of a queue (which must not be empty).
+ */
+static drbPage drbPageQueuePop(drbPageQueue* queue) {
+    drbPage page = queue->pages[queue->head];
+    queue->head = (queue->head + 1) % PAGER_DEPTH;
+    queue->count--;
+    return page;
+}
+
+/*!
+ * \brief   Free a page that will never reach the application.
+ */
+static void drbPageDiscard(drbPage* page) {
+    free(page->raw);
+    if (page->err)
+        free(page->output);
+    else
+        drbDestroyDelta(page->output, true);
+}
+
+/*!
+ * \brief   Decode the cursor JSON string of a page answer.
+ * \param   str    cursor JSON string, with its quotes
+ * \param   size   str size
+ * \return  decoded cursor (must be freed by caller), NULL on failure
+ */
+static char* drbPageDecodeCursor(const char* str, size_t size) {
+    char* cursor = NULL;
+    char* array;
+    if (asprintf(&array, "[%.*s]", (int)size, str) != -1) {
+        json_t* root = json_loads(array, 0, NULL);
+        const char* value = json_string_value(json_array_get(root, 0));
+        cursor = value ? strdup(value) : NULL;
+        json_decref(root);
+        free(array);
+    }
+    return cursor;
+}
+
+/*!
+ * \brief   Follow the top level of a page answer to find its cursor and
+ *          has_more, and announce the next page as soon as both are known.
+ * \param   load   page loader state
+ * \param   raw    answer received so far
+ * \param   from   offset of the bytes not scanned yet
+ * \param   size   answer size
+ * \return  void
+ */
+static void drbPageScan(drbPageLoad* load, const char* raw, size_t from, size_t size) {
+    for (size_t i = from; i < size && !load->announced; i++) {
+        char c = raw[i];
+        if (load->inStr) {
+            if (load->escaped)
+                load->escaped = false;
+            else if (c == '\\')
+                load->escaped = true, load->keySize = sizeof(load->key);
+            else if (c == '"') {
+                load->inStr = false;
+                if (load->inCursor) {
+                    load->inCursor = false;
+                    free(load->cursor);
+                    load->cursor = drbPageDecodeCursor(raw + load->cursorStart,
+                                                       i + 1 - load->cursorStart);
+                }
+            } else if (load->keySize < sizeof(load->key))
+                load->key[load->keySize++] = c;
+        } else if (c == ':' && load->depth == 1) {
+            load->expect = PAGE_NONE;
+            if (load->keySize == strlen("cursor") && !memcmp(load->key, "cursor", load->keySize))
+                load->expect = PAGE_CURSOR;
+            else if (load->keySize == strlen("has_more") && !memcmp(load->key, "has_more", load->keySize))
+                load->expect = PAGE_HAS_MORE;
+        } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != ',') {
+            if (load->depth == 1 && load->expect == PAGE_HAS_MORE)
+                load->hasMore = c == 't';
+            if (c == '"') {
+                load->inStr = true;
+                load->keySize = load->depth == 1 ? 0 : sizeof(load->key);
+                if (load->depth == 1 && load->expect == PAGE_CURSOR)
+                    load->inCursor = true, load->cursorStart = i;
+            } else if (c == '[' || c == '{')
+                load->depth++;
+            else if (c == ']' || c == '}')
+                load->depth--;
+            load->expect = PAGE_NONE; // Value started
+        }
+        
+        if (load->cursor && load->hasMore != -1) {
+            drbDeltaPager* pager = load->pager;
+            pthread_mutex_lock(&pager->lock);
+            if (load->hasMore) {
+                pager->cursor = load->cursor;
+                pager->fetchReady = true;
+                load->cursor = NULL;
+            } else
+                pager->fetchOver = true;
+            load->announced = true;
+            pthread_cond_broadcast(&pager->change);
+            pthread_mutex_unlock(&pager->lock);
+        }
+    }
+}
+
+/*!
+ * \brief   Tell whether the fetch of a page must be given up.
+ * \param   arg   page loader state (drbPageLoad*)
+ * \return  true once the pager is over.
+ */
+static bool drbPageAbort(void* arg) {
+    drbDeltaPager* pager = ((drbPageLoad*)arg)->pager;
+    pthread_mutex_lock(&pager->lock);
+    bool stop = pager->stop;
+    pthread_mutex_unlock(&pager->lock);
+    return stop;
+}
+
+/*!
+ * \brief   Load a page answer while it is read, watching for its cursor.
+ * \param   xread   function reading the next part of the answer
+ * \param   data    xread data (stream)
+ * \param   arg     page loader state (drbPageLoad*)
+ * \return  loaded answer, NUL terminated (must be freed by caller).
+ */
+static void* drbPageLoader(drbReadFct xread, void* data, void* arg) {
+    drbPageLoad* load = arg;
+    char* raw = NULL;
+    size_t size = 0, capacity = 0, read;
+    
+    do {
+        // Grow geometrically, the answer size is unknown
+        if (capacity - size < PAGER_READ_SIZE + 1) {
+            capacity = capacity ? capacity * 2 : 4 * PAGER_READ_SIZE;
+            if ((raw = memRealloc(raw, capacity)) == NULL)
+                return NULL;
+        }
+        size += (read = xread(raw + size, PAGER_READ_SIZE, data));
+        drbPageScan(load, raw, size - read, size);
+    } while (read > 0 && !drbPageAbort(load));
+    
+    raw[size] = '\0';
+    return raw;
+}
+
+/*!
+ * \brief   Fetcher thread: download the pages once their cursor is known, and
+ *          queue them in order for the parser.
+ * \param   arg   pager (drbDeltaPager*)
+ * \return  NULL
+ */
+static void* drbPagerFetch(void* arg) {
+    drbDeltaPager* pager = arg;
+    
+    pthread_mutex_lock(&pager->lock);
+    while (true) {
+        while (!pager->stop && !pager->fetchReady && !pager->fetchOver)
+            pthread_cond_wait(&pager->change, &pager->lock);
+        if (pager->stop || !pager->fetchReady)
+            break;
+        
+        char* cursor = pager->cursor;
+        size_t seq = pager->fetchSeq++;
+        pager->cursor = NULL;
+        pager->fetchReady = false;
+        pager->fetching++;
+        pthread_mutex_unlock(&pager->lock);
+        
+        drbPage page = {DRBERR_OK, NULL, NULL};
+        drbPageLoad load;
+        memset(&load, 0, sizeof(drbPageLoad));
+        load.pager = pager;
+        load.hasMore = -1;
+        
+        char* url;
+        int res = cursor ? asprintf(&url, "%s?%s&cursor=%s", pager->url, pager->args, cursor)
+                         : asprintf(&url, "%s?%s", pager->url, pager->args);
+        if (res != -1) {
+            // A destroyed pager gives its transfers up
+            page.err = drbOAuthPostStreamUntil(pager->cli, url, drbPageLoader, &load,
+                                               drbPageAbort, (void**)&page.raw, pager->timeout);
+            free(url);
+        } else
+            page.err = DRBERR_MALLOC;
+        free(load.cursor);
+        free(cursor);
+        
+        pthread_mutex_lock(&pager->lock);
+        if (!load.announced)
+            pager->fetchOver = true; // Failed or malformed, the sequence ends here
+        
+        // Queue the pages in their sequence order
+        while (!pager->stop && (seq != pager->queueSeq || pager->fetched.count == PAGER_DEPTH))
+            pthread_cond_wait(&pager->change, &pager->lock);
+        if (!pager->stop)
+            drbPageQueuePush(&pager->fetched, page);
+        else
+            drbPageDiscard(&page);
+        pager->queueSeq++;
+        pager->fetching--;
+        pthread_cond_broadcast(&pager->change);
+    }
+    pthread_mutex_unlock(&pager->lock);
+    return NULL;
+}
+
+/*!
+ * \brief   Parser thread: build the fetched pages output for the application.
+ * \param   arg   pager (drbDeltaPager*)
+ * \return  NULL
+ */
+static void* drbPagerParse(void* arg) {
+    drbDeltaPager* pager = arg;
+    
+    pthread_mutex_lock(&pager->lock);
+    while (true) {
+        while (!pager->stop && !pager->fetched.count && !(pager->fetchOver && !pager->fetching))
+            pthread_cond_wait(&pager->change, &pager->lock);
+        if (pager->stop || !pager->fetched.count)
+            break;
+        
+        drbPage page = drbPageQueuePop(&pager->fetched);
+        pthread_cond_broadcast(&pager->change);
+        pthread_mutex_unlock(&pager->lock);
+        
+        json_t* root = page.raw ? json_loads(page.raw, 0, NULL) : NULL;
+        pager->outputFct(pager->cli, page.err, root, pager->fields, &page.output);
+        if (!page.err && !page.output)
+            pager->outputFct(pager->cli, page.err = DRBERR_UNKNOWN, NULL, pager->fields,
+                             &page.output);
+        json_decref(root);
+        free(page.raw);
+        page.raw = NULL;
+        
+        pthread_mutex_lock(&pager->lock);
+        while (!pager->stop && pager->parsed.count == PAGER_DEPTH)
+            pthread_cond_wait(&pager->change, &pager->lock);
+        if (!pager->stop)
+            drbPageQueuePush(&pager->parsed, page);
+        else
+            drbPageDiscard(&page);
+        pthread_cond_broadcast(&pager->change);
+    }
+    pager->parseOver = true;
+    pthread_cond_broadcast(&pager->change);
+    pthread_mutex_unlock(&pager->lock);
+    return NULL;
+}
+
+/*!
+ * \brief   Create a delta pager and start fetching its first page.
+ * \param   cli         authenticated dropbox client
+ * \param   url         delta request url
+ * \param   args        request arguments, without the cursor
+ * \param   cursor      cursor of the first page (NULL to start from scratch)
+ * \param   fields      DRBFIELD_XXX mask of the entries metadata fields to load
+ * \param   timeout     request timeout limit (0 is infinite)
+ * \param   outputFct   function setting the pages output
+ * \return  created pager (NULL on failure)
+ */
+drbDeltaPager* drbCreatePager(drbClient* cli, const char* url, const char* args,
+                              const char* cursor, unsigned int fields, int timeout,
+                              drbPagerOutputFct outputFct) {
+    drbDeltaPager* pager = calloc(1, sizeof(drbDeltaPager));
+    if (pager == NULL)
+        return NULL;
+    
+    pager->cli = cli;
+    pager->fields = fields;
+    pager->timeout = timeout;
+    pager->outputFct = outputFct;
+    pager->fetchReady = true;
+    pager->url = strdup(url);
+    pager->args = strdup(args);
+    pager->cursor = cursor ? strdup(cursor) : NULL;
+    pthread_mutex_init(&pager->lock, NULL);
+    pthread_cond_init(&pager->change, NULL);
+    
+    bool ok = pager->url && pager->args && (pager->cursor || !cursor);
+    if (ok && (ok = !pthread_create(&pager->parser, NULL, drbPagerParse, pager)))
+        pager->threads++;
+    for (int i = 0; ok && i < PAGER_FETCHERS; i++)
+        if ((ok = !pthread_create(&pager->fetchers[i], NULL, drbPagerFetch, pager)))
+            pager->threads++;
+    
+    if (!ok) {
+        drbDestroyDeltaPager(pager);
+        pager = NULL;
+    }
+    return pager;
+}
+
+int drbDeltaPagerNext(drbDeltaPager* pager, void** output) {
+    drbPage page = {DRBERR_OK, NULL, NULL};
+    
+    pthread_mutex_lock(&pager->lock);
+    while (!pager->stop && !pager->parsed.count && !pager->parseOver)
+        pthread_cond_wait(&pager->change, &pager->lock);
+    if (!pager->stop && pager->parsed.count) {
+        page = drbPageQueuePop(&pager->parsed);
+        pager->stop = page.err != DRBERR_OK; // The cursor is lost after an error
+        pthread_cond_broadcast(&pager->change);
+    }
+    pthread_mutex_unlock(&pager->lock);
+    
+    if (output)
+        *output = page.output;
+    else
+        drbPageDiscard(&page);
+    return page.err;
+}
+
+void drbDestroyDeltaPager(drbDeltaPager* pager) {
+    if (pager) {
+        pthread_mutex_lock(&pager->lock);
+        pager->stop = true;
+        pthread_cond_broadcast(&pager->change);
+        pthread_mutex_unlock(&pager->lock);
+        
+        if (pager->threads > 0)
+            pthread_join(pager->parser, NULL);
+        for (size_t i = 1; i < pager->threads; i++)
+            pthread_join(pager->fetchers[i - 1], NULL);
+        
+        while (pager->fetched.count) {
+            drbPage page = drbPageQueuePop(&pager->fetched);
+            drbPageDiscard(&page);
+        }
+        while (pager->parsed.count) {
+            drbPage page = drbPageQueuePop(&pager->parsed);
+            drbPageDiscard(&page);
+        }
+        
+        pthread_cond_destroy(&pager->change);
+        pthread_mutex_destroy(&pager->lock);
+        free(pager->cursor);
+        free(pager->args);
+        free(pager->url);
+        free(pager);
+    }
+}
@@ -0,0 +1,225 @@
+/*!
+ * \file    dropboxPipe.c
+ * \brief   Ring buffer between a download and its consumer thread.
+ *
+ * The data goes through a lock-free ring buffer. The mutex is only taken to
+ * sleep when the ring is empty (reader) or full (writer), and to wake the
+ * sleeper up. A download never sleeps: its transfer is paused when the ring
+ * is full, and the reader wakes the transfer thread up once it made room. The
+ * pause flag is only used under the mutex, so a pause can't be missed by a
+ * reader that made room meanwhile.
+ *
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <memStream.h>
+#include "dropboxPipe.h"
+
+/*! Default ring size. */
+static const size_t DRB_PIPE_CAPACITY = 1024 * 1024;
+
+/*! Room a paused transfer needs to continue (a whole curl write). */
+static const size_t DRB_PIPE_RESUME_ROOM = CURL_MAX_WRITE_SIZE;
+
+/*!
+ * \struct  drbPipe
+ * \breif   Ring buffer between a producer and a consumer thread.
+ */
+struct drbPipe {
+    memRing ring;             /*!< Transferred data. */
+    pthread_mutex_t lock;     /*!< Serialize the sleeps, wake ups and multi. */
+    pthread_cond_t readable;  /*!< Signaled when data is written. */
+    pthread_cond_t writable;  /*!< Signaled when data is read. */
+    bool readerWaiting;       /*!< The reader sleeps on readable. */
+    bool writerWaiting;       /*!< The writer sleeps on writable. */
+    bool paused;              /*!< The transfer waits for room (under lock). */
+    CURLM* multi;             /*!< Multi handle of the transfer (NULL if none). */
+    int err;                  /*!< Error code given when the pipe was closed. */
+};
+
+/*!
+ * \brief   Wake a sleeping thread up.
+ * \param   pipe      pipe to handle
+ * \param   waiting   flag of the sleeper
+ * \param   cond      condition of the sleeper
+ * \return  void
+ */
+static void drbPipeWake(drbPipe* pipe, bool* waiting, pthread_cond_t* cond) {
+    // Pairs with the flag set before the sleeper checks the ring
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&pipe->lock);
+        pthread_cond_broadcast(cond);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+}
+
+/*!
+ * \brief   Sleep until the ring has data (reader) or room (writer).
+ * \param   pipe      pipe to handle
+ * \param   waiting   flag of the sleeper
+ * \param   cond      condition to wait for
+ * \param   full      ring usage to sleep on (0 for the reader, the capacity
+ *                    for the writer)
+ * \return  void
+ */
+static void drbPipeSleep(drbPipe* pipe, bool* waiting, pthread_cond_t* cond, size_t full) {
+    pthread_mutex_lock(&pipe->lock);
+    __atomic_store_n(waiting, true, __ATOMIC_SEQ_CST);
+    while (memRingUsed(&pipe->ring) == full && !memRingClosed(&pipe->ring))
+        pthread_cond_wait(cond, &pipe->lock);
+    __atomic_store_n(waiting, false, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+drbPipe* drbCreatePipe(size_t capacity) {
+    drbPipe* pipe = calloc(1, sizeof(drbPipe));
+    
+    // A paused transfer must be able to continue once the ring is drained
+    if (!capacity)
+        capacity = DRB_PIPE_CAPACITY;
+    if (capacity < 2 * DRB_PIPE_RESUME_ROOM)
+        capacity = 2 * DRB_PIPE_RESUME_ROOM;
+    
+    if (pipe) {
+        if (memRingInit(&pipe->ring, capacity)) {
+            pthread_mutex_init(&pipe->lock, NULL);
+            pthread_cond_init(&pipe->readable, NULL);
+            pthread_cond_init(&pipe->writable, NULL);
+        } else {
+            free(pipe);
+            pipe = NULL;
+        }
+    }
+    return pipe;
+}
+
+void drbDestroyPipe(drbPipe* pipe) {
+    if (pipe) {
+        pthread_cond_destroy(&pipe->writable);
+        pthread_cond_destroy(&pipe->readable);
+        pthread_mutex_destroy(&pipe->lock);
+        memRingCleanup(&pipe->ring);
+        free(pipe);
+    }
+}
+
+size_t drbPipeRead(void* ptr, size_t size, size_t count, drbPipe* pipe) {
+    size_t len;
+    bool closed;
+    
+    // The data written before the pipe was closed is still read
+    while (!(closed = memRingClosed(&pipe->ring)) &&
+           (len = memRingRead(ptr, size, count, &pipe->ring)) == 0)
+        drbPipeSleep(pipe, &pipe->readerWaiting, &pipe->readable, 0);
+    if (closed)
+        len = memRingRead(ptr, size, count, &pipe->ring);
+    
+    if (len) {
+        drbPipeWake(pipe, &pipe->writerWaiting, &pipe->writable);
+        
+        // Resume a paused transfer once a whole curl write fits
+        pthread_mutex_lock(&pipe->lock);
+        if (pipe->paused && pipe->multi &&
+            pipe->ring.capacity - memRingUsed(&pipe->ring) >= DRB_PIPE_RESUME_ROOM)
+            curl_multi_wakeup(pipe->multi);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+    return len;
+}
+
+size_t drbPipeWrite(const void* ptr, size_t size, size_t count, drbPipe* pipe) {
+    size_t realSize = size * count, written = 0, len;
+    
+    while (written < realSize && !memRingClosed(&pipe->ring)) {
+        if ((len = memRingWrite((const char*)ptr + written, 1, realSize - written, &pipe->ring)) > 0) {
+            written += len;
+            drbPipeWake(pipe, &pipe->readerWaiting, &pipe->readable);
+        } else
+            drbPipeSleep(pipe, &pipe->writerWaiting, &pipe->writable, pipe->ring.capacity);
+    }
+    return written;
+}
+
+void drbClosePipe(drbPipe* pipe, int err) {
+    pthread_mutex_lock(&pipe->lock);
+    if (!memRingClosed(&pipe->ring))
+        pipe->err = err;
+    memRingClose(&pipe->ring);
+    
+    // Nothing more to wait for on both sides
+    pthread_cond_broadcast(&pipe->readable);
+    pthread_cond_broadcast(&pipe->writable);
+    if (pipe->multi)
+        curl_multi_wakeup(pipe->multi);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+int drbPipeError(drbPipe* pipe) {
+    pthread_mutex_lock(&pipe->lock);
+    int err = pipe->err;
+    pthread_mutex_unlock(&pipe->lock);
+    return err;
+}
+
+/*!
+ *   Act as a curl write function feeding a pipe: a curl write can't be
+ *   partial, so the transfer is paused until the whole data fits the ring.
+ */
+size_t drbPipeTransferWrite(const void* ptr, size_t size, size_t count, drbPipe* pipe) {
+    size_t realSize = size * count;
+    
+    // The reader gave up, abort the transfer
+    if (memRingClosed(&pipe->ring))
+        return 0;
+    
+    if (pipe->ring.capacity - memRingUsed(&pipe->ring) < realSize) {
+        pthread_mutex_lock(&pipe->lock);
+        pipe->paused = true;
+        pthread_mutex_unlock(&pipe->lock);
+        return CURL_WRITEFUNC_PAUSE;
+    }
+    memRingWrite(ptr, 1, realSize, &pipe->ring);
+    drbPipeWake(pipe, &pipe->readerWaiting, &pipe->readable);
+    return realSize;
+}
+
+/*!
+ * \brief   Set the multi handle to wake up when the transfer may continue.
+ * \param   pipe    pipe fed by the transfer
+ * \param   multi   multi handle of the transfer (NULL once it is over)
+ * \return  void
+ */
+void drbPipeAttach(drbPipe* pipe, CURLM* multi) {
+    pthread_mutex_lock(&pipe->lock);
+    pipe->multi = multi;
+    pipe->paused = false;
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+/*!
+ * \brief   Tell whether a paused transfer may continue.
+ *
+ * It may continue once a whole curl write fits the ring, or when the pipe is
+ * closed (the write then aborts the transfer).
+ *
+ * \param   pipe   pipe fed by the transfer
+ * \return  true if the transfer was paused and must be resumed.
+ */
+bool drbPipeResume(drbPipe* pipe) {
+    pthread_mutex_lock(&pipe->lock);
+    bool resume = pipe->paused &&
+                  (pipe->ring.capacity - memRingUsed(&pipe->ring) >= DRB_PIPE_RESUME_ROOM ||
+                   memRingClosed(&pipe->ring));
+    if (resume)
+        pipe->paused = false;
+    pthread_mutex_unlock(&pipe->lock);
+    return resume;
+}
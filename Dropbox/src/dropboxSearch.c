@@ -0,0 +1,236 @@
+/*!
+ * \file    dropboxSearch.c
+ * \brief   Trigram index of the names of local items.
+ *
+ * Each indexed name gets an increasing id, which is added to the posting
+ * list of each of its (lower case) trigrams. The trigrams are hashed to a
+ * fixed number of lists, so a list may hold the ids of a few trigrams: the
+ * visited items are only candidates, that the caller checks. Removed ids are
+ * left in the lists and skipped, until they outnumber the indexed names and
+ * the lists are compacted. The compaction also renumbers the indexed names
+ * from 1 (in the same order), so the ids are never exhausted by a long lived
+ * index.
+ *
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "dropboxSearch.h"
+
+/*! Number of posting lists (power of 2). */
+#define SEARCH_LIST_BITS 18
+
+/*! Removed ids left in the lists before they may be compacted. */
+#define SEARCH_MIN_DEAD 4096
+
+/*!
+ * \struct  drbPostingList
+ * \breif   Increasing ids of the names holding a trigram.
+ */
+typedef struct {
+    uint32_t* ids;     /*!< Name ids. */
+    uint32_t count;    /*!< Number of ids. */
+    uint32_t capacity; /*!< Allocated ids. */
+} drbPostingList;
+
+struct drbSearchIndex {
+    drbSearchRenumber renumber; /*!< Called with the new id of a renumbered item. */
+    drbPostingList* lists; /*!< Posting lists, by trigram hash. */
+    void** items;          /*!< Indexed items, by id (NULL once removed). */
+    uint32_t next;         /*!< Next id (0 is never used). */
+    uint32_t capacity;     /*!< Allocated items. */
+    uint32_t live;         /*!< Number of indexed items. */
+    uint32_t dead;         /*!< Removed ids left in the lists. */
+};
+
+/*!
+ * \brief   Get the posting list of a trigram.
+ * \param   index   search index
+ * \param   str     trigram (3 characters, already in lower case)
+ * \return  posting list.
+ */
+static drbPostingList* drbSearchList(drbSearchIndex* index, const char* str) {
+    uint32_t trigram = (uint32_t)(unsigned char)str[0] << 16 |
+                       (uint32_t)(unsigned char)str[1] << 8 | (unsigned char)str[2];
+    return &index->lists[(trigram * 2654435761u) >> (32 - SEARCH_LIST_BITS)];
+}
+
+/*!
+ * \brief   Create an empty search index.
+ * \param   renumber   called with the new id of each item when the ids are
+ *                     renumbered (by drbSearchIndexRemove or drbSearchIndexAdd)
+ * \return  search index (NULL if the memory can't be allocated).
+ */
+drbSearchIndex* drbCreateSearchIndex(drbSearchRenumber renumber) {
+    drbSearchIndex* index = calloc(1, sizeof(drbSearchIndex));
+    if (index && (index->lists = calloc(1 << SEARCH_LIST_BITS, sizeof(drbPostingList))) == NULL) {
+        free(index);
+        index = NULL;
+    }
+    if (index) {
+        index->renumber = renumber;
+        index->next = 1;
+    }
+    return index;
+}
+
+void drbDestroySearchIndex(drbSearchIndex* index) {
+    if (index) {
+        for (size_t i = 0; i < 1 << SEARCH_LIST_BITS; i++)
+            free(index->lists[i].ids);
+        free(index->lists);
+        free(index->items);
+        free(index);
+    }
+}
+
+/*!
+ * \brief   Drop the removed ids from the lists, and renumber the items left.
+ *
+ * The items keep their order, so the lists stay sorted. Without the memory
+ * to map the ids, the removed ones are only dropped.
+ *
+ * \param   index   search index
+ * \return  void
+ */
+static void drbSearchCompact(drbSearchIndex* index) {
+    // New id of each id (0 once removed)
+    uint32_t* ids = malloc(index->next * sizeof(uint32_t));
+    uint32_t next = 1;
+    for (uint32_t id = 1; ids && id < index->next; id++) {
+        ids[id] = index->items[id] ? next++ : 0;
+        if (ids[id]) {
+            index->items[ids[id]] = index->items[id];
+            index->renumber(index->items[ids[id]], ids[id]);
+        }
+    }
+    
+    for (size_t i = 0; i < 1 << SEARCH_LIST_BITS; i++) {
+        drbPostingList* list = &index->lists[i];
+        uint32_t kept = 0;
+        for (uint32_t k = 0; k < list->count; k++) {
+            uint32_t id = ids ? ids[list->ids[k]] : index->items[list->ids[k]] ? list->ids[k] : 0;
+            if (id)
+                list->ids[kept++] = id;
+        }
+        list->count = kept;
+    }
+    
+    if (ids)
+        index->next = next;
+    index->dead = 0;
+    free(ids);
+}
+
+/*!
+ * \brief   Index the name of an item.
+ * \param   index   search index
+ * \param   name    item name
+ * \param   item    item given to the visitors (not NULL)
+ * \return  item id (0 if the memory can't be allocated).
+ */
+uint32_t drbSearchIndexAdd(drbSearchIndex* index, const char* name, void* item) {
+    if (index->next == UINT32_MAX && index->dead)
+        drbSearchCompact(index);
+    if (index->next == UINT32_MAX)
+        return 0;
+    if (index->next >= index->capacity) {
+        uint32_t capacity = index->capacity ? index->capacity * 2 : 1024;
+        void** items = realloc(index->items, capacity * sizeof(void*));
+        if (!items)
+            return 0;
+        index->items = items;
+        index->capacity = capacity;
+    }
+    
+    uint32_t id = index->next;
+    size_t length = strlen(name);
+    char trigram[3];
+    for (size_t i = 0; i + 3 <= length; i++) {
+        for (int k = 0; k < 3; k++)
+            trigram[k] = tolower((unsigned char)name[i + k]);
+        
+        // A trigram repeated in the name (or sharing its list) is added once
+        drbPostingList* list = drbSearchList(index, trigram);
+        if (list->count && list->ids[list->count - 1] == id)
+            continue;
+        if (list->count == list->capacity) {
+            uint32_t capacity = list->capacity ? list->capacity * 2 : 4;
+            uint32_t* ids = realloc(list->ids, capacity * sizeof(uint32_t));
+            if (!ids) {
+                // The ids already added are skipped as removed ones
+                index->items[id] = NULL;
+                index->next++, index->dead++;
+                return 0;
+            }
+            list->ids = ids;
+            list->capacity = capacity;
+        }
+        list->ids[list->count++] = id;
+    }
+    
+    index->items[id] = item;
+    index->next++, index->live++;
+    return id;
+}
+
+/*!
+ * \brief   Remove an item from the index.
+ * \param   index   search index
+ * \param   id      item id (drbSearchIndexAdd)
+ * \return  void
+ */
+void drbSearchIndexRemove(drbSearchIndex* index, uint32_t id) {
+    if (!id || id >= index->next || !index->items[id])
+        return;
+    index->items[id] = NULL;
+    index->live--, index->dead++;
+    
+    // Drop the removed ids from the lists once they are the majority
+    if (index->dead >= SEARCH_MIN_DEAD && index->dead > index->live)
+        drbSearchCompact(index);
+}
+
+/*!
+ * \brief   Visit the items whose name may hold all the given words.
+ *
+ * The items are visited by increasing id. Their names hold at least one
+ * trigram of the words, unless no word has 3 characters (then all the items
+ * are visited).
+ *
+ * \param   index     search index
+ * \param   words     words to search (in lower case)
+ * \param   count     number of words
+ * \param   visitor   function checking each candidate item
+ * \param   data      visitor data
+ * \return  void
+ */
+void drbSearchIndexVisit(drbSearchIndex* index, char* const* words, size_t count,
+                         drbSearchVisitor visitor, void* data) {
+    // The shortest list of all the words trigrams holds all the matches
+    drbPostingList* best = NULL;
+    for (size_t w = 0; w < count; w++) {
+        size_t length = strlen(words[w]);
+        for (size_t i = 0; i + 3 <= length; i++) {
+            drbPostingList* list = drbSearchList(index, words[w] + i);
+            if (!best || list->count < best->count)
+                best = list;
+        }
+    }
+    
+    if (best) {
+        for (uint32_t k = 0; k < best->count; k++) {
+            void* item = index->items[best->ids[k]];
+            if (item && !visitor(item, data))
+                return;
+        }
+    } else {
+        for (uint32_t id = 1; id < index->next; id++)
+            if (index->items[id] && !visitor(index->items[id], data))
+                return;
+    }
+}
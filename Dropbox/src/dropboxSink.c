@@ -0,0 +1,176 @@
+/*!
+ * \file    dropboxSink.c
+ * \brief   Download sinks and upload sources.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <memStream.h>
+#include "dropboxSink.h"
+
+/*!
+ * \brief   Write buffers in a sink, until they are fully written.
+ *
+ * The sink writev is used if it has one, its write otherwise. The buffers are
+ * modified to follow the written data.
+ *
+ * \param   sink    sink to write
+ * \param   iov     buffers to write
+ * \param   count   number of buffers
+ * \return  indicates whether all the buffers were written.
+ */
+bool drbSinkWriteAll(drbSink* sink, struct iovec* iov, int count) {
+    size_t written;
+    
+    while (count > 0) {
+        if (iov->iov_len == 0) {
+            iov++, count--;
+            continue;
+        }
+        if (sink->writev && count > 1)
+            written = sink->writev(iov, count, sink->data);
+        else
+            written = sink->write(iov->iov_base, iov->iov_len, sink->data);
+        if (written == 0)
+            return false;
+        
+        // Skip the written buffers, then the written part of the next one
+        while (count > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++, count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+size_t drbSinkWrite(const void* ptr, size_t size, size_t count, drbSink* sink) {
+    struct iovec iov = {(void*)ptr, size * count};
+    return drbSinkWriteAll(sink, &iov, 1) ? size * count : 0;
+}
+
+size_t drbSourceRead(void* ptr, size_t size, size_t count, drbSource* source) {
+    ssize_t len = source->read(ptr, size * count, source->data);
+    if (len < 0) {
+        source->failed = true;
+        return 0;
+    }
+    return len;
+}
+
+/*!
+ *   Act as a sink write in a file descriptor (data).
+ */
+static size_t drbFdWrite(const void* ptr, size_t size, void* data) {
+    ssize_t written;
+    while ((written = write((int)(intptr_t)data, ptr, size)) < 0 && errno == EINTR);
+    return written > 0 ? written : 0;
+}
+
+/*!
+ *   Act as a sink writev in a file descriptor (data).
+ */
+static size_t drbFdWritev(const struct iovec* iov, int count, void* data) {
+    ssize_t written;
+    if (count > IOV_MAX)
+        count = IOV_MAX;
+    while ((written = writev((int)(intptr_t)data, iov, count)) < 0 && errno == EINTR);
+    return written > 0 ? written : 0;
+}
+
+/*!
+ *   Reserve the space of the answer after the file descriptor (data) offset.
+ *   It's only a hint: a file system without preallocation is fine.
+ */
+static bool drbFdPreallocate(uint64_t size, void* data) {
+#ifdef __linux__
+    int fd = (int)(intptr_t)data;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (offset >= 0)
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, (off_t)size);
+#endif
+    return true;
+}
+
+/*!
+ *   Act as a source read in a file descriptor (data).
+ */
+static ssize_t drbFdRead(void* ptr, size_t size, void* data) {
+    ssize_t len;
+    while ((len = read((int)(intptr_t)data, ptr, size)) < 0 && errno == EINTR);
+    return len;
+}
+
+/*!
+ *   Act as a sink write in a memory stream (data).
+ */
+static size_t drbMemoryWrite(const void* ptr, size_t size, void* data) {
+    return memStreamWrite(ptr, 1, size, data);
+}
+
+/*!
+ *   Allocate the memory stream (data) for the answer.
+ */
+static bool drbMemoryPreallocate(uint64_t size, void* data) {
+    memStream* stream = data;
+    return size > SIZE_MAX - stream->size - 1 || memStreamReserve(stream, stream->size + size);
+}
+
+/*!
+ *   Act as a source read in a memory stream (data).
+ */
+static ssize_t drbMemoryRead(void* ptr, size_t size, void* data) {
+    return memStreamRead(ptr, 1, size, data);
+}
+
+/*!
+ *   Act as a sink write discarding the data.
+ */
+static size_t drbNullWrite(const void* ptr, size_t size, void* data) {
+    return size;
+}
+
+void drbInitFdSink(drbSink* sink, int fd) {
+    memset(sink, 0, sizeof(drbSink));
+    sink->write = drbFdWrite;
+    sink->writev = drbFdWritev;
+    sink->preallocate = drbFdPreallocate;
+    sink->data = (void*)(intptr_t)fd;
+}
+
+void drbInitMemorySink(drbSink* sink, memStream* stream) {
+    memset(sink, 0, sizeof(drbSink));
+    sink->write = drbMemoryWrite;
+    sink->preallocate = drbMemoryPreallocate;
+    sink->data = stream;
+}
+
+void drbInitNullSink(drbSink* sink) {
+    memset(sink, 0, sizeof(drbSink));
+    sink->write = drbNullWrite;
+}
+
+void drbInitFdSource(drbSource* source, int fd) {
+    memset(source, 0, sizeof(drbSource));
+    source->read = drbFdRead;
+    source->data = (void*)(intptr_t)fd;
+}
+
+void drbInitMemorySource(drbSource* source, memStream* stream) {
+    memset(source, 0, sizeof(drbSource));
+    source->read = drbMemoryRead;
+    source->data = stream;
+}
@@ -0,0 +1,556 @@
+/*!
+ * \file    dropboxUring.c
+ * \brief   File sinks and sources keeping several io_uring requests in flight.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "dropbox.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define DRB_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+/*! Default number of requests in flight. */
+static const unsigned DRB_URING_DEPTH = 4;
+
+/*! Default size of a request buffer. */
+static const size_t DRB_URING_BLOCK_SIZE = 256 * 1024;
+
+/*!
+ * \struct  drbUringSlot
+ * \breif   Buffer of a request.
+ */
+typedef struct {
+    struct iovec iov;   /*!< Buffer (registered in the ring if possible). */
+    struct iovec part;  /*!< Part of the buffer left to transfer. */
+    uint64_t offset;    /*!< File offset of the buffer. */
+    size_t length;      /*!< Bytes to transfer (buffer filling for a sink). */
+    size_t done;        /*!< Bytes transferred. */
+    bool busy;          /*!< Queued in the ring and not completed. */
+} drbUringSlot;
+
+/*!
+ * \struct  drbUring
+ * \breif   File transfered by a ring of requests, or by pwrite/pread.
+ */
+typedef struct {
+    drbSink sink;           /*!< Sink given to the user (data is this). */
+    drbSource source;       /*!< Source given to the user (data is this). */
+    int fd;                 /*!< File to transfer. */
+    bool reading;           /*!< Source (true) or sink (false). */
+    bool failed;            /*!< A request failed during the current call. */
+    bool broken;            /*!< The ring can't be used anymore. */
+    bool eof;               /*!< End of file reached by the source. */
+    bool opened;            /*!< A transfer is started (drbUringOpen). */
+    uint64_t offset;        /*!< File offset of the next request. */
+    uint64_t position;      /*!< File offset reached by the user. */
+    drbUringSlot* slots;    /*!< Request buffers. */
+    unsigned depth;         /*!< Number of buffers. */
+    size_t blockSize;       /*!< Size of a buffer. */
+    char* buffers;          /*!< Memory of the buffers. */
+    unsigned current;       /*!< Buffer filled or consumed by the user. */
+    size_t cursor;          /*!< Bytes of the current buffer consumed. */
+    int ring;               /*!< io_uring file descriptor (-1 for pwrite/pread). */
+#ifdef DRB_URING
+    bool fixed;             /*!< The buffers are registered in the ring. */
+    unsigned queued;        /*!< Requests queued but not submitted. */
+    void* sqMap;            /*!< Submission ring mapping. */
+    size_t sqMapSize;
+    void* cqMap;            /*!< Completion ring mapping (maybe sqMap). */
+    size_t cqMapSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe* cqes;
+#endif
+} drbUring;
+
+#ifdef DRB_URING
+
+/*!
+ * \brief   Release the ring of a file.
+ * \param   u   file to release the ring
+ * \return  void
+ */
+static void drbUringTeardown(drbUring* u) {
+    if (u->sqes)
+        munmap(u->sqes, u->sqesSize);
+    if (u->cqMap && u->cqMap != u->sqMap)
+        munmap(u->cqMap, u->cqMapSize);
+    if (u->sqMap)
+        munmap(u->sqMap, u->sqMapSize);
+    if (u->ring >= 0)
+        close(u->ring);
+    u->sqes = NULL, u->sqMap = u->cqMap = NULL;
+    u->ring = -1;
+}
+
+/*!
+ * \brief   Map a ring region.
+ * \return  mapped region, NULL on failure.
+ */
+static void* drbUringMap(int ring, size_t size, off_t offset) {
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, offset);
+    return map != MAP_FAILED ? map : NULL;
+}
+
+/*!
+ * \brief   Set up the ring of a file and register its buffers.
+ * \param   u   file to set up, with its buffers allocated
+ * \return  indicates whether the ring can be used.
+ */
+static bool drbUringSetup(drbUring* u) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    
+    if ((u->ring = (int)syscall(__NR_io_uring_setup, u->depth, &p)) < 0)
+        return false;
+    
+    u->sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    bool single = false;
+#ifdef IORING_FEAT_SINGLE_MMAP
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        single = true;
+        if (u->cqMapSize > u->sqMapSize)
+            u->sqMapSize = u->cqMapSize;
+    }
+#endif
+    u->sqMap = drbUringMap(u->ring, u->sqMapSize, IORING_OFF_SQ_RING);
+    u->cqMap = single ? u->sqMap : drbUringMap(u->ring, u->cqMapSize, IORING_OFF_CQ_RING);
+    u->sqes = drbUringMap(u->ring, u->sqesSize, IORING_OFF_SQES);
+    if (!u->sqMap || !u->cqMap || !u->sqes) {
+        drbUringTeardown(u);
+        return false;
+    }
+    
+    char* sq = u->sqMap, *cq = u->cqMap;
+    u->sqTail  = (unsigned*)(sq + p.sq_off.tail);
+    u->sqMask  = (unsigned*)(sq + p.sq_off.ring_mask);
+    u->sqArray = (unsigned*)(sq + p.sq_off.array);
+    u->cqHead  = (unsigned*)(cq + p.cq_off.head);
+    u->cqTail  = (unsigned*)(cq + p.cq_off.tail);
+    u->cqMask  = (unsigned*)(cq + p.cq_off.ring_mask);
+    u->cqes    = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    
+    // Registered buffers are not mapped by each request, but they count in
+    // the locked memory limit: plain buffers are used if it's too low
+    struct iovec iovs[u->depth];
+    for (unsigned i = 0; i < u->depth; i++)
+        iovs[i] = u->slots[i].iov;
+    u->fixed = syscall(__NR_io_uring_register, u->ring, IORING_REGISTER_BUFFERS, iovs, u->depth) == 0;
+    return true;
+}
+
+/*!
+ * \brief   Queue the transfer of the rest of a buffer.
+ * \param   u   file to transfer
+ * \param   i   index of the buffer
+ * \return  void
+ */
+static void drbUringQueue(drbUring* u, unsigned i) {
+    drbUringSlot* slot = &u->slots[i];
+    unsigned tail = *u->sqTail;
+    unsigned index = tail & *u->sqMask;
+    struct io_uring_sqe* sqe = &u->sqes[index];
+    
+    slot->part.iov_base = (char*)slot->iov.iov_base + slot->done;
+    slot->part.iov_len = slot->length - slot->done;
+    
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->fd = u->fd;
+    sqe->off = slot->offset + slot->done;
+    sqe->user_data = i;
+    if (u->fixed) {
+        sqe->opcode = u->reading ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->addr = (uintptr_t)slot->part.iov_base;
+        sqe->len = (unsigned)slot->part.iov_len;
+        sqe->buf_index = i;
+    } else {
+        sqe->opcode = u->reading ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe->addr = (uintptr_t)&slot->part;
+        sqe->len = 1;
+    }
+    
+    u->sqArray[index] = index;
+    __atomic_store_n(u->sqTail, tail + 1, __ATOMIC_RELEASE);
+    u->queued++;
+    slot->busy = true;
+}
+
+/*!
+ * \brief   Handle the completed requests of a file.
+ *
+ * Interrupted and short transfers are queued again for their remaining part.
+ *
+ * \param   u   file to handle
+ * \return  void
+ */
+static void drbUringReap(drbUring* u) {
+    unsigned head = *u->cqHead;
+    
+    while (head != __atomic_load_n(u->cqTail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe* cqe = &u->cqes[head & *u->cqMask];
+        unsigned i = (unsigned)cqe->user_data;
+        int res = cqe->res;
+        __atomic_store_n(u->cqHead, ++head, __ATOMIC_RELEASE);
+        
+        drbUringSlot* slot = &u->slots[i];
+        slot->busy = false;
+        if (res == -EINTR || res == -EAGAIN)
+            drbUringQueue(u, i);
+        else if (res < 0 || (res == 0 && !u->reading))
+            u->failed = true;
+        else if (res == 0)
+            slot->length = slot->done;
+        else if ((slot->done += res) < slot->length)
+            drbUringQueue(u, i);
+    }
+}
+
+/*!
+ * \brief   Submit the queued requests, then handle the completed ones.
+ * \param   u      file to transfer
+ * \param   wait   number of completions to wait for
+ * \return  void
+ */
+static void drbUringEnter(drbUring* u, unsigned wait) {
+    long submitted;
+    
+    while ((submitted = syscall(__NR_io_uring_enter, u->ring, u->queued, wait,
+                                wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0)) < 0 &&
+           errno == EINTR);
+    if (submitted < 0) {
+        u->failed = u->broken = true;
+        return;
+    }
+    u->queued -= (unsigned)submitted;
+    drbUringReap(u);
+}
+
+/*!
+ * \brief   Wait for the transfer of a buffer.
+ * \param   u      file to transfer
+ * \param   slot   buffer to wait for
+ * \return  void
+ */
+static void drbUringWait(drbUring* u, drbUringSlot* slot) {
+    while ((slot->busy || u->queued) && !u->broken)
+        drbUringEnter(u, slot->busy ? 1 : 0);
+}
+
+/*!
+ * \brief   Wait for all the transfers of a file.
+ * \param   u   file to transfer
+ * \return  void
+ */
+static void drbUringDrain(drbUring* u) {
+    for (unsigned i = 0; i < u->depth; i++)
+        drbUringWait(u, &u->slots[i]);
+}
+
+/*!
+ * \brief   Queue a buffer at the next file offset, and submit it.
+ * \param   u        file to transfer
+ * \param   i        index of the buffer
+ * \param   length   bytes to transfer
+ * \return  void
+ */
+static void drbUringSubmit(drbUring* u, unsigned i, size_t length) {
+    drbUringSlot* slot = &u->slots[i];
+    slot->offset = u->offset;
+    slot->length = length;
+    slot->done = 0;
+    u->offset += length;
+    drbUringQueue(u, i);
+    drbUringEnter(u, 0);
+}
+
+/*!
+ *   Act as a sink write: fill the current buffer, and submit it when full.
+ *   Only blocks when all the buffers are being written.
+ */
+static size_t drbUringWrite(const void* ptr, size_t size, void* data) {
+    drbUring* u = data;
+    const char* src = ptr;
+    size_t left = size;
+    
+    while (left > 0 && !u->failed) {
+        drbUringSlot* slot = &u->slots[u->current];
+        size_t len = u->blockSize - slot->length;
+        if (len > left)
+            len = left;
+        memcpy((char*)slot->iov.iov_base + slot->length, src, len);
+        slot->length += len, src += len, left -= len;
+        
+        if (slot->length == u->blockSize) {
+            drbUringSubmit(u, u->current, slot->length);
+            u->current = (u->current + 1) % u->depth;
+            slot = &u->slots[u->current];
+            drbUringWait(u, slot);
+            slot->length = 0;
+        }
+    }
+    return u->failed ? 0 : size;
+}
+
+/*!
+ *   Act as a source read: consume the current buffer, and read it again
+ *   ahead when it's empty. Only blocks when the current buffer isn't read yet.
+ */
+static ssize_t drbUringRead(void* ptr, size_t size, void* data) {
+    drbUring* u = data;
+    char* dst = ptr;
+    size_t total = 0;
+    
+    while (total < size && !u->eof && !u->failed) {
+        drbUringSlot* slot = &u->slots[u->current];
+        drbUringWait(u, slot);
+        if (u->failed)
+            break;
+        
+        size_t len = slot->done - u->cursor;
+        if (len > size - total)
+            len = size - total;
+        memcpy(dst + total, (char*)slot->iov.iov_base + u->cursor, len);
+        u->cursor += len, total += len;
+        
+        if (u->cursor == slot->done) {
+            // A short buffer is only left by the end of the file
+            if (slot->done < u->blockSize) {
+                u->eof = true;
+            } else {
+                drbUringSubmit(u, u->current, u->blockSize);
+                u->current = (u->current + 1) % u->depth;
+                u->cursor = 0;
+            }
+        }
+    }
+    u->position += total;
+    
+    // The data read before the failure is dropped with the upload
+    return u->failed ? -1 : (ssize_t)total;
+}
+
+#endif /* DRB_URING */
+
+/*!
+ *   Act as a sink write at the file offset with pwrite.
+ */
+static size_t drbUringPwrite(const void* ptr, size_t size, void* data) {
+    drbUring* u = data;
+    ssize_t written;
+    
+    while ((written = pwrite(u->fd, ptr, size, (off_t)u->offset)) < 0 && errno == EINTR);
+    if (written <= 0) {
+        u->failed = true;
+        return 0;
+    }
+    u->offset += written;
+    return written;
+}
+
+/*!
+ *   Act as a source read at the file offset with pread.
+ */
+static ssize_t drbUringPread(void* ptr, size_t size, void* data) {
+    drbUring* u = data;
+    ssize_t len;
+    
+    while ((len = pread(u->fd, ptr, size, (off_t)u->offset)) < 0 && errno == EINTR);
+    if (len < 0)
+        u->failed = true;
+    if (len <= 0)
+        return len;
+    u->offset += len;
+    u->position = u->offset;
+    return len;
+}
+
+/*!
+ *   Start a transfer at the file position. A source starts reading ahead
+ *   with all its buffers.
+ */
+static bool drbUringOpen(void* data) {
+    drbUring* u = data;
+    off_t offset = lseek(u->fd, 0, SEEK_CUR);
+    
+    if (offset < 0)
+        return false;
+    u->offset = u->position = offset;
+    u->failed = u->eof = false;
+    u->current = 0, u->cursor = 0;
+
+#ifdef DRB_URING
+    if (u->ring >= 0) {
+        if (u->broken)
+            return false;
+        if (u->reading)
+            for (unsigned i = 0; i < u->depth; i++)
+                drbUringSubmit(u, i, u->blockSize);
+        
+        // A failed source start isn't closed by its user
+        if (u->failed)
+            drbUringDrain(u);
+    }
+#endif
+    return u->opened = !u->failed;
+}
+
+/*!
+ *   Reserve the space of the answer after the file offset.
+ *   It's only a hint: a file system without preallocation is fine.
+ */
+static bool drbUringPreallocate(uint64_t size, void* data) {
+#ifdef __linux__
+    drbUring* u = data;
+    fallocate(u->fd, FALLOC_FL_KEEP_SIZE, (off_t)u->offset, (off_t)size);
+#endif
+    return true;
+}
+
+/*!
+ *   End a transfer: write the last buffer of a sink, wait for all the
+ *   requests and move the file position after the transferred data.
+ *   A sink closed without any data was never opened: the file is untouched.
+ */
+static int drbUringClose(int err, void* data) {
+    drbUring* u = data;
+    
+    if (!u->opened)
+        return err;
+    u->opened = false;
+
+#ifdef DRB_URING
+    if (u->ring >= 0) {
+        drbUringSlot* slot = &u->slots[u->current];
+        if (!u->reading && !u->failed && slot->length > 0)
+            drbUringSubmit(u, u->current, slot->length);
+        drbUringDrain(u);
+        
+        // The next transfer starts with empty buffers
+        for (unsigned i = 0; i < u->depth; i++)
+            u->slots[i].length = 0;
+    }
+#endif
+    
+    if (!u->reading)
+        u->position = u->offset;
+    lseek(u->fd, (off_t)u->position, SEEK_SET);
+    return u->failed && !err ? DRBERR_IO : err;
+}
+
+/*!
+ * \brief   Create a file transferred with io_uring, or pwrite/pread without it.
+ * \param   fd          file descriptor to transfer
+ * \param   depth       number of requests in flight (0 for default)
+ * \param   blockSize   size of a request (0 for default)
+ * \param   reading     source (true) or sink (false)
+ * \return  file to transfer (NULL on failure).
+ */
+static drbUring* drbCreateUring(int fd, unsigned depth, size_t blockSize, bool reading) {
+    drbUring* u = calloc(1, sizeof(drbUring));
+    if (!u)
+        return NULL;
+    
+    u->fd = fd;
+    u->ring = -1;
+    u->reading = reading;
+    u->depth = depth ? depth : DRB_URING_DEPTH;
+    u->blockSize = blockSize ? blockSize : DRB_URING_BLOCK_SIZE;
+
+#ifdef DRB_URING
+    // The buffers are page aligned, so they also fit O_DIRECT files
+    u->slots = calloc(u->depth, sizeof(drbUringSlot));
+    if (u->slots && u->blockSize <= UINT32_MAX && u->blockSize <= SIZE_MAX / u->depth &&
+        posix_memalign((void**)&u->buffers, 4096, u->depth * u->blockSize) == 0) {
+        for (unsigned i = 0; i < u->depth; i++) {
+            u->slots[i].iov.iov_base = u->buffers + i * u->blockSize;
+            u->slots[i].iov.iov_len = u->blockSize;
+        }
+        drbUringSetup(u);
+    }
+    if (u->ring < 0) {
+        free(u->buffers), free(u->slots);
+        u->buffers = NULL, u->slots = NULL;
+    }
+#endif
+    return u;
+}
+
+/*!
+ * \brief   Free a file created by drbCreateUring.
+ * \param   u   file to free
+ * \return  void
+ */
+static void drbDestroyUring(drbUring* u) {
+#ifdef DRB_URING
+    drbUringTeardown(u);
+#endif
+    free(u->buffers);
+    free(u->slots);
+    free(u);
+}
+
+drbSink* drbCreateUringSink(int fd, unsigned depth, size_t blockSize) {
+    drbUring* u = drbCreateUring(fd, depth, blockSize, false);
+    if (!u)
+        return NULL;
+    
+    drbSink* sink = &u->sink;
+    sink->open = drbUringOpen;
+    sink->preallocate = drbUringPreallocate;
+    sink->write = drbUringPwrite;
+#ifdef DRB_URING
+    if (u->ring >= 0)
+        sink->write = drbUringWrite;
+#endif
+    sink->close = drbUringClose;
+    sink->data = u;
+    return sink;
+}
+
+void drbDestroyUringSink(drbSink* sink) {
+    if (sink)
+        drbDestroyUring(sink->data);
+}
+
+drbSource* drbCreateUringSource(int fd, unsigned depth, size_t blockSize) {
+    drbUring* u = drbCreateUring(fd, depth, blockSize, true);
+    if (!u)
+        return NULL;
+    
+    drbSource* source = &u->source;
+    source->open = drbUringOpen;
+    source->read = drbUringPread;
+#ifdef DRB_URING
+    if (u->ring >= 0)
+        source->read = drbUringRead;
+#endif
+    source->close = drbUringClose;
+    source->data = u;
+    source->bufferSize = u->blockSize;
+    return source;
+}
+
+void drbDestroyUringSource(drbSource* source) {
+    if (source)
+        drbDestroyUring(source->data);
+}
@@ -9,12 +9,16 @@
 #define _GNU_SOURCE
 
 #define BUFFER_SIZE 1024
+#define ARENA_ALIGN sizeof(void*)
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <ctype.h>
+#include <strings.h>
 #include <oauth.h>
 #include <stdbool.h>
+#include "dropbox.h"
 #include "dropboxUtils.h"
 
 /*!
@@ -32,9 +36,9 @@ char* drbStrDup(const char* str) {
  * \param   header   header to parse
  * \return  copy of the field content (must be freed by caller)
  */
-char* drbGetHeaderFieldContent(const char* field, char* header) {
+char* drbGetHeaderFieldContent(const char* field, const char* header) {
     char* content = NULL;
-    char* fieldLine = strstr(header, field); // find field line
+    const char* fieldLine = strstr(header, field); // find field line
     
     if (fieldLine && (fieldLine == header || *(fieldLine-1) == '\n')) {
         fieldLine += strlen(field) + 1; // Get field content starting point
@@ -53,3 +57,329 @@ char* drbGetHeaderFieldContent(const char* field, char* header) {
     
     return content;
 }
+
+/*!
+ * \brief   Parse a fixed number of decimal digits.
+ * \param       str      digits to parse
+ * \param       count    number of digits
+ * \param[out]  value    parsed value
+ * \return  true if the count chars are digits, false otherwise.
+ */
+static bool drbParseDigits(const char* str, int count, int* value) {
+    *value = 0;
+    for (int i = 0; i < count; i++) {
+        if (str[i] < '0' || str[i] > '9')
+            return false;
+        *value = *value * 10 + (str[i] - '0');
+    }
+    return true;
+}
+
+bool drbParseTime(const char* str, int64_t* time) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    int day, month, year, hour, min, sec, zone;
+    const char* p = str;
+    
+    // Optional day of week ("Sat, ")
+    if (p[0] && p[1] && p[2] && p[3] == ',' && p[4] == ' ')
+        p += 5;
+    
+    // Day (one or two digits) and month ("21 Aug ")
+    if (!p[0] || !drbParseDigits(p, p[1] == ' ' ? 1 : 2, &day))
+        return false;
+    p += p[1] == ' ' ? 2 : 3;
+    for (month = 0; month < 12 && strncmp(p, months + month * 3, 3) != 0; month++);
+    if (month == 12 || p[3] != ' ')
+        return false;
+    p += 4;
+    
+    // Year and time ("2010 22:31:20 ")
+    if (!drbParseDigits(p, 4, &year) || p[4] != ' '
+        || !drbParseDigits(p + 5, 2, &hour) || p[7] != ':'
+        || !drbParseDigits(p + 8, 2, &min) || p[10] != ':'
+        || !drbParseDigits(p + 11, 2, &sec) || p[13] != ' ')
+        return false;
+    p += 14;
+    
+    // Zone ("+0000")
+    if ((p[0] != '+' && p[0] != '-') || !drbParseDigits(p + 1, 4, &zone))
+        return false;
+    zone = (zone / 100 * 60 + zone % 100) * (p[0] == '-' ? -60 : 60);
+    
+    if (day < 1 || day > 31 || hour > 23 || min > 59 || sec > 60)
+        return false;
+    
+    // Days since the epoch of the proleptic Gregorian date (March based years)
+    int64_t y = year - (month < 2);
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (month + (month > 1 ? -2 : 10)) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = era * 146097 + doe - 719468;
+    
+    *time = days * 86400 + hour * 3600 + min * 60 + sec - zone;
+    return true;
+}
+
+/*!
+ * \brief   Allocate aligned memory in an arena.
+ * \param   arena   arena to allocate from
+ * \param   size    needed memory size
+ * \return  allocated memory (NULL while measuring or if the arena is full)
+ */
+void* drbArenaAlloc(drbArena* arena, size_t size) {
+    void* ptr = NULL;
+    size_t offset = (arena->used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    
+    if (!arena->base || offset + size <= arena->size) {
+        if (arena->base)
+            ptr = arena->base + offset;
+        arena->used = offset + size;
+    }
+    return ptr;
+}
+
+/*!
+ * \brief   As strdup, but the copy is allocated in an arena.
+ * \param   arena   arena to allocate from
+ * \param   str     string to duplicate
+ * \return  duplicated string (NULL while measuring or if the arena is full)
+ */
+char* drbArenaStrDup(drbArena* arena, const char* str) {
+    char* copy = NULL;
+    size_t size = strlen(str) + 1;
+    
+    if (!arena->base || arena->used + size <= arena->size) {
+        if (arena->base)
+            copy = memcpy(arena->base + arena->used, str, size);
+        arena->used += size;
+    }
+    return copy;
+}
+
+/*!
+ * \brief   As drbArenaStrDup, but equal strings share the same copy.
+ *
+ * Strings are interned in the arena strings table. As the table is cleared but
+ * not shrunk between the measure and the build passes, both allocate the
+ * same memory.
+ *
+ * \param   arena   arena to allocate from
+ * \param   str     string to duplicate
+ * \return  shared copy (NULL while measuring or if the arena is full)
+ */
+char* drbArenaStrIntern(drbArena* arena, const char* str) {
+    bool added;
+    drbStrEntry* entry = arena->strings ? drbStrTableFind(arena->strings, str, &added) : NULL;
+    
+    if (!entry)
+        return drbArenaStrDup(arena, str);
+    if (added)
+        entry->copy = drbArenaStrDup(arena, str);
+    return entry->copy;
+}
+
+/*!
+ * \brief   FNV-1a hash of a string.
+ * \param   str    string to hash
+ * \return  str hash.
+ */
+size_t drbStrHash(const char* str) {
+    size_t hash = 2166136261u;
+    while (*str)
+        hash = (hash ^ (unsigned char)*str++) * 16777619u;
+    return hash;
+}
+
+/*!
+ * \brief   Normalize a path as a lookup key: lower case, without trailing slash
+ *          and with a leading one (except for the root).
+ * \param   path   path to normalize
+ * \return  normalized path ("" for the root, NULL on failure), must be freed
+ *          by the caller.
+ */
+char* drbPathKey(const char* path) {
+    size_t length = strlen(path);
+    while (length && path[length - 1] == '/')
+        length--;
+    
+    bool slash = length && path[0] != '/';
+    char* key = malloc(length + slash + 1);
+    if (key) {
+        key[0] = '/';
+        for (size_t i = 0; i < length; i++)
+            key[i + slash] = tolower((unsigned char)path[i]);
+        key[length + slash] = '\0';
+    }
+    return key;
+}
+
+/*!
+ * \brief   Resize a strings table and move its entries in the new slots.
+ * \param   table      table to resize
+ * \param   capacity   new number of slots (power of 2)
+ * \return  true on success, false if the memory can't be allocated.
+ */
+static bool drbStrTableResize(drbStrTable* table, size_t capacity) {
+    drbStrEntry* entries = calloc(capacity, sizeof(drbStrEntry));
+    if (!entries)
+        return false;
+    
+    for (size_t i = 0; i < table->capacity; i++) {
+        drbStrEntry* entry = &table->entries[i];
+        if (entry->str) {
+            size_t slot = entry->hash & (capacity - 1);
+            while (entries[slot].str)
+                slot = (slot + 1) & (capacity - 1);
+            entries[slot] = *entry;
+        }
+    }
+    free(table->entries);
+    table->entries = entries;
+    table->capacity = capacity;
+    return true;
+}
+
+/*!
+ * \brief   Allocate a strings table for a number of strings, so their
+ *          additions can't fail.
+ * \param   table   table to grow
+ * \param   count   number of strings the table must hold
+ * \return  true on success, false if the memory can't be allocated.
+ */
+bool drbStrTableReserve(drbStrTable* table, size_t count) {
+    // Keep the table at most half full
+    size_t capacity = table->capacity ? table->capacity : 64;
+    while (capacity < count * 2)
+        capacity *= 2;
+    return capacity == table->capacity || drbStrTableResize(table, capacity);
+}
+
+/*!
+ * \brief   Find a string in a strings table, add it if it is not found.
+ * \param       table   table to search
+ * \param       str     string to find (referenced by the table if added)
+ * \param[out]  added   true if str was added in the table
+ * \return  str entry (NULL if the memory can't be allocated).
+ */
+drbStrEntry* drbStrTableFind(drbStrTable* table, const char* str, bool* added) {
+    // Keep the table at most half full
+    if ((table->count + 1) * 2 > table->capacity &&
+        !drbStrTableResize(table, table->capacity ? table->capacity * 2 : 64))
+        return NULL;
+    
+    size_t hash = drbStrHash(str);
+    size_t slot = hash & (table->capacity - 1);
+    drbStrEntry* entry;
+    while ((entry = &table->entries[slot])->str) {
+        if (entry->hash == hash && strcmp(entry->str, str) == 0) {
+            *added = false;
+            return entry;
+        }
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    
+    entry->str = str;
+    entry->copy = NULL;
+    entry->hash = hash;
+    table->count++;
+    *added = true;
+    return entry;
+}
+
+/*!
+ * \brief   Find the slot of a path in a paths table.
+ * \param   table    table to search (with at least one free slot)
+ * \param   path     path to find (not necessarily NUL terminated)
+ * \param   length   path length
+ * \param   hash     path hash (drbPathTableCovers)
+ * \return  path entry, or the free slot where it should be added.
+ */
+static drbStrEntry* drbPathTableSlot(drbStrTable* table, const char* path, size_t length,
+                                     size_t hash) {
+    size_t slot = hash & (table->capacity - 1);
+    drbStrEntry* entry;
+    while ((entry = &table->entries[slot])->str) {
+        if (entry->hash == hash && strncasecmp(entry->str, path, length) == 0
+            && entry->str[length] == '\0')
+            break;
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    return entry;
+}
+
+/*!
+ * \brief   Find a path in a paths table, add it if it is not found.
+ *
+ * Paths tables are strings tables whose strings are compared and hashed
+ * without case, as Dropbox paths.
+ *
+ * \param       table   table to search
+ * \param       path    path to find (referenced by the table if added)
+ * \param       hash    path hash (drbPathTableCovers)
+ * \param[out]  added   true if path was added in the table (NULL to only
+ *                      search it)
+ * \return  path entry (NULL if not found or if the memory can't be allocated).
+ */
+drbStrEntry* drbPathTableFind(drbStrTable* table, const char* path, size_t hash,
+                              bool* added) {
+    if (added) {
+        // Keep the table at most half full
+        if ((table->count + 1) * 2 > table->capacity &&
+            !drbStrTableResize(table, table->capacity ? table->capacity * 2 : 64))
+            return NULL;
+    } else if (!table->count)
+        return NULL;
+    
+    drbStrEntry* entry = drbPathTableSlot(table, path, strlen(path), hash);
+    if (added && (*added = !entry->str)) {
+        entry->str = path;
+        entry->copy = NULL;
+        entry->hash = hash;
+        table->count++;
+    }
+    return entry->str ? entry : NULL;
+}
+
+/*!
+ * \brief   Check whether a path or one of its parent folders is in a paths
+ *          table.
+ *
+ * The path is hashed once (FNV-1a without case), checking each parent folder
+ * on the way, and its hash is given back for drbPathTableFind.
+ *
+ * \param       table   table to search
+ * \param       path    path to check
+ * \param[out]  hash    path hash (set when false is returned)
+ * \return  true if the path or a parent folder is found.
+ */
+bool drbPathTableCovers(drbStrTable* table, const char* path, size_t* hash) {
+    *hash = 2166136261u;
+    for (size_t length = 0; ; length++) {
+        if (table->count && ((path[length] == '/' && length > 0) || path[length] == '\0') &&
+            drbPathTableSlot(table, path, length, *hash)->str)
+            return true;
+        if (path[length] == '\0')
+            return false;
+        *hash = (*hash ^ (unsigned char)tolower((unsigned char)path[length])) * 16777619u;
+    }
+}
+
+/*!
+ * \brief   Remove all the strings of a table, but keep its memory.
+ * \param   table   table to clear
+ */
+void drbStrTableClear(drbStrTable* table) {
+    if (table->entries)
+        memset(table->entries, 0, table->capacity * sizeof(drbStrEntry));
+    table->count = 0;
+}
+
+/*!
+ * \brief   Free the memory of a strings table.
+ * \param   table   table to free
+ */
+void drbStrTableFree(drbStrTable* table) {
+    free(table->entries);
+    memset(table, 0, sizeof(drbStrTable));
+}
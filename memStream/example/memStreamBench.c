@@ -0,0 +1,88 @@
+/*!
+ * \file    memStreamBench.c
+ * \brief   Time of many writes to a memory stream, with the geometric growth
+ *          of memStreamWrite and with a reallocation on each write.
+ * \author  Adrien Python
+ * \version 1.0
+ * \date    29.10.2013
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <memStream.h>
+
+/*! Written size. */
+static const size_t MEM_BENCH_TOTAL = 50 * 1000 * 1000;
+
+/*! Runs of each case, the best time is kept. */
+static const int MEM_BENCH_RUNS = 5;
+
+/*!
+ * \brief   Get the current time of the monotonic clock.
+ * \return  time (s).
+ */
+static double now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*!
+ * \brief   Write to a memory stream as memStreamWrite did before it tracked
+ *          the capacity: the memory is reallocated on each write.
+ */
+static size_t reallocWrite(const void *ptr, size_t size, size_t count, memStream *stream) {
+    size_t realSize = size * count;
+    if((stream->data = realloc(stream->data, stream->size + realSize + 1)) != NULL){
+        memcpy(stream->data + stream->size, ptr, realSize);
+        stream->size += realSize;
+        stream->cursor = stream->size;
+        stream->data[stream->size] = '\0';
+        return realSize;
+    } else
+        return 0;
+}
+
+/*!
+ * \brief   Time the writes of a total size in pieces.
+ * \param   write     write function
+ * \param   piece     written piece size
+ * \param   reserve   reserve the total size first
+ * \return  best time of MEM_BENCH_RUNS runs (ms).
+ */
+static double bench(size_t (*write)(const void*, size_t, size_t, memStream*), size_t piece,
+                    bool reserve) {
+    static char buffer[16 * 1024];
+    double best = 0;
+    for (int run = 0; run < MEM_BENCH_RUNS; run++) {
+        memStream stream;
+        memStreamInit(&stream);
+        double start = now();
+        if (reserve)
+            memStreamReserve(&stream, MEM_BENCH_TOTAL);
+        for (size_t written = 0; written < MEM_BENCH_TOTAL; written += piece)
+            if (write(buffer, 1, piece, &stream) != piece) {
+                fprintf(stderr, "Write failed\n");
+                exit(EXIT_FAILURE);
+            }
+        double time = (now() - start) * 1e3;
+        memStreamCleanup(&stream);
+        if (run == 0 || time < best)
+            best = time;
+    }
+    return best;
+}
+
+int main (int argc, char **argv) {
+    
+    static const size_t pieces[] = {50, 1024, 16 * 1024};
+    printf("%zu MB written in pieces of:  realloc each   memStreamWrite   reserved\n",
+           MEM_BENCH_TOTAL / 1000000);
+    for (int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+        printf("%6zu bytes %26.1f ms %13.1f ms %8.1f ms\n", pieces[i],
+               bench(reallocWrite, pieces[i], false), bench(memStreamWrite, pieces[i], false),
+               bench(memStreamWrite, pieces[i], true));
+    return EXIT_SUCCESS;
+}
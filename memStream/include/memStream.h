@@ -11,17 +11,56 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <sys/uio.h>
+
+#define MEM_SEG_BLOCK_SIZE (16*1024)
+#define MEM_POOL_MIN_SIZE  1024
+#define MEM_POOL_CLASSES   16 /* 1 KiB to 32 MiB buffers */
+#define MEM_PIPE_BUFFER_SIZE (256*1024)
+#define MEM_CACHE_LINE_SIZE  64
 
 /*!
  * \struct  memStream
  * \breif   Memory space to read/write with memRead/memWrite.
  */
 typedef struct {
-    char* data;    /*< where the data memory start */
-    size_t size;   /*< data memory size */
-    size_t cursor; /*< where memRead is currently reading data. */
+    char* data;      /*< where the data memory start */
+    size_t size;     /*< data memory size */
+    size_t cursor;   /*< where memRead is currently reading data. */
+    size_t capacity; /*< allocated data memory size, trusted by the writes
+                         and loads (0 if unknown). A caller replacing data
+                         must reset it (e.g. with memStreamInit): a stale
+                         capacity lets them overflow the new data. */
 } memStream;
 
+/*!
+ * \struct  memPoolStats
+ * \breif   Usage statistics of a buffer pool.
+ */
+typedef struct {
+    size_t hits;     /*< buffers taken from the pool */
+    size_t misses;   /*< buffers allocated because the pool had none */
+    size_t released; /*< buffers kept by the pool for reuse */
+    size_t dropped;  /*< buffers freed because the pool was full */
+    size_t cached;   /*< memory currently kept by the pool */
+} memPoolStats;
+
+/*!
+ * \struct  memPool
+ * \breif   Released memory stream buffers, kept to be reused.
+ *
+ * Buffers are sorted in power of 2 size classes, from MEM_POOL_MIN_SIZE bytes,
+ * so a buffer is reused for any size its class covers. The pool keeps at most
+ * maxCached bytes, further released buffers are freed.
+ *
+ * A pool is not thread safe, its use must be serialized by the caller.
+ */
+typedef struct {
+    void* free[MEM_POOL_CLASSES]; /*< released buffers of each size class */
+    size_t maxCached;             /*< maximum memory kept by the pool */
+    memPoolStats stats;           /*< pool usage statistics */
+} memPool;
+
 /*!
  * \brief   As realloc but free unreallocated memory on failure.
  * \param   ptr    pointer on the memory to realloc
@@ -44,6 +83,62 @@ void memStreamInit(memStream *stream);
  */
 void memStreamCleanup(memStream *stream);
 
+/*!
+ * \brief   Allocate memory in a memory stream for later writes.
+ *
+ * Writes grow the stream memory geometrically, reserving it beforehand (e.g.
+ * when the final size is known) avoids the intermediate reallocations.
+ *
+ * \param   stream     memory stream to handle
+ * \param   capacity   number of data bytes the stream must hold without
+ *                     reallocation
+ * \return  indicates whether the memory was allocated (stream is unchanged
+ *          otherwise).
+ */
+bool memStreamReserve(memStream *stream, size_t capacity);
+
+/*!
+ * \brief   Release the memory of a memory stream that is not used by its data.
+ * \param   stream   memory stream to handle
+ * \return  indicates whether the memory was shrunk (stream is unchanged
+ *          otherwise).
+ */
+bool memStreamShrink(memStream *stream);
+
+/*!
+ * \brief   Initialize a buffer pool before its use.
+ * \param   pool        buffer pool to initialize
+ * \param   maxCached   maximum memory kept by the pool
+ * \return  void
+ */
+void memPoolInit(memPool* pool, size_t maxCached);
+
+/*!
+ * \brief   Free the buffers kept by a buffer pool (statistics are kept).
+ * \param   pool   buffer pool to clean up
+ * \return  void
+ */
+void memPoolCleanup(memPool* pool);
+
+/*!
+ * \brief   Initialize a memory stream with a buffer taken from a pool.
+ * \param   stream   memory stream to initialize
+ * \param   pool     pool to take the buffer from (NULL to allocate it)
+ * \param   size     number of data bytes the stream must hold without
+ *                   reallocation
+ * \return  indicates whether the buffer was allocated (the stream is then
+ *          initialized empty otherwise).
+ */
+bool memStreamAcquire(memStream *stream, memPool* pool, size_t size);
+
+/*!
+ * \brief   As memStreamCleanup, but give the stream buffer back to a pool.
+ * \param   stream   memory stream to clean up
+ * \param   pool     pool to give the buffer to (NULL to free it)
+ * \return  void
+ */
+void memStreamRelease(memStream *stream, memPool* pool);
+
 /*!
  * As fwrite, but for a memory stream.
  */
@@ -54,13 +149,36 @@ size_t memStreamWrite(const void *ptr, size_t size, size_t count, memStream *mem
  */
 size_t memStreamRead(void *ptr, size_t size, size_t count, memStream *mem);
 
+/*!
+ * \brief   Reader handing out its own memory instead of copying the data.
+ *
+ * Sets *buffer to the next data of the input and moves past it. The data is
+ * valid until the input is written, moved or cleaned up.
+ *
+ * \param[out]  buffer   where the data starts
+ * \param       max      maximum number of bytes to hand out
+ * \param       in       input stream
+ * \return  number of bytes available at *buffer (0 at the end of the input).
+ */
+typedef size_t (*memPeekFct)(const void** buffer, size_t max, void* in);
+
+/*!
+ * As memStreamRead, but hand out the stream memory (see memPeekFct).
+ */
+size_t memStreamPeek(const void** buffer, size_t max, memStream* stream);
+
 /*!
  * \brief   Load any kind of data into a memory stream.
+ *
+ * The data is read directly into the stream memory, which is allocated at
+ * once for the remaining part of a file read with fread.
+ *
  * \note    Use this instead of memStreamPipe as memory allocation is optimized.
  * \param   stream    stream to load with data
  * \param   data      data to load in stream
  * \param   readFct   function to read data content
- * \return  indicates whether the data were loaded successfully or not.
+ * \return  indicates whether the data were loaded successfully or not. On
+ *          failure the stream keeps its previous data.
  */
 bool memStreamLoad(memStream* stream, void* data,
                    size_t (*xread)(void *, size_t , size_t , void*));
@@ -68,16 +186,7 @@ bool memStreamLoad(memStream* stream, void* data,
 /*!
  * \breif   Transfert any kind of stream from a one to another.
  *
- * Try to avoid it when you know which kind of stream you deal with, as there
- * might be a more efficent way to deal with them:
- *   -# memStreamPipe(mem, memStreamRead, file, fwrite):
- *      -> use fwrite directly: fwrite(mem->data, 1, mem->size, file)
- *   -# memStreamPipe(aMem, memStreamRead, bMem, memStreamWrite)
- *      -> just copy the memory yourself: malloc + memcpy
- *   -# memStreamPipe(aFile, fread, bFile, fwrite)
- *      -> file copy, valid but there's might be better implemtation for this
- *   -# memStreamPipe(file, fread, mem, memStreamWrite)
- *      -> use memStreamLoad for a better memory allocation
+ * Same as memStreamPipeBuffered with a MEM_PIPE_BUFFER_SIZE buffer.
  *
  * \param   in       input stream
  * \param   xread    function to read the input stream
@@ -88,6 +197,54 @@ bool memStreamLoad(memStream* stream, void* data,
 bool memStreamPipe(void* in,  size_t (*xread)(void*, size_t ,size_t ,void*),
                    void* out, size_t (*xwrite)(void*, size_t ,size_t ,void*));
 
+/*!
+ * \breif   Transfert any kind of stream from a one to another through a
+ *          buffer of a given size.
+ *
+ * The known kinds of stream skip the buffer:
+ *   -# memStreamRead or memSegStreamRead input
+ *      -> written from the stream memory with memStreamPipePeek
+ *   -# memStreamWrite output, with the cursor at the end of the stream
+ *      -> read in place with memStreamLoad
+ *   -# fread input and fwrite output, when the input file is seekable
+ *      -> copied by the kernel with memFdCopy
+ *
+ * \param   in           input stream
+ * \param   xread        function to read the input stream
+ * \param   out          ouput stream
+ * \param   xwrite       function to write the output stream
+ * \param   bufferSize   buffer size (0 for MEM_PIPE_BUFFER_SIZE)
+ * \return  indicates whether the data were 'piped' successfully or not.
+ */
+bool memStreamPipeBuffered(void* in,  size_t (*xread)(void*, size_t ,size_t ,void*),
+                           void* out, size_t (*xwrite)(void*, size_t ,size_t ,void*),
+                           size_t bufferSize);
+
+/*!
+ * \brief   Transfert a stream handing out its own memory to another one,
+ *          without intermediate copy.
+ * \param   in       input stream
+ * \param   peek     function handing out the input stream memory
+ * \param   out      ouput stream
+ * \param   xwrite   function to write the output stream
+ * \return  indicates whether the data were 'piped' successfully or not.
+ */
+bool memStreamPipePeek(void* in, memPeekFct peek,
+                       void* out, size_t (*xwrite)(void*, size_t ,size_t ,void*));
+
+/*!
+ * \brief   Copy a file descriptor to another one until the end of the input.
+ *
+ * On Linux, the copy stays in the kernel: copy_file_range between regular
+ * files, sendfile from a regular file and splice from or to a pipe. Other
+ * descriptors are copied through a MEM_PIPE_BUFFER_SIZE buffer.
+ *
+ * \param   in    input file descriptor
+ * \param   out   output file descriptor
+ * \return  indicates whether the data were copied successfully or not.
+ */
+bool memFdCopy(int in, int out);
+
 
 /*!
  * \brief   Sets the stream position to the beginning his data.
@@ -105,5 +262,274 @@ void memStreamRewind(memStream* stream);
  */
 int memStreamSeek(memStream* stream, long int offset, int origin);
 
+/*!
+ * \struct  memBlock
+ * \breif   Fixed-size block of a segmented memory stream.
+ */
+typedef struct memBlock {
+    struct memBlock* next; /*< next block of the stream (or of the pool) */
+    size_t used;           /*< number of data bytes in the block */
+    char data[];           /*< block data (block size bytes) */
+} memBlock;
+
+/*!
+ * \struct  memBlockPool
+ * \breif   Released blocks kept to be reused by segmented memory streams.
+ *
+ * A pool is not thread safe, its streams must be used by one thread at once.
+ */
+typedef struct {
+    size_t blockSize; /*< data bytes per block */
+    memBlock* free;   /*< released blocks */
+    size_t freeCount; /*< number of released blocks */
+    size_t maxFree;   /*< maximum number of released blocks kept */
+} memBlockPool;
+
+/*!
+ * \struct  memSegStream
+ * \breif   Memory stream made of a chain of fixed-size blocks.
+ *
+ * Unlike memStream, growing the stream never moves its data: writes only
+ * chain new blocks. Data is accessed in place with memSegStreamSegments, or
+ * copied in a single memory space with memSegStreamFlatten.
+ */
+typedef struct {
+    memBlockPool* pool; /*< where blocks are taken from (NULL for malloc) */
+    memBlock* head;     /*< first block */
+    memBlock* tail;     /*< last block (the only one not full) */
+    size_t size;        /*< data size */
+    size_t cursor;      /*< where memSegStreamRead is currently reading data */
+    memBlock* block;    /*< block holding the cursor (NULL if unknown) */
+    size_t blockStart;  /*< offset of block in the data */
+} memSegStream;
+
+/*!
+ * \brief   Initialize a block pool before its use.
+ * \param   pool        block pool to initialize
+ * \param   blockSize   data bytes per block
+ * \param   maxFree     maximum number of released blocks kept for reuse
+ * \return  void
+ */
+void memBlockPoolInit(memBlockPool* pool, size_t blockSize, size_t maxFree);
+
+/*!
+ * \brief   Release the blocks kept by a pool (its streams must be cleaned up).
+ * \param   pool   block pool to clean up
+ * \return  void
+ */
+void memBlockPoolCleanup(memBlockPool* pool);
+
+/*!
+ * \brief   Initialize a segmented memory stream before its use.
+ * \param   stream   segmented memory stream to initialize
+ * \param   pool     pool of the stream blocks (NULL to allocate blocks of
+ *                   MEM_SEG_BLOCK_SIZE bytes with malloc)
+ * \return  void
+ */
+void memSegStreamInit(memSegStream* stream, memBlockPool* pool);
+
+/*!
+ * \brief   Release the blocks of a segmented memory stream.
+ * \param   stream   segmented memory stream to clean up
+ * \return  void
+ */
+void memSegStreamCleanup(memSegStream* stream);
+
+/*!
+ * As fwrite, but for a segmented memory stream.
+ */
+size_t memSegStreamWrite(const void *ptr, size_t size, size_t count, memSegStream *stream);
+
+/*!
+ * As fread, but for a segmented memory stream.
+ */
+size_t memSegStreamRead(void *ptr, size_t size, size_t count, memSegStream *stream);
+
+/*!
+ * As memSegStreamRead, but hand out the stream memory, up to the end of the
+ * cursor block (see memPeekFct).
+ */
+size_t memSegStreamPeek(const void** buffer, size_t max, memSegStream *stream);
+
+/*!
+ * \brief   Sets the stream position to the beginning his data.
+ * \param   stream    stream to rewind
+ * \return  void
+ */
+void memSegStreamRewind(memSegStream* stream);
+
+/*!
+ * \brief   Sets the position indicator of the stream to a new position.
+ * \param   stream    stream to handle
+ * \param   offset    number of bytes to offset from origin
+ * \param   origin    offset reference (SEEK_SET, SEEK_CUR, SEEK_END)
+ * \return  if successful, returns zero. Otherwise, returns non-zero value.
+ */
+int memSegStreamSeek(memSegStream* stream, long int offset, int origin);
+
+/*!
+ * \brief   Get the data segments of a segmented memory stream in place.
+ *
+ * Call it until it returns 0, with *iter set to NULL on the first call. The
+ * segments are valid until the stream is written or cleaned up.
+ *
+ * \param           stream   segmented memory stream to handle
+ * \param[in,out]    iter     iteration state (NULL to start from the beginning)
+ * \param[out]       iov      filled segments (e.g. for writev)
+ * \param           count    number of iov elements
+ * \return  number of filled segments (0 when all were returned).
+ */
+size_t memSegStreamSegments(const memSegStream* stream, void** iter,
+                            struct iovec* iov, size_t count);
+
+/*!
+ * \brief   Copy the data of a segmented memory stream in a single memory space.
+ * \param   stream   segmented memory stream to flatten
+ * \return  NUL terminated copy of the data (NULL on failure), must be freed
+ *          by the caller.
+ */
+char* memSegStreamFlatten(const memSegStream* stream);
+
+/*!
+ * \struct  memSpillStream
+ * \breif   Memory stream spilling to a temporary file above a size threshold.
+ *
+ * The first threshold bytes of the data are kept in memory. When the data
+ * grows beyond, all of it is written to an unlinked temporary file (created
+ * in $TMPDIR, or P_tmpdir), and the memory only serves the reads of the first
+ * bytes. The memory stream may be acquired from a memPool after the stream
+ * initialization, and released to it before the stream cleanup.
+ */
+typedef struct {
+    memStream mem;     /*< first bytes of the data */
+    size_t threshold;  /*< data size kept in memory (0 to never spill) */
+    int fd;            /*< temporary file holding the data (-1 until spilled) */
+    char* map;         /*< temporary file mapping (see memSpillStreamMap) */
+    size_t size;       /*< data size */
+    size_t cursor;     /*< where memSpillStreamRead is currently reading data */
+    bool failed;       /*< an operation on the temporary file failed */
+} memSpillStream;
+
+/*!
+ * \brief   Initialize a spill stream before its use.
+ * \param   stream      spill stream to initialize
+ * \param   threshold   data size kept in memory (0 to never spill)
+ * \return  void
+ */
+void memSpillStreamInit(memSpillStream* stream, size_t threshold);
+
+/*!
+ * \brief   Release the memory and the temporary file of a spill stream.
+ * \param   stream   spill stream to clean up
+ * \return  void
+ */
+void memSpillStreamCleanup(memSpillStream* stream);
+
+/*!
+ * As fwrite, but for a spill stream.
+ */
+size_t memSpillStreamWrite(const void *ptr, size_t size, size_t count, memSpillStream *stream);
+
+/*!
+ * As fread, but for a spill stream.
+ */
+size_t memSpillStreamRead(void *ptr, size_t size, size_t count, memSpillStream *stream);
+
+/*!
+ * \brief   Sets the stream position to the beginning his data.
+ * \param   stream    stream to rewind
+ * \return  void
+ */
+void memSpillStreamRewind(memSpillStream* stream);
+
+/*!
+ * \brief   Sets the position indicator of the stream to a new position.
+ * \param   stream    stream to handle
+ * \param   offset    number of bytes to offset from origin
+ * \param   origin    offset reference (SEEK_SET, SEEK_CUR, SEEK_END)
+ * \return  if successful, returns zero. Otherwise, returns non-zero value.
+ */
+int memSpillStreamSeek(memSpillStream* stream, long int offset, int origin);
+
+/*!
+ * \brief   Get the data of a spill stream in a single memory space.
+ *
+ * Spilled data is mapped from the temporary file, so it is paged in on
+ * demand and never counts as private memory.
+ *
+ * \param   stream   spill stream to handle
+ * \return  NUL terminated data (NULL on failure), valid until the stream is
+ *          written or cleaned up.
+ */
+const char* memSpillStreamMap(memSpillStream* stream);
+
+/*!
+ * \struct  memRing
+ * \breif   Lock-free ring buffer between a producer and a consumer thread.
+ *
+ * One thread writes and another one reads, without locks: each of them only
+ * moves its own position, kept on its own cache line. Reads and writes never
+ * block, they transfer what the ring can hold or has (waiting is up to the
+ * caller).
+ */
+typedef struct {
+    char* data;      /*< ring memory */
+    size_t capacity; /*< ring size (power of 2) */
+    bool closed;     /*< no more data will be transferred */
+    size_t head __attribute__((aligned(MEM_CACHE_LINE_SIZE))); /*< bytes written */
+    size_t tail __attribute__((aligned(MEM_CACHE_LINE_SIZE))); /*< bytes read */
+} memRing;
+
+/*!
+ * \brief   Initialize a ring buffer before its use.
+ * \param   ring       ring buffer to initialize
+ * \param   capacity   minimum ring size (rounded up to a power of 2)
+ * \return  indicates whether the ring memory was allocated.
+ */
+bool memRingInit(memRing* ring, size_t capacity);
+
+/*!
+ * \brief   Release the memory of a ring buffer.
+ * \param   ring   ring buffer to clean up
+ * \return  void
+ */
+void memRingCleanup(memRing* ring);
+
+/*!
+ * As fwrite, but for a ring buffer (from the producer thread only). Only
+ * what the ring can hold is written.
+ */
+size_t memRingWrite(const void *ptr, size_t size, size_t count, memRing *ring);
+
+/*!
+ * As fread, but for a ring buffer (from the consumer thread only). Only what
+ * the ring has is read.
+ */
+size_t memRingRead(void *ptr, size_t size, size_t count, memRing *ring);
+
+/*!
+ * \brief   Get the number of bytes written and not read yet.
+ * \param   ring   ring buffer to handle
+ * \return  number of bytes in the ring.
+ */
+size_t memRingUsed(const memRing* ring);
+
+/*!
+ * \brief   Mark the end of a transfer through a ring buffer (from any side).
+ *
+ * The bytes written before the ring was closed can still be read.
+ *
+ * \param   ring   ring buffer to close
+ * \return  void
+ */
+void memRingClose(memRing* ring);
+
+/*!
+ * \brief   Tell whether a ring buffer was closed.
+ * \param   ring   ring buffer to handle
+ * \return  true once memRingClose was called.
+ */
+bool memRingClosed(const memRing* ring);
+
 
 #endif /* MEM_STREAM_H */
\ No newline at end of file
@@ -9,9 +9,18 @@
 #define _GNU_SOURCE
 
 #define MEM_BUFFER_SIZE 1024
+#define MEM_FD_CHUNK_SIZE (1024*1024*1024)
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include "memStream.h"
 
 
@@ -22,6 +31,120 @@ void* memRealloc(void* ptr, size_t size) {
     return newPtr;
 }
 
+/*!
+ * \struct  memPoolBuffer
+ * \breif   Released buffer, linked in its size class.
+ */
+typedef struct memPoolBuffer {
+    struct memPoolBuffer* next; /*< next released buffer of the class */
+    size_t capacity;            /*< buffer size */
+} memPoolBuffer;
+
+/*!
+ * \brief   Get the smallest size class holding a size.
+ * \param   size   needed size
+ * \return  size class (MEM_POOL_CLASSES if the size is too large).
+ */
+static int memPoolClass(size_t size) {
+    int class = 0;
+    while (class < MEM_POOL_CLASSES && ((size_t)MEM_POOL_MIN_SIZE << class) < size)
+        class++;
+    return class;
+}
+
+void memPoolInit(memPool* pool, size_t maxCached) {
+    memset(pool, 0, sizeof(memPool));
+    pool->maxCached = maxCached;
+}
+
+void memPoolCleanup(memPool* pool) {
+    for (int class = 0; class < MEM_POOL_CLASSES; class++) {
+        while (pool->free[class]) {
+            memPoolBuffer* buffer = pool->free[class];
+            pool->free[class] = buffer->next;
+            free(buffer);
+        }
+    }
+    pool->stats.cached = 0;
+}
+
+/*!
+ * \brief   Take a buffer from a pool, from the smallest size class available.
+ * \param       pool       pool to take the buffer from
+ * \param       size       needed size
+ * \param[out]  capacity   taken buffer size
+ * \return  taken buffer (NULL on failure)
+ */
+static void* memPoolTake(memPool* pool, size_t size, size_t* capacity) {
+    int class = memPoolClass(size);
+    memPoolBuffer* buffer = NULL;
+    
+    // Streams grow, so their buffers are often given back in a larger class
+    for (int larger = class; !buffer && larger < MEM_POOL_CLASSES; larger++)
+        if ((buffer = pool->free[larger]) != NULL)
+            class = larger;
+    
+    if (buffer) {
+        pool->free[class] = buffer->next;
+        pool->stats.cached -= buffer->capacity;
+        pool->stats.hits++;
+        *capacity = buffer->capacity;
+        return buffer;
+    }
+    
+    pool->stats.misses++;
+    *capacity = class < MEM_POOL_CLASSES ? (size_t)MEM_POOL_MIN_SIZE << class : size;
+    return malloc(*capacity);
+}
+
+/*!
+ * \brief   Give a buffer to a pool, in the largest size class it covers.
+ * \param   pool       pool to give the buffer to
+ * \param   data       buffer to give
+ * \param   capacity   buffer size
+ * \return  void
+ */
+static void memPoolGive(memPool* pool, void* data, size_t capacity) {
+    int class = memPoolClass(capacity);
+    if (class == MEM_POOL_CLASSES || ((size_t)MEM_POOL_MIN_SIZE << class) > capacity)
+        class--;
+    
+    if (class < 0 || pool->stats.cached + capacity > pool->maxCached) {
+        pool->stats.dropped++;
+        free(data);
+    } else {
+        memPoolBuffer* buffer = data;
+        buffer->capacity = capacity;
+        buffer->next = pool->free[class];
+        pool->free[class] = buffer;
+        pool->stats.cached += capacity;
+        pool->stats.released++;
+    }
+}
+
+bool memStreamAcquire(memStream *stream, memPool* pool, size_t size) {
+    memStreamInit(stream);
+    if (!pool)
+        return memStreamReserve(stream, size);
+    
+    // One more byte for the NUL terminator kept after the data
+    if ((stream->data = memPoolTake(pool, size + 1, &stream->capacity)) == NULL) {
+        stream->capacity = 0;
+        return false;
+    }
+    stream->data[0] = '\0';
+    return true;
+}
+
+void memStreamRelease(memStream *stream, memPool* pool) {
+    // The capacity of buffers not allocated by the stream is unknown
+    if (pool && stream->data && stream->capacity > stream->size)
+        memPoolGive(pool, stream->data, stream->capacity);
+    else
+        free(stream->data);
+    memStreamInit(stream);
+}
+
 void memStreamInit(memStream *stream) {
     memset(stream, 0, sizeof(memStream));
 }
@@ -31,9 +154,51 @@ void memStreamCleanup(memStream *stream) {
     memStreamInit(stream);
 }
 
+bool memStreamReserve(memStream *stream, size_t capacity) {
+    if (capacity < stream->size)
+        capacity = stream->size;
+    // One more byte for the NUL terminator kept after the data
+    if (stream->capacity > stream->size && capacity < stream->capacity)
+        return true;
+    
+    char* data = realloc(stream->data, capacity + 1);
+    if (data) {
+        stream->data = data;
+        stream->capacity = capacity + 1;
+    }
+    return data != NULL;
+}
+
+bool memStreamShrink(memStream *stream) {
+    size_t capacity = stream->capacity;
+    if (!stream->data || capacity == stream->size + 1)
+        return true;
+    
+    stream->capacity = 0; // forces the reallocation
+    if (memStreamReserve(stream, stream->size))
+        return true;
+    stream->capacity = capacity;
+    return false;
+}
+
 size_t memStreamWrite(const void *ptr, size_t size, size_t count, memStream *stream) {
     size_t realSize = size * count;
-    if((stream->data = memRealloc(stream->data, stream->size + realSize + 1)) != NULL){
+    size_t needed = stream->size + realSize;
+    
+    // Amortized growth: the memory at least doubles when it is reallocated
+    if (needed + 1 > stream->capacity) {
+        size_t capacity = stream->capacity > stream->size ? stream->capacity * 2 : MEM_BUFFER_SIZE;
+        if (capacity < needed + 1)
+            capacity = needed + 1;
+        // The reserved capacity excludes the NUL terminator
+        if (!memStreamReserve(stream, capacity - 1)) {
+            free(stream->data);
+            stream->data = NULL;
+            stream->capacity = 0;
+        }
+    }
+    
+    if(stream->data != NULL){
         size_t offset = stream->cursor > stream->size ? stream->size : stream->cursor;
         memcpy(stream->data + offset, ptr, realSize);
         stream->cursor = offset + realSize;
@@ -65,36 +230,238 @@ size_t memStreamRead(void *ptr, size_t size, size_t count, memStream *stream) {
  * @ any code reviewer (like myself): dont replace the code with a memStreamPipe
  * call, code is optimized here to reduce memory reallocation (realloc calls).
  */
+/*!
+ * \brief   Reserve the remaining size of a file in a memory stream.
+ * \param   stream   memory stream to load the file into
+ * \param   file     file to load
+ * \return  void
+ */
+static void memFileReserve(memStream* stream, FILE* file) {
+    struct stat st;
+    off_t pos = ftello(file);
+    
+    if (pos >= 0 && fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > pos)
+        // One spare byte, so that reading the end of file needs no growth
+        memStreamReserve(stream, stream->size + (size_t)(st.st_size - pos) + 1);
+}
+
 bool memStreamLoad(memStream* stream, void* data, size_t (*xread)(void *, size_t , size_t , void*)) {
-    char buffer[MEM_BUFFER_SIZE];
-    size_t len, allocSize = 0;
+    size_t len, room, size = stream->size;
     
-    while ((len = xread(buffer, sizeof(char), MEM_BUFFER_SIZE, data)) > 0) {
+    // A regular file is loaded in a single allocation
+    if ((void*)xread == (void*)fread)
+        memFileReserve(stream, data);
+    do {
+        room = stream->capacity > stream->size + 1 ? stream->capacity - stream->size - 1 : 0;
+        if (room == 0) {
+            // Amortized growth, the memory doubles when it is reallocated
+            if (!memStreamReserve(stream, stream->size ? stream->size * 2 : MEM_BUFFER_SIZE)) {
+                // The stream keeps its memory and its previous data
+                stream->size = size;
+                if (stream->data)
+                    stream->data[size] = '\0';
+                return false;
+            }
+            room = stream->capacity - stream->size - 1;
+        }
+        // Read in place, without intermediate buffer
+        len = xread(stream->data + stream->size, sizeof(char), room, data);
         stream->size += len;
-        if (stream->size > allocSize) {
-            allocSize = stream->size * 2;
-            if ((stream->data = memRealloc(stream->data, allocSize)) == NULL)
-                break;
+    } while (len > 0);
+    
+    stream->data[stream->size] = '\0';
+    return true;
+}
+
+size_t memStreamPeek(const void** buffer, size_t max, memStream* stream) {
+    size_t len = stream->cursor < stream->size ? stream->size - stream->cursor : 0;
+    
+    if (len > max)
+        len = max;
+    *buffer = stream->data + stream->cursor;
+    stream->cursor += len;
+    return len;
+}
+
+/*!
+ * \brief   Write a whole buffer to an output stream.
+ * \param   buffer   data to write
+ * \param   len      data size
+ * \param   out      output stream
+ * \param   xwrite   function to write the output stream
+ * \return  indicates whether all the data were written.
+ */
+static bool memPipeWrite(const char* buffer, size_t len, void* out,
+                         size_t (*xwrite)(void*, size_t, size_t, void*)) {
+    size_t written;
+    
+    // Stop on write failure or overflow (written > len -> xwrite bug!)
+    while (len > 0 && (written = xwrite((void*)buffer, 1, len, out)) > 0 && written <= len) {
+        buffer += written;
+        len -= written;
+    }
+    return len == 0;
+}
+
+bool memStreamPipePeek(void* in, memPeekFct peek,
+                       void* out, size_t (*xwrite)(void*, size_t, size_t, void*)) {
+    const void* buffer;
+    size_t len;
+    
+    while ((len = peek(&buffer, (size_t)-1, in)) > 0)
+        if (!memPipeWrite(buffer, len, out, xwrite))
+            return false;
+    return true;
+}
+
+#ifdef __linux__
+/*!
+ * \brief   Copy function of a kernel fast path (NULL offsets, the file
+ *          descriptors positions are updated).
+ */
+typedef ssize_t (*memFdCopyFct)(int in, int out, size_t count);
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 27)
+static ssize_t memCopyFileRange(int in, int out, size_t count) {
+    return copy_file_range(in, NULL, out, NULL, count, 0);
+}
+#endif
+
+static ssize_t memSendFile(int in, int out, size_t count) {
+    return sendfile(out, in, NULL, count);
+}
+
+static ssize_t memSplice(int in, int out, size_t count) {
+    return splice(in, NULL, out, NULL, count, SPLICE_F_MOVE);
+}
+
+/*!
+ * \brief   Copy file descriptors until the end of the input with a kernel
+ *          fast path.
+ * \param   in     input file descriptor
+ * \param   out    output file descriptor
+ * \param   copy   kernel copy function
+ * \return  1 on success, 0 on failure or -1 if the file descriptors don't
+ *          support the fast path (what was copied so far is kept).
+ */
+static int memFdKernelCopy(int in, int out, memFdCopyFct copy) {
+    ssize_t len;
+    
+    while ((len = copy(in, out, MEM_FD_CHUNK_SIZE)) != 0) {
+        if (len < 0 && errno != EINTR)
+            return errno == EINVAL || errno == EXDEV || errno == ENOSYS ||
+                   errno == EOPNOTSUPP || errno == EBADF ? -1 : 0;
+    }
+    return 1;
+}
+#endif
+
+bool memFdCopy(int in, int out) {
+#ifdef __linux__
+    struct stat inStat, outStat;
+    int copied = -1;
+    
+    if (fstat(in, &inStat) != 0 || fstat(out, &outStat) != 0)
+        return false;
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 27)
+    // Between regular files, the filesystem may even share the data blocks
+    if (S_ISREG(inStat.st_mode) && S_ISREG(outStat.st_mode))
+        copied = memFdKernelCopy(in, out, memCopyFileRange);
+#endif
+    // From a regular file to anything (file, socket, pipe)
+    if (copied < 0 && S_ISREG(inStat.st_mode))
+        copied = memFdKernelCopy(in, out, memSendFile);
+    // From or to a pipe
+    if (copied < 0 && (S_ISFIFO(inStat.st_mode) || S_ISFIFO(outStat.st_mode)))
+        copied = memFdKernelCopy(in, out, memSplice);
+    if (copied >= 0)
+        return copied;
+#endif
+    char* buffer = malloc(MEM_PIPE_BUFFER_SIZE);
+    bool success = buffer != NULL;
+    ssize_t len, written;
+    
+    while (success && (len = read(in, buffer, MEM_PIPE_BUFFER_SIZE)) != 0) {
+        if (len < 0) {
+            success = errno == EINTR;
+            continue;
+        }
+        for (ssize_t offset = 0; success && offset < len; ) {
+            if ((written = write(out, buffer + offset, len - offset)) >= 0)
+                offset += written;
+            else
+                success = errno == EINTR;
         }
-        memcpy(stream->data + stream->size - len, buffer, len);
     }
-    // is memory still allocated and then shrinked with success ?
-    return stream->data && (stream->data = memRealloc(stream->data, stream->size)) != NULL;
+    free(buffer);
+    return success;
+}
+
+/*!
+ * \brief   Copy a file to another one through their file descriptors.
+ * \param   in    input file
+ * \param   out   output file
+ * \return  1 on success, 0 on failure or -1 if the input file is not
+ *          seekable (its read ahead data would be lost) or has no
+ *          file descriptor.
+ */
+static int memFilePipe(FILE* in, FILE* out) {
+    int inFd = fileno(in), outFd = fileno(out);
+    off_t pos = ftello(in);
+    
+    // Move the input descriptor where stdio is logically reading
+    if (inFd < 0 || outFd < 0 || pos < 0 || lseek(inFd, pos, SEEK_SET) != pos)
+        return -1;
+    if (fflush(out) != 0)
+        return 0;
+    
+    bool copied = memFdCopy(inFd, outFd);
+    
+    // Synchronize the stdio streams with their descriptors
+    if ((pos = lseek(inFd, 0, SEEK_CUR)) >= 0)
+        fseeko(in, pos, SEEK_SET);
+    if ((pos = lseek(outFd, 0, SEEK_CUR)) >= 0)
+        fseeko(out, pos, SEEK_SET);
+    return copied;
 }
 
 bool memStreamPipe(void* in,  size_t (*xread)(void*, size_t, size_t, void*),
                    void* out, size_t (*xwrite)(void*, size_t, size_t, void*)) {
-    char buffer[MEM_BUFFER_SIZE];
-    size_t rLen, wLen;
-    while ((rLen = xread(buffer, sizeof(char), MEM_BUFFER_SIZE, in)) > 0) {
-        do { // write cached memory
-            rLen -= (wLen = xwrite(buffer, 1, rLen, out));
-        } while (wLen);
-        
-        if (rLen)         // flush fail when there's still memory to read or
-            return false; // on write overflow (wLen > rLen -> xwrite bug!)
+    return memStreamPipeBuffered(in, xread, out, xwrite, MEM_PIPE_BUFFER_SIZE);
+}
+
+bool memStreamPipeBuffered(void* in,  size_t (*xread)(void*, size_t, size_t, void*),
+                           void* out, size_t (*xwrite)(void*, size_t, size_t, void*),
+                           size_t bufferSize) {
+    // Memory streams hand out their own memory
+    if ((void*)xread == (void*)memStreamRead)
+        return memStreamPipePeek(in, (memPeekFct)memStreamPeek, out, xwrite);
+    if ((void*)xread == (void*)memSegStreamRead)
+        return memStreamPipePeek(in, (memPeekFct)memSegStreamPeek, out, xwrite);
+    // Appending to a memory stream, read in place
+    if ((void*)xwrite == (void*)memStreamWrite && ((memStream*)out)->cursor >= ((memStream*)out)->size) {
+        if (!memStreamLoad(out, in, xread))
+            return false;
+        ((memStream*)out)->cursor = ((memStream*)out)->size;
+        return true;
     }
-    return true;
+    if ((void*)xread == (void*)fread && (void*)xwrite == (void*)fwrite) {
+        int copied = memFilePipe(in, out);
+        if (copied >= 0)
+            return copied;
+    }
+    
+    if (!bufferSize)
+        bufferSize = MEM_PIPE_BUFFER_SIZE;
+    
+    char* buffer = malloc(bufferSize);
+    bool success = buffer != NULL;
+    size_t len;
+    
+    while (success && (len = xread(buffer, sizeof(char), bufferSize, in)) > 0)
+        success = memPipeWrite(buffer, len, out, xwrite);
+    free(buffer);
+    return success;
 }
 
 
@@ -124,3 +491,487 @@ int memStreamSeek(memStream* stream, long int offset, int origin) {
 
 
 
+/*!
+ * \brief   Take a block for a segmented memory stream.
+ * \param   stream   stream needing the block
+ * \return  empty block (NULL on failure)
+ */
+static memBlock* memSegTakeBlock(memSegStream* stream) {
+    memBlockPool* pool = stream->pool;
+    memBlock* block = NULL;
+    
+    if (pool && pool->free) {
+        block = pool->free;
+        pool->free = block->next;
+        pool->freeCount--;
+    } else
+        block = malloc(sizeof(memBlock) + (pool ? pool->blockSize : MEM_SEG_BLOCK_SIZE));
+    
+    if (block) {
+        block->next = NULL;
+        block->used = 0;
+    }
+    return block;
+}
+
+/*!
+ * \brief   Give back a block of a segmented memory stream.
+ * \param   stream   stream releasing the block
+ * \param   block    released block
+ * \return  void
+ */
+static void memSegGiveBlock(memSegStream* stream, memBlock* block) {
+    memBlockPool* pool = stream->pool;
+    if (pool && pool->freeCount < pool->maxFree) {
+        block->next = pool->free;
+        pool->free = block;
+        pool->freeCount++;
+    } else
+        free(block);
+}
+
+/*!
+ * \brief   Find the block holding a data offset.
+ *
+ * The search starts from the block of the cursor when it precedes the
+ * offset, so sequential accesses are O(1).
+ *
+ * \param       stream   stream to search
+ * \param       offset   data offset (at most the stream size)
+ * \param[out]  start    offset of the found block in the data
+ * \return  found block (NULL if the stream has no block).
+ */
+static memBlock* memSegLocate(memSegStream* stream, size_t offset, size_t* start) {
+    memBlock* block = stream->head;
+    size_t blockStart = 0;
+    
+    if (stream->block && offset >= stream->blockStart) {
+        block = stream->block;
+        blockStart = stream->blockStart;
+    }
+    // All blocks but the tail are full, offset may be the end of the tail
+    while (block && block->next && offset >= blockStart + block->used) {
+        blockStart += block->used;
+        block = block->next;
+    }
+    *start = blockStart;
+    return block;
+}
+
+void memBlockPoolInit(memBlockPool* pool, size_t blockSize, size_t maxFree) {
+    memset(pool, 0, sizeof(memBlockPool));
+    pool->blockSize = blockSize ? blockSize : MEM_SEG_BLOCK_SIZE;
+    pool->maxFree = maxFree;
+}
+
+void memBlockPoolCleanup(memBlockPool* pool) {
+    while (pool->free) {
+        memBlock* next = pool->free->next;
+        free(pool->free);
+        pool->free = next;
+    }
+    pool->freeCount = 0;
+}
+
+void memSegStreamInit(memSegStream* stream, memBlockPool* pool) {
+    memset(stream, 0, sizeof(memSegStream));
+    stream->pool = pool;
+}
+
+void memSegStreamCleanup(memSegStream* stream) {
+    while (stream->head) {
+        memBlock* next = stream->head->next;
+        memSegGiveBlock(stream, stream->head);
+        stream->head = next;
+    }
+    memSegStreamInit(stream, stream->pool);
+}
+
+size_t memSegStreamWrite(const void *ptr, size_t size, size_t count, memSegStream *stream) {
+    size_t blockSize = stream->pool ? stream->pool->blockSize : MEM_SEG_BLOCK_SIZE;
+    size_t realSize = size * count, written = 0;
+    size_t offset = stream->cursor > stream->size ? stream->size : stream->cursor;
+    size_t blockStart;
+    memBlock* block = memSegLocate(stream, offset, &blockStart);
+    
+    while (written < realSize) {
+        // Only the tail may be filled up to the block size
+        size_t limit = block == stream->tail ? blockSize : (block ? block->used : 0);
+        if (!block || offset - blockStart >= limit) {
+            if (block && block->next) {
+                blockStart += block->used;
+                block = block->next;
+                continue;
+            }
+            memBlock* added = memSegTakeBlock(stream);
+            if (!added)
+                break;
+            if (block) {
+                blockStart += block->used;
+                block->next = added;
+            } else
+                stream->head = added;
+            stream->tail = block = added;
+            limit = blockSize;
+        }
+        
+        size_t pos = offset - blockStart;
+        size_t len = limit - pos < realSize - written ? limit - pos : realSize - written;
+        memcpy(block->data + pos, (const char*)ptr + written, len);
+        if (pos + len > block->used) {
+            stream->size += pos + len - block->used;
+            block->used = pos + len;
+        }
+        offset += len;
+        written += len;
+    }
+    
+    stream->cursor = offset;
+    stream->block = block;
+    stream->blockStart = blockStart;
+    return written;
+}
+
+size_t memSegStreamRead(void *ptr, size_t size, size_t count, memSegStream *stream) {
+    size_t realSize = size * count, read = 0;
+    
+    if (stream->cursor < stream->size) {
+        size_t blockStart;
+        memBlock* block = memSegLocate(stream, stream->cursor, &blockStart);
+        
+        if (realSize > stream->size - stream->cursor)
+            realSize = stream->size - stream->cursor;
+        while (read < realSize) {
+            size_t pos = stream->cursor - blockStart;
+            if (pos >= block->used) {
+                blockStart += block->used;
+                block = block->next;
+                continue;
+            }
+            size_t len = block->used - pos < realSize - read ? block->used - pos : realSize - read;
+            memcpy((char*)ptr + read, block->data + pos, len);
+            stream->cursor += len;
+            read += len;
+        }
+        stream->block = block;
+        stream->blockStart = blockStart;
+    }
+    return read;
+}
+
+size_t memSegStreamPeek(const void** buffer, size_t max, memSegStream *stream) {
+    size_t len = 0;
+    
+    if (stream->cursor < stream->size) {
+        size_t blockStart;
+        memBlock* block = memSegLocate(stream, stream->cursor, &blockStart);
+        size_t pos = stream->cursor - blockStart;
+        
+        // The data is handed out up to the end of the cursor block
+        len = block->used - pos < max ? block->used - pos : max;
+        *buffer = block->data + pos;
+        stream->cursor += len;
+        stream->block = block;
+        stream->blockStart = blockStart;
+    }
+    return len;
+}
+
+void memSegStreamRewind(memSegStream* stream) {
+    stream->cursor = 0;
+}
+
+int memSegStreamSeek(memSegStream* stream, long int offset, int origin) {
+    size_t base;
+    switch (origin) {
+        case SEEK_SET: base = 0;
+            break;
+        case SEEK_CUR: base = stream->cursor;
+            break;
+        case SEEK_END: base = stream->size;
+            break;
+        default:
+            return -1;
+    }
+    
+    if (offset < 0 && (size_t)-offset > base)
+        return -1;
+    stream->cursor = base + offset;
+    return 0;
+}
+
+size_t memSegStreamSegments(const memSegStream* stream, void** iter,
+                            struct iovec* iov, size_t count) {
+    memBlock* block = *iter == NULL ? stream->head : *iter == stream ? NULL : *iter;
+    size_t filled = 0;
+    
+    for (; block && filled < count; block = block->next) {
+        if (block->used) {
+            iov[filled].iov_base = block->data;
+            iov[filled].iov_len = block->used;
+            filled++;
+        }
+    }
+    // The stream itself marks the end (NULL would restart the iteration)
+    *iter = block ? (void*)block : (void*)stream;
+    return filled;
+}
+
+char* memSegStreamFlatten(const memSegStream* stream) {
+    char* data = malloc(stream->size + 1);
+    if (data) {
+        size_t offset = 0;
+        for (memBlock* block = stream->head; block; block = block->next) {
+            memcpy(data + offset, block->data, block->used);
+            offset += block->used;
+        }
+        data[offset] = '\0';
+    }
+    return data;
+}
+
+/*!
+ * \brief   Write a whole buffer at an offset of a file.
+ * \param   fd       file descriptor
+ * \param   ptr      data to write
+ * \param   len      data size
+ * \param   offset   where the data is written in the file
+ * \return  indicates whether all the data were written.
+ */
+static bool memSpillPWrite(int fd, const void* ptr, size_t len, size_t offset) {
+    ssize_t written;
+    while (len > 0) {
+        if ((written = pwrite(fd, ptr, len, offset)) > 0) {
+            ptr = (const char*)ptr + written;
+            len -= written;
+            offset += written;
+        } else if (written == 0 || errno != EINTR)
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief   Unmap the temporary file of a spill stream.
+ * \param   stream   spill stream to handle
+ * \return  void
+ */
+static void memSpillUnmap(memSpillStream* stream) {
+    if (stream->map) {
+        munmap(stream->map, stream->size + 1);
+        stream->map = NULL;
+    }
+}
+
+/*!
+ * \brief   Move the data of a spill stream to an unlinked temporary file.
+ * \param   stream   spill stream to handle
+ * \return  indicates whether the temporary file was created.
+ */
+static bool memSpillOpen(memSpillStream* stream) {
+    const char* dir = getenv("TMPDIR");
+    char* path = NULL;
+    int fd = -1;
+    
+    if (!dir || !*dir)
+        dir = P_tmpdir;
+#ifdef O_TMPFILE
+    // Never linked, nothing is left behind when the process dies
+    fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+    if (fd < 0 && asprintf(&path, "%s/memSpillXXXXXX", dir) >= 0) {
+        if ((fd = mkstemp(path)) >= 0)
+            unlink(path);
+        free(path);
+    }
+    
+    // The file holds all the data, the memory keeps the first bytes for reads
+    if (fd < 0 || !memSpillPWrite(fd, stream->mem.data, stream->mem.size, 0)) {
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    stream->fd = fd;
+    return true;
+}
+
+void memSpillStreamInit(memSpillStream* stream, size_t threshold) {
+    memset(stream, 0, sizeof(memSpillStream));
+    stream->threshold = threshold;
+    stream->fd = -1;
+}
+
+void memSpillStreamCleanup(memSpillStream* stream) {
+    memSpillUnmap(stream);
+    if (stream->fd >= 0)
+        close(stream->fd);
+    memStreamCleanup(&stream->mem);
+    memSpillStreamInit(stream, stream->threshold);
+}
+
+size_t memSpillStreamWrite(const void *ptr, size_t size, size_t count, memSpillStream *stream) {
+    size_t realSize = size * count;
+    size_t offset = stream->cursor > stream->size ? stream->size : stream->cursor;
+    size_t end = offset + realSize;
+    size_t limit = stream->threshold ? stream->threshold : (size_t)-1;
+    
+    if (stream->fd < 0 && end > limit && !memSpillOpen(stream)) {
+        stream->failed = true;
+        return 0;
+    }
+    
+    // The first bytes stay in memory
+    if (offset < limit) {
+        size_t len = (end < limit ? end : limit) - offset;
+        memStream* mem = &stream->mem;
+        
+        // The memory growth stops at the threshold
+        if (offset + len + 1 > mem->capacity && mem->capacity > mem->size &&
+            mem->capacity * 2 > limit)
+            memStreamReserve(mem, limit);
+        mem->cursor = offset;
+        if (memStreamWrite(ptr, 1, len, mem) != len)
+            return 0;
+    }
+    if (stream->fd >= 0) {
+        memSpillUnmap(stream);
+        if (!memSpillPWrite(stream->fd, ptr, realSize, offset)) {
+            stream->failed = true;
+            return 0;
+        }
+    }
+    
+    stream->cursor = end;
+    if (end > stream->size)
+        stream->size = end;
+    return realSize;
+}
+
+size_t memSpillStreamRead(void *ptr, size_t size, size_t count, memSpillStream *stream) {
+    size_t realSize = size * count, read = 0;
+    ssize_t len;
+    
+    if (stream->cursor >= stream->size)
+        return 0;
+    if (realSize > stream->size - stream->cursor)
+        realSize = stream->size - stream->cursor;
+    
+    // From memory as long as possible, then from the temporary file
+    if (stream->cursor < stream->mem.size) {
+        read = stream->mem.size - stream->cursor < realSize ? stream->mem.size - stream->cursor : realSize;
+        memcpy(ptr, stream->mem.data + stream->cursor, read);
+    }
+    while (read < realSize && stream->fd >= 0) {
+        if ((len = pread(stream->fd, (char*)ptr + read, realSize - read, stream->cursor + read)) > 0)
+            read += len;
+        else if (len == 0 || errno != EINTR) {
+            stream->failed = true;
+            break;
+        }
+    }
+    stream->cursor += read;
+    return read;
+}
+
+void memSpillStreamRewind(memSpillStream* stream) {
+    stream->cursor = 0;
+}
+
+int memSpillStreamSeek(memSpillStream* stream, long int offset, int origin) {
+    size_t base;
+    switch (origin) {
+        case SEEK_SET: base = 0;
+            break;
+        case SEEK_CUR: base = stream->cursor;
+            break;
+        case SEEK_END: base = stream->size;
+            break;
+        default:
+            return -1;
+    }
+    
+    if (offset < 0 && (size_t)-offset > base)
+        return -1;
+    stream->cursor = base + offset;
+    return 0;
+}
+
+const char* memSpillStreamMap(memSpillStream* stream) {
+    if (stream->fd < 0)
+        return stream->mem.data;
+    
+    if (!stream->map) {
+        // NUL terminated in the file, as the memory streams data
+        void* map;
+        if (!memSpillPWrite(stream->fd, "", 1, stream->size) ||
+            (map = mmap(NULL, stream->size + 1, PROT_READ, MAP_SHARED, stream->fd, 0)) == MAP_FAILED) {
+            stream->failed = true;
+            return NULL;
+        }
+        stream->map = map;
+    }
+    return stream->map;
+}
+
+bool memRingInit(memRing* ring, size_t capacity) {
+    memset(ring, 0, sizeof(memRing));
+    ring->capacity = MEM_BUFFER_SIZE;
+    while (ring->capacity < capacity)
+        ring->capacity *= 2;
+    if ((ring->data = malloc(ring->capacity)) == NULL)
+        ring->capacity = 0;
+    return ring->data != NULL;
+}
+
+void memRingCleanup(memRing* ring) {
+    free(ring->data);
+    memset(ring, 0, sizeof(memRing));
+}
+
+size_t memRingWrite(const void *ptr, size_t size, size_t count, memRing *ring) {
+    // The producer owns head, the consumer releases the room it read
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    size_t len = size * count, room = ring->capacity - (head - tail);
+    
+    if (len > room)
+        len = room;
+    
+    size_t pos = head & (ring->capacity - 1);
+    size_t first = len < ring->capacity - pos ? len : ring->capacity - pos;
+    memcpy(ring->data + pos, ptr, first);
+    memcpy(ring->data, (const char*)ptr + first, len - first);
+    
+    __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+size_t memRingRead(void *ptr, size_t size, size_t count, memRing *ring) {
+    // The consumer owns tail, the producer publishes the data it wrote
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t len = size * count;
+    
+    if (len > head - tail)
+        len = head - tail;
+    
+    size_t pos = tail & (ring->capacity - 1);
+    size_t first = len < ring->capacity - pos ? len : ring->capacity - pos;
+    memcpy(ptr, ring->data + pos, first);
+    memcpy((char*)ptr + first, ring->data, len - first);
+    
+    __atomic_store_n(&ring->tail, tail + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+size_t memRingUsed(const memRing* ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+void memRingClose(memRing* ring) {
+    __atomic_store_n(&ring->closed, true, __ATOMIC_RELEASE);
+}
+
+bool memRingClosed(const memRing* ring) {
+    return __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+}